@@ -0,0 +1,83 @@
+
+#include "pch.h"
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "Utils.hpp"
+#include "Transpiler.hpp"
+
+
+std::string readFile(const std::string& filePath)
+{
+    std::ifstream file(filePath);
+    if (!file)
+    {
+        throw std::runtime_error("Could not open file.");
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+
+// bpc script.pc -o script.cpp
+int main(int argc, char *argv[])
+{
+    std::string path;
+    std::string output;
+    int optimize = OPT_LEVEL_DEFAULT;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0 && isdigit(arg[2]))
+        {
+            optimize = arg[2] - '0';
+        }
+        else
+        {
+            path = arg;
+        }
+    }
+    if (path.empty())
+    {
+        std::cout << "usage: bpc <script.pc> [-O<level>] [-o <output.cpp>]" << std::endl;
+        return 1;
+    }
+    if (output.empty())
+    {
+        output = path.substr(0, path.find_last_of('.')) + ".cpp";
+    }
+
+    std::string code;
+    Transpiler transpiler;
+    try
+    {
+        if (!transpiler.translate(readFile(path), path, code, optimize))
+        {
+            std::cout << "Could not parse " << path << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << "Abort " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::ofstream file(output);
+    if (!file)
+    {
+        std::cout << "Could not write " << output << std::endl;
+        return 1;
+    }
+    file << code;
+    return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "Config.hpp"
+#include "Interpreter.hpp"
+
+typedef std::function<Value()> ExprCode;
+typedef std::function<u8()> StmtCode;
+typedef std::function<bool()> TestCode;
+
+// Closure backend: every Expr/Stmt is turned once into a C++ callable with its operator,
+// operand kinds and slot indices already fixed. The callables run on the tree-walker's
+// Compiler state (environments, self, natives), so both backends share one semantics;
+// node kinds that are not worth specialising call straight back into the Compiler.
+class Binder
+{
+public:
+    explicit Binder(Compiler *compiler);
+
+    void execute(Program *program);
+    StmtCode compile_body(BlockStmt *body);
+
+private:
+    Compiler *c;
+
+    ExprCode compile(const ExprPtr &node);
+    ExprCode compile_binary(BinaryExpr *node);
+    ExprCode compile_unary(UnaryExpr *node);
+    ExprCode compile_logical(LogicalExpr *node);
+    ExprCode compile_variable(Variable *node);
+    ExprCode compile_call(CallExpr *node);
+    ExprCode compile_get_definition(GetDefinitionExpr *node);
+    TestCode compile_test(const ExprPtr &condition);
+
+    StmtCode compile(const StmtPtr &stmt);
+    StmtCode compile_list(const std::vector<StmtPtr> &statements);
+    StmtCode compile_block(BlockStmt *node);
+    StmtCode compile_declaration(Declaration *node);
+    StmtCode compile_if(IFStmt *node);
+    StmtCode compile_while(WhileStmt *node);
+    StmtCode compile_do(DoStmt *node);
+    StmtCode compile_for(ForStmt *node);
+    StmtCode compile_from(FromStmt *node);
+    StmtCode compile_tail_call(CallExpr *node, const ExprCode &call);
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include "Config.hpp"
+#include "Value.hpp"
+
+// X-macro so the OpCode enum, the names table and the VM dispatch table never drift apart.
+#define BULANG_OPCODES(X) \
+    X(CONSTANT)           \
+    X(NIL)                \
+    X(TRUE)               \
+    X(FALSE)              \
+    X(POP)                \
+    X(DUP)                \
+    X(GET_LOCAL)          \
+    X(SET_LOCAL)          \
+    X(GET_GLOBAL)         \
+    X(SET_GLOBAL)         \
+    X(DEFINE_GLOBAL)      \
+    X(GET_NAME)           \
+    X(SET_NAME)           \
+    X(GET_PROPERTY)       \
+    X(SET_PROPERTY)       \
+    X(ADD)                \
+    X(SUBTRACT)           \
+    X(MULTIPLY)           \
+    X(DIVIDE)             \
+    X(MOD)                \
+    X(EQUAL)              \
+    X(NOT_EQUAL)          \
+    X(GREATER)            \
+    X(GREATER_EQUAL)      \
+    X(LESS)               \
+    X(LESS_EQUAL)         \
+    X(NEGATE)             \
+    X(NOT)                \
+    X(XOR)                \
+    X(JUMP)               \
+    X(JUMP_IF_FALSE)      \
+    X(JUMP_IF_FALSE_KEEP) \
+    X(JUMP_IF_TRUE_KEEP)  \
+    X(LOOP)               \
+    X(ITERATE)            \
+    X(CALL)               \
+    X(TAIL_CALL)          \
+    X(INVOKE)             \
+    X(SUPER_INVOKE)       \
+    X(RETURN)             \
+    X(PRINT)              \
+    X(NOW)                \
+    X(ARRAY)              \
+    X(MAP)                \
+    X(FREEZE)             \
+    X(STRUCT)             \
+    X(STRUCT_FIELD)       \
+    X(CLASS)              \
+    X(FIELD)              \
+    X(METHOD)             \
+    X(FIELD_TYPE)         \
+    X(CHECK_TYPE)
+
+enum OpCode : u8
+{
+#define BULANG_OPCODE_ENUM(name) OP_##name,
+    BULANG_OPCODES(BULANG_OPCODE_ENUM)
+#undef BULANG_OPCODE_ENUM
+    OP_COUNT
+};
+
+const char *opcodeName(u8 op);
+
+// A compiled function body: flat bytecode, its constant pool and a line per byte for errors.
+struct Chunk
+{
+    std::vector<u8> code;
+    std::vector<Value> constants;
+    std::vector<int> lines;
+
+    void write(u8 byte, int line);
+    void writeShort(u16 value, int line);
+    u32 addConstant(Value value);
+
+    u32 count() const { return (u32)code.size(); }
+
+    void disassemble(const char *name);
+    u32 disassembleInstruction(u32 offset);
+};
@@ -2,8 +2,12 @@
 #include "Token.hpp"
 #include <memory>
 #include "Utils.hpp"
+#include "Value.hpp"
 
 struct Visitor;
+struct StructLayout;
+struct ClassShape;
+struct MethodTable;
 
 enum ExprType
 {
@@ -15,12 +19,7 @@ enum ExprType
     LITERAL,
     L_NUMBER,
     L_STRING,
-    L_FUNCTION,
-    L_NATIVE,
-    L_CLASS,
-    L_STRUCT,
-    L_ARRAY,
-    L_MAP,
+    L_BOOLEAN,
     GET,
     GET_DEF,
     SET,
@@ -34,6 +33,70 @@ enum ExprType
     E_COUNT
 };
 
+// tree-walker specialisations, a node picks one the first time it runs and falls
+// back to Q_GENERIC for good once a guard fails. The Q_TYPED_* ones are set by
+// TypeInference before anything runs and are never guarded.
+enum Quick : u8
+{
+    Q_NONE,
+    Q_GENERIC,
+    Q_NUMBER,        // BinaryExpr / UnaryExpr '-': operands have only been numbers
+    Q_SLOT_NUMBER,   // UnaryExpr ++/--: resolved local that holds a number
+    Q_DIRECT,        // CallExpr: callee has always been the same Function
+    Q_CACHED,        // CallExpr: callee is a global whose binding still holds `target`
+    Q_TYPED_NUMBER,  // BinaryExpr / UnaryExpr '-': operands are always numbers
+    Q_TYPED_STRING,  // BinaryExpr + == !=: operands are always strings
+};
+
+// `: number`, `: string` and `: bool` on declarations, parameters and results
+enum Annotation : u8
+{
+    A_NONE,
+    A_NUMBER,
+    A_STRING,
+    A_BOOL,
+};
+
+inline bool annotation_fits(u8 annotation, const Value &value)
+{
+    switch (annotation)
+    {
+        case A_NUMBER: return value.isNumber();
+        case A_STRING: return value.isString();
+        case A_BOOL:   return value.isBool();
+        default:       return true;
+    }
+}
+
+inline const char *annotation_name(u8 annotation)
+{
+    switch (annotation)
+    {
+        case A_NUMBER: return "number";
+        case A_STRING: return "string";
+        case A_BOOL:   return "bool";
+        default:       return "any";
+    }
+}
+
+// builtin array/map methods, GetDefinitionExpr caches the decoded name
+enum BuiltinMethod : u8
+{
+    M_NONE,
+    M_UNKNOWN,
+    M_PUSH,
+    M_POP,
+    M_SIZE,
+    M_AT,
+    M_SET,
+    M_LAST,
+    M_REMOVE,
+    M_CLEAR,
+    M_FOREACH,
+    M_ERASE,
+    M_FIND,
+};
+
 class Expr;
 using ExprPtr =  std::shared_ptr<Expr>;
 
@@ -47,17 +110,15 @@ public:
         INFO("Expr deleted %s", toString().c_str());
      }
 
-    virtual ExprPtr accept( Visitor &v) = 0;
+    virtual Value accept( Visitor &v) = 0;
 
     ExprType type{ExprType::E_NONE};
 
     std::string toString();
 
+    // structural, equal trees hash alike; 0 for nodes the Optimizer never compares
     virtual std::size_t hash()  const { return 0; }
 
-    virtual void print() {};
-    virtual ExprPtr clone() { return nullptr; }
-
 };
 
 
@@ -69,8 +130,7 @@ class EmptyExpr : public Expr
 public:
     EmptyExpr() : Expr() { type = ExprType::EMPTY_EXPR; }
 
-    ExprPtr accept( Visitor &v) override;
-    ExprPtr clone() override;
+    Value accept( Visitor &v) override;
 };
 
 
@@ -79,11 +139,13 @@ class BinaryExpr : public Expr
 public:
     BinaryExpr() : Expr() { type = ExprType::BINARY; }
 
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
+    std::size_t hash() const override;
 
     ExprPtr left;
     ExprPtr right;
     Token op;
+    u8 quick{Q_NONE};
 };
 
 
@@ -92,11 +154,13 @@ class UnaryExpr : public Expr
 public:
     UnaryExpr() : Expr() { type = ExprType::UNARY; }
 
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
+    std::size_t hash() const override;
 
     ExprPtr right;
     Token op;
     bool isPrefix;
+    u8 quick{Q_NONE};
 };
 
 class GroupingExpr : public Expr
@@ -104,7 +168,8 @@ class GroupingExpr : public Expr
 public:
     GroupingExpr() : Expr() { type = ExprType::GROUPING; }
 
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
+    std::size_t hash() const override;
 
     ExprPtr expr;
 };
@@ -114,7 +179,7 @@ class LogicalExpr : public Expr
 public:
     LogicalExpr() : Expr() { type = ExprType::LOGICAL; }
 
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
 
     ExprPtr left;
     ExprPtr right;
@@ -130,12 +195,8 @@ class Literal : public Expr
 public:
     Literal() : Expr() { type = ExprType::LITERAL;  }
 
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
     virtual ~Literal() { }
-    virtual void print() override;
-
-    ExprPtr clone() override;
- 
 };
 
 class NumberLiteral : public Literal
@@ -160,13 +221,20 @@ public:
         return std::hash<double>()(value);
     }
 
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
 
-    void print() override;
+    double value;
+};
 
-    ExprPtr clone() override;
+class BooleanLiteral : public Literal
+{
+public:
+    BooleanLiteral() : Literal() { type = ExprType::L_BOOLEAN; }
 
-    double value;
+    Value accept( Visitor &v) override;
+    std::size_t hash() const override { return std::hash<bool>()(value); }
+
+    bool value;
 };
 
 
@@ -182,11 +250,7 @@ public:
         INFO("StringLiteral deleted %s", value.c_str());
     }
  
-    ExprPtr accept( Visitor &v) override;
-
-    void print() override;
-
-    ExprPtr clone() override;
+    Value accept( Visitor &v) override;
 
     bool operator==(const StringLiteral& outra) const 
     {
@@ -198,13 +262,14 @@ public:
     }
 
     std::string value;
+    Value cached;   // runtime string, built on first evaluation
 };
 
 class NowExpr : public Expr
 {
 public:
     NowExpr() : Expr() { type = ExprType::NOW; }
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
 
 };
 
@@ -215,40 +280,70 @@ class Variable : public Expr
 {
 public:
     Variable() : Expr() { type = ExprType::VARIABLE; }
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
+    std::size_t hash() const override { return std::hash<std::string>()(name.lexeme); }
 
     Token name;
+    int depth{-1};   // set by the Resolver, -1 means lookup by name
+    int slot{-1};
 };
 
 class Assign : public Expr
 {
 public:
     Assign() : Expr() { type = ExprType::ASSIGN; }
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
 
     Token name;   
     ExprPtr value;
+    int depth{-1};
+    int slot{-1};
+    u8 annotation{A_NONE};   // set by the Parser when the target was declared with one
 };
 
 class CallExpr : public Expr
 {
 public:
     CallExpr() : Expr() { type = ExprType::CALL; }
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
     Token name;
     ExprPtr callee;
     std::vector<ExprPtr> args;
+    u8 quick{Q_NONE};
+    Object *target{nullptr};   // Q_DIRECT only compares against it, Q_CACHED calls it
+    Value *cell{nullptr};      // Q_CACHED: the global binding of the callee
+    u32 version{0};            // Q_CACHED: Environment::version of the globals then
+    bool global{false};        // set by the Optimizer, nothing but a global has the callee's name
+
+};
 
+
+// inline cache of GetExpr/SetExpr, the slot of the field in the last struct layout or
+// instance shape seen
+struct FieldCache
+{
+    std::shared_ptr<StructLayout> layout;
+    std::shared_ptr<ClassShape> shape;
+    u32 slot{0};
 };
 
+// method a call site found last, good while the receiver has the same shape and class
+struct MethodCache
+{
+    std::shared_ptr<ClassShape> shape;
+    std::shared_ptr<MethodTable> table;
+    u32 slot{0};
+};
 
 class GetExpr : public Expr
 {
 public:
     GetExpr() : Expr() { type = ExprType::GET; }
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
+    std::size_t hash() const override;
     Token name;
     ExprPtr object;
+    FieldCache cache;
 
 };
 
@@ -256,10 +351,13 @@ class GetDefinitionExpr : public Expr
 {
 public:
     GetDefinitionExpr() : Expr() { type = ExprType::GET_DEF; }
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
     Token name;
     ExprPtr variable;
     std::vector<ExprPtr> values;
+    u8 method{M_NONE};
+    bool super{false};   // super.name(...), bound to the running instance
+    MethodCache cache;
 };
 
 
@@ -267,22 +365,23 @@ class SetExpr : public Expr
 {
 public:
     SetExpr() : Expr() { type = ExprType::SET; }
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
     Token name;
     ExprPtr object;
     ExprPtr value;
+    FieldCache cache;
 };
 
 class SelfExpr : public Expr
 {
 public:
     SelfExpr() : Expr() { type = ExprType::SELF; }
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
 };
 
 class SuperExpr : public Expr
 {
 public:
     SuperExpr() : Expr() { type = ExprType::SUPER; }
-    ExprPtr accept( Visitor &v) override;
+    Value accept( Visitor &v) override;
 };
\ No newline at end of file
@@ -5,11 +5,20 @@
 #include "Expr.hpp"
 #include "Stmt.hpp"
 #include "Arena.hpp"
+#include "Value.hpp"
+#include <functional>
+#include <list>
 
 class Interpreter;
 class Context;
-
-typedef ExprPtr (*NativeFunction)(Context *ctx, int argc);
+class VM;
+class Binder;
+class Jit;
+struct Chunk;
+struct ClassLiteral;
+
+typedef Value (*NativeFunction)(Context *ctx, int argc);
+typedef int (*JitCode)(const double *args, double *result);
 typedef struct
 {
     const char *name;
@@ -17,96 +26,202 @@ typedef struct
 } NativeFuncDef;
 
 
-struct Function : public Literal
+// results of a @memo function keyed on its arguments, least recently used dropped first
+struct MemoTable
+{
+    std::string name;
+    u32 capacity;   // 0: unbounded
+    u64 hits{0};
+    u64 misses{0};
+    std::list<std::pair<std::string, Value>> entries;   // most recently used first
+    std::unordered_map<std::string, std::list<std::pair<std::string, Value>>::iterator> index;
+
+    static bool key(const Value *args, u32 count, std::string &key);
+    bool find(const std::string &key, Value &result);
+    void insert(const std::string &key, const Value &result);
+};
+
+struct MemoStats
+{
+    std::string name;
+    u64 hits;
+    u64 misses;
+    size_t entries;
+};
+
+struct Function : public Object
 {
     std::string args[32];
     u32 arity;
     Token name;
     StmtPtr body;
+    std::shared_ptr<Chunk> chunk;
+    std::function<u8()> code;   // body pre-bound by the closure backend
+    u32 calls;
+    JitCode native;             // set once the JIT took the body
+    bool nojit;                 // rejected by the JIT or deoptimized
+    std::shared_ptr<MemoTable> memo;
+    std::vector<u8> argTypes;   // Annotation per parameter, empty when there are none
+    u8 result;
     Function();
-    ExprPtr clone() override;
-
- 
-
 };
 
-struct Native : public Literal
+struct Native : public Object
 {
     Token name;
+    NativeFunction function;
     Native();
 };
 
-struct ClassLiteral : public Literal
+// field slots of class instances. Shapes grow one field at a time from an empty root and
+// each step is kept, so instances that got the same fields in the same order share a
+// shape, a child class continues from its parent's.
+struct ClassShape
+{
+    Scope scope;   // names by slot, an instance Environment finds bare names through it
+    std::unordered_map<std::string, u32> slots;
+    std::unordered_map<std::string, std::shared_ptr<ClassShape>> transitions;
+
+    static std::shared_ptr<ClassShape> root();
+    static std::shared_ptr<ClassShape> add(const std::shared_ptr<ClassShape> &shape, const std::string &name);
+    int find(const std::string &name) const;
+};
+
+// methods of a class by slot. A child class starts from a copy of its parent's, so an
+// override takes the slot of the method it replaces and a call never walks the parents.
+struct MethodTable
+{
+    std::vector<Value *> methods;        // the binding in the class that declares it
+    std::vector<ClassLiteral *> owners;  // that class, a super call in the method goes to its base
+    std::unordered_map<std::string, u32> slots;
+
+    int find(const std::string &name) const;
+};
+
+// both a class and an instance of one. An instance holds its fields in the slots of its
+// Environment, named by its shape. Methods are not copied: the Environment's parent is the
+// class's, and a child class's Environment has its parent's as parent.
+struct ClassLiteral : public Object
 {
     std::string name;
     std::string parentName;
     
     bool isChild;
     Environment *environment;
+    std::shared_ptr<ClassShape> shape;   // an instance: its fields; a class: what its instances start with
+    Value owner;                         // an instance: the class it was made from
+
+    // a class, filled in by prepare() the first time it is called
+    std::vector<std::string> fields;   // declared by its body, in order
+    std::vector<std::string> methods;  // declared by its body, in order
+    std::shared_ptr<MethodTable> table;
+    std::vector<Value *> defaults;     // per slot, the binding in this class or a parent it starts from
+    Value base;                        // the parent class
+    bool prepared;
+    bool preparing;                    // guards against a class that ends up extending itself
 
     
     ClassLiteral();
     virtual ~ClassLiteral();
-    void print();
-    ExprPtr clone() override;
+    std::string toString() override;
+    void print() override;
+    Value clone() override;
 
+    bool instance() const { return !owner.isEmpty(); }
+    void prepare(const Value &parent);
+    Value instantiate();
+    void add(const std::string &name, Value value);
+    Value *method(const std::string &name, ClassLiteral *&holder);
 };
 
 
 
-struct StructLiteral : public Literal
+// field names of a struct in declaration order, the struct and every instance share it
+struct StructLayout
 {
     std::string name;
-    std::unordered_map<std::string, ExprPtr> members;
+    std::vector<std::string> fields;
+    std::vector<u8> types;   // Annotation per field, empty when there are none
+    std::unordered_map<std::string, u32> slots;
+
+    int find(const std::string &name) const;
+    u32 add(const std::string &name, u8 type);
+};
+
+// one allocation per struct: the object, then one Value per field of the layout. The
+// struct a script declares holds the defaults its instances start from.
+struct StructLiteral : public Object
+{
+    std::shared_ptr<StructLayout> layout;
+    u32 count;
 
-    StructLiteral();
+    static StructLiteral *create(std::shared_ptr<StructLayout> layout, u32 count);
+    static void operator delete(void *p);
     virtual ~StructLiteral();
-    void print();
-    ExprPtr clone() override;
+    Value *values() { return reinterpret_cast<Value *>(this + 1); }
+    std::string toString() override;
+    void print() override;
+    Value clone() override;
+
+private:
+    StructLiteral(std::shared_ptr<StructLayout> layout, u32 count);
 };
 
-struct ArrayLiteral : public Literal
+struct ArrayLiteral : public Object
 {
-    std::vector<ExprPtr> values;
+    std::vector<Value> values;
     std::string name;
+    bool frozen{false};   // a `const` array, clone() shares it
     ArrayLiteral();
+    std::string toString() override;
     void print() override;
-
-    ExprPtr clone() override;
+    Value clone() override;
 };
 
-struct MapLiteral : public Literal
+struct MapLiteral : public Object
 {
-    std::map<ExprPtr, ExprPtr> values;
+    std::unordered_map<Value, Value, ValueHash, ValueEqual> values;
     std::string name;
+    bool frozen{false};   // a `const` map, clone() shares it
     MapLiteral();
+    std::string toString() override;
     void print() override;
-    ExprPtr clone() override;
+    Value clone() override;
 };
 
+// what a statement hands back to its enclosing statement, break/continue/return
+// travel up through the u8 of execute() instead of unwinding the C++ stack
+enum Completion : u8
+{
+    C_NORMAL = 0,
+    C_BREAK,
+    C_CONTINUE,
+    C_RETURN,
+};
 
 struct Visitor
 {
     virtual ~Visitor() {}
-    virtual ExprPtr visit(ExprPtr node) = 0;
-
-    virtual ExprPtr visit_empty_expression(EmptyExpr *node) = 0;
-    virtual ExprPtr visit_binary(BinaryExpr *node) = 0;
-    virtual ExprPtr visit_unary(UnaryExpr *node) = 0;
-    virtual ExprPtr visit_logical(LogicalExpr *node) = 0;
-    virtual ExprPtr visit_grouping(GroupingExpr *node) = 0;
-    virtual ExprPtr visit_literal(Literal *node) = 0;
-    virtual ExprPtr visit_number_literal(NumberLiteral *node) = 0;
-    virtual ExprPtr visit_string_literal(StringLiteral *node) = 0;
-    virtual ExprPtr visit_now_expression(NowExpr *node) = 0;
-    virtual ExprPtr visit_read_variable(Variable *node) = 0;
-    virtual ExprPtr visit_assign(Assign *node) = 0;
-    virtual ExprPtr visit_call(CallExpr *node) = 0;
-    virtual ExprPtr visit_get(GetExpr *node) = 0;
-    virtual ExprPtr visit_get_definition(GetDefinitionExpr *node) = 0;
-    virtual ExprPtr visit_set(SetExpr *node) = 0;
-    virtual ExprPtr visit_self(SelfExpr *node) = 0;
-    virtual ExprPtr visit_super(SuperExpr *node) = 0;
+    virtual Value visit(ExprPtr node) = 0;
+
+    virtual Value visit_empty_expression(EmptyExpr *node) = 0;
+    virtual Value visit_binary(BinaryExpr *node) = 0;
+    virtual Value visit_unary(UnaryExpr *node) = 0;
+    virtual Value visit_logical(LogicalExpr *node) = 0;
+    virtual Value visit_grouping(GroupingExpr *node) = 0;
+    virtual Value visit_literal(Literal *node) = 0;
+    virtual Value visit_number_literal(NumberLiteral *node) = 0;
+    virtual Value visit_string_literal(StringLiteral *node) = 0;
+    virtual Value visit_boolean_literal(BooleanLiteral *node) = 0;
+    virtual Value visit_now_expression(NowExpr *node) = 0;
+    virtual Value visit_read_variable(Variable *node) = 0;
+    virtual Value visit_assign(Assign *node) = 0;
+    virtual Value visit_call(CallExpr *node) = 0;
+    virtual Value visit_get(GetExpr *node) = 0;
+    virtual Value visit_get_definition(GetDefinitionExpr *node) = 0;
+    virtual Value visit_set(SetExpr *node) = 0;
+    virtual Value visit_self(SelfExpr *node) = 0;
+    virtual Value visit_super(SuperExpr *node) = 0;
 
 
 
@@ -141,29 +256,47 @@ private:
 
     Environment *parent;
     u32 depth;
-    std::unordered_map<std::string, ExprPtr> m_values;
+    std::unordered_map<std::string, Value> m_values;
+
+    // resolved locals, named by scope->names for by-name lookups
+    std::vector<Value> m_slots;
+    const Scope *scope;
+
+    Value *findSlot(const std::string &name);
 
 public:
     Environment();
     Environment(Environment *parent);
+    Environment(Environment *parent, const Scope *scope);
     virtual ~Environment();
 
+    Value getAt(u32 depth, u32 slot);
+    Value *slotAt(u32 depth, u32 slot);
+    bool assignAt(u32 depth, u32 slot, Value value);
+    void defineAt(u32 slot, Value value) { m_slots[slot] = std::move(value); }
+    Value &slot(u32 slot) { return m_slots[slot]; }
+    void extend(const Scope *scope, Value value);
+    void reset(const Scope *scope);
+
 
 
     void print();
 
-    bool define(const std::string &name, ExprPtr value);
-    ExprPtr get(const std::string &name);
-    bool set(const std::string &name, ExprPtr value);
+    bool define(const std::string &name, Value value);
+    Value get(const std::string &name);
+    bool set(const std::string &name, Value value);
 
     bool empty() { return m_values.empty(); }
     bool size() { return m_values.size(); }
 
     bool contains(const std::string &name);
     void remove(const std::string &name); 
+    Value *find(const std::string &name);   // this environment's own binding, no parents
+
+    u32 version{0};   // bumped when a binding goes away, a Value * into m_values stays valid until then
 
-    bool assign(const std::string &name, ExprPtr value);
-    bool replace(const std::string &name, ExprPtr value);
+    bool assign(const std::string &name, Value value);
+    bool replace(const std::string &name, Value value);
 
     bool addInteger(const std::string &name, int value);
     bool addDouble(const std::string &name, double value);
@@ -171,13 +304,13 @@ public:
     bool addBoolean(const std::string &name, bool value);
 
 
-    bool copy(std::unordered_map<std::string, ExprPtr> values);
+    bool copy(std::unordered_map<std::string, Value> values);
     bool copy(Environment *environment); 
 
     std::shared_ptr<Environment> clone();
 
-    std::unordered_map<std::string, ExprPtr> values() { return m_values; }
-    std::unordered_map<std::string, ExprPtr> values() const { return m_values; }
+    std::unordered_map<std::string, Value> values() { return m_values; }
+    std::unordered_map<std::string, Value> values() const { return m_values; }
 
     void setParent(Environment *p) { parent = p; }
     Environment* getParent() { return parent; }
@@ -199,13 +332,13 @@ public:
     std::string getString(u8 index);
     bool getBoolean(u8 index);
 
-    ExprPtr asFloat(float value);
-    ExprPtr asDouble(double value);
-    ExprPtr asInt(int value);
-    ExprPtr asLong(long value);
-    ExprPtr asString(std::string value);
-    ExprPtr asBoolean(bool value);
-    ExprPtr asNil();
+    Value asFloat(float value);
+    Value asDouble(double value);
+    Value asInt(int value);
+    Value asLong(long value);
+    Value asString(std::string value);
+    Value asBoolean(bool value);
+    Value asNil();
 
     bool isNumber(u8 index);
     bool isString(u8 index);
@@ -213,18 +346,16 @@ public:
 private:
     friend class Interpreter;
     friend class Compiler;
+    friend class VM;
 
 
     Context(const Context &) = delete;
     Context &operator=(const Context &) = delete;
 
-    void add(ExprPtr value, Literal *literal);
+    void add(Value value);
 
-    std::vector<ExprPtr> values;
-    std::vector<Literal *> literals;
-    std::vector<ExprPtr>   expressions;
+    std::vector<Value> args;
     Interpreter *interpreter;
-    ExprPtr NIL;
     
 
     void clear();
@@ -239,32 +370,46 @@ private:
 struct Compiler : public Visitor
 {
 
-    ExprPtr visit(ExprPtr node) override;
-    ExprPtr visit_empty_expression(EmptyExpr *node) override;
-    ExprPtr visit_binary(BinaryExpr *node) override;
-    ExprPtr visit_unary(UnaryExpr *node) override;
-    ExprPtr visit_logical(LogicalExpr *node) override;
-    ExprPtr visit_grouping(GroupingExpr *node) override;
-    ExprPtr visit_literal(Literal *node) override;
-    ExprPtr visit_number_literal(NumberLiteral *node) override;
-    ExprPtr visit_string_literal(StringLiteral *node) override;
-    ExprPtr visit_now_expression(NowExpr *node) override;
-    ExprPtr visit_read_variable(Variable *node) override;//read
-    ExprPtr visit_assign(Assign *node) override;
-    ExprPtr evaluate(ExprPtr node);
-    ExprPtr visit_call(CallExpr *node) override;
-    ExprPtr visit_get(GetExpr *node) override;
-    ExprPtr visit_self(SelfExpr *node) override;
-    ExprPtr visit_super(SuperExpr *node) override;
+    Value visit(ExprPtr node) override;
+    Value visit_empty_expression(EmptyExpr *node) override;
+    Value visit_binary(BinaryExpr *node) override;
+    Value visit_unary(UnaryExpr *node) override;
+    Value visit_logical(LogicalExpr *node) override;
+    Value visit_grouping(GroupingExpr *node) override;
+    Value visit_literal(Literal *node) override;
+    Value visit_number_literal(NumberLiteral *node) override;
+    Value visit_string_literal(StringLiteral *node) override;
+    Value visit_boolean_literal(BooleanLiteral *node) override;
+    Value visit_now_expression(NowExpr *node) override;
+    Value visit_read_variable(Variable *node) override;//read
+    Value visit_assign(Assign *node) override;
+    Value evaluate(const ExprPtr &node);
+    Value visit_call(CallExpr *node) override;
+    Value visit_get(GetExpr *node) override;
+    Value visit_self(SelfExpr *node) override;
+    Value visit_super(SuperExpr *node) override;
     
 
 
-    ExprPtr visit_get_definition(GetDefinitionExpr *node) override;
-    ExprPtr visit_set(SetExpr *node) override;
-    ExprPtr visit_call_native(CallExpr *node);
-    ExprPtr visit_call_struct(const ExprPtr &var,CallExpr *node, Expr *expr);
-    ExprPtr visit_call_function(CallExpr *node, Expr *expr);
-    ExprPtr visit_call_class(const ExprPtr &var,CallExpr *node, Expr *expr);
+    Value visit_get_definition(GetDefinitionExpr *node) override;
+    Value visit_set(SetExpr *node) override;
+    Value visit_call_native(Native *native, CallExpr *node);
+    Value visit_call_struct(StructLiteral *original, CallExpr *node);
+    bool prepare_class(ClassLiteral *cl);
+    Value visit_call_function(Function *function, CallExpr *node);
+    Value visit_call_class(ClassLiteral *main, CallExpr *node);
+    Object *cached_callee(CallExpr *node);
+    void cache_callee(CallExpr *node, const Value &callee);
+    Value call_function(Function *function, std::vector<Value> &args, const Token &name, Environment *enclosing, ClassLiteral *self = nullptr);
+    Value run_function(Function *function, std::vector<Value> &args, const Token &name, Environment *enclosing, ClassLiteral *self = nullptr);
+    bool call_native(Function *function, const std::vector<Value> &args, Environment *enclosing, Value &result);
+    bool call_jit(Function *function, const std::vector<Value> &args, Environment *enclosing, Value &result);
+    u8 tail_call(Function *function, std::vector<Value> &args, const Token &name);
+    void check_type(u8 annotation, const Value &value, const std::string &name, int line);
+    void check_args(Function *function, const std::vector<Value> &args, const Token &name);
+    Value *counter(ForStmt *node);
+    bool count_test(ForStmt *node, const Value *counter, const Value &bound);
+    void count_step(ForStmt *node, Value *counter);
 
     u8 execute(Stmt *stmt);
 
@@ -290,28 +435,53 @@ struct Compiler : public Visitor
     u8 visit_array(ArrayStmt *node) override;
     u8 visit_map(MapStmt *node) override;
 
-    ExprPtr ProcessString(Expr *var, GetDefinitionExpr *node);
-    ExprPtr ProcessArray(Expr *var, GetDefinitionExpr *node);
-    ExprPtr ProcessMap(Expr *var, GetDefinitionExpr *node);
-    ExprPtr ProcessClass(Expr *var, GetDefinitionExpr *node);
-    ExprPtr visit_call_function_member(CallExpr *node, Expr *callee, ClassLiteral *main);
+    Value ProcessString(const Value &var, GetDefinitionExpr *node);
+    Value ProcessArray(const Value &var, GetDefinitionExpr *node);
+    Value ProcessMap(const Value &var, GetDefinitionExpr *node);
+    Value find_method(ClassLiteral *&self, GetDefinitionExpr *node, ClassLiteral *&owner);
+    Value ProcessClass(const Value &var, GetDefinitionExpr *node);
+
+    Value get_member(const Value &object, const Token &name);
+    Value *field(StructLiteral *sl, const Token &name, FieldCache &cache);
+    Value *field(ClassLiteral *cl, const Token &name, FieldCache &cache);
+    void set_member(const Value &object, const Token &name, Value value);
+    void assign_variable(const Token &name, int depth, int slot, Value value);
 
     u8 execte_block(BlockStmt *node, Environment *env);
+    u8 execte_code(const std::function<u8()> &code, Environment *env);
+
+    Value binary(BinaryExpr *node, const Value &left, const Value &right);
+    Value unary(UnaryExpr *expr, const Value &right);
+    bool is_true(const ExprPtr &condition);
 
     Compiler(Interpreter *i, Compiler *parent = nullptr);
     ~Compiler();
 
 private:
     friend class Interpreter;
+    friend class VM;
+    friend class Binder;
+    friend class Runtime;
     Interpreter *interpreter;
     Environment *environment;
     std::shared_ptr<Environment> global;
     Environment *prefEnv;
     Compiler *parent;
     u32 loop_count = 0;
+    Value returnValue;
     std::stack<Environment *> locals;
 
-    std::shared_ptr<ClassLiteral> instance;
+    // a `return f(...)` marked by the Resolver, run by call_function in the caller's frame
+    Function *tailFunction{nullptr};
+    std::vector<Value> tailArgs;
+    const Token *tailName{nullptr};
+
+    ClassLiteral *instance;
+    ClassLiteral *holder{nullptr};   // the class that declares the running method
+    Binder *binder{nullptr};
+    Jit *jit{nullptr};
+    std::unordered_map<const Stmt *, std::function<u8()>> bodies;   // function bodies built ahead of time
+    std::vector<std::shared_ptr<MemoTable>> memos;
 
 
     void pop_local();
@@ -322,6 +492,15 @@ private:
     void init();
 };
 
+const int OPT_LEVEL_DEFAULT = 1;   // see Optimizer
+
+enum class Backend
+{
+    AST,
+    BYTECODE,
+    CLOSURE
+};
+
 class Interpreter
 {
 
@@ -329,7 +508,7 @@ public:
     ~Interpreter();
     Interpreter();
 
-    bool compile(const std::string &source);
+    bool compile(const std::string &source, int optimize = OPT_LEVEL_DEFAULT);
 
     void clear();
 
@@ -340,25 +519,51 @@ public:
     bool registerBoolean(const std::string &name, bool value);
     bool registerDouble(const std::string &name, double value);
     bool registerString(const std::string &name, std::string value);
-    
+
+    // immutable, the Optimizer folds reads into the program and scripts cannot bind them
+    bool registerConstInteger(const std::string &name, int value);
+    bool registerConstBoolean(const std::string &name, bool value);
+    bool registerConstDouble(const std::string &name, double value);
+    bool registerConstString(const std::string &name, std::string value);
+
 
     bool isnative(const std::string &name);
 
+    void setBackend(Backend value) { backend = value; }
+    Backend getBackend() const { return backend; }
+
+    void setJit(bool value) { compiler->jit = value ? jit : nullptr; }
+    void setOptimizerLog(bool value) { optimizerLog = value; }
+
+    std::vector<MemoStats> memoStats() const;
+
 private:
     friend class Compiler;
     friend class Context;
+    friend class VM;
+    friend class Runtime;
 
     Compiler *compiler;
     Context *context;
+    VM *vm;
+    Binder *binder;
+    Jit *jit;
+    Backend backend;
+    bool optimizerLog{false};
 
     std::shared_ptr<Compiler> currentCompiler;
     std::shared_ptr<Context> currentContext;
+    std::shared_ptr<VM> currentVM;
+    std::shared_ptr<Binder> currentBinder;
+    std::shared_ptr<Jit> currentJit;
 
    std::unordered_map<std::string, NativeFunction> nativeFunctions;
+   std::unordered_map<std::string, Value> constants;
 
 
-    ExprPtr CallNativeFunction(const std::string &name, int argc);
-    bool registerGlobal(const std::string &name, ExprPtr value);
+    Value CallNativeFunction(const std::string &name, int argc);
+    bool registerGlobal(const std::string &name, Value value);
+    bool registerConst(const std::string &name, Value value);
     
 
     void Error(const Token &token, const std::string &message);
@@ -0,0 +1,29 @@
+#pragma once
+#include "Config.hpp"
+#include "Interpreter.hpp"
+
+// calls before a function is handed to the JIT
+#define JIT_THRESHOLD 64
+
+enum JitStatus : int
+{
+    JIT_OK = 0,
+    JIT_DEOPT,
+};
+
+// Baseline template JIT for x86-64. Only functions made of numbers, locals, arithmetic,
+// comparisons, if/while/do/for and calls to themselves are compiled; locals live in the
+// native frame as doubles. Such bodies have no side effects, so when a guard fails
+// (division by zero, falling off the end) the native code returns JIT_DEOPT and the
+// call simply runs again in the Compiler.
+class Jit
+{
+public:
+    Jit();
+    ~Jit();
+
+    JitCode compile(Function *function);
+
+private:
+    std::vector<std::pair<void *, size_t>> pages;
+};
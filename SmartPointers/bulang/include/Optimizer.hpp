@@ -0,0 +1,122 @@
+#pragma once
+#include "Config.hpp"
+#include "Interpreter.hpp"
+#include <unordered_set>
+
+// Rewrites a parsed Program before the Resolver sees it.
+//  level 0: nothing
+//  level 1: operators whose operands are all literals are folded into one literal,
+//           groupings are dropped, `!!x` is read as `x` where only its truth is used,
+//           and if/elif branches with a literal condition are pruned
+//  level 2: also x*1, 1*x, x/1, x+0, 0+x and x-0, which assumes x is a number, and
+//           invariant expressions are hoisted out of loop bodies, which assumes they
+//           do not throw when the body would not have run
+// From level 1 calls to small top-level functions are inlined (see Optimizer::candidate),
+// invariant parts of while/for conditions are computed once before the loop, counted for
+// loops are marked (ForStmt::counted), dead code is dropped (see Optimizer::eliminate),
+// repeated pure expressions in a basic block are computed once (see Optimizer::share) and
+// TypeInference then marks the operators it can prove the operand types of.
+// Calls whose callee can only be a global are marked (CallExpr::global) for the call-site
+// cache of the tree-walker and the Binder.
+// Host constants (Interpreter::registerConst*) and script `const` names whose value folds
+// to a literal are read as literals from level 1, so the folding and pruning above see
+// them; at any level a script that binds one again, or changes a const array or map, is
+// rejected.
+// Anything that would throw at run time (x / 0, "a" * 2, nil operands) is left alone.
+// With verbose set every rewrite that crosses a call is logged.
+class Optimizer
+{
+public:
+    explicit Optimizer(int level, bool verbose = false) : level(level), verbose(verbose) {}
+
+    void optimize(Program *program);
+    void setConstants(const std::unordered_map<std::string, Value> *values) { constants = values; }
+
+private:
+    struct Inline
+    {
+        std::vector<std::string> params;
+        ExprPtr body;   // the returned expression, locals already substituted
+    };
+
+    // what the code of one loop may change
+    struct Region
+    {
+        std::unordered_set<std::string> bound;   // declared, assigned or stepped inside
+        bool calls{false};     // a script function or method runs, through dynamic scoping it may write anything
+        bool natives{false};   // a native runs, it may change the objects it is given
+        bool stores{false};    // a field or an element is written
+    };
+
+    // a pure expression seen in the current basic block
+    struct Common
+    {
+        ExprPtr expr;                 // the first occurrence, the one that runs
+        std::vector<ExprPtr *> uses;  // every occurrence, the first one included
+        size_t statement;             // of the block's list, the temporary is declared before it
+    };
+
+    struct Block
+    {
+        std::vector<Common> seen;
+        std::unordered_multimap<std::size_t, size_t> available;   // Expr::hash() -> seen, until killed
+        size_t statement{0};
+        int conditional{0};   // inside the right side of and/or
+    };
+
+    int level;
+    bool verbose;
+    bool typed{false};   // TypeInference has marked the program
+    const std::unordered_map<std::string, Value> *constants{nullptr};
+    std::unordered_map<std::string, int> fixed;        // `const` names, the line they are declared on
+    std::unordered_map<std::string, Value> known;      // of those, the ones that fold to a literal
+    std::unordered_set<std::string> nested;            // bound somewhere other than the globals
+    std::unordered_map<std::string, int> bindings;   // declarations and assignments of each name
+    std::unordered_map<std::string, int> containers; // of those, `var a[]` and `var m{}`
+    std::unordered_map<std::string, Inline> inlines;
+    int temps{0};
+    int shared{0};
+    int substituted{0};
+
+    void bind(const StmtPtr &stmt);
+    void bind(const ExprPtr &expr);
+    void bind(const std::string &name, int line);
+    void fix(const StmtPtr &stmt);
+    void shadow(const StmtPtr &stmt, bool top);
+    bool free(const ExprPtr &expr, const std::vector<std::string> &params);
+    bool pure(const ExprPtr &expr, bool calls);
+    void candidate(FunctionStmt *node);
+    void inline_call(ExprPtr &expr);
+
+    void loop(StmtPtr &stmt);
+    void region(const StmtPtr &stmt, Region &r);
+    void region(const ExprPtr &expr, Region &r);
+    bool invariant(const ExprPtr &expr, const Region &r);
+    void hoist(ExprPtr &expr, const Region &r, std::vector<StmtPtr> &out);
+    void hoist_body(const StmtPtr &stmt, const Region &r, std::vector<StmtPtr> &out);
+    void count(ForStmt *node, const Region &r);
+
+    void eliminate(Program *program);
+    void references(const StmtPtr &stmt, std::unordered_map<std::string, int> &uses);
+    void references(const ExprPtr &expr, std::unordered_map<std::string, int> &uses);
+    bool sweep(std::vector<StmtPtr> &list, const std::unordered_map<std::string, int> &uses);
+    bool sweep(const StmtPtr &stmt, const std::unordered_map<std::string, int> &uses);
+    bool unused(const StmtPtr &stmt, const std::unordered_map<std::string, int> &uses);
+
+    void share(std::vector<StmtPtr> &list);
+    void share(const StmtPtr &stmt);
+    void common(ExprPtr &expr, Block &b);
+    void kill(Block &b, const std::string &name, bool fields);
+    void reuse(Block &b, std::vector<std::pair<size_t, StmtPtr>> &temporaries);
+
+    void statements(std::vector<StmtPtr> &list);
+    void statement(StmtPtr &stmt);
+    void branch(StmtPtr &stmt);
+    void prune(StmtPtr &stmt);
+
+    void expression(ExprPtr &expr);
+    void condition(ExprPtr &expr);
+    void binary(ExprPtr &expr);
+    void unary(ExprPtr &expr);
+    void logical(ExprPtr &expr);
+};
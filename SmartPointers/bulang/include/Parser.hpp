@@ -27,6 +27,9 @@ private:
     int countBegins;
     int countEnds ;
 
+    // annotated names by block, restarted for every function body
+    std::vector<std::unordered_map<std::string, u8>> annotations;
+
 
 
 
@@ -45,6 +48,10 @@ private:
     void Error(const std::string &message);
     void Warning(const Token &token, const std::string &message);
 
+    u8 type_annotation();
+    void annotate(const std::string &name, u8 annotation);
+    u8 annotation_of(const std::string &name);
+
 
     ExprPtr expression();
     ExprPtr equality();
@@ -72,7 +79,9 @@ private:
 
     StmtPtr expression_statement();
     StmtPtr variable_declaration(bool inIntern=false);
+    StmtPtr const_declaration();
     StmtPtr function_declaration();
+    StmtPtr annotated_declaration();
     StmtPtr print_statement();
     StmtPtr statement();
     StmtPtr declarations();
@@ -0,0 +1,95 @@
+#pragma once
+#include "Config.hpp"
+#include "Interpreter.hpp"
+#include <unordered_set>
+
+// Static pass run before the tree-walker. Variables declared inside a function body
+// (or any block) get a (depth, slot) address; everything else stays a by-name lookup.
+// Calls use dynamic scoping, so resolution never crosses a function, class or struct
+// boundary and the top level is left to the global hash map.
+//
+// `return f(...)` inside a function is marked as a tail call when no function body
+// ever looks up one of the caller's names by name: only then can dynamic scoping not
+// tell the caller's frame was dropped before f ran.
+struct Resolver : public Visitor
+{
+    Resolver();
+    ~Resolver();
+
+    void resolve(Program *program);
+
+    Value visit(ExprPtr node) override;
+    Value visit_empty_expression(EmptyExpr *node) override;
+    Value visit_binary(BinaryExpr *node) override;
+    Value visit_unary(UnaryExpr *node) override;
+    Value visit_logical(LogicalExpr *node) override;
+    Value visit_grouping(GroupingExpr *node) override;
+    Value visit_literal(Literal *node) override;
+    Value visit_number_literal(NumberLiteral *node) override;
+    Value visit_string_literal(StringLiteral *node) override;
+    Value visit_boolean_literal(BooleanLiteral *node) override;
+    Value visit_now_expression(NowExpr *node) override;
+    Value visit_read_variable(Variable *node) override;
+    Value visit_assign(Assign *node) override;
+    Value visit_call(CallExpr *node) override;
+    Value visit_get(GetExpr *node) override;
+    Value visit_get_definition(GetDefinitionExpr *node) override;
+    Value visit_set(SetExpr *node) override;
+    Value visit_self(SelfExpr *node) override;
+    Value visit_super(SuperExpr *node) override;
+
+    u8 execute(Stmt *stmt) override;
+    u8 visit_block_smt(BlockStmt *node) override;
+    u8 visit_expression_smt(ExpressionStmt *node) override;
+    u8 visit_print_smt(PrintStmt *node) override;
+    u8 visit_declaration(Declaration *node) override;
+    u8 visit_if(IFStmt *node) override;
+    u8 visit_while(WhileStmt *node) override;
+    u8 visit_do(DoStmt *node) override;
+    u8 visit_program(Program *node) override;
+    u8 visit_function(FunctionStmt *node) override;
+    u8 visit_for(ForStmt *node) override;
+    u8 visit_from(FromStmt *node) override;
+    u8 visit_return(ReturnStmt *node) override;
+    u8 visit_break(BreakStmt *node) override;
+    u8 visit_switch(SwitchStmt *node) override;
+    u8 visit_continue(ContinueStmt *node) override;
+    u8 visit_struct(StructStmt *node) override;
+    u8 visit_class(ClassStmt *node) override;
+    u8 visit_array(ArrayStmt *node) override;
+    u8 visit_map(MapStmt *node) override;
+
+private:
+    // one runtime Environment
+    struct Frame
+    {
+        Scope *scope;                                // nullptr: names only
+        std::unordered_map<std::string, int> names;  // slot, or -1 when defined by name
+        bool boundary;
+    };
+
+    std::vector<Frame> frames;
+
+    struct Function
+    {
+        std::unordered_set<std::string> names;   // parameters, locals and nested definitions
+        std::vector<ReturnStmt *> tails;
+    };
+
+    std::vector<Function> functions;
+    std::vector<u32> open;                     // functions being resolved, innermost last
+    std::unordered_set<std::string> byName;    // names looked up by name from inside a function
+    u32 classes{0};
+
+    void lookup(const std::string &name, int slot);
+    void mark_tail_calls();
+
+    void begin_scope(Scope *scope, bool boundary);
+    void end_scope();
+
+    int declare(const std::string &name);
+    void declare_named(const std::string &name);
+    void resolve_name(const std::string &name, int &depth, int &slot);
+
+    void resolve_statements(std::vector<StmtPtr> &statements);
+};
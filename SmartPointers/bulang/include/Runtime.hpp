@@ -0,0 +1,206 @@
+#pragma once
+#include "Config.hpp"
+#include "Interpreter.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+
+// Every Expr/Stmt of a program in one fixed pre-order, so a translation unit written
+// by the Transpiler can name the nodes of the same source parsed again at run time.
+struct NodeTable
+{
+    std::vector<ExprPtr> exprs;
+    std::vector<StmtPtr> stmts;
+    std::unordered_map<const Expr *, u32> exprIds;
+    std::unordered_map<const Stmt *, u32> stmtIds;
+
+    void build(Program *program);
+
+private:
+    void add(const ExprPtr &expr);
+    void add(const StmtPtr &stmt);
+};
+
+// What code emitted by the Transpiler links against. The emitted code keeps locals,
+// control flow and number arithmetic in C++; values, environments, arrays, maps,
+// structs, classes and natives stay with the Compiler, so a script behaves the same
+// compiled or interpreted.
+class Runtime
+{
+public:
+    explicit Runtime(Interpreter *interpreter);
+    ~Runtime();
+
+    bool load(const std::string &source, int optimize = OPT_LEVEL_DEFAULT);
+    void bind(u32 function, u8 (*code)(Runtime &));
+    void run(u8 (*program)(Runtime &));
+
+    template <typename T>
+    T *expr(u32 index) const { return static_cast<T *>(nodes.exprs[index].get()); }
+
+    template <typename T>
+    T *stmt(u32 index) const { return static_cast<T *>(nodes.stmts[index].get()); }
+
+    // an environment for the lifetime of a C++ scope, like Compiler::execte_block
+    struct Frame
+    {
+        Compiler *c;
+        Environment *previous;
+        Environment env;
+
+        Frame(Runtime &rt, const Scope *scope) : c(rt.c), previous(rt.c->environment), env(rt.c->environment, scope)
+        {
+            c->environment = &env;
+        }
+        ~Frame() { c->environment = previous; }
+    };
+
+    struct Loop
+    {
+        Compiler *c;
+        explicit Loop(Runtime &rt) : c(rt.c) { c->loop_count++; }
+        ~Loop() { c->loop_count--; }
+    };
+
+    Value read(Variable *node)
+    {
+        if (node->slot >= 0)
+        {
+            Value *value = c->environment->slotAt(node->depth, node->slot);
+            if (value != nullptr)
+            {
+                return *value;
+            }
+        }
+        return c->visit_read_variable(node);
+    }
+
+    Value *counter(ForStmt *node) { return c->counter(node); }
+    bool count_test(ForStmt *node, const Value *counter, const Value &bound) { return c->count_test(node, counter, bound); }
+    void count_step(ForStmt *node, Value *counter) { c->count_step(node, counter); }
+
+    Value assign(Assign *node, Value value)
+    {
+        if (node->annotation != A_NONE)
+        {
+            c->check_type(node->annotation, value, node->name.lexeme, node->name.line);
+        }
+        c->assign_variable(node->name, node->depth, node->slot, value);
+        return value;
+    }
+
+    // operands TypeInference proved to be numbers
+    template <TokenType OP>
+    Value typed(BinaryExpr *node, double x, double y)
+    {
+        switch (OP)
+        {
+            case TokenType::PLUS:
+            case TokenType::PLUS_EQUAL:    return Value::number(x + y);
+            case TokenType::MINUS:
+            case TokenType::MINUS_EQUAL:   return Value::number(x - y);
+            case TokenType::STAR:
+            case TokenType::STAR_EQUAL:    return Value::number(x * y);
+            case TokenType::SLASH:
+            case TokenType::SLASH_EQUAL:   if (y != 0) return Value::number(x / y); break;
+            case TokenType::MOD:           return Value::number(std::fmod(x, y));
+            case TokenType::LESS:          return Value::boolean(x < y);
+            case TokenType::LESS_EQUAL:    return Value::boolean(x <= y);
+            case TokenType::GREATER:       return Value::boolean(x > y);
+            case TokenType::GREATER_EQUAL: return Value::boolean(x >= y);
+            case TokenType::EQUAL_EQUAL:   return Value::boolean(x == y);
+            case TokenType::BANG_EQUAL:    return Value::boolean(x != y);
+            default: break;
+        }
+        return c->binary(node, Value::number(x), Value::number(y));
+    }
+
+    template <TokenType OP>
+    Value binary(BinaryExpr *node, const Value &a, const Value &b)
+    {
+        if (a.isNumber() && b.isNumber())
+        {
+            double x = a.asNumber();
+            double y = b.asNumber();
+            switch (OP)
+            {
+                case TokenType::PLUS:
+                case TokenType::PLUS_EQUAL:    return Value::number(x + y);
+                case TokenType::MINUS:
+                case TokenType::MINUS_EQUAL:   return Value::number(x - y);
+                case TokenType::STAR:
+                case TokenType::STAR_EQUAL:    return Value::number(x * y);
+                case TokenType::SLASH:
+                case TokenType::SLASH_EQUAL:   if (y != 0) return Value::number(x / y); break;
+                case TokenType::MOD:           return Value::number(std::fmod(x, y));
+                case TokenType::LESS:          return Value::boolean(x < y);
+                case TokenType::LESS_EQUAL:    return Value::boolean(x <= y);
+                case TokenType::GREATER:       return Value::boolean(x > y);
+                case TokenType::GREATER_EQUAL: return Value::boolean(x >= y);
+                case TokenType::EQUAL_EQUAL:   return Value::boolean(x == y);
+                case TokenType::BANG_EQUAL:    return Value::boolean(x != y);
+                default: break;
+            }
+        }
+        return c->binary(node, a, b);
+    }
+
+    template <TokenType OP>
+    bool test(BinaryExpr *node, const Value &a, const Value &b)
+    {
+        if (a.isNumber() && b.isNumber())
+        {
+            double x = a.asNumber();
+            double y = b.asNumber();
+            switch (OP)
+            {
+                case TokenType::LESS:          return x < y;
+                case TokenType::LESS_EQUAL:    return x <= y;
+                case TokenType::GREATER:       return x > y;
+                case TokenType::GREATER_EQUAL: return x >= y;
+                case TokenType::EQUAL_EQUAL:   return x == y;
+                case TokenType::BANG_EQUAL:    return x != y;
+                default: break;
+            }
+        }
+        return c->binary(node, a, b).isTruthy();
+    }
+
+    Value negate(UnaryExpr *node, const Value &value)
+    {
+        if (value.isNumber())
+        {
+            return Value::number(-value.asNumber());
+        }
+        return c->unary(node, value);
+    }
+
+    Value unary(UnaryExpr *node, const Value &value) { return c->unary(node, value); }
+    Value step(UnaryExpr *node);
+    Value logical(LogicalExpr *node, const Value &left);
+    Value call(CallExpr *node, const Value &function, std::vector<Value> &args)
+    {
+        return c->call_function(function.as<Function>(), args, node->name, c->environment);
+    }
+    u8 tail_call(CallExpr *node, const Value &function, std::vector<Value> &args)
+    {
+        return c->tail_call(function.as<Function>(), args, node->name);
+    }
+    Value get_definition(GetDefinitionExpr *node, const Value &value);
+
+    void declare(Declaration *node, const Value &value);
+    void print(const Value &value) { value.print(); }
+    void ret(Value value) { c->returnValue = std::move(value); }
+    ArrayLiteral *iterate(const Value &array);
+    void define(FromStmt *node, Frame &init, const Value &value);
+
+    Value evaluate(u32 index) { return c->evaluate(nodes.exprs[index]); }
+    Value evaluate() { return c->evaluate(ExprPtr()); }
+    u8 execute(Stmt *node) { return c->execute(node); }
+
+private:
+    Interpreter *interpreter;
+    Compiler *c;
+    Parser parser;
+    std::shared_ptr<Program> program;
+    NodeTable nodes;
+};
@@ -4,6 +4,7 @@
 #include "Config.hpp"
 #include "Utils.hpp"
 #include "Token.hpp"
+#include "Expr.hpp"
 
 
 struct Visitor;
@@ -53,6 +54,14 @@ public:
 
 using StmtPtr =  std::shared_ptr<Stmt>;
 
+// Slot layout of one runtime Environment, filled in by the Resolver.
+struct Scope
+{
+    std::vector<std::string> names;
+};
+
+using ScopePtr = std::shared_ptr<Scope>;
+
 class BlockStmt : public Stmt
 {
 public:
@@ -63,6 +72,7 @@ public:
     u8 visit( Visitor &v) override;
 
     std::vector<StmtPtr> statements;
+    ScopePtr scope;
 };
 
 
@@ -151,6 +161,9 @@ public:
     ExprPtr condition;
     ExprPtr increment;
     StmtPtr body;
+    ScopePtr scope;     // initializer
+    ScopePtr loopScope; // one per iteration
+    bool counted{false};   // set by the Optimizer: `var i = a; i < n; i++` with n invariant and i left alone by the body
 
 };
 
@@ -163,6 +176,8 @@ public:
     StmtPtr variable;
     ExprPtr array;
     StmtPtr body;
+    ScopePtr scope;
+    ScopePtr loopScope;
 };
 
 
@@ -182,6 +197,9 @@ public:
     u8 visit( Visitor &v) override;
     std::vector<Token> names;
     ExprPtr initializer;
+    std::vector<int> slots; // empty when the names live in a by-name environment
+    u8 annotation{A_NONE};
+    bool constant{false};   // `const`, the Optimizer rejects any other binding of the names
 };
 
 class ReturnStmt : public Stmt
@@ -191,6 +209,7 @@ public:
     u8 visit( Visitor &v) override;
 
     ExprPtr value;
+    bool tail{false};   // set by the Resolver, value is a call that may reuse the caller's frame
 
 };
 
@@ -219,6 +238,10 @@ public:
     std::vector<std::string> args;
     Token name;
     StmtPtr body;
+    bool memo{false};   // @memo
+    u32 memoSize{0};    // most results kept, 0 keeps all
+    std::vector<u8> argTypes;   // empty when no parameter is annotated
+    u8 result{A_NONE};
 
 };
 
@@ -254,6 +277,7 @@ public:
     u8 visit( Visitor &v) override;
     std::vector<ExprPtr> values;
     Token name;
+    bool constant{false};   // `const name[]`, the array is frozen once built
 };
 
 class MapStmt : public Stmt
@@ -263,6 +287,7 @@ public:
     u8 visit( Visitor &v) override;
     std::unordered_map<ExprPtr, ExprPtr> values;
     Token name;
+    bool constant{false};   // `const name{}`, the map is frozen once built
 };
 
 
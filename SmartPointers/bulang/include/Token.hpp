@@ -14,6 +14,7 @@ enum class TokenType
 
     COLON,     // :
     DOLLAR,    // $
+    AT,        // @
     COMMA,     // ,
     DOT,       // .
     MINUS,     // -
@@ -48,6 +49,7 @@ enum class TokenType
     // Literals.
     IDENTIFIER,
     VAR,
+    CONST,
     STRING,
     NUMBER,
 
@@ -108,6 +110,7 @@ inline std::string tknString(TokenType type)
         case TokenType::RIGHT_BRACKET: return "RIGHT_BRACKET";
         case TokenType::COLON:         return "COLON";
         case TokenType::DOLLAR:        return "DOLLAR";
+        case TokenType::AT:            return "AT";
         case TokenType::COMMA:         return "COMMA";
         case TokenType::DOT:           return "DOT";
         case TokenType::MINUS:         return "MINUS";
@@ -133,6 +136,7 @@ inline std::string tknString(TokenType type)
         case TokenType::SLASH_EQUAL:   return "SLASH EQUAL /=";
         case TokenType::IDENTIFIER:    return "IDENTIFIER";
         case TokenType::VAR:    return "VAR";
+        case TokenType::CONST:  return "CONST";
         case TokenType::OR:    return "||";
         case TokenType::AND:    return "&&";
         
@@ -0,0 +1,43 @@
+#pragma once
+#include "Config.hpp"
+#include "Runtime.hpp"
+
+// Writes a script out as a C++ translation unit for the Runtime. Control flow, locals,
+// number arithmetic and calls to script functions become plain C++; anything that
+// touches objects is handed to the Runtime by node index (see NodeTable), so the
+// output needs the script source again at run time and embeds it.
+class Transpiler
+{
+public:
+    bool translate(const std::string &source, const std::string &path, std::string &output, int optimize = OPT_LEVEL_DEFAULT);
+
+private:
+    struct Loop
+    {
+        bool isFor;
+        int label;
+    };
+
+    NodeTable nodes;
+    std::map<u32, std::string> usedExprs;
+    std::map<u32, std::string> usedStmts;
+    std::vector<FunctionStmt *> pending;
+    std::vector<Loop> loops;
+    std::string code;
+    int depth{0};
+    int labels{0};
+
+    std::string expr_ref(const ExprPtr &node, const char *type);
+    std::string stmt_ref(Stmt *node, const char *type);
+
+    std::string expression(const ExprPtr &node);
+    std::string binary(BinaryExpr *node, const ExprPtr &ref);
+    std::string test(const ExprPtr &node);
+
+    void line(const std::string &text);
+    void statement(const StmtPtr &node);
+    void block(const std::vector<StmtPtr> &statements);
+    void fallback(Stmt *node);
+    void loop_body(const StmtPtr &body);
+    void function(FunctionStmt *node);
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include "Config.hpp"
+#include "Interpreter.hpp"
+#include <unordered_set>
+
+// Flow-sensitive pass run by the Optimizer once folding is done. It follows every
+// variable declared in the program through assignments, branches and loops, and marks
+// operators whose operands are always numbers (or always strings) with Q_TYPED_*, so the
+// tree-walker, the Binder and bpc output run them with no type checks.
+//
+// What it will not trust:
+//  - a name a function assigns without declaring it, dynamic scoping can reach any
+//    variable of that name in a caller
+//  - a name a function reads without declaring it
+//  - parameters of a function that is used as a value
+//  - anything that comes back from a method, a native or a host global
+// Annotated declarations, parameters and results are taken as written, the engines check
+// them where the value comes in.
+// Parameters and results of a top-level def whose name is bound nowhere else are
+// inferred from the calls in the program, which is taken as a closed world: such a
+// function is only called from the program it is declared in.
+class TypeInference
+{
+public:
+    void run(Program *program);
+
+private:
+    enum Type : u8
+    {
+        T_NONE,     // no value reaches here (yet)
+        T_NUMBER,
+        T_STRING,
+        T_BOOL,
+        T_ANY,
+    };
+
+    using Scope = std::unordered_map<std::string, u8>;
+    using Locals = std::vector<std::unordered_set<std::string>>;
+
+    struct State
+    {
+        std::vector<Scope> scopes;
+        bool dead{false};   // after return/break/continue
+    };
+
+    struct FunctionInfo
+    {
+        std::vector<u8> args;
+        u8 result{T_NONE};
+        u8 annotation{A_NONE};   // declared result, every return is checked against it
+        bool open{false};   // called from places we cannot see
+    };
+
+    struct Loop
+    {
+        State breaks;
+        State continues;
+    };
+
+    std::unordered_map<std::string, FunctionInfo> functions;
+    std::unordered_map<std::string, int> declared;
+    std::unordered_set<std::string> dynamic;
+    State state;
+    std::vector<Loop> loops;
+    FunctionInfo *current{nullptr};
+    bool changed{false};
+
+    static u8 annotated(u8 annotation, u8 type);
+    static u8 join(u8 a, u8 b);
+    static void join(State &into, const State &from);
+    static bool same(const State &a, const State &b);
+
+    void collect(const StmtPtr &stmt, Locals *locals);
+    void collect(const ExprPtr &expr, Locals *locals);
+    void collect_function(FunctionStmt *node);
+    void name(const std::string &name, Locals *locals);
+
+    void declare(const std::string &name, u8 type);
+    void assign(const std::string &name, u8 type);
+    u8 lookup(const std::string &name);
+    void raise(u8 &slot, u8 type);
+
+    void pass(Program *program);
+    void statements(const std::vector<StmtPtr> &list);
+    void statement(const StmtPtr &stmt);
+    void block(const std::vector<StmtPtr> &list);
+    void function(FunctionStmt *node, FunctionInfo *info);
+    void detached(const std::vector<StmtPtr> &list);
+    void loop(const ExprPtr &condition, const StmtPtr &body, const ExprPtr &increment, bool testFirst);
+
+    u8 expression(const ExprPtr &expr);
+    u8 binary(BinaryExpr *node);
+    u8 unary(UnaryExpr *node);
+    u8 call(CallExpr *node);
+};
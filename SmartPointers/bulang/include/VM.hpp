@@ -0,0 +1,186 @@
+#pragma once
+#include "Config.hpp"
+#include "Interpreter.hpp"
+#include "Chunk.hpp"
+
+const u32 VM_FRAMES_MAX = 256;
+const u32 VM_LOCALS_MAX = 256;
+const u32 VM_STACK_MAX = VM_FRAMES_MAX * VM_LOCALS_MAX;
+
+// Lowers a parsed Program into bytecode. Every function body becomes its own Chunk;
+// the top level is compiled as an implicit zero-arity "script" function.
+struct Emitter : public Visitor
+{
+    Emitter();
+    ~Emitter();
+
+    Value compile(Program *program);
+
+    std::vector<std::shared_ptr<MemoTable>> *memos{nullptr};   // @memo tables, for Interpreter::memoStats
+
+    Value visit(ExprPtr node) override;
+    Value visit_empty_expression(EmptyExpr *node) override;
+    Value visit_binary(BinaryExpr *node) override;
+    Value visit_unary(UnaryExpr *node) override;
+    Value visit_logical(LogicalExpr *node) override;
+    Value visit_grouping(GroupingExpr *node) override;
+    Value visit_literal(Literal *node) override;
+    Value visit_number_literal(NumberLiteral *node) override;
+    Value visit_string_literal(StringLiteral *node) override;
+    Value visit_boolean_literal(BooleanLiteral *node) override;
+    Value visit_now_expression(NowExpr *node) override;
+    Value visit_read_variable(Variable *node) override;
+    Value visit_assign(Assign *node) override;
+    Value visit_call(CallExpr *node) override;
+    Value visit_get(GetExpr *node) override;
+    Value visit_get_definition(GetDefinitionExpr *node) override;
+    Value visit_set(SetExpr *node) override;
+    Value visit_self(SelfExpr *node) override;
+    Value visit_super(SuperExpr *node) override;
+
+    u8 execute(Stmt *stmt) override;
+    u8 visit_block_smt(BlockStmt *node) override;
+    u8 visit_expression_smt(ExpressionStmt *node) override;
+    u8 visit_print_smt(PrintStmt *node) override;
+    u8 visit_declaration(Declaration *node) override;
+    u8 visit_if(IFStmt *node) override;
+    u8 visit_while(WhileStmt *node) override;
+    u8 visit_do(DoStmt *node) override;
+    u8 visit_program(Program *node) override;
+    u8 visit_function(FunctionStmt *node) override;
+    u8 visit_for(ForStmt *node) override;
+    u8 visit_from(FromStmt *node) override;
+    u8 visit_return(ReturnStmt *node) override;
+    u8 visit_break(BreakStmt *node) override;
+    u8 visit_switch(SwitchStmt *node) override;
+    u8 visit_continue(ContinueStmt *node) override;
+    u8 visit_struct(StructStmt *node) override;
+    u8 visit_class(ClassStmt *node) override;
+    u8 visit_array(ArrayStmt *node) override;
+    u8 visit_map(MapStmt *node) override;
+
+private:
+    struct Local
+    {
+        std::string name;
+        int depth;
+    };
+
+    struct Loop
+    {
+        int depth;
+        int continueTarget; // -1 until known, continues are then patched forward
+        std::vector<u32> breaks;
+        std::vector<u32> continues;
+    };
+
+    struct State
+    {
+        Value function;
+        Chunk *chunk;
+        std::vector<Local> locals;
+        std::vector<Loop> loops;
+        std::unordered_map<std::string, u16> names;
+        int scopeDepth;
+        bool isMethod;
+        State *enclosing;
+    };
+
+    State *current;
+    int line;
+    bool tailCall{false};   // the call being emitted is the value of a return
+
+    Chunk *chunk() { return current->chunk; }
+
+    void begin_function(State &state, const std::string &name, bool isMethod);
+    Value end_function();
+    Value compile_function(FunctionStmt *node, bool isMethod);
+
+    void begin_scope();
+    void end_scope();
+    void pop_locals(int depth);
+
+    void emit(u8 byte);
+    void emit(u8 op, u8 operand);
+    void emit_short(u8 op, u16 operand);
+    void emit_constant(Value value);
+    u32 emit_jump(u8 op);
+    void patch_jump(u32 offset);
+    void emit_loop(u32 start);
+
+    u16 make_constant(Value value);
+    u16 name_constant(const std::string &name);
+
+    int resolve_local(const std::string &name);
+    void add_local(const std::string &name);
+    void define_variable(const std::string &name);
+    void emit_get_variable(const Token &name);
+    void emit_set_variable(const Token &name);
+
+    void emit_field_values(Stmt *stmt, u8 op);
+    void emit_check(u8 annotation, const std::string &name);
+
+    void error(const std::string &message);
+};
+
+struct CallFrame
+{
+    Function *function;
+    const u8 *ip;
+    Value *slots;
+    bool constructor;
+    MemoTable *memo;    // stores the result on return, under key
+    ClassLiteral *holder;   // a method: the class that declares it, super calls go to its base
+    std::string key;
+};
+
+// Stack based bytecode interpreter. Uses direct-threaded dispatch (computed goto)
+// when the compiler supports it and a plain switch otherwise.
+class VM
+{
+public:
+    VM(Interpreter *interpreter);
+    ~VM();
+
+    u8 execute(Program *program);
+
+private:
+    friend class Interpreter;
+
+    Interpreter *interpreter;
+    Environment *globals;
+
+    std::vector<Value> stack;
+    Value *sp;
+
+    CallFrame frames[VM_FRAMES_MAX];
+    u32 frameCount;
+
+    void reset();
+    void run(u32 exitFrame);
+
+    void push(Value value) { *sp++ = std::move(value); }
+    Value pop()
+    {
+        --sp;
+        return std::move(*sp);
+    }
+    void drop(u32 count);
+
+    bool call_value(u8 argc);
+    void call_function(Function *function, u8 argc, bool constructor);
+    bool call_memo(Function *function, u8 argc);
+    void invoke(const std::string &name, u8 argc);
+    void invoke_super(const std::string &name, u8 argc);
+    Value call_sync(const Value &callee, const std::vector<Value> &args);
+
+    Value construct_struct(StructLiteral *original, u8 argc);
+    void prepare_class(ClassLiteral *cl);
+    bool construct_class(ClassLiteral *main, u8 argc);
+
+    Value array_method(ArrayLiteral *array, const std::string &name, u8 argc);
+    Value map_method(MapLiteral *map, const std::string &name, u8 argc);
+    Value string_method(const std::string &string, const std::string &name, u8 argc);
+
+    void runtime_error(const std::string &message);
+};
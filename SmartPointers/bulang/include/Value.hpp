@@ -0,0 +1,194 @@
+#pragma once
+#include <string>
+#include <cstring>
+#include "Config.hpp"
+
+// Runtime values are NaN-boxed into 64 bits: a double is stored as itself, every other
+// value lives in the payload of a quiet NaN. Heap objects are intrusively reference
+// counted, so numbers, booleans and nil never allocate.
+
+enum ObjectType : u8
+{
+    O_STRING,
+    O_FUNCTION,
+    O_NATIVE,
+    O_CLASS,
+    O_STRUCT,
+    O_ARRAY,
+    O_MAP,
+};
+
+enum class ValueType : u8
+{
+    EMPTY,
+    NIL,
+    BOOLEAN,
+    NUMBER,
+    STRING,
+    FUNCTION,
+    NATIVE,
+    CLASS,
+    STRUCT,
+    ARRAY,
+    MAP,
+};
+
+class Value;
+
+struct Object
+{
+    ObjectType type;
+    u32 refs{0};
+
+    explicit Object(ObjectType type) : type(type) {}
+    virtual ~Object() {}
+
+    virtual std::string toString();
+    virtual void print();
+    virtual Value clone();
+};
+
+class Value
+{
+public:
+    Value() : bits(TAG_EMPTY) {}
+    explicit Value(Object *object) : bits(SIGN_BIT | QNAN | (u64)(uintptr_t)object) { object->refs++; }
+
+    Value(const Value &other) : bits(other.bits) { retain(); }
+    Value(Value &&other) noexcept : bits(other.bits) { other.bits = TAG_EMPTY; }
+    ~Value() { release(); }
+
+    Value &operator=(const Value &other)
+    {
+        other.retain();
+        release();
+        bits = other.bits;
+        return *this;
+    }
+    Value &operator=(Value &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            bits = other.bits;
+            other.bits = TAG_EMPTY;
+        }
+        return *this;
+    }
+
+    static Value number(double value)
+    {
+        Value v;
+        if (value != value)
+        {
+            v.bits = CANONICAL_NAN;
+        }
+        else
+        {
+            memcpy(&v.bits, &value, sizeof(double));
+        }
+        return v;
+    }
+    static Value boolean(bool value) { return raw(value ? TAG_TRUE : TAG_FALSE); }
+    static Value nil() { return raw(TAG_NIL); }
+    static Value string(const std::string &value);
+
+    bool isNumber() const { return (bits & QNAN) != QNAN; }
+    bool isEmpty() const { return bits == TAG_EMPTY; }
+    bool isNil() const { return bits == TAG_NIL; }
+    bool isBool() const { return (bits | 1) == TAG_TRUE; }
+    bool isObject() const { return (bits & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT); }
+    bool isObject(ObjectType type) const { return isObject() && asObject()->type == type; }
+    bool isString() const { return isObject(O_STRING); }
+
+    double asNumber() const
+    {
+        double value;
+        memcpy(&value, &bits, sizeof(double));
+        return value;
+    }
+    bool asBool() const { return bits == TAG_TRUE; }
+    Object *asObject() const { return (Object *)(uintptr_t)(bits & ~(SIGN_BIT | QNAN)); }
+    template <typename T>
+    T *as() const { return static_cast<T *>(asObject()); }
+    const std::string &asString() const;
+
+    ValueType type() const;
+    const char *typeName() const;
+
+    // nil stays truthy, only false and 0 are false
+    bool isTruthy() const
+    {
+        if (isNumber()) return asNumber() != 0;
+        if (isBool()) return asBool();
+        return true;
+    }
+
+    bool equals(const Value &other) const;
+    size_t hash() const;
+    std::string toString() const;
+    void print() const;
+    Value clone() const;
+
+private:
+    static const u64 SIGN_BIT = 0x8000000000000000ull;
+    static const u64 QNAN = 0x7ffc000000000000ull;
+    static const u64 CANONICAL_NAN = 0x7ff8000000000000ull;
+    static const u64 TAG_EMPTY = QNAN | 0;
+    static const u64 TAG_NIL = QNAN | 1;
+    static const u64 TAG_FALSE = QNAN | 2;
+    static const u64 TAG_TRUE = QNAN | 3;
+
+    u64 bits;
+
+    static Value raw(u64 bits)
+    {
+        Value v;
+        v.bits = bits;
+        return v;
+    }
+
+    void retain() const
+    {
+        if (isObject()) asObject()->refs++;
+    }
+    void release()
+    {
+        if (isObject())
+        {
+            Object *object = asObject();
+            if (--object->refs == 0) delete object;
+        }
+    }
+};
+
+struct StringObject : public Object
+{
+    std::string value;
+
+    StringObject() : Object(O_STRING) {}
+    explicit StringObject(std::string value) : Object(O_STRING), value(std::move(value)) {}
+
+    std::string toString() override { return value; }
+    void print() override;
+};
+
+inline Value Value::string(const std::string &value)
+{
+    return Value(new StringObject(value));
+}
+
+inline const std::string &Value::asString() const
+{
+    return as<StringObject>()->value;
+}
+
+struct ValueHash
+{
+    size_t operator()(const Value &value) const { return value.hash(); }
+};
+
+struct ValueEqual
+{
+    bool operator()(const Value &a, const Value &b) const { return a.equals(b); }
+};
@@ -0,0 +1,845 @@
+#include "pch.h"
+#include "Binder.hpp"
+#include "Utils.hpp"
+
+Binder::Binder(Compiler *compiler)
+{
+    c = compiler;
+}
+
+void Binder::execute(Program *program)
+{
+    StmtCode code = compile_list(program->statements);
+
+    auto previousEnvironment = c->environment;
+    code();
+    c->returnValue = Value();
+    c->environment = previousEnvironment;
+    c->clear();
+}
+
+StmtCode Binder::compile_body(BlockStmt *body)
+{
+    return compile_list(body->statements);
+}
+
+//***************************************************************************************** */
+
+ExprCode Binder::compile(const ExprPtr &node)
+{
+    Compiler *c = this->c;
+    if (!node)
+    {
+        return [c]() { return c->evaluate(ExprPtr()); };
+    }
+
+    switch (node->type)
+    {
+        case ExprType::L_NUMBER:
+        {
+            Value value = Value::number(static_cast<NumberLiteral *>(node.get())->value);
+            return [value]() { return value; };
+        }
+        case ExprType::L_BOOLEAN:
+        {
+            Value value = Value::boolean(static_cast<BooleanLiteral *>(node.get())->value);
+            return [value]() { return value; };
+        }
+        case ExprType::L_STRING:
+        {
+            Value value = Value::string(static_cast<StringLiteral *>(node.get())->value);
+            return [value]() { return value; };
+        }
+        case ExprType::GROUPING:
+            return compile(static_cast<GroupingExpr *>(node.get())->expr);
+        case ExprType::VARIABLE:
+            return compile_variable(static_cast<Variable *>(node.get()));
+        case ExprType::ASSIGN:
+        {
+            Assign *assign = static_cast<Assign *>(node.get());
+            ExprCode value = compile(assign->value);
+            if (assign->annotation != A_NONE)
+            {
+                return [c, assign, value]()
+                {
+                    Value result = value();
+                    c->check_type(assign->annotation, result, assign->name.lexeme, assign->name.line);
+                    c->assign_variable(assign->name, assign->depth, assign->slot, result);
+                    return result;
+                };
+            }
+            return [c, assign, value]()
+            {
+                Value result = value();
+                c->assign_variable(assign->name, assign->depth, assign->slot, result);
+                return result;
+            };
+        }
+        case ExprType::BINARY:
+            return compile_binary(static_cast<BinaryExpr *>(node.get()));
+        case ExprType::UNARY:
+            return compile_unary(static_cast<UnaryExpr *>(node.get()));
+        case ExprType::LOGICAL:
+            return compile_logical(static_cast<LogicalExpr *>(node.get()));
+        case ExprType::CALL:
+            return compile_call(static_cast<CallExpr *>(node.get()));
+        case ExprType::GET_DEF:
+            return compile_get_definition(static_cast<GetDefinitionExpr *>(node.get()));
+        default:
+            break;
+    }
+
+    ExprPtr expr = node;
+    return [c, expr]() { return c->evaluate(expr); };
+}
+
+ExprCode Binder::compile_variable(Variable *node)
+{
+    Compiler *c = this->c;
+    if (node->slot < 0)
+    {
+        return [c, node]() { return c->visit_read_variable(node); };
+    }
+
+    u32 depth = node->depth;
+    u32 slot = node->slot;
+    return [c, node, depth, slot]()
+    {
+        Value *value = c->environment->slotAt(depth, slot);
+        if (value != nullptr)
+        {
+            return *value;
+        }
+        return c->visit_read_variable(node);
+    };
+}
+
+#define BINDER_NUMBER_OP(token, expression)                                  \
+    case TokenType::token:                                                   \
+        return [c, node, left, right]()                                      \
+        {                                                                    \
+            Value a = left();                                                \
+            Value b = right();                                               \
+            if (a.isNumber() && b.isNumber())                                \
+            {                                                                \
+                double x = a.asNumber();                                     \
+                double y = b.asNumber();                                     \
+                return expression;                                           \
+            }                                                                \
+            return c->binary(node, a, b);                                    \
+        };
+
+// operands TypeInference proved to be numbers, nothing left to check
+#define BINDER_TYPED_OP(token, expression)                                   \
+    case TokenType::token:                                                   \
+        return [c, node, left, right]()                                      \
+        {                                                                    \
+            double x = left().asNumber();                                    \
+            double y = right().asNumber();                                   \
+            return expression;                                               \
+        };
+
+ExprCode Binder::compile_binary(BinaryExpr *node)
+{
+    Compiler *c = this->c;
+    ExprCode left = compile(node->left);
+    ExprCode right = compile(node->right);
+
+    if (node->quick == Q_TYPED_NUMBER)
+    {
+        switch (node->op.type)
+        {
+            BINDER_TYPED_OP(PLUS, Value::number(x + y))
+            BINDER_TYPED_OP(PLUS_EQUAL, Value::number(x + y))
+            BINDER_TYPED_OP(MINUS, Value::number(x - y))
+            BINDER_TYPED_OP(MINUS_EQUAL, Value::number(x - y))
+            BINDER_TYPED_OP(STAR, Value::number(x * y))
+            BINDER_TYPED_OP(STAR_EQUAL, Value::number(x * y))
+            BINDER_TYPED_OP(MOD, Value::number(std::fmod(x, y)))
+            BINDER_TYPED_OP(LESS, Value::boolean(x < y))
+            BINDER_TYPED_OP(LESS_EQUAL, Value::boolean(x <= y))
+            BINDER_TYPED_OP(GREATER, Value::boolean(x > y))
+            BINDER_TYPED_OP(GREATER_EQUAL, Value::boolean(x >= y))
+            BINDER_TYPED_OP(EQUAL_EQUAL, Value::boolean(x == y))
+            BINDER_TYPED_OP(BANG_EQUAL, Value::boolean(x != y))
+            BINDER_TYPED_OP(SLASH, y != 0 ? Value::number(x / y) : c->binary(node, Value::number(x), Value::number(y)))
+            BINDER_TYPED_OP(SLASH_EQUAL, y != 0 ? Value::number(x / y) : c->binary(node, Value::number(x), Value::number(y)))
+            default:
+                break;
+        }
+    }
+    else if (node->quick == Q_TYPED_STRING)
+    {
+        TokenType op = node->op.type;
+        return [op, left, right]()
+        {
+            Value a = left();
+            Value b = right();
+            if (op == TokenType::EQUAL_EQUAL)
+                return Value::boolean(a.asString() == b.asString());
+            if (op == TokenType::BANG_EQUAL)
+                return Value::boolean(a.asString() != b.asString());
+            return Value::string(a.asString() + b.asString());
+        };
+    }
+
+    switch (node->op.type)
+    {
+        BINDER_NUMBER_OP(PLUS, Value::number(x + y))
+        BINDER_NUMBER_OP(PLUS_EQUAL, Value::number(x + y))
+        BINDER_NUMBER_OP(MINUS, Value::number(x - y))
+        BINDER_NUMBER_OP(MINUS_EQUAL, Value::number(x - y))
+        BINDER_NUMBER_OP(STAR, Value::number(x * y))
+        BINDER_NUMBER_OP(STAR_EQUAL, Value::number(x * y))
+        BINDER_NUMBER_OP(MOD, Value::number(std::fmod(x, y)))
+        BINDER_NUMBER_OP(LESS, Value::boolean(x < y))
+        BINDER_NUMBER_OP(LESS_EQUAL, Value::boolean(x <= y))
+        BINDER_NUMBER_OP(GREATER, Value::boolean(x > y))
+        BINDER_NUMBER_OP(GREATER_EQUAL, Value::boolean(x >= y))
+        BINDER_NUMBER_OP(EQUAL_EQUAL, Value::boolean(x == y))
+        BINDER_NUMBER_OP(BANG_EQUAL, Value::boolean(x != y))
+        // division by zero is reported by the generic path
+        BINDER_NUMBER_OP(SLASH, y != 0 ? Value::number(x / y) : c->binary(node, a, b))
+        BINDER_NUMBER_OP(SLASH_EQUAL, y != 0 ? Value::number(x / y) : c->binary(node, a, b))
+        default:
+            break;
+    }
+
+    return [c, node, left, right]()
+    {
+        Value a = left();
+        Value b = right();
+        return c->binary(node, a, b);
+    };
+}
+
+#undef BINDER_NUMBER_OP
+#undef BINDER_TYPED_OP
+
+TestCode Binder::compile_test(const ExprPtr &condition)
+{
+    if (condition && condition->type == ExprType::BINARY)
+    {
+        Compiler *c = this->c;
+        BinaryExpr *node = static_cast<BinaryExpr *>(condition.get());
+        ExprCode left = compile(node->left);
+        ExprCode right = compile(node->right);
+        bool typed = node->quick == Q_TYPED_NUMBER;
+
+#define BINDER_COMPARE(token, op)                                            \
+    case TokenType::token:                                                   \
+        if (typed)                                                           \
+        {                                                                    \
+            return [left, right]()                                           \
+            {                                                                \
+                double a = left().asNumber();                                \
+                return a op right().asNumber();                              \
+            };                                                               \
+        }                                                                    \
+        return [c, node, left, right]()                                      \
+        {                                                                    \
+            Value a = left();                                                \
+            Value b = right();                                               \
+            if (a.isNumber() && b.isNumber())                                \
+            {                                                                \
+                return a.asNumber() op b.asNumber();                         \
+            }                                                                \
+            return c->binary(node, a, b).isTruthy();                         \
+        };
+
+        switch (node->op.type)
+        {
+            BINDER_COMPARE(LESS, <)
+            BINDER_COMPARE(LESS_EQUAL, <=)
+            BINDER_COMPARE(GREATER, >)
+            BINDER_COMPARE(GREATER_EQUAL, >=)
+            BINDER_COMPARE(EQUAL_EQUAL, ==)
+            BINDER_COMPARE(BANG_EQUAL, !=)
+            default:
+                break;
+        }
+
+#undef BINDER_COMPARE
+    }
+
+    ExprCode value = compile(condition);
+    return [value]() { return value().isTruthy(); };
+}
+
+ExprCode Binder::compile_unary(UnaryExpr *node)
+{
+    Compiler *c = this->c;
+    bool step = node->op.type == TokenType::INC || node->op.type == TokenType::DEC;
+    if (step)
+    {
+        if (node->right->type != ExprType::VARIABLE || static_cast<Variable *>(node->right.get())->slot < 0)
+        {
+            return [c, node]() { return c->visit_unary(node); };
+        }
+
+        Variable *var = static_cast<Variable *>(node->right.get());
+        u32 depth = var->depth;
+        u32 slot = var->slot;
+        double delta = node->op.type == TokenType::INC ? 1 : -1;
+        bool prefix = node->isPrefix;
+        return [c, node, depth, slot, delta, prefix]()
+        {
+            Value *value = c->environment->slotAt(depth, slot);
+            if (value != nullptr && value->isNumber())
+            {
+                double old = value->asNumber();
+                *value = Value::number(old + delta);
+                return Value::number(prefix ? old + delta : old);
+            }
+            return c->visit_unary(node);
+        };
+    }
+
+    ExprCode right = compile(node->right);
+    if (node->op.type == TokenType::MINUS && node->quick == Q_TYPED_NUMBER)
+    {
+        return [right]() { return Value::number(-right().asNumber()); };
+    }
+    if (node->op.type == TokenType::MINUS)
+    {
+        return [c, node, right]()
+        {
+            Value value = right();
+            if (value.isNumber())
+            {
+                return Value::number(-value.asNumber());
+            }
+            return c->unary(node, value);
+        };
+    }
+    return [c, node, right]()
+    {
+        Value value = right();
+        return c->unary(node, value);
+    };
+}
+
+ExprCode Binder::compile_logical(LogicalExpr *node)
+{
+    ExprCode left = compile(node->left);
+    ExprCode right = compile(node->right);
+    TokenType op = node->op.type;
+
+    return [node, left, right, op]()
+    {
+        Value value = left();
+        if (value.isEmpty())
+        {
+            throw FatalException("Unknown expression type for Logical avaliation: "+ node->toString());
+        }
+        if (value.isNil())
+        {
+            throw FatalException("Invalid logical expression. '"+ node->op.lexeme +"' Literals are not allowed at line "+ std::to_string(node->op.line));
+        }
+
+        if (op == TokenType::OR)
+        {
+            if (value.isTruthy())
+            {
+                return value;
+            }
+        }
+        else if (op == TokenType::AND)
+        {
+            if (!value.isTruthy())
+            {
+                return value;
+            }
+        }
+        else if (op == TokenType::XOR)
+        {
+            return Value::boolean(value.isTruthy() != right().isTruthy());
+        }
+        return right();
+    };
+}
+
+ExprCode Binder::compile_call(CallExpr *node)
+{
+    Compiler *c = this->c;
+    if (node->callee->type != ExprType::VARIABLE)
+    {
+        return [c, node]() { return c->visit_call(node); };
+    }
+
+    ExprCode callee = compile(node->callee);
+    std::vector<ExprCode> args;
+    args.reserve(node->args.size());
+    for (auto &arg : node->args)
+    {
+        args.push_back(compile(arg));
+    }
+
+    return [c, node, callee, args]()
+    {
+        Object *target = c->cached_callee(node);
+        Value function;
+        if (target == nullptr || target->type != O_FUNCTION)
+        {
+            function = callee();
+            if (!function.isObject(O_FUNCTION))
+            {
+                // natives, structs and classes, reading the callee again has no side effect
+                return c->visit_call(node);
+            }
+            c->cache_callee(node, function);
+            target = function.asObject();
+        }
+        std::vector<Value> values;
+        values.reserve(args.size());
+        for (auto &arg : args)
+        {
+            values.push_back(arg());
+        }
+        if (node->quick == Q_CACHED)
+        {
+            return c->run_function(static_cast<Function *>(target), values, node->name, c->environment);
+        }
+        return c->call_function(static_cast<Function *>(target), values, node->name, c->environment);
+    };
+}
+
+StmtCode Binder::compile_tail_call(CallExpr *node, const ExprCode &call)
+{
+    Compiler *c = this->c;
+    ExprCode callee = compile(node->callee);
+    std::vector<ExprCode> args;
+    args.reserve(node->args.size());
+    for (auto &arg : node->args)
+    {
+        args.push_back(compile(arg));
+    }
+
+    return [c, node, call, callee, args]()
+    {
+        Value function = callee();
+        if (!function.isObject(O_FUNCTION))
+        {
+            c->returnValue = call();
+            return (u8)C_RETURN;
+        }
+        std::vector<Value> values;
+        values.reserve(args.size());
+        for (auto &arg : args)
+        {
+            values.push_back(arg());
+        }
+        return c->tail_call(function.as<Function>(), values, node->name);
+    };
+}
+
+ExprCode Binder::compile_get_definition(GetDefinitionExpr *node)
+{
+    Compiler *c = this->c;
+    ExprCode variable = compile(node->variable);
+
+    return [c, node, variable]()
+    {
+        if (node->super && c->holder != nullptr && !c->holder->base.isEmpty())
+        {
+            return c->ProcessClass(c->holder->base, node);
+        }
+        Value value = variable();
+        if (!value.isObject())
+        {
+            return value;
+        }
+        switch (value.asObject()->type)
+        {
+            case O_ARRAY:  return c->ProcessArray(value, node);
+            case O_MAP:    return c->ProcessMap(value, node);
+            case O_CLASS:  return c->ProcessClass(value, node);
+            case O_STRING: return c->ProcessString(value, node);
+            default:       return value;
+        }
+    };
+}
+
+//***************************************************************************************** */
+
+StmtCode Binder::compile(const StmtPtr &stmt)
+{
+    Compiler *c = this->c;
+    if (!stmt)
+    {
+        return []() { return (u8)C_NORMAL; };
+    }
+
+    switch (stmt->type)
+    {
+        case StmtType::EXPRESSION:
+        {
+            ExpressionStmt *node = static_cast<ExpressionStmt *>(stmt.get());
+            if (node->expression == nullptr)
+            {
+                break;
+            }
+            ExprCode expression = compile(node->expression);
+            return [expression]()
+            {
+                expression();
+                return (u8)C_NORMAL;
+            };
+        }
+        case StmtType::PRINT:
+        {
+            ExprCode expression = compile(static_cast<PrintStmt *>(stmt.get())->expression);
+            return [expression]()
+            {
+                expression().print();
+                return (u8)C_NORMAL;
+            };
+        }
+        case StmtType::RETURN:
+        {
+            ReturnStmt *node = static_cast<ReturnStmt *>(stmt.get());
+            ExprCode value = compile(node->value);
+            if (node->tail)
+            {
+                return compile_tail_call(static_cast<CallExpr *>(node->value.get()), value);
+            }
+            return [c, value]()
+            {
+                c->returnValue = value();
+                return (u8)C_RETURN;
+            };
+        }
+        case StmtType::BLOCK:       return compile_block(static_cast<BlockStmt *>(stmt.get()));
+        case StmtType::DECLARATION: return compile_declaration(static_cast<Declaration *>(stmt.get()));
+        case StmtType::IF:          return compile_if(static_cast<IFStmt *>(stmt.get()));
+        case StmtType::WHILE:       return compile_while(static_cast<WhileStmt *>(stmt.get()));
+        case StmtType::DO:          return compile_do(static_cast<DoStmt *>(stmt.get()));
+        case StmtType::FOR:         return compile_for(static_cast<ForStmt *>(stmt.get()));
+        case StmtType::FROM:        return compile_from(static_cast<FromStmt *>(stmt.get()));
+        default:
+            break;
+    }
+
+    // functions, classes, structs, switch, break/continue: the tree-walker already does the job
+    StmtPtr node = stmt;
+    return [c, node]() { return c->execute(node.get()); };
+}
+
+StmtCode Binder::compile_list(const std::vector<StmtPtr> &statements)
+{
+    std::vector<StmtCode> codes;
+    codes.reserve(statements.size());
+    for (auto &s : statements)
+    {
+        codes.push_back(compile(s));
+    }
+    return [codes]()
+    {
+        for (auto &code : codes)
+        {
+            u8 result = code();
+            if (result != C_NORMAL)
+            {
+                return result;
+            }
+        }
+        return (u8)C_NORMAL;
+    };
+}
+
+StmtCode Binder::compile_block(BlockStmt *node)
+{
+    Compiler *c = this->c;
+    StmtCode body = compile_list(node->statements);
+    const Scope *scope = node->scope.get();
+    return [c, body, scope]()
+    {
+        Environment env(c->environment, scope);
+        return c->execte_code(body, &env);
+    };
+}
+
+StmtCode Binder::compile_declaration(Declaration *node)
+{
+    Compiler *c = this->c;
+    ExprCode initializer = compile(node->initializer);
+    if (node->annotation != A_NONE)
+    {
+        ExprCode value = initializer;
+        initializer = [c, node, value]()
+        {
+            Value result = value();
+            c->check_type(node->annotation, result, node->names[0].lexeme, node->names[0].line);
+            return result;
+        };
+    }
+
+    if (!node->slots.empty())
+    {
+        return [c, node, initializer]()
+        {
+            Value value = initializer();
+            for (u32 i = 0; i < node->names.size(); i++)
+            {
+                if (node->slots[i] >= 0)
+                    c->environment->defineAt(node->slots[i], value);
+                else
+                    c->environment->define(node->names[i].lexeme, value);
+            }
+            return (u8)C_NORMAL;
+        };
+    }
+
+    return [c, node, initializer]()
+    {
+        Value value = initializer();
+        if (node->names.size() == 1)
+        {
+            c->environment->define(node->names[0].lexeme, value);
+            return (u8)C_NORMAL;
+        }
+        for (u32 i = 0; i < node->names.size(); i++)
+        {
+            const Token &name = node->names[i];
+            if (!c->environment->define(name.lexeme, value))
+            {
+                WARNING("Variable already defined: %s at line %d", name.lexeme.c_str(), name.line);
+            }
+        }
+        return (u8)C_NORMAL;
+    };
+}
+
+StmtCode Binder::compile_if(IFStmt *node)
+{
+    TestCode condition = compile_test(node->condition);
+    StmtCode then = compile(node->then_branch);
+    std::vector<std::pair<TestCode, StmtCode>> elifs;
+    for (auto &elif : node->elifBranch)
+    {
+        elifs.push_back({compile_test(elif->condition), compile(elif->then_branch)});
+    }
+    StmtCode otherwise = compile(node->else_branch);
+
+    return [condition, then, elifs, otherwise]()
+    {
+        if (condition())
+        {
+            return then();
+        }
+        for (auto &elif : elifs)
+        {
+            if (elif.first())
+            {
+                return elif.second();
+            }
+        }
+        return otherwise();
+    };
+}
+
+StmtCode Binder::compile_while(WhileStmt *node)
+{
+    Compiler *c = this->c;
+    TestCode condition = compile_test(node->condition);
+    StmtCode body = compile(node->body);
+
+    return [c, condition, body]()
+    {
+        u8 completion = C_NORMAL;
+        c->loop_count++;
+        while (condition())
+        {
+            u8 result = body();
+            if (result == C_BREAK)
+            {
+                break;
+            }
+            if (result == C_RETURN)
+            {
+                completion = C_RETURN;
+                break;
+            }
+        }
+        c->loop_count--;
+        return completion;
+    };
+}
+
+StmtCode Binder::compile_do(DoStmt *node)
+{
+    Compiler *c = this->c;
+    TestCode condition = compile_test(node->condition);
+    StmtCode body = compile(node->body);
+
+    return [c, condition, body]()
+    {
+        u8 completion = C_NORMAL;
+        c->loop_count++;
+        do
+        {
+            u8 result = body();
+            if (result == C_BREAK)
+            {
+                break;
+            }
+            if (result == C_RETURN)
+            {
+                completion = C_RETURN;
+                break;
+            }
+        } while (condition());
+        c->loop_count--;
+        return completion;
+    };
+}
+
+StmtCode Binder::compile_for(ForStmt *node)
+{
+    Compiler *c = this->c;
+    StmtCode initializer = compile(node->initializer);
+    TestCode condition = compile_test(node->condition);
+    ExprCode increment = compile(node->increment);
+    StmtCode body = compile_list(static_cast<BlockStmt *>(node->body.get())->statements);
+    const Scope *scope = node->scope.get();
+    const Scope *loopScope = node->loopScope.get();
+
+    if (node->counted)
+    {
+        ExprCode bound = compile(static_cast<BinaryExpr *>(node->condition.get())->right);
+        return [c, node, initializer, bound, body, scope, loopScope]()
+        {
+            auto previousEnvironment = c->environment;
+            Environment envInit(c->environment, scope);
+            c->environment = &envInit;
+            initializer();
+            Value *counter = c->counter(node);
+
+            u8 completion = C_NORMAL;
+            c->loop_count++;
+            Environment local(&envInit, loopScope);
+            c->environment = &local;
+            Value limit = bound();
+            for (bool first = true; ; first = false)
+            {
+                if (!first)
+                {
+                    local.reset(loopScope);
+                }
+                c->environment = &local;
+                if (!c->count_test(node, counter, limit))
+                {
+                    break;
+                }
+                u8 result = c->execte_code(body, &local);
+                if (result == C_BREAK)
+                {
+                    break;
+                }
+                if (result == C_RETURN)
+                {
+                    completion = C_RETURN;
+                    break;
+                }
+                c->count_step(node, counter);
+            }
+            c->loop_count--;
+            c->environment = previousEnvironment;
+            return completion;
+        };
+    }
+
+    return [c, initializer, condition, increment, body, scope, loopScope]()
+    {
+        auto previousEnvironment = c->environment;
+        Environment envInit(c->environment, scope);
+        c->environment = &envInit;
+        initializer();
+
+        u8 completion = C_NORMAL;
+        c->loop_count++;
+        while (true)
+        {
+            Environment local(&envInit, loopScope);
+            c->environment = &local;
+            if (!condition())
+            {
+                break;
+            }
+            u8 result = c->execte_code(body, &local);
+            if (result == C_BREAK)
+            {
+                break;
+            }
+            if (result == C_RETURN)
+            {
+                completion = C_RETURN;
+                break;
+            }
+            increment();
+        }
+        c->loop_count--;
+        c->environment = previousEnvironment;
+        return completion;
+    };
+}
+
+StmtCode Binder::compile_from(FromStmt *node)
+{
+    Compiler *c = this->c;
+    if (!node->variable || node->variable->type != StmtType::DECLARATION)
+    {
+        return [c, node]() { return c->visit_from(node); };
+    }
+
+    ExprCode array = compile(node->array);
+    StmtCode body = compile(node->body);
+    Declaration *decl = static_cast<Declaration *>(node->variable.get());
+    std::string name = decl->names[0].lexeme;
+    int slot = decl->slots.empty() ? -1 : decl->slots[0];
+    const Scope *scope = node->scope.get();
+    const Scope *loopScope = node->loopScope.get();
+
+    return [c, array, body, name, slot, scope, loopScope]()
+    {
+        Value value = array();
+        if (!value.isObject(O_ARRAY))
+        {
+            ERROR("Expected array to iterate");
+            return (u8)C_NORMAL;
+        }
+        ArrayLiteral *al = value.as<ArrayLiteral>();
+        if (al->values.size() == 0)
+        {
+            return (u8)C_NORMAL;
+        }
+
+        auto previousEnvironment = c->environment;
+        u8 completion = C_NORMAL;
+        c->loop_count++;
+        Environment envInit(c->environment, scope);
+        for (u32 i = 0; i < al->values.size(); i++)
+        {
+            Environment env(&envInit, loopScope);
+            c->environment = &env;
+            if (slot >= 0)
+                envInit.defineAt(slot, al->values[i]);
+            else
+                envInit.define(name, al->values[i]);
+
+            u8 result = body();
+            if (result == C_BREAK)
+            {
+                break;
+            }
+            if (result == C_RETURN)
+            {
+                completion = C_RETURN;
+                break;
+            }
+        }
+        c->loop_count--;
+        c->environment = previousEnvironment;
+        return completion;
+    };
+}
@@ -0,0 +1,131 @@
+#include "pch.h"
+#include "Chunk.hpp"
+#include "Interpreter.hpp"
+#include "Utils.hpp"
+
+static const char *opcodeNames[] =
+{
+#define BULANG_OPCODE_NAME(name) "OP_" #name,
+    BULANG_OPCODES(BULANG_OPCODE_NAME)
+#undef BULANG_OPCODE_NAME
+};
+
+const char *opcodeName(u8 op)
+{
+    if (op >= OP_COUNT) return "OP_UNKNOWN";
+    return opcodeNames[op];
+}
+
+void Chunk::write(u8 byte, int line)
+{
+    code.push_back(byte);
+    lines.push_back(line);
+}
+
+void Chunk::writeShort(u16 value, int line)
+{
+    write((u8)((value >> 8) & 0xff), line);
+    write((u8)(value & 0xff), line);
+}
+
+u32 Chunk::addConstant(Value value)
+{
+    constants.push_back(std::move(value));
+    return (u32)constants.size() - 1;
+}
+
+void Chunk::disassemble(const char *name)
+{
+    INFO("== %s ==", name);
+    for (u32 offset = 0; offset < code.size();)
+    {
+        offset = disassembleInstruction(offset);
+    }
+}
+
+u32 Chunk::disassembleInstruction(u32 offset)
+{
+    u8 op = code[offset];
+    auto readShort = [&](u32 at) -> u16 { return (u16)((code[at] << 8) | code[at + 1]); };
+    auto constantName = [&](u16 index) -> std::string
+    {
+        return constants[index].toString();
+    };
+
+    switch (op)
+    {
+        case OP_CONSTANT:
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_DEFINE_GLOBAL:
+        case OP_GET_NAME:
+        case OP_SET_NAME:
+        case OP_GET_PROPERTY:
+        case OP_SET_PROPERTY:
+        case OP_STRUCT_FIELD:
+        case OP_FIELD:
+        case OP_METHOD:
+        {
+            u16 index = readShort(offset + 1);
+            INFO("%04d %4d %-20s %4d '%s'", offset, lines[offset], opcodeName(op), index, constantName(index).c_str());
+            return offset + 3;
+        }
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_CALL:
+        case OP_TAIL_CALL:
+        case OP_FIELD_TYPE:
+        {
+            INFO("%04d %4d %-20s %4d", offset, lines[offset], opcodeName(op), code[offset + 1]);
+            return offset + 2;
+        }
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_FALSE_KEEP:
+        case OP_JUMP_IF_TRUE_KEEP:
+        {
+            u16 jump = readShort(offset + 1);
+            INFO("%04d %4d %-20s %4d -> %d", offset, lines[offset], opcodeName(op), offset, offset + 3 + jump);
+            return offset + 3;
+        }
+        case OP_LOOP:
+        {
+            u16 jump = readShort(offset + 1);
+            INFO("%04d %4d %-20s %4d -> %d", offset, lines[offset], opcodeName(op), offset, offset + 3 - jump);
+            return offset + 3;
+        }
+        case OP_ITERATE:
+        {
+            u16 jump = readShort(offset + 3);
+            INFO("%04d %4d %-20s %4d %4d -> %d", offset, lines[offset], opcodeName(op), code[offset + 1], code[offset + 2], offset + 5 + jump);
+            return offset + 5;
+        }
+        case OP_INVOKE:
+        case OP_SUPER_INVOKE:
+        {
+            u16 index = readShort(offset + 1);
+            INFO("%04d %4d %-20s (%d args) '%s'", offset, lines[offset], opcodeName(op), code[offset + 3], constantName(index).c_str());
+            return offset + 4;
+        }
+        case OP_CHECK_TYPE:
+        {
+            u16 index = readShort(offset + 1);
+            INFO("%04d %4d %-20s '%s' %s", offset, lines[offset], opcodeName(op), constantName(index).c_str(), annotation_name(code[offset + 3]));
+            return offset + 4;
+        }
+        case OP_ARRAY:
+        case OP_MAP:
+        case OP_STRUCT:
+        case OP_CLASS:
+        {
+            u16 index = readShort(offset + 1);
+            INFO("%04d %4d %-20s '%s' %d", offset, lines[offset], opcodeName(op), constantName(index).c_str(), readShort(offset + 3));
+            return offset + 5;
+        }
+        default:
+        {
+            INFO("%04d %4d %-20s", offset, lines[offset], opcodeName(op));
+            return offset + 1;
+        }
+    }
+}
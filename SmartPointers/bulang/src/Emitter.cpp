@@ -0,0 +1,1022 @@
+#include "pch.h"
+#include "VM.hpp"
+#include "Utils.hpp"
+#include <unordered_set>
+
+Emitter::Emitter()
+{
+    current = nullptr;
+    line = 0;
+}
+
+Emitter::~Emitter()
+{
+    current = nullptr;
+}
+
+void Emitter::error(const std::string &message)
+{
+    throw FatalException(message + " at line " + std::to_string(line));
+}
+
+//***************************************************************************************** */
+
+void Emitter::begin_function(State &state, const std::string &name, bool isMethod)
+{
+    Function *function = new Function();
+    state.function = Value(function);
+    function->name = Token(TokenType::IDENTIFIER, name, name, line);
+    function->arity = 0;
+    function->chunk = std::make_shared<Chunk>();
+    state.chunk = function->chunk.get();
+    state.scopeDepth = 0;
+    state.isMethod = isMethod;
+    state.enclosing = current;
+
+    // slot 0 holds the callee, or the receiver when running a method
+    state.locals.push_back({isMethod ? "self" : "", 0});
+
+    current = &state;
+}
+
+Value Emitter::end_function()
+{
+    emit(OP_NIL);
+    emit(OP_RETURN);
+
+    Value function = std::move(current->function);
+    current = current->enclosing;
+    return function;
+}
+
+Value Emitter::compile(Program *program)
+{
+    State state;
+    begin_function(state, "script", false);
+    execute(program);
+    return end_function();
+}
+
+Value Emitter::compile_function(FunctionStmt *node, bool isMethod)
+{
+    if (node->args.size() > 32)
+    {
+        error("Too many parameters in function '" + node->name.lexeme + "'");
+    }
+
+    State state;
+    begin_function(state, node->name.lexeme, isMethod);
+    Function *function = state.function.as<Function>();
+    function->arity = (u32)node->args.size();
+    function->argTypes = node->argTypes;
+    function->result = node->result;
+    if (node->memo)
+    {
+        function->memo = std::make_shared<MemoTable>();
+        function->memo->name = node->name.lexeme;
+        function->memo->capacity = node->memoSize;
+        if (memos != nullptr)
+        {
+            memos->push_back(function->memo);
+        }
+    }
+
+    // parameters and the body share one scope, as in Compiler::visit_call_function
+    begin_scope();
+    for (u32 i = 0; i < node->args.size(); i++)
+    {
+        function->args[i] = node->args[i];
+        add_local(node->args[i]);
+    }
+
+    BlockStmt *body = static_cast<BlockStmt *>(node->body.get());
+    for (auto &s : body->statements)
+    {
+        execute(s.get());
+    }
+    return end_function();
+}
+
+//***************************************************************************************** */
+
+void Emitter::begin_scope()
+{
+    current->scopeDepth++;
+}
+
+void Emitter::end_scope()
+{
+    current->scopeDepth--;
+    std::vector<Local> &locals = current->locals;
+    while (!locals.empty() && locals.back().depth > current->scopeDepth)
+    {
+        emit(OP_POP);
+        locals.pop_back();
+    }
+}
+
+void Emitter::pop_locals(int depth)
+{
+    // used by break/continue: discard the stack slots without forgetting the locals
+    std::vector<Local> &locals = current->locals;
+    for (int i = (int)locals.size() - 1; i >= 0 && locals[i].depth > depth; i--)
+    {
+        emit(OP_POP);
+    }
+}
+
+void Emitter::emit(u8 byte)
+{
+    chunk()->write(byte, line);
+}
+
+void Emitter::emit(u8 op, u8 operand)
+{
+    emit(op);
+    emit(operand);
+}
+
+void Emitter::emit_short(u8 op, u16 operand)
+{
+    emit(op);
+    chunk()->writeShort(operand, line);
+}
+
+void Emitter::emit_constant(Value value)
+{
+    emit_short(OP_CONSTANT, make_constant(std::move(value)));
+}
+
+u32 Emitter::emit_jump(u8 op)
+{
+    emit(op);
+    emit(0xff);
+    emit(0xff);
+    return chunk()->count() - 2;
+}
+
+void Emitter::patch_jump(u32 offset)
+{
+    u32 jump = chunk()->count() - offset - 2;
+    if (jump > UINT16_MAX)
+    {
+        error("Too much code to jump over");
+    }
+    chunk()->code[offset] = (jump >> 8) & 0xff;
+    chunk()->code[offset + 1] = jump & 0xff;
+}
+
+void Emitter::emit_loop(u32 start)
+{
+    emit(OP_LOOP);
+    u32 offset = chunk()->count() - start + 2;
+    if (offset > UINT16_MAX)
+    {
+        error("Loop body too large");
+    }
+    chunk()->writeShort((u16)offset, line);
+}
+
+u16 Emitter::make_constant(Value value)
+{
+    u32 index = chunk()->addConstant(std::move(value));
+    if (index > UINT16_MAX)
+    {
+        error("Too many constants in one chunk");
+    }
+    return (u16)index;
+}
+
+u16 Emitter::name_constant(const std::string &name)
+{
+    auto it = current->names.find(name);
+    if (it != current->names.end())
+    {
+        return it->second;
+    }
+    u16 index = make_constant(Value::string(name));
+    current->names[name] = index;
+    return index;
+}
+
+//***************************************************************************************** */
+
+int Emitter::resolve_local(const std::string &name)
+{
+    std::vector<Local> &locals = current->locals;
+    for (int i = (int)locals.size() - 1; i >= 0; i--)
+    {
+        if (locals[i].name == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void Emitter::add_local(const std::string &name)
+{
+    if (current->locals.size() >= VM_LOCALS_MAX)
+    {
+        error("Too many local variables in function");
+    }
+    current->locals.push_back({name, current->scopeDepth});
+}
+
+void Emitter::define_variable(const std::string &name)
+{
+    // the value is on top of the stack
+    if (current->scopeDepth == 0)
+    {
+        emit_short(OP_DEFINE_GLOBAL, name_constant(name));
+        return;
+    }
+
+    std::vector<Local> &locals = current->locals;
+    for (int i = (int)locals.size() - 1; i >= 0 && locals[i].depth == current->scopeDepth; i--)
+    {
+        if (locals[i].name == name)
+        {
+            // redeclaration in the same scope just rebinds the slot
+            emit(OP_SET_LOCAL, (u8)i);
+            emit(OP_POP);
+            return;
+        }
+    }
+    add_local(name);
+}
+
+void Emitter::emit_get_variable(const Token &name)
+{
+    line = name.line;
+    int slot = resolve_local(name.lexeme);
+    if (slot >= 0)
+    {
+        emit(OP_GET_LOCAL, (u8)slot);
+    }
+    else if (current->isMethod)
+    {
+        emit_short(OP_GET_NAME, name_constant(name.lexeme));
+    }
+    else
+    {
+        emit_short(OP_GET_GLOBAL, name_constant(name.lexeme));
+    }
+}
+
+void Emitter::emit_set_variable(const Token &name)
+{
+    line = name.line;
+    int slot = resolve_local(name.lexeme);
+    if (slot >= 0)
+    {
+        emit(OP_SET_LOCAL, (u8)slot);
+    }
+    else if (current->isMethod)
+    {
+        emit_short(OP_SET_NAME, name_constant(name.lexeme));
+    }
+    else
+    {
+        emit_short(OP_SET_GLOBAL, name_constant(name.lexeme));
+    }
+}
+
+void Emitter::emit_field_values(Stmt *stmt, u8 op)
+{
+    // fields of a struct or class; the owner sits on top of the stack
+    if (stmt->type == StmtType::DECLARATION)
+    {
+        Declaration *decl = static_cast<Declaration *>(stmt);
+        for (auto &name : decl->names)
+        {
+            line = name.line;
+            visit(decl->initializer);
+            emit_check(decl->annotation, name.lexeme);
+            emit_short(op, name_constant(name.lexeme));
+            if (decl->annotation != A_NONE && op == OP_STRUCT_FIELD)
+            {
+                emit(OP_FIELD_TYPE, decl->annotation);
+            }
+        }
+    }
+    else if (stmt->type == StmtType::ARRAY)
+    {
+        ArrayStmt *array = static_cast<ArrayStmt *>(stmt);
+        for (auto &value : array->values)
+        {
+            visit(value);
+        }
+        emit_short(OP_ARRAY, name_constant(array->name.lexeme));
+        chunk()->writeShort((u16)array->values.size(), line);
+        emit_short(op, name_constant(array->name.lexeme));
+    }
+    else if (stmt->type == StmtType::MAP)
+    {
+        MapStmt *map = static_cast<MapStmt *>(stmt);
+        for (auto &it : map->values)
+        {
+            visit(it.first);
+            visit(it.second);
+        }
+        emit_short(OP_MAP, name_constant(map->name.lexeme));
+        chunk()->writeShort((u16)map->values.size(), line);
+        emit_short(op, name_constant(map->name.lexeme));
+    }
+    else
+    {
+        error("Invalid field declaration " + stmt->toString());
+    }
+}
+
+void Emitter::emit_check(u8 annotation, const std::string &name)
+{
+    if (annotation != A_NONE)
+    {
+        emit_short(OP_CHECK_TYPE, name_constant(name));
+        emit(annotation);
+    }
+}
+
+//***************************************************************************************** */
+
+Value Emitter::visit(ExprPtr node)
+{
+    if (!node)
+    {
+        emit(OP_NIL);
+        return Value();
+    }
+    return node->accept(*this);
+}
+
+Value Emitter::visit_empty_expression(EmptyExpr *node)
+{
+    emit(OP_NIL);
+    return Value();
+}
+
+Value Emitter::visit_binary(BinaryExpr *node)
+{
+    visit(node->left);
+    visit(node->right);
+    line = node->op.line;
+
+    switch (node->op.type)
+    {
+        case TokenType::PLUS:
+        case TokenType::PLUS_EQUAL:    emit(OP_ADD); break;
+        case TokenType::MINUS:
+        case TokenType::MINUS_EQUAL:   emit(OP_SUBTRACT); break;
+        case TokenType::STAR:
+        case TokenType::STAR_EQUAL:    emit(OP_MULTIPLY); break;
+        case TokenType::SLASH:
+        case TokenType::SLASH_EQUAL:   emit(OP_DIVIDE); break;
+        case TokenType::MOD:           emit(OP_MOD); break;
+        case TokenType::EQUAL_EQUAL:   emit(OP_EQUAL); break;
+        case TokenType::BANG_EQUAL:    emit(OP_NOT_EQUAL); break;
+        case TokenType::GREATER:       emit(OP_GREATER); break;
+        case TokenType::GREATER_EQUAL: emit(OP_GREATER_EQUAL); break;
+        case TokenType::LESS:          emit(OP_LESS); break;
+        case TokenType::LESS_EQUAL:    emit(OP_LESS_EQUAL); break;
+        default:
+            error("Invalid binary expression, With operator '" + node->op.lexeme + "'");
+    }
+    return Value();
+}
+
+Value Emitter::visit_unary(UnaryExpr *node)
+{
+    line = node->op.line;
+    switch (node->op.type)
+    {
+        case TokenType::MINUS:
+        {
+            visit(node->right);
+            emit(OP_NEGATE);
+            return Value();
+        }
+        case TokenType::BANG:
+        {
+            visit(node->right);
+            emit(OP_NOT);
+            return Value();
+        }
+        case TokenType::INC:
+        case TokenType::DEC:
+        {
+            u8 op = node->op.type == TokenType::INC ? OP_ADD : OP_SUBTRACT;
+            Value one = Value::number(1);
+
+            if (node->right->type == ExprType::VARIABLE)
+            {
+                Variable *var = static_cast<Variable *>(node->right.get());
+                emit_get_variable(var->name);
+                if (!node->isPrefix)
+                {
+                    emit(OP_DUP);
+                }
+                emit_constant(one);
+                emit(op);
+                emit_set_variable(var->name);
+                if (!node->isPrefix)
+                {
+                    emit(OP_POP);
+                }
+            }
+            else if (node->right->type == ExprType::GET)
+            {
+                GetExpr *get = static_cast<GetExpr *>(node->right.get());
+                visit(get->object);
+                emit(OP_DUP);
+                emit_short(OP_GET_PROPERTY, name_constant(get->name.lexeme));
+                emit_constant(one);
+                emit(op);
+                emit_short(OP_SET_PROPERTY, name_constant(get->name.lexeme));
+            }
+            else
+            {
+                visit(node->right);
+                emit_constant(one);
+                emit(op);
+            }
+            return Value();
+        }
+        default:
+            error("Invalid unary expression, With operator '" + node->op.lexeme + "'");
+    }
+    return Value();
+}
+
+Value Emitter::visit_logical(LogicalExpr *node)
+{
+    line = node->op.line;
+    visit(node->left);
+    if (node->op.type == TokenType::XOR)
+    {
+        visit(node->right);
+        emit(OP_XOR);
+        return Value();
+    }
+
+    u32 jump = emit_jump(node->op.type == TokenType::OR ? OP_JUMP_IF_TRUE_KEEP : OP_JUMP_IF_FALSE_KEEP);
+    emit(OP_POP);
+    visit(node->right);
+    patch_jump(jump);
+    return Value();
+}
+
+Value Emitter::visit_grouping(GroupingExpr *node)
+{
+    return visit(node->expr);
+}
+
+Value Emitter::visit_literal(Literal *node)
+{
+    emit(OP_NIL);
+    return Value();
+}
+
+Value Emitter::visit_number_literal(NumberLiteral *node)
+{
+    emit_constant(Value::number(node->value));
+    return Value();
+}
+
+Value Emitter::visit_boolean_literal(BooleanLiteral *node)
+{
+    emit(node->value ? OP_TRUE : OP_FALSE);
+    return Value();
+}
+
+Value Emitter::visit_string_literal(StringLiteral *node)
+{
+    emit_constant(Value::string(node->value));
+    return Value();
+}
+
+Value Emitter::visit_now_expression(NowExpr *node)
+{
+    emit(OP_NOW);
+    return Value();
+}
+
+Value Emitter::visit_read_variable(Variable *node)
+{
+    emit_get_variable(node->name);
+    return Value();
+}
+
+Value Emitter::visit_assign(Assign *node)
+{
+    visit(node->value);
+    line = node->name.line;
+    emit_check(node->annotation, node->name.lexeme);
+    emit_set_variable(node->name);
+    return Value();
+}
+
+Value Emitter::visit_call(CallExpr *node)
+{
+    if (node->args.size() > UINT8_MAX)
+    {
+        error("Too many arguments in call to '" + node->name.lexeme + "'");
+    }
+    bool tail = tailCall;
+    tailCall = false;
+
+    // inside a method a bare call resolves through the receiver, like the tree walker
+    // finds it through the instance environment
+    if (current->isMethod && node->callee->type == ExprType::VARIABLE)
+    {
+        Variable *var = static_cast<Variable *>(node->callee.get());
+        if (resolve_local(var->name.lexeme) < 0)
+        {
+            emit(OP_GET_LOCAL, 0);
+            for (auto &arg : node->args)
+            {
+                visit(arg);
+            }
+            line = node->name.line;
+            emit_short(OP_INVOKE, name_constant(var->name.lexeme));
+            emit((u8)node->args.size());
+            return Value();
+        }
+    }
+
+    visit(node->callee);
+    for (auto &arg : node->args)
+    {
+        visit(arg);
+    }
+    line = node->name.line;
+    emit(tail ? OP_TAIL_CALL : OP_CALL, (u8)node->args.size());
+    return Value();
+}
+
+Value Emitter::visit_get(GetExpr *node)
+{
+    visit(node->object);
+    line = node->name.line;
+    emit_short(OP_GET_PROPERTY, name_constant(node->name.lexeme));
+    return Value();
+}
+
+Value Emitter::visit_get_definition(GetDefinitionExpr *node)
+{
+    if (node->values.size() > UINT8_MAX)
+    {
+        error("Too many arguments in call to '" + node->name.lexeme + "'");
+    }
+    bool super = node->super && current->isMethod && resolve_local("super") < 0;
+    if (super)
+    {
+        emit(OP_GET_LOCAL, 0);
+    }
+    else
+    {
+        visit(node->variable);
+    }
+    for (auto &value : node->values)
+    {
+        visit(value);
+    }
+    line = node->name.line;
+    emit_short(super ? OP_SUPER_INVOKE : OP_INVOKE, name_constant(node->name.lexeme));
+    emit((u8)node->values.size());
+    return Value();
+}
+
+Value Emitter::visit_set(SetExpr *node)
+{
+    visit(node->object);
+    visit(node->value);
+    line = node->name.line;
+    emit_short(OP_SET_PROPERTY, name_constant(node->name.lexeme));
+    return Value();
+}
+
+Value Emitter::visit_self(SelfExpr *node)
+{
+    if (!current->isMethod)
+    {
+        error("Self must be call from a class");
+    }
+    emit(OP_GET_LOCAL, 0);
+    return Value();
+}
+
+Value Emitter::visit_super(SuperExpr *node)
+{
+    error("Super is not supported by the bytecode backend");
+    return Value();
+}
+
+//***************************************************************************************** */
+
+u8 Emitter::execute(Stmt *stmt)
+{
+    if (!stmt)
+    {
+        return 0;
+    }
+    return stmt->visit(*this);
+}
+
+u8 Emitter::visit_program(Program *node)
+{
+    for (auto &s : node->statements)
+    {
+        execute(s.get());
+    }
+    return 0;
+}
+
+u8 Emitter::visit_block_smt(BlockStmt *node)
+{
+    begin_scope();
+    for (auto &s : node->statements)
+    {
+        execute(s.get());
+    }
+    end_scope();
+    return 0;
+}
+
+u8 Emitter::visit_expression_smt(ExpressionStmt *node)
+{
+    if (node->expression == nullptr)
+    {
+        error("[EXPRESSION STATEMENT] Unknown expression type");
+    }
+    visit(node->expression);
+    emit(OP_POP);
+    return 0;
+}
+
+u8 Emitter::visit_print_smt(PrintStmt *node)
+{
+    visit(node->expression);
+    emit(OP_PRINT);
+    return 0;
+}
+
+u8 Emitter::visit_declaration(Declaration *node)
+{
+    line = node->names[0].line;
+    visit(node->initializer);
+    emit_check(node->annotation, node->names[0].lexeme);
+
+    if (current->scopeDepth == 0)
+    {
+        for (u32 i = 0; i < node->names.size(); i++)
+        {
+            if (i + 1 < node->names.size())
+            {
+                emit(OP_DUP);
+            }
+            define_variable(node->names[i].lexeme);
+        }
+        return 0;
+    }
+
+    define_variable(node->names[0].lexeme);
+    int first = resolve_local(node->names[0].lexeme);
+    for (u32 i = 1; i < node->names.size(); i++)
+    {
+        emit(OP_GET_LOCAL, (u8)first);
+        define_variable(node->names[i].lexeme);
+    }
+    return 0;
+}
+
+u8 Emitter::visit_if(IFStmt *node)
+{
+    std::vector<u32> exits;
+
+    visit(node->condition);
+    u32 next = emit_jump(OP_JUMP_IF_FALSE);
+    execute(node->then_branch.get());
+    exits.push_back(emit_jump(OP_JUMP));
+    patch_jump(next);
+
+    for (auto &elif : node->elifBranch)
+    {
+        visit(elif->condition);
+        next = emit_jump(OP_JUMP_IF_FALSE);
+        execute(elif->then_branch.get());
+        exits.push_back(emit_jump(OP_JUMP));
+        patch_jump(next);
+    }
+
+    if (node->else_branch != nullptr)
+    {
+        execute(node->else_branch.get());
+    }
+
+    for (u32 exit : exits)
+    {
+        patch_jump(exit);
+    }
+    return 0;
+}
+
+u8 Emitter::visit_while(WhileStmt *node)
+{
+    u32 start = chunk()->count();
+    current->loops.push_back({current->scopeDepth, (int)start, {}, {}});
+
+    visit(node->condition);
+    u32 exit = emit_jump(OP_JUMP_IF_FALSE);
+    execute(node->body.get());
+    emit_loop(start);
+    patch_jump(exit);
+
+    Loop loop = std::move(current->loops.back());
+    current->loops.pop_back();
+    for (u32 offset : loop.breaks)
+    {
+        patch_jump(offset);
+    }
+    return 0;
+}
+
+u8 Emitter::visit_do(DoStmt *node)
+{
+    u32 start = chunk()->count();
+    current->loops.push_back({current->scopeDepth, -1, {}, {}});
+
+    execute(node->body.get());
+
+    for (u32 offset : current->loops.back().continues)
+    {
+        patch_jump(offset);
+    }
+    current->loops.back().continueTarget = (int)chunk()->count();
+
+    visit(node->condition);
+    u32 exit = emit_jump(OP_JUMP_IF_FALSE);
+    emit_loop(start);
+    patch_jump(exit);
+
+    Loop loop = std::move(current->loops.back());
+    current->loops.pop_back();
+    for (u32 offset : loop.breaks)
+    {
+        patch_jump(offset);
+    }
+    return 0;
+}
+
+u8 Emitter::visit_for(ForStmt *node)
+{
+    begin_scope();
+    execute(node->initializer.get());
+
+    u32 start = chunk()->count();
+    current->loops.push_back({current->scopeDepth, -1, {}, {}});
+
+    visit(node->condition);
+    u32 exit = emit_jump(OP_JUMP_IF_FALSE);
+    execute(node->body.get());
+
+    for (u32 offset : current->loops.back().continues)
+    {
+        patch_jump(offset);
+    }
+    visit(node->increment);
+    emit(OP_POP);
+    emit_loop(start);
+    patch_jump(exit);
+
+    Loop loop = std::move(current->loops.back());
+    current->loops.pop_back();
+    for (u32 offset : loop.breaks)
+    {
+        patch_jump(offset);
+    }
+
+    end_scope();
+    return 0;
+}
+
+u8 Emitter::visit_from(FromStmt *node)
+{
+    if (node->variable->type != StmtType::DECLARATION)
+    {
+        error("Expected variable declaration to iterate");
+    }
+    Declaration *decl = static_cast<Declaration *>(node->variable.get());
+
+    begin_scope();
+
+    visit(node->array);
+    add_local("$array");
+    u8 array = (u8)(current->locals.size() - 1);
+
+    emit_constant(Value::number(0));
+    add_local("$index");
+
+    emit(OP_NIL);
+    add_local(decl->names[0].lexeme);
+    u8 variable = (u8)(current->locals.size() - 1);
+
+    u32 start = chunk()->count();
+    current->loops.push_back({current->scopeDepth, (int)start, {}, {}});
+
+    emit(OP_ITERATE);
+    emit(array);
+    emit(variable);
+    emit(0xff);
+    emit(0xff);
+    u32 exit = chunk()->count() - 2;
+
+    execute(node->body.get());
+    emit_loop(start);
+    patch_jump(exit);
+
+    Loop loop = std::move(current->loops.back());
+    current->loops.pop_back();
+    for (u32 offset : loop.breaks)
+    {
+        patch_jump(offset);
+    }
+
+    end_scope();
+    return 0;
+}
+
+u8 Emitter::visit_return(ReturnStmt *node)
+{
+    tailCall = current->enclosing != nullptr && node->value && node->value->type == ExprType::CALL;
+    visit(node->value);
+    tailCall = false;
+    emit(OP_RETURN);
+    return 0;
+}
+
+u8 Emitter::visit_break(BreakStmt *node)
+{
+    if (current->loops.empty())
+    {
+        WARNING("BREAK outside of loop");
+        return 0;
+    }
+    Loop &loop = current->loops.back();
+    pop_locals(loop.depth);
+    loop.breaks.push_back(emit_jump(OP_JUMP));
+    return 0;
+}
+
+u8 Emitter::visit_continue(ContinueStmt *node)
+{
+    if (current->loops.empty())
+    {
+        WARNING("CONTINUE outside of loop");
+        return 0;
+    }
+    Loop &loop = current->loops.back();
+    pop_locals(loop.depth);
+    if (loop.continueTarget >= 0)
+    {
+        emit_loop((u32)loop.continueTarget);
+    }
+    else
+    {
+        loop.continues.push_back(emit_jump(OP_JUMP));
+    }
+    return 0;
+}
+
+u8 Emitter::visit_switch(SwitchStmt *node)
+{
+    begin_scope();
+    visit(node->condition);
+    add_local("$switch");
+    u8 slot = (u8)(current->locals.size() - 1);
+
+    std::vector<u32> exits;
+    for (auto &caseStmt : node->cases)
+    {
+        emit(OP_GET_LOCAL, slot);
+        visit(caseStmt->condition);
+        emit(OP_EQUAL);
+        u32 next = emit_jump(OP_JUMP_IF_FALSE);
+        execute(caseStmt->body.get());
+        exits.push_back(emit_jump(OP_JUMP));
+        patch_jump(next);
+    }
+    if (node->defaultBranch != nullptr)
+    {
+        execute(node->defaultBranch.get());
+    }
+    for (u32 exit : exits)
+    {
+        patch_jump(exit);
+    }
+
+    end_scope();
+    return 0;
+}
+
+u8 Emitter::visit_function(FunctionStmt *node)
+{
+    line = node->name.line;
+    emit_constant(compile_function(node, false));
+    define_variable(node->name.lexeme);
+    return 0;
+}
+
+u8 Emitter::visit_struct(StructStmt *node)
+{
+    line = node->name.line;
+    // the struct is sized for its fields up front, a name declared twice has one slot
+    std::unordered_set<std::string> fields;
+    for (auto &value : node->values)
+    {
+        if (value->type == StmtType::DECLARATION)
+        {
+            for (auto &name : static_cast<Declaration *>(value.get())->names)
+                fields.insert(name.lexeme);
+        }
+        else if (value->type == StmtType::ARRAY)
+        {
+            fields.insert(static_cast<ArrayStmt *>(value.get())->name.lexeme);
+        }
+        else if (value->type == StmtType::MAP)
+        {
+            fields.insert(static_cast<MapStmt *>(value.get())->name.lexeme);
+        }
+    }
+    emit_short(OP_STRUCT, name_constant(node->name.lexeme));
+    chunk()->writeShort((u16)fields.size(), line);
+    for (auto &value : node->values)
+    {
+        emit_field_values(value.get(), OP_STRUCT_FIELD);
+    }
+    define_variable(node->name.lexeme);
+    return 0;
+}
+
+u8 Emitter::visit_class(ClassStmt *node)
+{
+    line = node->name.line;
+    u16 parent = UINT16_MAX;
+    if (node->superClass != nullptr)
+    {
+        Variable *superName = static_cast<Variable *>(node->superClass.get());
+        parent = name_constant(superName->name.lexeme);
+    }
+
+    emit_short(OP_CLASS, name_constant(node->name.lexeme));
+    chunk()->writeShort(parent, line);
+
+    for (auto &field : node->fields)
+    {
+        emit_field_values(field.get(), OP_FIELD);
+    }
+    for (auto &method : node->methods)
+    {
+        FunctionStmt *stmt = static_cast<FunctionStmt *>(method.get());
+        emit_constant(compile_function(stmt, true));
+        emit_short(OP_METHOD, name_constant(stmt->name.lexeme));
+    }
+
+    define_variable(node->name.lexeme);
+    return 0;
+}
+
+u8 Emitter::visit_array(ArrayStmt *node)
+{
+    line = node->name.line;
+    for (auto &value : node->values)
+    {
+        visit(value);
+    }
+    emit_short(OP_ARRAY, name_constant(node->name.lexeme));
+    chunk()->writeShort((u16)node->values.size(), line);
+    if (node->constant)
+    {
+        emit(OP_FREEZE);
+    }
+    define_variable(node->name.lexeme);
+    return 0;
+}
+
+u8 Emitter::visit_map(MapStmt *node)
+{
+    line = node->name.line;
+    for (auto &it : node->values)
+    {
+        visit(it.first);
+        visit(it.second);
+    }
+    emit_short(OP_MAP, name_constant(node->name.lexeme));
+    chunk()->writeShort((u16)node->values.size(), line);
+    if (node->constant)
+    {
+        emit(OP_FREEZE);
+    }
+    define_variable(node->name.lexeme);
+    return 0;
+}
@@ -11,6 +11,7 @@ Environment::Environment()
 {
     depth = ++env_depth;
     parent = nullptr;
+    scope = nullptr;
    // INFO("Environment created %d", depth);
 }
 
@@ -19,9 +20,31 @@ Environment::Environment(Environment *parent)
 {
 
     depth = ++env_depth;
+    scope = nullptr;
  //   INFO("Environment created %d", depth);
 }
 
+Environment::Environment(Environment *parent, const Scope *scope)
+    : parent(parent), scope(scope)
+{
+    depth = ++env_depth;
+    if (scope != nullptr)
+    {
+        m_slots.resize(scope->names.size());
+    }
+}
+
+void Environment::reset(const Scope *scope)
+{
+    this->scope = scope;
+    if (!m_values.empty())
+    {
+        version++;
+    }
+    m_values.clear();
+    m_slots.assign(scope != nullptr ? scope->names.size() : 0, Value());
+}
+
 Environment::~Environment()
 {
     parent = nullptr;
@@ -36,45 +59,106 @@ void Environment::print()
 
     for (auto it = m_values.begin(); it != m_values.end(); it++)
     {
-        ExprPtr l = it->second;
-        if (l != nullptr)
+        const Value &l = it->second;
+        if (!l.isEmpty())
         {
-            INFO("%s: %s", it->first.c_str(), l->toString().c_str());
+            INFO("%s: %s", it->first.c_str(), l.typeName());
         }
     }
 }
 
-bool Environment::define(const std::string &name, ExprPtr value)
+Value *Environment::findSlot(const std::string &name)
 {
-    if (m_values.find(name) != m_values.end())
+    if (scope == nullptr)
+    {
+        return nullptr;
+    }
+    for (u32 i = 0; i < m_slots.size(); i++)
+    {
+        if (!m_slots[i].isEmpty() && scope->names[i] == name)
+        {
+            return &m_slots[i];
+        }
+    }
+    return nullptr;
+}
+
+Value Environment::getAt(u32 depth, u32 slot)
+{
+    Environment *env = this;
+    while (depth-- > 0)
+    {
+        env = env->parent;
+    }
+    return env->m_slots[slot];
+}
+
+Value *Environment::slotAt(u32 depth, u32 slot)
+{
+    Environment *env = this;
+    while (depth-- > 0)
+    {
+        env = env->parent;
+    }
+    return env->m_slots[slot].isEmpty() ? nullptr : &env->m_slots[slot];
+}
+
+bool Environment::assignAt(u32 depth, u32 slot, Value value)
+{
+    Environment *env = this;
+    while (depth-- > 0)
+    {
+        env = env->parent;
+    }
+    if (env->m_slots[slot].isEmpty() || value.isEmpty())
     {
-        m_values[name] = value;
         return false;
     }
-    
-    m_values[name] =std::move(value);
+    env->m_slots[slot] = std::move(value);
     return true;
 }
 
-ExprPtr Environment::get(const std::string &name)
+// an instance that got a field, `scope` is its new shape's
+void Environment::extend(const Scope *scope, Value value)
 {
-    if (m_values.find(name) != m_values.end())
+    this->scope = scope;
+    m_slots.push_back(std::move(value));
+}
+
+bool Environment::define(const std::string &name, Value value)
+{
+    return m_values.insert_or_assign(name, std::move(value)).second;
+}
+
+Value Environment::get(const std::string &name)
+{
+    auto it = m_values.find(name);
+    if (it != m_values.end())
+    {
+        return it->second;
+    }
+    if (Value *slot = findSlot(name))
     {
-        return m_values[name];
+        return *slot;
     }
     if (parent != nullptr)
     {
         return parent->get(name);
     }
-    return nullptr;
+    return Value();
 }
 
-bool Environment::set(const std::string &name, ExprPtr value)
+bool Environment::set(const std::string &name, Value value)
 {
-    if (m_values.find(name) != m_values.end())
+    auto it = m_values.find(name);
+    if (it != m_values.end())
     {
-        ExprPtr expr = m_values[name];
-        m_values[name] = value;
+        it->second = std::move(value);
+        return true;
+    }
+    if (Value *slot = findSlot(name))
+    {
+        *slot = std::move(value);
         return true;
     }
     if (parent != nullptr)
@@ -86,7 +170,7 @@ bool Environment::set(const std::string &name, ExprPtr value)
 
 bool Environment::contains(const std::string &name)
 {
-    if (m_values.find(name) != m_values.end())
+    if (m_values.find(name) != m_values.end() || findSlot(name) != nullptr)
     {
         return true;
     }
@@ -102,27 +186,34 @@ void Environment::remove(const std::string &name)
     if (m_values.find(name) != m_values.end())
     {
         m_values.erase(name);
+        version++;
     }
 }
 
-bool Environment::assign(const std::string &name, ExprPtr value)
+Value *Environment::find(const std::string &name)
+{
+    auto it = m_values.find(name);
+    return it != m_values.end() ? &it->second : nullptr;
+}
+
+bool Environment::assign(const std::string &name, Value value)
 {
-    if (value == nullptr)
+    if (value.isEmpty())
     {
         ERROR("Cannot assign variable to undefined value: %s", name.c_str());
         return false;
     }
 
-    if (m_values.find(name) != m_values.end())
+    auto it = m_values.find(name);
+    if (it != m_values.end())
     {
-            ExprPtr expr = m_values[name];
-            if (expr == nullptr)
+            if (it->second.isEmpty())
             {
                 ERROR("Cannot assign variable to undefined value: %s", name.c_str());
                 return false;
             }
 
-            m_values[name] = std::move(value);
+            it->second = std::move(value);
 
             // if (expr->type == ExprType::LITERAL)
             // {
@@ -159,6 +250,11 @@ bool Environment::assign(const std::string &name, ExprPtr value)
             return true;
     }
 
+    if (Value *slot = findSlot(name))
+    {
+        *slot = std::move(value);
+        return true;
+    }
 
     if (parent != nullptr)
     {
@@ -171,11 +267,17 @@ bool Environment::assign(const std::string &name, ExprPtr value)
     return false;
 }
 
-bool Environment::replace(const std::string &name, ExprPtr value)
+bool Environment::replace(const std::string &name, Value value)
 {
-    if (m_values.find(name) != m_values.end())
+    auto it = m_values.find(name);
+    if (it != m_values.end())
     {
-        m_values[name] = value;
+        it->second = std::move(value);
+        return true;
+    }
+    if (Value *slot = findSlot(name))
+    {
+        *slot = std::move(value);
         return true;
     }
     if (parent != nullptr)
@@ -187,32 +289,24 @@ bool Environment::replace(const std::string &name, ExprPtr value)
 
 bool Environment::addInteger(const std::string &name, int value)
 {
-    std::shared_ptr<NumberLiteral> nl =  std::make_shared<NumberLiteral>();
-    nl->value = value;
-    return define(name, nl);
+    return define(name, Value::number(value));
 }
 
 bool Environment::addDouble(const std::string &name, double value)
 {
-    std::shared_ptr<NumberLiteral> nl =  std::make_shared<NumberLiteral>();
-    nl->value = value;
-    return define(name, nl);
+    return define(name, Value::number(value));
 }
 
 bool Environment::addString(const std::string &name, std::string value)
 {
-    std::shared_ptr<StringLiteral> sl =  std::make_shared<StringLiteral>();
-    sl->value = value;
-    return define(name, sl);
+    return define(name, Value::string(value));
 }
 
 bool Environment::addBoolean(const std::string &name, bool value)
 {
-    std::shared_ptr<NumberLiteral> bl =  std::make_shared<NumberLiteral>();
-    bl->value = value ? 1 : 0;
-    return define(name, bl);
+    return define(name, Value::boolean(value));
 }
-bool Environment::copy(std::unordered_map<std::string, ExprPtr> values)
+bool Environment::copy(std::unordered_map<std::string, Value> values)
 {
     this->m_values=std::move(values);
     return true;
@@ -227,13 +321,14 @@ bool Environment::copy(Environment *env)
 }
 std::shared_ptr<Environment> Environment::clone()
 {
-    std::shared_ptr<Environment>  env = std::make_shared<Environment>(parent);
+    std::shared_ptr<Environment>  env = std::make_shared<Environment>(parent, scope);
+    for (u32 i = 0; i < m_slots.size(); i++)
+    {
+        env->m_slots[i] = m_slots[i].clone();
+    }
     for (auto it = m_values.begin(); it != m_values.end(); it++)
     {
-        if (it->second->type == ExprType::L_FUNCTION)
-            env->define(it->first, it->second);
-        else 
-            env->define(it->first, it->second->clone());
+        env->define(it->first, it->second.clone());
     }
 
     return env;
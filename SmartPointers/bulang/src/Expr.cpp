@@ -5,107 +5,102 @@
 #include "Utils.hpp"
 
 
-ExprPtr EmptyExpr::accept(Visitor &v)
+Value EmptyExpr::accept(Visitor &v)
 {
     return v.visit_empty_expression(this);
 }
 
-ExprPtr EmptyExpr::clone()
+
+static std::size_t mix(std::size_t seed, std::size_t value)
+{
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+static std::size_t child_hash(const ExprPtr &expr)
 {
-    return std::make_shared<EmptyExpr>();
+    return expr ? expr->hash() : 0;
 }
 
-ExprPtr BinaryExpr::accept(Visitor &v)
+Value BinaryExpr::accept(Visitor &v)
 {
     return v.visit_binary(this);
 }
 
+std::size_t BinaryExpr::hash() const
+{
+    return mix(mix((std::size_t)op.type, child_hash(left)), child_hash(right));
+}
+
 
 
-ExprPtr UnaryExpr::accept(Visitor &v)
+Value UnaryExpr::accept(Visitor &v)
 {
     return v.visit_unary(this);
 }
 
+std::size_t UnaryExpr::hash() const
+{
+    return mix((std::size_t)op.type, child_hash(right));
+}
 
 
-ExprPtr GroupingExpr::accept(Visitor &v)
+
+Value GroupingExpr::accept(Visitor &v)
 {
     return v.visit_grouping(this);
 }
 
+std::size_t GroupingExpr::hash() const
+{
+    return child_hash(expr);
+}
+
 
 
-ExprPtr LogicalExpr::accept(Visitor &v)
+Value LogicalExpr::accept(Visitor &v)
 {
     return v.visit_logical(this);
 }
 
 
 
-ExprPtr NumberLiteral::accept(Visitor &v)
+Value NumberLiteral::accept(Visitor &v)
 {
     return v.visit_number_literal(this);
 }
 
-void NumberLiteral::print()
-{
-    PRINT("%f", value);
-}
 
-ExprPtr NumberLiteral::clone()
+Value BooleanLiteral::accept(Visitor &v)
 {
-    std::shared_ptr<NumberLiteral> expr = std::make_shared<NumberLiteral>();
-    expr->value = value;
-    return expr;
+    return v.visit_boolean_literal(this);
 }
 
-ExprPtr StringLiteral::accept(Visitor &v)
+Value StringLiteral::accept(Visitor &v)
 {
     return  v.visit_string_literal(this);
 }
 
-void StringLiteral::print()
-{
-    PRINT("%s", value.c_str());
-}
 
-ExprPtr StringLiteral::clone()
-{
-    std::shared_ptr<StringLiteral> expr = std::make_shared<StringLiteral>();
-    expr->value = value;
-    return expr;
-}
-
-ExprPtr NowExpr::accept(Visitor &v)
+Value NowExpr::accept(Visitor &v)
 {
     return v.visit_now_expression(this);
 }
 
-ExprPtr Variable::accept(Visitor &v)
+Value Variable::accept(Visitor &v)
 {
     return  v.visit_read_variable(this);
 }
 
-ExprPtr Assign::accept(Visitor &v)
+Value Assign::accept(Visitor &v)
 {
     return  v.visit_assign(this);
 }
 
-ExprPtr Literal::accept(Visitor &v)
+Value Literal::accept(Visitor &v)
 {
     return  v.visit_literal(this);
 }
 
-void Literal::print()
-{
-    PRINT("nil");
-}
-
-ExprPtr Literal::clone()
-{
-    return std::make_shared<Literal>();
-}
 
 std::string Expr::toString()
 {
@@ -114,12 +109,7 @@ std::string Expr::toString()
        case ExprType::E_NONE: return "NONE";
        case ExprType::L_NUMBER: return "NUMBER";
        case ExprType::L_STRING: return "STRING";
-       case ExprType::L_FUNCTION: return "FUNCTION";
-       case ExprType::L_CLASS: return "CLASS";
-       case ExprType::L_STRUCT: return "STRUCT";
-       case ExprType::L_ARRAY: return "ARRAY";
-       case ExprType::L_MAP: return "MAP";
-       case ExprType::L_NATIVE: return "NATIVE";
+       case ExprType::L_BOOLEAN: return "BOOLEAN";
        case ExprType::LITERAL: return "LITERAL";
        case ExprType::BINARY: return "BINARY";
        case ExprType::UNARY: return "UNARY";
@@ -141,32 +131,37 @@ std::string Expr::toString()
    return "UNKNOWN";
 }
 
-ExprPtr CallExpr::accept(Visitor &v)
+Value CallExpr::accept(Visitor &v)
 {
     return v.visit_call(this);
 }
 
-ExprPtr GetExpr::accept(Visitor &v)
+Value GetExpr::accept(Visitor &v)
 {
     return v.visit_get(this);
 }
 
-ExprPtr SetExpr::accept(Visitor &v)
+std::size_t GetExpr::hash() const
+{
+    return mix(std::hash<std::string>()(name.lexeme), child_hash(object));
+}
+
+Value SetExpr::accept(Visitor &v)
 {
     return v.visit_set(this);
 }
 
-ExprPtr GetDefinitionExpr::accept(Visitor &v)
+Value GetDefinitionExpr::accept(Visitor &v)
 {
     return v.visit_get_definition(this);
 }
 
-ExprPtr SelfExpr::accept(Visitor &v)
+Value SelfExpr::accept(Visitor &v)
 {
     return  v.visit_self(this);
 }
 
-ExprPtr SuperExpr::accept(Visitor &v)
+Value SuperExpr::accept(Visitor &v)
 {
     return  v.visit_super(this);
 }
@@ -1,286 +1,569 @@
 #include "pch.h"
 
 #include "Interpreter.hpp"
+#include "VM.hpp"
+#include "Resolver.hpp"
+#include "Binder.hpp"
+#include "Jit.hpp"
+#include "Optimizer.hpp"
 #include "Utils.hpp"
 
 
-
-class BreakException : public std::runtime_error
-{
-public:
-    explicit BreakException(std::string message) : std::runtime_error(message) {}
-};
-
-class ContinueException : public std::runtime_error
-{
-public:
-    explicit ContinueException(std::string message) : std::runtime_error(message) {}
-};
-
+static Value number_binary(BinaryExpr *node, double a, double b);
+static Value string_binary(BinaryExpr *node, const Value &a, const Value &b);
 
 
-class ReturnException : public std::runtime_error
+Value Compiler::visit(ExprPtr node)
 {
-public:
-    explicit ReturnException(ExprPtr value) : std::runtime_error("return"), value(value) {}
-    ExprPtr value {nullptr};
-};
-
-
-ExprPtr Compiler::visit(ExprPtr node)
-{
-    if (!node) std::make_shared<Literal>();
+    if (!node) return Value::nil();
     return node->accept(*this);
 }
 
-ExprPtr Compiler::visit_assign(Assign *node)
+void Compiler::assign_variable(const Token &name, int depth, int slot, Value value)
 {
-    if (!node) return std::make_shared<Literal>();
-    ExprPtr value = evaluate(node->value);
-
-    
+    if (slot >= 0 && environment->assignAt(depth, slot, value))
+    {
+        return;
+    }
 
-    if (!environment->assign(node->name.lexeme, std::move(value)))
+    if (!environment->assign(name.lexeme, std::move(value)))
     {
+       throw FatalException("Undefined variable: '" + name.lexeme +"' at line  "+ std::to_string(name.line )+" or mixe types.");
+    }
+}
 
-      
-       throw FatalException("Undefined variable: '" + node->name.lexeme +"' at line  "+ std::to_string(node->name.line )+" or mixe types.");
+Value Compiler::visit_assign(Assign *node)
+{
+    if (!node) return Value::nil();
+    Value value = evaluate(node->value);
+    if (node->annotation != A_NONE)
+    {
+        check_type(node->annotation, value, node->name.lexeme, node->name.line);
     }
 
+    assign_variable(node->name, node->depth, node->slot, value);
 
     return value;
 }
 
-ExprPtr Compiler::evaluate(ExprPtr node)
+Value Compiler::evaluate(const ExprPtr &node)
 {
-   
+
     if (!node)
     {
         WARNING("Evaluation error: Unknown expression type");
-        return std::make_shared<Literal>();
+        return Value::nil();
     }
-    std::shared_ptr<Expr>  result = visit(node);
-    return result;
+#ifdef BULANG_SWITCH_EVAL
+    // one jump on the tag instead of accept() + visit_*(), the hot kinds never leave here
+    Expr *expr = node.get();
+    switch (expr->type)
+    {
+        case ExprType::L_NUMBER:
+            return Value::number(static_cast<NumberLiteral *>(expr)->value);
+        case ExprType::VARIABLE:
+        {
+            Variable *var = static_cast<Variable *>(expr);
+            if (var->slot >= 0)
+            {
+                Value *slot = environment->slotAt(var->depth, var->slot);
+                if (slot != nullptr)
+                {
+                    return *slot;
+                }
+            }
+            return Compiler::visit_read_variable(var);
+        }
+        case ExprType::BINARY:
+        {
+            BinaryExpr *binary = static_cast<BinaryExpr *>(expr);
+            Value left  = evaluate(binary->left);
+            Value right = evaluate(binary->right);
+            if (binary->quick == Q_TYPED_NUMBER)
+            {
+                return number_binary(binary, left.asNumber(), right.asNumber());
+            }
+            if (binary->quick == Q_TYPED_STRING)
+            {
+                return string_binary(binary, left, right);
+            }
+            if (binary->quick == Q_NUMBER)
+            {
+                if (left.isNumber() && right.isNumber())
+                {
+                    return number_binary(binary, left.asNumber(), right.asNumber());
+                }
+                binary->quick = Q_GENERIC;
+            }
+            return Compiler::binary(binary, left, right);
+        }
+        case ExprType::ASSIGN:
+        {
+            Assign *assign = static_cast<Assign *>(expr);
+            Value value = evaluate(assign->value);
+            if (assign->annotation != A_NONE)
+            {
+                check_type(assign->annotation, value, assign->name.lexeme, assign->name.line);
+            }
+            assign_variable(assign->name, assign->depth, assign->slot, value);
+            return value;
+        }
+        case ExprType::CALL:         return Compiler::visit_call(static_cast<CallExpr *>(expr));
+        case ExprType::UNARY:        return Compiler::visit_unary(static_cast<UnaryExpr *>(expr));
+        case ExprType::GROUPING:     return evaluate(static_cast<GroupingExpr *>(expr)->expr);
+        case ExprType::LOGICAL:      return Compiler::visit_logical(static_cast<LogicalExpr *>(expr));
+        case ExprType::L_STRING:     return Compiler::visit_string_literal(static_cast<StringLiteral *>(expr));
+        case ExprType::L_BOOLEAN:    return Value::boolean(static_cast<BooleanLiteral *>(expr)->value);
+        case ExprType::GET:          return Compiler::visit_get(static_cast<GetExpr *>(expr));
+        case ExprType::GET_DEF:      return Compiler::visit_get_definition(static_cast<GetDefinitionExpr *>(expr));
+        case ExprType::SET:          return Compiler::visit_set(static_cast<SetExpr *>(expr));
+        default:
+            break;
+    }
+#endif
+    return node->accept(*this);
 }
 
 
-ExprPtr Compiler::visit_call_native(CallExpr *node)
+Value Compiler::visit_call_native(Native *native, CallExpr *node)
 {
  //   INFO("CALL: %s ",node->name.lexeme.c_str());
 
-    interpreter->context->clear();
+    std::vector<Value> args;
+    args.reserve(node->args.size());
     for (u32 i = 0; i < node->args.size(); i++)
     {
-        ExprPtr arg = evaluate(node->args[i]);
-        Literal *l = static_cast<Literal *>(arg.get());
-        interpreter->context->add(std::move(arg),l);
-        
+        args.push_back(evaluate(node->args[i]));
     }
-    ExprPtr  result = interpreter->CallNativeFunction(node->name.lexeme,(int) node->args.size());
 
+    interpreter->context->clear();
+    for (auto &arg : args)
+    {
+        interpreter->context->add(std::move(arg));
+    }
+    Value result = native->function != nullptr
+                       ? native->function(interpreter->context, (int)node->args.size())
+                       : interpreter->CallNativeFunction(node->name.lexeme, (int)node->args.size());
+    if (result.isEmpty())
+    {
+        return Value::nil();
+    }
     return result;
 }
-ExprPtr Compiler::visit_call_struct(const ExprPtr &var,CallExpr *node,Expr *expr) 
+Value Compiler::visit_call_struct(StructLiteral *original, CallExpr *node)
 {
-
-    StructLiteral *original = static_cast<StructLiteral *>(var.get());
-    std::shared_ptr<StructLiteral> result = std::make_shared<StructLiteral>();
-    result->name = node->name.lexeme;
-     if (!node->args.empty())
-     {
-         if (node->args.size() > original->members.size())
-         {
-             WARNING("Too many arguments in struct call: '%s' (pass %d / %d have) ", node->name.lexeme.c_str(), node->args.size(), original->members.size());
-         }
+    Value keep(original);   // the arguments may rebind its name
+    StructLayout *layout = original->layout.get();
+    if (node->args.size() > original->count)
+    {
+        WARNING("Too many arguments in struct call: '%s' (pass %d / %d have) ", node->name.lexeme.c_str(), node->args.size(), original->count);
     }
-    u32 index = 0;
-    for (auto it = original->members.begin(); it != original->members.end(); it++)
+    StructLiteral *result = StructLiteral::create(original->layout, original->count);
+    Value value(result);
+    Value *slots = result->values();
+    u32 i = 0;
+    for (; i < original->count && i < node->args.size(); i++)
     {
-         result->members[it->first] =  it->second->clone();
-        if (!node->args.empty())
+        slots[i] = evaluate(node->args[i]);
+        if (!layout->types.empty())
         {
-            if (index < node->args.size())
-            {
-                ExprPtr arg = evaluate(node->args[index]);
-                std::string name = it->first;
-                result->members[name] = std::move(arg);
-            }
-            index++;
-        } 
-    } 
-
-    return result;
+            check_type(layout->types[i], slots[i], node->name.lexeme + "." + layout->fields[i], node->name.line);
+        }
+    }
+    const Value *defaults = original->values();
+    for (; i < original->count; i++)
+    {
+        slots[i] = defaults[i].clone();
+    }
+    return value;
+}
 
+// shapes and defaults are laid out the first time a class is called, parents first
+bool Compiler::prepare_class(ClassLiteral *cl)
+{
+    if (cl->prepared)
+    {
+        return true;
+    }
+    Value parent;
+    if (cl->isChild)
+    {
+        parent = environment->get(cl->parentName);
+        if (!parent.isObject(O_CLASS) || parent.as<ClassLiteral>()->instance())
+        {
+            WARNING("Undefined parent class: '%s'", cl->parentName.c_str());
+            return false;
+        }
+        if (cl->preparing)
+        {
+            WARNING("Class '%s' extends itself", cl->name.c_str());
+            return false;
+        }
+        cl->preparing = true;
+        bool ready = prepare_class(parent.as<ClassLiteral>());
+        cl->preparing = false;
+        if (!ready)
+        {
+            return false;
+        }
+    }
+    cl->prepare(parent);
+    return true;
+}
 
+Value Compiler::call_function(Function *function, std::vector<Value> &args, const Token &name, Environment *enclosing, ClassLiteral *self)
+{
+    if (function->arity != args.size())
+    {
+        throw FatalException("Incorrect number of arguments in call to '" + name.lexeme +"' at line "+ std::to_string(name.line )+ " expected " + std::to_string(function->arity) + " but got " + std::to_string(args.size()));
+    }
+    return run_function(function, args, name, enclosing, self);
 }
 
-ExprPtr Compiler::visit_call_function(CallExpr *node,Expr *callee) 
+// call_function once the argument count is known to match
+Value Compiler::run_function(Function *function, std::vector<Value> &args, const Token &name, Environment *enclosing, ClassLiteral *self)
 {
-    auto previousEnvironment = environment;
+    check_args(function, args, name);
+    // every function a tail call passes through returns this same value, the first one
+    // to declare a result type is the one reported
+    Function *results[A_BOOL + 1] = {};
+    results[function->result] = function;
 
-    Function *function = static_cast<Function *>(callee);
-    if (function->arity != node->args.size())
+    Value result;
+    std::string key;
+    bool memo = function->memo && self == nullptr && MemoTable::key(args.data(), args.size(), key);
+    if (memo && function->memo->find(key, result))
+    {
+        return result;
+    }
+    if (self == nullptr && call_jit(function, args, enclosing, result))
     {
-        throw FatalException("Incorrect number of arguments in call to '" + node->name.lexeme +"' at line "+ std::to_string(node->name.line )+ " expected " + std::to_string(function->arity) + " but got " + std::to_string(node->args.size()));
+        check_type(function->result, result, function->name.lexeme, name.line);
+        return result;
     }
 
-    std::shared_ptr<Environment>  local = std::make_shared<Environment>(environment);
+    auto previousEnvironment = environment;
 
-    for (u32 i = 0; i < node->args.size(); i++)
+    BlockStmt *body = static_cast<BlockStmt *>(function->body.get());
+    std::shared_ptr<Environment>  local = std::make_shared<Environment>(enclosing, body->scope.get());
+    if (self != nullptr)
     {
-        ExprPtr arg = evaluate(node->args[i]);
-        local->define(function->args[i], std::move(arg));
+        local->define("self", Value(self));
     }
-    ExprPtr result = nullptr;
-    try  
+
+    for (u32 i = 0; i < args.size(); i++)
     {
-        BlockStmt *body = static_cast<BlockStmt *>(function->body.get());
-        execte_block(body, local.get());
-        
+        if (body->scope)
+            local->defineAt(i, std::move(args[i]));
+        else
+            local->define(function->args[i], std::move(args[i]));
     }
-    catch (ReturnException &e)
+    u8 completion = function->code ? execte_code(function->code, local.get()) : execte_block(body, local.get());
+
+    // tail calls run here, one after the other, in the same frame
+    while (completion == C_RETURN && tailFunction != nullptr)
     {
-        result = e.value;
-    }  
-    
+        function = tailFunction;
+        tailFunction = nullptr;
+        std::vector<Value> next;
+        next.swap(tailArgs);
+        if (function->arity != next.size())
+        {
+            throw FatalException("Incorrect number of arguments in call to '" + tailName->lexeme +"' at line "+ std::to_string(tailName->line )+ " expected " + std::to_string(function->arity) + " but got " + std::to_string(next.size()));
+        }
+        check_args(function, next, *tailName);
+        if (results[function->result] == nullptr)
+        {
+            results[function->result] = function;
+        }
+        if (function->memo)
+        {
+            returnValue = call_function(function, next, *tailName, enclosing);
+            break;
+        }
+        if (call_jit(function, next, enclosing, returnValue))
+        {
+            break;
+        }
+
+        body = static_cast<BlockStmt *>(function->body.get());
+        local->reset(body->scope.get());
+        for (u32 i = 0; i < next.size(); i++)
+        {
+            if (body->scope)
+                local->defineAt(i, std::move(next[i]));
+            else
+                local->define(function->args[i], std::move(next[i]));
+        }
+        completion = function->code ? execte_code(function->code, local.get()) : execte_block(body, local.get());
+    }
 
+    if (completion == C_RETURN)
+    {
+        result = std::move(returnValue);
+    }
 
-    if (result == nullptr)
+    if (result.isEmpty())
+    {
+        result = Value::nil();
+    }
+    for (u8 annotation = A_NUMBER; annotation <= A_BOOL; annotation++)
+    {
+        if (results[annotation] != nullptr)
+        {
+            check_type(annotation, result, results[annotation]->name.lexeme, name.line);
+        }
+    }
+    if (memo)
     {
-        result = std::make_shared<Literal>();
+        function->memo->insert(key, result);
     }
 
     environment = previousEnvironment;
 
     return result;
 }
-ExprPtr Compiler::visit_call_class(const ExprPtr &result,CallExpr *node, Expr *callee) //contructor
-{
-  //  INFO("CREATE CLASS: %s %d", node->name.lexeme.c_str(), node->args.size());
 
-   
-    ClassLiteral *main = static_cast<ClassLiteral *>(result.get());
+void Compiler::check_type(u8 annotation, const Value &value, const std::string &name, int line)
+{
+    if (!annotation_fits(annotation, value))
+    {
+        throw FatalException("Type mismatch: '" + name + "' is " + annotation_name(annotation) + ", got " + value.typeName() + " at line " + std::to_string(line));
+    }
+}
 
-    ExprPtr parent = nullptr;
-    if (main->isChild)
+void Compiler::check_args(Function *function, const std::vector<Value> &args, const Token &name)
+{
+    for (u32 i = 0; i < function->argTypes.size(); i++)
     {
-        parent = environment->get(main->parentName);
-        if (!parent)
+        if (!annotation_fits(function->argTypes[i], args[i]))
         {
-            WARNING("Undefined parent class: '%s'", main->parentName.c_str());
-            return  std::make_shared<Literal>();
+            check_type(function->argTypes[i], args[i], name.lexeme + "(" + function->args[i] + ")", name.line);
         }
     }
+}
 
-    std::shared_ptr<ClassLiteral> s = std::make_shared<ClassLiteral>(); 
-    s->name        = node->name.lexeme;
-    
- 
-
-
-    if (main->isChild)
-    {       
-        ClassLiteral *p = static_cast<ClassLiteral *>(parent.get());
-        s->environment= new Environment(p->environment);
-    } else 
+bool Compiler::call_jit(Function *function, const std::vector<Value> &args, Environment *enclosing, Value &result)
+{
+    if (jit == nullptr || function->nojit)
     {
-        s->environment= new Environment(environment);
-        
+        return false;
     }
+    if (function->native == nullptr && ++function->calls == JIT_THRESHOLD)
+    {
+        function->native = jit->compile(function);
+        function->nojit = function->native == nullptr;
+    }
+    return function->native != nullptr && call_native(function, args, enclosing, result);
+}
 
-    s->environment->copy(main->environment);
-
-  //  s->environment->define("self", s);
+u8 Compiler::tail_call(Function *function, std::vector<Value> &args, const Token &name)
+{
+    tailFunction = function;
+    tailArgs.swap(args);
+    tailName = &name;
+    return C_RETURN;
+}
 
+bool Compiler::call_native(Function *function, const std::vector<Value> &args, Environment *enclosing, Value &result)
+{
+    // the native body calls itself directly, so its name must still resolve to it here
+    double values[32];
+    for (u32 i = 0; i < args.size(); i++)
+    {
+        if (!args[i].isNumber())
+        {
+            return false;
+        }
+        values[i] = args[i].asNumber();
+    }
+    Value callee = enclosing->get(function->name.lexeme);
+    if (!callee.isObject(O_FUNCTION) || callee.as<Function>() != function)
+    {
+        return false;
+    }
 
+    double number;
+    if (function->native(values, &number) != JIT_OK)
+    {
+        function->native = nullptr;
+        function->nojit = true;
+        return false;
+    }
+    result = Value::number(number);
+    return true;
+}
 
+Value Compiler::visit_call_function(Function *function, CallExpr *node)
+{
+    std::vector<Value> args;
+    args.reserve(node->args.size());
+    for (u32 i = 0; i < node->args.size(); i++)
+    {
+        args.push_back(evaluate(node->args[i]));
+    }
+    return call_function(function, args, node->name, environment);
+}
 
+// The Optimizer marks a call `global` when no local, parameter or member anywhere in the
+// program has the callee's name, so looking it up by name can only end in the globals.
+// The binding's Value is then watched directly: while it holds the object it held when
+// cached, that object is the callee. The pointer is not retained, so an object freed and
+// another made at its address passes too; it is still what the binding holds, its type is
+// read again and the arity is checked on every call.
+Object *Compiler::cached_callee(CallExpr *node)
+{
+    if (node->quick != Q_CACHED)
+    {
+        return nullptr;
+    }
+    if (node->version == global->version && node->cell->isObject() && node->cell->asObject() == node->target)
+    {
+        return node->target;
+    }
+    node->quick = Q_NONE;
+    node->target = nullptr;
+    node->cell = nullptr;
+    return nullptr;
+}
 
-   // std::shared_ptr<SelfExpr> self = std::make_shared<SelfExpr>();
-   // self->parent = s;
+void Compiler::cache_callee(CallExpr *node, const Value &callee)
+{
+    if (node->quick != Q_NONE || !node->global || !callee.isObject())
+    {
+        return;
+    }
+    Value *cell = global->find(static_cast<Variable *>(node->callee.get())->name.lexeme);
+    if (cell == nullptr || !cell->isObject() || cell->asObject() != callee.asObject())
+    {
+        return;
+    }
+    if (callee.isObject(O_FUNCTION) && callee.as<Function>()->arity != node->args.size())
+    {
+        return;
+    }
+    node->quick = Q_CACHED;
+    node->target = callee.asObject();
+    node->cell = cell;
+    node->version = global->version;
+}
+Value Compiler::visit_call_class(ClassLiteral *main, CallExpr *node) //contructor
+{
+  //  INFO("CREATE CLASS: %s %d", node->name.lexeme.c_str(), node->args.size());
 
- //   s->environment->define("self", s);
+    if (main->instance())
+    {
+        main = main->owner.as<ClassLiteral>();
+    }
+    if (!prepare_class(main))
+    {
+        return Value::nil();
+    }
 
-    if (main->isChild)
-    {       
-        s->environment->define("super", parent);
-    } 
+    Value result = main->instantiate();
+    ClassLiteral *s = result.as<ClassLiteral>();
 
 
     if (!node->args.empty())
-    {   
+    {
 
-         if (s->environment->contains("init"))
+         ClassLiteral *owner = nullptr;
+         if (Value *init = s->method("init", owner))
          {
-            ExprPtr value = s->environment->get("init");
-            if (value->type == ExprType::L_FUNCTION)
+            Value value = *init;
+            if (value.isObject(O_FUNCTION))
             {
+                std::vector<Value> args;
+                args.reserve(node->args.size());
+                for (u32 i = 0; i < node->args.size(); i++)
+                {
+                    args.push_back(evaluate(node->args[i]));
+                }
 
-                instance= s;    
-
+                ClassLiteral *previousInstance = instance;
+                ClassLiteral *previousHolder = holder;
+                Environment *previousPref = prefEnv;
+                instance = s;
+                holder = owner;
                 prefEnv = s->environment;
-                std::shared_ptr<CallExpr> call = std::make_shared<CallExpr>();
-                call->name = node->name;
-                call->callee = value;
-                call->args = std::move(node->args);
                 try
                 {
-                     visit_call_function_member(call.get(), value.get(), s.get());
+                     call_function(value.as<Function>(), args, node->name, s->environment, s);
                 }
                 catch(const std::exception& e)
                 {
                     ERROR("Fail call init ");
-                    
+
                 }
-                
-                instance= nullptr;
-                   
-                prefEnv = nullptr;
 
-            } else 
+                instance = previousInstance;
+                holder = previousHolder;
+                prefEnv = previousPref;
+
+            } else
             {
                 ERROR("Function constructor init not found in class");
             }
         }
 
     }
-    return s;
+    return result;
 }
 
-ExprPtr Compiler::visit_call(CallExpr *node)
+Value Compiler::visit_call(CallExpr *node)
 {
 
-    if (!node)   return  std::make_shared<Literal>();
-          
-
-
-
+    if (!node)   return Value::nil();
 
-    ExprPtr callee = evaluate(node->callee);
-
-
-    ExprPtr var = environment->get(node->name.lexeme);
-    if (var->type == ExprType::L_STRUCT)
+    if (Object *target = cached_callee(node))
     {
-        return visit_call_struct(var,node, callee.get());
+        switch (target->type)
+        {
+            case O_FUNCTION: return visit_call_function(static_cast<Function *>(target), node);
+            case O_NATIVE:   return visit_call_native(static_cast<Native *>(target), node);
+            case O_STRUCT:   return visit_call_struct(static_cast<StructLiteral *>(target), node);
+            case O_CLASS:    return visit_call_class(static_cast<ClassLiteral *>(target), node);
+            default:         break;
+        }
     }
 
-    if (var->type == ExprType::L_NATIVE)
+    Value callee = evaluate(node->callee);
+    if (node->quick == Q_DIRECT)
     {
-        return visit_call_native(node);
-    }
-    if (var->type == ExprType::L_CLASS)
-    {
-        return visit_call_class(var,node, callee.get());
+        if (callee.isObject(O_FUNCTION) && callee.asObject() == node->target)
+        {
+            return visit_call_function(callee.as<Function>(), node);
+        }
+        node->quick = Q_GENERIC;
+        node->target = nullptr;
     }
+    cache_callee(node, callee);
 
- 
 
-    if (var->type != ExprType::L_FUNCTION)
+    // a plain name was just looked up (or slot-resolved) while evaluating the callee
+    Value var = node->callee->type == ExprType::VARIABLE ? callee : environment->get(node->name.lexeme);
+    if (!var.isObject())
+    {
         return callee;
+    }
 
-    return visit_call_function(node, callee.get());
-} 
+    switch (var.asObject()->type)
+    {
+        case O_STRUCT:   return visit_call_struct(var.as<StructLiteral>(), node);
+        case O_NATIVE:   return visit_call_native(var.as<Native>(), node);
+        case O_CLASS:    return visit_call_class(var.as<ClassLiteral>(), node);
+        case O_FUNCTION:
+        {
+            if (node->quick == Q_NONE && node->callee->type == ExprType::VARIABLE)
+            {
+                node->quick = Q_DIRECT;
+                node->target = var.asObject();
+            }
+            return visit_call_function(var.as<Function>(), node);
+        }
+        default:         return callee;
+    }
+}
 
 std::string toLower(const std::string &str)
 {
@@ -289,57 +572,65 @@ std::string toLower(const std::string &str)
     return lowerStr;
 }
 
-ExprPtr Compiler::ProcessString(Expr *var, GetDefinitionExpr *node)
+Value Compiler::ProcessString(const Value &var, GetDefinitionExpr *node)
 {
 
-    StringLiteral *estring = static_cast<StringLiteral *>(var);
+    const std::string &estring = var.asString();
     std::string action = node->name.lexeme;
     if (action == "length")
     {
-        std::shared_ptr<NumberLiteral> number = std::make_shared<NumberLiteral>();
-        number->value = static_cast<double>(estring->value.length());
-        return number;
-    } else if (action == "asInt") 
+        return Value::number(static_cast<double>(estring.length()));
+    } else if (action == "asInt")
     {
         if (node->values.size() < 1)
         {
             throw FatalException("String 'asInt' requires an argument");
         }
 
-        ExprPtr value = evaluate(node->values[0]);
-        if (value->type != ExprType::L_NUMBER)
+        Value value = evaluate(node->values[0]);
+        if (!value.isNumber())
         {
             throw FatalException("String 'asInt' requires a number argument");
         }
-        NumberLiteral *number = static_cast<NumberLiteral *>(value.get());
-        std::shared_ptr<StringLiteral> result = std::make_shared<StringLiteral>();
-        long numberValue = static_cast<long>(number->value);
-        result->value = std::to_string(numberValue);
-        return result;
-    }else 
+        long numberValue = static_cast<long>(value.asNumber());
+        return Value::string(std::to_string(numberValue));
+    }else
     {
-        
+
          throw FatalException("Unknown string function '" + action + "'");
     }
-    return std::make_shared<Literal>();
+    return Value::nil();
 }
 
-ExprPtr Compiler::ProcessArray(Expr *var, GetDefinitionExpr *node)
+// array/map method names are decoded once per call site, not compared on every call
+static u8 builtin_method(GetDefinitionExpr *node)
 {
-        ArrayLiteral *earray = static_cast<ArrayLiteral *>(var);
-        
-        ExprPtr expr    = environment->get(earray->name);
-        if (!expr)  
+    if (node->method != M_NONE)
+    {
+        return node->method;
+    }
+    static const std::unordered_map<std::string, u8> methods =
+    {
+        {"push", M_PUSH}, {"pop", M_POP}, {"size", M_SIZE}, {"at", M_AT},
+        {"set", M_SET}, {"last", M_LAST}, {"remove", M_REMOVE}, {"clear", M_CLEAR},
+        {"foreach", M_FOREACH}, {"erase", M_ERASE}, {"find", M_FIND},
+    };
+    auto it = methods.find(toLower(node->name.lexeme));
+    node->method = it != methods.end() ? it->second : M_UNKNOWN;
+    return node->method;
+}
+
+Value Compiler::ProcessArray(const Value &var, GetDefinitionExpr *node)
+{
+        ArrayLiteral *array = var.as<ArrayLiteral>();
+        u8 action = builtin_method(node);
+        if (array->frozen && (action == M_PUSH || action == M_POP || action == M_SET || action == M_REMOVE || action == M_CLEAR))
         {
-           
-           throw FatalException("Array not found: " + earray->name);
-           
+            throw FatalException("Cannot change const array '" + array->name + "' at line " + std::to_string(node->name.line));
         }
-        ArrayLiteral *array = static_cast<ArrayLiteral *>(expr.get());
-        std::string action = toLower(node->name.lexeme);
 
 
-        if (action == "push")
+        if (action == M_PUSH)
         {
                 if (node->values.size() < 1)
                 {
@@ -347,591 +638,579 @@ ExprPtr Compiler::ProcessArray(Expr *var, GetDefinitionExpr *node)
                 }
                 for (u32 i = 0; i < node->values.size(); i++)
                 {
-                    ExprPtr value = evaluate(node->values[i]);
-                    ExprPtr clone = value->clone();
-                    array->values.push_back(std::move(clone));
+                    Value value = evaluate(node->values[i]);
+                    array->values.push_back(value.clone());
                 }
-                return expr;
-  
-        } else if (action == "pop")
+                return var;
+
+        } else if (action == M_POP)
         {
-                ExprPtr value = std::move(array->values.back());
+                if (array->values.empty())
+                {
+                    throw FatalException("Array 'pop' on empty array");
+                }
+                Value value = std::move(array->values.back());
                 array->values.pop_back();
                 return value;
-        } else if (action == "size")
+        } else if (action == M_SIZE)
         {
-            std::shared_ptr<NumberLiteral> size = std::make_shared<NumberLiteral>();
-            size->value = array->values.size();
-            return size;
+            return Value::number(array->values.size());
         }
-        else if (action == "at")
+        else if (action == M_AT)
         {
             if (node->values.size() != 1)
             {
                 ERROR("Array 'at' requires 1 argument");
-                return expr;
+                return var;
             }
-            ExprPtr value = evaluate(node->values[0]);
-            if (value->type != ExprType::L_NUMBER)
+            Value value = evaluate(node->values[0]);
+            if (!value.isNumber())
             {
                 ERROR("Array index must be a number");
-                return expr;
+                return var;
             }
-            NumberLiteral *nl = static_cast<NumberLiteral *>(value.get());
-            if (nl->value < 0 || nl->value >= array->values.size())
+            double index = value.asNumber();
+            if (index < 0 || index >= array->values.size())
             {
                 ERROR("Array index out of bounds");
-                return expr;
+                return var;
             }
-            u32 index = (u32) static_cast<int>(nl->value);
-            return array->values[index];
-        }else  if (action == "set")
+            return array->values[(u32)index];
+        }else  if (action == M_SET)
         {
             if (node->values.size() != 2)
             {
                 throw FatalException("Array 'set' requires 2 arguments");
             }
-            ExprPtr value = evaluate(node->values[0]);
-            if (value->type != ExprType::L_NUMBER)
+            Value value = evaluate(node->values[0]);
+            if (!value.isNumber())
             {
                 throw FatalException("Array index must be a number");
             }
-            NumberLiteral *nl = static_cast<NumberLiteral *>(value.get());
-            if (nl->value < 0 || nl->value >= array->values.size())
+            double index = value.asNumber();
+            if (index < 0 || index >= array->values.size())
             {
                 throw FatalException("Array index out of bounds");
             }
 
-            int index = nl->value;
-
-            array->values[index] = std::move(evaluate(node->values[1]));
-
-            array->values[index];
+            array->values[(u32)index] = evaluate(node->values[1]);
         }
-        else if (action == "last")
+        else if (action == M_LAST)
         {
+            if (array->values.empty())
+            {
+                return Value::nil();
+            }
             return array->values.back();
         }
-        else if (action == "remove")
+        else if (action == M_REMOVE)
         {
             if (node->values.size() != 1)
             {
-                
+
                 throw FatalException("Array 'remove' requires 1 argument");
             }
-            ExprPtr value = evaluate(node->values[0]);
-            if (value->type != ExprType::L_NUMBER)
+            Value value = evaluate(node->values[0]);
+            if (!value.isNumber())
             {
                 throw FatalException("Array index must be a number");
             }
-            NumberLiteral *nl = static_cast<NumberLiteral *>(value.get());
-            if (nl->value < 0 || nl->value >= array->values.size())
+            double index = value.asNumber();
+            if (index < 0 || index >= array->values.size())
             {
 
                 throw FatalException("Array index out of bounds");
             }
 
-            int index = nl->value;
-            auto v =    array->values.erase(array->values.begin() + index);
-            ExprPtr item = *v;
+            Value item = array->values[(u32)index];
+            array->values.erase(array->values.begin() + (u32)index);
             return item;
-            
-        } else if (action == "clear")
+
+        } else if (action == M_CLEAR)
         {
-            
+
             array->values.clear();
-            
-            return expr;
+
+            return var;
         }
-        else if (action == "foreach")
+        else if (action == M_FOREACH)
         {
                 if (node->values.size() < 1)
                 {
                     throw FatalException("Array 'foreach' requires 1 function argument");
                 }
-                ExprPtr value = evaluate(node->values[0]);
-                if (value->type != ExprType::L_FUNCTION)
+                Value value = evaluate(node->values[0]);
+                if (!value.isObject(O_FUNCTION))
                 {
                     throw FatalException("Array 'foreach' requires 1 function argument");
                 }
-                std::vector<std::shared_ptr<CallExpr>> calls;     
                 for (u32 i = 0; i < array->values.size(); i++)
                 {
-                      std::shared_ptr<CallExpr> call = std::make_shared<CallExpr>();
-                      calls.push_back(call);
-                      call->name = node->name;
-                      call->callee = value;
-                      call->args.push_back(array->values[i]);
-                      visit_call_function(call.get(), value.get());
+                      std::vector<Value> args{array->values[i]};
+                      call_function(value.as<Function>(), args, node->name, environment);
                 }
-                calls.clear();
-            return expr;
+            return var;
         }
-        else 
+        else
         {
-             
+
              throw FatalException("Unknown array function: "+ node->name.lexeme);
         }
-    
-    return expr;
+
+    return var;
 }
 
-ExprPtr Compiler::ProcessMap(Expr *var, GetDefinitionExpr *node)
+Value Compiler::ProcessMap(const Value &var, GetDefinitionExpr *node)
 {
-        MapLiteral *emap = static_cast<MapLiteral *>(var);
- 
-        ExprPtr expr    = environment->get(emap->name);
-        if (!expr)  
+        MapLiteral *map = var.as<MapLiteral>();
+        u8 action = builtin_method(node);
+        if (map->frozen && (action == M_ERASE || action == M_SET || action == M_CLEAR))
         {
-           
-           throw FatalException("Dictionary " +emap->name+ " not found");
+            throw FatalException("Cannot change const map '" + map->name + "' at line " + std::to_string(node->name.line));
         }
 
-        MapLiteral *map = static_cast<MapLiteral *>(expr.get());
-        std::string action = toLower(node->name.lexeme);
-
 
-        if (action == "erase")
+        if (action == M_ERASE)
         {
             if (node->values.size() != 1)
             {
-                
-                throw FatalException("Dictionary 'erase' requires 1 arguments");
-                
-            }
-            ExprPtr find = evaluate(node->values[0]);
-            if (find->type==ExprType::L_STRING)
-            {
-                StringLiteral *sl = static_cast<StringLiteral *>(find.get());
-                    auto it = map->values.begin();
-                    for (; it != map->values.end(); it++)
-                    {
-                        ExprPtr first = it->first;
-                        if (first->type == ExprType::L_STRING)
-                        {
-                            StringLiteral *key = static_cast<StringLiteral *>(first.get());
-                            if (key->value == sl->value)
-                            {
-                                ExprPtr value = it->second;
-                                map->values.erase(it);
-                                return value;
-                            }
-                        }
-                    }
-                
-                WARNING("Key not found: %s", sl->value.c_str());
-
-            } else if (find->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *nl = static_cast<NumberLiteral *>(find.get());
 
-                auto it = map->values.begin();
-                for (; it != map->values.end(); it++)   
-                {
-                    ExprPtr first = it->first;
-                    if (first->type == ExprType::L_NUMBER)
-                    {
-                        NumberLiteral *key = static_cast<NumberLiteral *>(first.get());
-                        if (key->value == nl->value)
-                        {
-                            ExprPtr value = it->second;
-                            map->values.erase(it);
-                            return value;
-                        }
-                    }
-                }
-                WARNING("Key not found: %f", nl->value);
-            }
-           
+                throw FatalException("Dictionary 'erase' requires 1 arguments");
 
-            
-            return  std::make_shared<Literal>();
-        } else if (action == "size")
+            }
+            Value find = evaluate(node->values[0]);
+            auto it = map->values.find(find);
+            if (it == map->values.end())
+            {
+                WARNING("Key not found: %s", find.toString().c_str());
+                return Value::nil();
+            }
+            Value value = it->second;
+            map->values.erase(it);
+            return value;
+        } else if (action == M_SIZE)
         {
-            std::shared_ptr<NumberLiteral> result = std::make_shared<NumberLiteral>();
-            result->value = map->values.size();
-            return result;
-        } else if (action == "set")
+            return Value::number(map->values.size());
+        } else if (action == M_SET)
         {
             if (node->values.size() != 2)
             {
-                
-                
+
+
                 throw FatalException("Dictionary 'set' requires 2 arguments");
             }
-            ExprPtr key   = evaluate(node->values[0]);
-            ExprPtr value = evaluate(node->values[1]);
-            ExprPtr remove = map->values[key];
-            map->values[key] = value->clone();
+            Value key   = evaluate(node->values[0]);
+            Value value = evaluate(node->values[1]);
+            map->values[key] = value.clone();
             return value;
         }
-        else if (action == "find")
+        else if (action == M_FIND)
         {
             if (node->values.size() != 1)
             {
-                
+
                 throw FatalException("Dictionary 'find' requires 1 arguments");
             }
-            ExprPtr find   = evaluate(node->values[0]);
-
-
-            if (find->type==ExprType::L_STRING)
-            {
-                StringLiteral *sl = static_cast<StringLiteral *>(find.get(  ));
-                    auto it = map->values.begin();
-                    for (; it != map->values.end(); it++)
-                    {
-                        ExprPtr first = it->first;
-                        if (first->type == ExprType::L_STRING)
-                        {
-                            StringLiteral *key = static_cast<StringLiteral *>(first.get());
-                            if (key->value == sl->value)
-                            {
-                                ExprPtr value = it->second;
-                                return value;
-                            }
-                        }
-                    }
-                
-                WARNING("Key not found: %s", sl->value.c_str());
-            } else if (find->type == ExprType::L_NUMBER)
+            Value find   = evaluate(node->values[0]);
+            auto it = map->values.find(find);
+            if (it == map->values.end())
             {
-                NumberLiteral *nl = static_cast<NumberLiteral *>(find.get());
-
-                auto it = map->values.begin();
-                for (; it != map->values.end(); it++)   
-                {
-                    ExprPtr first = it->first;
-                    if (first->type == ExprType::L_NUMBER)
-                    {
-                        NumberLiteral *key = static_cast<NumberLiteral *>(first.get());
-                        if (key->value == nl->value)
-                        {
-                            ExprPtr value = it->second;
-                            return value;
-                        }
-                    }
-                }
-                WARNING("Key not found: %f", nl->value);
+                WARNING("Key not found: %s", find.toString().c_str());
+                return Value::nil();
             }
-
-            return  std::make_shared<Literal>();
+            return it->second;
         }
-        else if (action == "clear")
+        else if (action == M_CLEAR)
         {
             map->values.clear();
-            return std::make_shared<Literal>();
+            return Value::nil();
         }
-        else if (action == "foreach")
+        else if (action == M_FOREACH)
         {
                 if (node->values.size() < 1)
                 {
                     throw FatalException("Dictionary 'foreach' requires 1 function argument");
                 }
-                ExprPtr value = evaluate(node->values[0]);
-                if (value->type != ExprType::L_FUNCTION)
+                Value value = evaluate(node->values[0]);
+                if (!value.isObject(O_FUNCTION))
                 {
                     throw FatalException("Dictionary 'foreach' requires 1 function argument");
                 }
-                
-              
-               std::vector<ExprPtr> calls;
-                auto it = map->values.begin();
-            for (; it != map->values.end(); it++)
+
+            // the callback may grow or shrink the map
+            std::vector<std::pair<Value, Value>> items(map->values.begin(), map->values.end());
+            for (auto &item : items)
             {
-                ExprPtr key   = it->first;
-                ExprPtr v = it->second;
-
-              
-                std::shared_ptr<CallExpr>call = std::shared_ptr<CallExpr>();
-                calls.push_back(call);
-                call->name = node->name;
-                call->callee = value;
-                call->args.push_back(key);
-                call->args.push_back(v);
-                visit_call_function(call.get(), value.get());
-                    
+                std::vector<Value> args{item.first, item.second};
+                call_function(value.as<Function>(), args, node->name, environment);
             }
-            calls.clear();
-            return std::make_shared<Literal>();
+            return Value::nil();
         }
-        else 
+        else
         {
-             
+
               throw FatalException("Unknown dictionary function: " + node->name.lexeme);
         }
-    
-    
-    return std::make_shared<Literal>();
-}
 
 
-ExprPtr Compiler::visit_call_function_member(CallExpr *node,Expr *callee, ClassLiteral *main) 
-{
-    Function *function = static_cast<Function *>(callee);
-    if (function->arity != node->args.size())
-    {
-        throw FatalException("Incorrect number of arguments in call to '" + node->name.lexeme +"' at line "+ std::to_string(node->name.line )+ " expected " + std::to_string(function->arity) + " but got " + std::to_string(node->args.size()));
-    }
+    return Value::nil();
+}
 
 
-    std::shared_ptr<Environment>  local = std::make_shared<Environment>(main->environment);
-    local->define("self", instance);
-    
-    for (u32 i = 0; i < node->args.size(); i++)
+// what node calls on self. A call site keeps the table slot it found for the shape and
+// class it saw last; super.name(...) goes to the base of the class declaring the running
+// method and keeps the running instance as self.
+Value Compiler::find_method(ClassLiteral *&self, GetDefinitionExpr *node, ClassLiteral *&owner)
+{
+    MethodCache &cache = node->cache;
+    const std::string &name = node->name.lexeme;
+    if (node->super && holder != nullptr && !holder->base.isEmpty() && instance != nullptr)
     {
-        ExprPtr arg = evaluate(node->args[i]);
-        if (!local->define(function->args[i], std::move(arg)))
+        ClassLiteral *base = holder->base.as<ClassLiteral>();
+        self = instance;
+        if (cache.table != base->table)
         {
-            throw FatalException("Duplicate identifier from argumnts");
+            int slot = base->table->find(name);
+            if (slot < 0)
+            {
+                owner = base;
+                return base->environment->get(name);
+            }
+            cache.table = base->table;
+            cache.slot = (u32)slot;
         }
+        owner = cache.table->owners[cache.slot];
+        return *cache.table->methods[cache.slot];
     }
-
-    ExprPtr result = nullptr;
-    try  
-    {
-        BlockStmt *body = static_cast<BlockStmt *>(function->body.get());
-        execte_block(body, local.get());
-    }
-    catch (const ReturnException &e)
-    {
-        result = e.value;
-    }  
-    catch (const std::exception &e)
-    {
-        throw e;
-    }
-
-
-
-    if (result == nullptr)
+    if (self->instance())
     {
-        result =  std::make_shared<Literal>();
+        ClassLiteral *cl = self->owner.as<ClassLiteral>();
+        if (cache.shape != self->shape || cache.table != cl->table)
+        {
+            int slot = self->shape->find(name) < 0 ? cl->table->find(name) : -1;
+            if (slot < 0)
+            {
+                Value *binding = self->method(name, owner);
+                return binding != nullptr ? *binding : self->environment->get(name);
+            }
+            cache.shape = self->shape;
+            cache.table = cl->table;
+            cache.slot = (u32)slot;
+        }
+        owner = cache.table->owners[cache.slot];
+        return *cache.table->methods[cache.slot];
     }
-     return result;
+    owner = self;
+    Value *binding = self->method(name, owner);
+    return binding != nullptr ? *binding : self->environment->get(name);
 }
 
-ExprPtr Compiler::ProcessClass(Expr *var, GetDefinitionExpr *node)//call_function member
+Value Compiler::ProcessClass(const Value &var, GetDefinitionExpr *node)//call_function member
 {
-        ClassLiteral *classl = static_cast<ClassLiteral *>(var);
-        if (!classl)
-        {
-            ERROR("Class '%s' not found: " ,node->name.lexeme.c_str());
-            return  std::make_shared<Literal>();
-        }
+        ClassLiteral *classl = var.as<ClassLiteral>();
+        ClassLiteral *owner = nullptr;
 
-        std::string action = node->name.lexeme;
+        const std::string &action = node->name.lexeme;
 
      //   INFO("Get Class: %s function %s", classl->name.c_str(), action.c_str());
 
 
-        ExprPtr value = classl->environment->get(action);
-        if (!value)  
+        Value value = find_method(classl, node, owner);
+        if (value.isEmpty())
         {
            ERROR("Function '%s' not found in class" ,action.c_str());
-           return  std::make_shared<Literal>();
+           return Value::nil();
         }
-        if (value->type == ExprType::L_FUNCTION)
+        if (value.isObject(O_FUNCTION))
         {
-            ExprPtr result = nullptr;
-            prefEnv = classl->environment;
-            std::shared_ptr<CallExpr> call = std::make_shared<CallExpr>();
-            call->name = node->name;
-            call->callee = value;
-            call->args = node->values;
+            std::vector<Value> args;
+            args.reserve(node->values.size());
+            for (u32 i = 0; i < node->values.size(); i++)
+            {
+                args.push_back(evaluate(node->values[i]));
+            }
 
-          
+            ClassLiteral *previousInstance = instance;
+            ClassLiteral *previousHolder = holder;
+            Environment *previousPref = prefEnv;
+            instance = classl;
+            holder = owner;
+            prefEnv = classl->environment;
 
+            Value result;
             try
             {
-                result = visit_call_function_member(call.get(), value.get(), classl);
+                result = call_function(value.as<Function>(), args, node->name, classl->environment, classl);
             }
             catch (const std::exception &e)
             {
+                instance = previousInstance;
+                holder = previousHolder;
+                prefEnv = previousPref;
                 ERROR("Fail  to execute '%s' function", action.c_str());
-                return  std::make_shared<Literal>();
+                return Value::nil();
             }
 
 
-            instance= nullptr;
-            prefEnv = nullptr;
+            instance = previousInstance;
+            holder = previousHolder;
+            prefEnv = previousPref;
             return result;
-        } else 
+        } else
         {
             ERROR("Function '%s' not found in class" ,action.c_str());
         }
 
 
-        return  std::make_shared<Literal>();
+        return Value::nil();
 }
-    
 
-ExprPtr Compiler::visit_get_definition(GetDefinitionExpr *node)
+
+Value Compiler::visit_get_definition(GetDefinitionExpr *node)
 {
 
     //  INFO("GET Built int defenition: %s ", node->name.lexeme.c_str());
- 
 
-    ExprPtr var     = evaluate(node->variable);    
-
-    if (var->type == ExprType::L_ARRAY)
-    {
-       return ProcessArray(var.get(), node);
-    } else if (var->type == ExprType::L_MAP)
+    if (node->super && holder != nullptr && !holder->base.isEmpty())
     {
-        return ProcessMap(var.get(), node);
-    } else if (var->type == ExprType::L_CLASS)
-    {
-
+        return ProcessClass(holder->base, node);
+    }
 
-        return ProcessClass(var.get(), node);
-    } else if (var->type == ExprType::L_STRING)
+    Value var     = evaluate(node->variable);
+    if (!var.isObject())
     {
-        return ProcessString(var.get(), node);
-    } else if (var->type == ExprType::L_NUMBER)
+        return var;
+    }
+
+    switch (var.asObject()->type)
     {
-     //   return ProcessNumber(var.get(), node);
+        case O_ARRAY:  return ProcessArray(var, node);
+        case O_MAP:    return ProcessMap(var, node);
+        case O_CLASS:  return ProcessClass(var, node);
+        case O_STRING: return ProcessString(var, node);
+        default:       break;
     }
 
 
-    
     return var;
 }
 
-ExprPtr Compiler::visit_get(GetExpr *node)
+Value Compiler::get_member(const Value &object, const Token &name)
 {
- //   INFO("GET arg: %s  ", node->name.lexeme.c_str());
-
-    
-    ExprPtr object = evaluate(node->object);
-    if (object->type==ExprType::L_STRUCT)
+    if (object.isObject(O_STRUCT))
     {
-        StructLiteral *sl = static_cast<StructLiteral *>(object.get());
-        if (sl->members.find(node->name.lexeme) != sl->members.end())
+        StructLiteral *sl = object.as<StructLiteral>();
+        int slot = sl->layout->find(name.lexeme);
+        if (slot >= 0)
         {
-            ExprPtr value = sl->members[node->name.lexeme];
-            return value;
-        } else 
+            return sl->values()[slot];
+        } else
         {
-            ERROR("Member not found: %s", node->name.lexeme.c_str());
-            return  std::make_shared<Literal>();
+            ERROR("Member not found: %s", name.lexeme.c_str());
+            return Value::nil();
         }
-    } else if (object->type == ExprType::L_ARRAY)
+    } else if (object.isObject(O_ARRAY))
     {
-        WARNING("TODO Array GET: %s", node->name.lexeme.c_str());
-    } else if (object->type == ExprType::L_MAP)
+        WARNING("TODO Array GET: %s", name.lexeme.c_str());
+    } else if (object.isObject(O_MAP))
     {
-        WARNING("TODO Map GET: %s", node->name.lexeme.c_str());
-        
-    } else if (object->type == ExprType::L_CLASS)
+        WARNING("TODO Map GET: %s", name.lexeme.c_str());
+
+    } else if (object.isObject(O_CLASS))
     {
-        std::string action = node->name.lexeme;
-        ClassLiteral *cl = static_cast<ClassLiteral *>(object.get());
-        ExprPtr key = cl->environment->get(action);
-        if (key)
+        Value key = object.as<ClassLiteral>()->environment->get(name.lexeme);
+        if (!key.isEmpty())
         {
             return key;
-           
-        }   else 
+
+        }   else
         {
-            WARNING("Class member not found: %s", action.c_str());
-            return  std::make_shared<Literal>();
+            WARNING("Class member not found: %s", name.lexeme.c_str());
+            return Value::nil();
         }
-    } else if (object->type == ExprType::L_STRING)
+    } else if (object.isString())
     {
-        INFO("TODO String GET: %s", node->name.lexeme.c_str());
-        
-    } else if (object->type == ExprType::L_NUMBER)
+        INFO("TODO String GET: %s", name.lexeme.c_str());
+
+    } else if (object.isNumber())
+    {
+        INFO("TODO Number GET: %s", name.lexeme.c_str());
+    }
+    return object;
+}
+
+Value Compiler::visit_get(GetExpr *node)
+{
+ //   INFO("GET arg: %s  ", node->name.lexeme.c_str());
+
+    Value object = evaluate(node->object);
+    if (object.isObject(O_STRUCT))
+    {
+        Value *slot = field(object.as<StructLiteral>(), node->name, node->cache);
+        if (slot != nullptr)
+        {
+            return *slot;
+        }
+        ERROR("Member not found: %s", node->name.lexeme.c_str());
+        return Value::nil();
+    }
+    if (object.isObject(O_CLASS) && object.as<ClassLiteral>()->instance())
+    {
+        if (Value *slot = field(object.as<ClassLiteral>(), node->name, node->cache))
+        {
+            return *slot;
+        }
+    }
+    return get_member(object, node->name);
+}
+
+// a hit is one pointer compare, a miss looks the name up and refills the cache
+Value *Compiler::field(StructLiteral *sl, const Token &name, FieldCache &cache)
+{
+    if (cache.layout != sl->layout)
+    {
+        int slot = sl->layout->find(name.lexeme);
+        if (slot < 0)
+        {
+            return nullptr;
+        }
+        cache.layout = sl->layout;
+        cache.slot = (u32)slot;
+    }
+    return &sl->values()[cache.slot];
+}
+
+// the same for the fields of an instance, nullptr for its methods
+Value *Compiler::field(ClassLiteral *cl, const Token &name, FieldCache &cache)
+{
+    if (cache.shape != cl->shape)
     {
-        INFO("TODO Number GET: %s", node->name.lexeme.c_str());   
+        int slot = cl->shape->find(name.lexeme);
+        if (slot < 0)
+        {
+            return nullptr;
+        }
+        cache.shape = cl->shape;
+        cache.slot = (u32)slot;
     }
-    return  object;
+    return &cl->environment->slot(cache.slot);
 }
 
-ExprPtr Compiler::visit_self(SelfExpr *node)
+Value Compiler::visit_self(SelfExpr *node)
 {
     if (instance==nullptr)
     {
         ERROR("Self must be call from a class");
-        return  std::make_shared<Literal>();
+        return Value::nil();
     }
-    return instance;
+    return Value(instance);
 }
 
-ExprPtr Compiler::visit_super(SuperExpr *node)
+Value Compiler::visit_super(SuperExpr *node)
 {
 
     if (instance==nullptr)
     {
         ERROR("Super must be call from a child class");
-        return  std::make_shared<Literal>();
+        return Value::nil();
     }
     if(!instance->isChild)
     {
         ERROR("Super must be call from a child class");
-        return  std::make_shared<Literal>();
+        return Value::nil();
     }
-    return instance;
+    return Value(instance);
 }
 
-ExprPtr Compiler::visit_set(SetExpr *node)
+void Compiler::set_member(const Value &object, const Token &name, Value value)
 {
-
-    
-    ExprPtr object = evaluate(node->object);
-    if (object->type==ExprType::L_STRUCT)
+    if (object.isObject(O_STRUCT))
     {
-        StructLiteral *sl = static_cast<StructLiteral *>(object.get());
-
-       // INFO("SET arg: %s", node->name.lexeme.c_str());
-
-        if (sl->members.find(node->name.lexeme) != sl->members.end())
+        StructLiteral *sl = object.as<StructLiteral>();
+        int slot = sl->layout->find(name.lexeme);
+        if (slot >= 0)
         {
-            ExprPtr value = evaluate(node->value);
-            sl->members[node->name.lexeme] = std::move(value);
+            if (!sl->layout->types.empty())
+            {
+                check_type(sl->layout->types[slot], value, sl->layout->name + "." + name.lexeme, name.line);
+            }
+            sl->values()[slot] = std::move(value);
         }
 
-
-
-
-    } else if (object->type == ExprType::L_ARRAY)
+    } else if (object.isObject(O_ARRAY))
     {
-        WARNING("TODO Array SET: %s", node->name.lexeme.c_str());
-    } else if (object->type == ExprType::L_MAP)
+        WARNING("TODO Array SET: %s", name.lexeme.c_str());
+    } else if (object.isObject(O_MAP))
     {
-        WARNING("TODO Map SET: %s", node->name.lexeme.c_str());
-    } else if (object->type == ExprType::L_CLASS)
+        WARNING("TODO Map SET: %s", name.lexeme.c_str());
+    } else if (object.isObject(O_CLASS))
     {
-        std::string action = node->name.lexeme;
-       // WARNING("TODO Class SET: %s", action.c_str());
-        
-        ClassLiteral *cl = static_cast<ClassLiteral *>(object.get());
-        ExprPtr key = cl->environment->get(action);
-
-        if (key)
+        ClassLiteral *cl = object.as<ClassLiteral>();
+        Environment *env = cl->environment;
+        int slot = cl->instance() ? cl->shape->find(name.lexeme) : -1;
+        if (slot >= 0)
         {
-               ExprPtr value = evaluate(node->value);
-               cl->environment->set(action, std::move(value));
-           
-        }   else 
+            env->slot(slot) = std::move(value);
+        }
+        else if (!env->get(name.lexeme).isEmpty())
         {
-            WARNING("Class member not found: %s", action.c_str());
+            // a method or `super`, it is this instance's own from now on
+            if (cl->instance())
+                cl->add(name.lexeme, std::move(value));
+            else
+               env->set(name.lexeme, std::move(value));
+
+        }   else
+        {
+            WARNING("Class member not found: %s", name.lexeme.c_str());
         }
 
 
-    } else 
+    } else
     {
-        ERROR("SET not implemented for %s", object->toString().c_str());
+        ERROR("SET not implemented for %s", object.typeName());
     }
-    return object;
 }
 
-ExprPtr Compiler::visit_now_expression(NowExpr *node)
+Value Compiler::visit_set(SetExpr *node)
 {
-    std::shared_ptr<NumberLiteral> result = std::make_shared<NumberLiteral>();
-    
-    result->value = time_now();
-    return result;
+    Value object = evaluate(node->object);
+    if (object.isObject(O_STRUCT))
+    {
+        StructLiteral *sl = object.as<StructLiteral>();
+        Value value = evaluate(node->value);
+        Value *slot = field(sl, node->name, node->cache);
+        if (slot != nullptr)
+        {
+            if (!sl->layout->types.empty())
+            {
+                check_type(sl->layout->types[node->cache.slot], value, sl->layout->name + "." + node->name.lexeme, node->name.line);
+            }
+            *slot = value;
+        }
+        return value;
+    }
+    if (object.isObject(O_CLASS) && object.as<ClassLiteral>()->instance())
+    {
+        Value value = evaluate(node->value);
+        if (Value *slot = field(object.as<ClassLiteral>(), node->name, node->cache))
+        {
+            *slot = value;
+        }
+        else
+        {
+            set_member(object, node->name, value);
+        }
+        return value;
+    }
+    Value value = evaluate(node->value);
+    set_member(object, node->name, value);
+    return value;
+}
+
+Value Compiler::visit_now_expression(NowExpr *node)
+{
+    return Value::number(time_now());
 }
 
 
@@ -942,6 +1221,34 @@ u8 Compiler::execute(Stmt *stmt)
     {
         return 0;
     }
+#ifdef BULANG_SWITCH_EVAL
+    switch (stmt->type)
+    {
+        case StmtType::EXPRESSION:
+        {
+            ExpressionStmt *node = static_cast<ExpressionStmt *>(stmt);
+            if (node->expression != nullptr)
+            {
+                evaluate(node->expression);
+                return C_NORMAL;
+            }
+            break;
+        }
+        case StmtType::BLOCK:       return Compiler::visit_block_smt(static_cast<BlockStmt *>(stmt));
+        case StmtType::DECLARATION: return Compiler::visit_declaration(static_cast<Declaration *>(stmt));
+        case StmtType::IF:          return Compiler::visit_if(static_cast<IFStmt *>(stmt));
+        case StmtType::WHILE:       return Compiler::visit_while(static_cast<WhileStmt *>(stmt));
+        case StmtType::FOR:         return Compiler::visit_for(static_cast<ForStmt *>(stmt));
+        case StmtType::FROM:        return Compiler::visit_from(static_cast<FromStmt *>(stmt));
+        case StmtType::DO:          return Compiler::visit_do(static_cast<DoStmt *>(stmt));
+        case StmtType::RETURN:      return Compiler::visit_return(static_cast<ReturnStmt *>(stmt));
+        case StmtType::BREAK:       return Compiler::visit_break(static_cast<BreakStmt *>(stmt));
+        case StmtType::CONTINUE:    return Compiler::visit_continue(static_cast<ContinueStmt *>(stmt));
+        case StmtType::PRINT:       return Compiler::visit_print_smt(static_cast<PrintStmt *>(stmt));
+        default:
+            break;
+    }
+#endif
     return stmt->visit(*this);
 }
 
@@ -954,20 +1261,43 @@ void Compiler::clear()
 
 u8 Compiler::execte_block(BlockStmt *node, Environment *env)
 {
-    u8 result = 0;
+    u8 result = C_NORMAL;
     auto previousEnvironment = environment;
     environment = env;
     try
     {
         for (auto &s : node->statements)
         {
-            result |=  execute(s.get());
+            result = execute(s.get());
+            if (result != C_NORMAL)
+            {
+                break;
+            }
         }
-    } 
-    catch (const FatalException &e)
+    }
+    catch (...)
     {
         environment = previousEnvironment;
-        throw e;
+        throw;
+    }
+
+    environment = previousEnvironment;
+    return result;
+}
+
+u8 Compiler::execte_code(const std::function<u8()> &code, Environment *env)
+{
+    u8 result = C_NORMAL;
+    auto previousEnvironment = environment;
+    environment = env;
+    try
+    {
+        result = code();
+    }
+    catch (...)
+    {
+        environment = previousEnvironment;
+        throw;
     }
 
     environment = previousEnvironment;
@@ -979,14 +1309,14 @@ u8 Compiler::visit_block_smt(BlockStmt *node)
     if (!node) return  0;
 
     Environment * prev = environment;
- 
-    std::shared_ptr<Environment> env = std::make_shared<Environment>(environment);
-    
 
-   
+    std::shared_ptr<Environment> env = std::make_shared<Environment>(environment, node->scope.get());
+
+
+
     u8 result = execte_block(node, env.get());
 
-    
+
     environment = prev;
 
     return result;
@@ -1009,84 +1339,37 @@ u8 Compiler::visit_print_smt(PrintStmt *node)
 {
     if (!node) return  0;
 
- 
-
-    ExprPtr result = evaluate(node->expression);
-    if (result == nullptr)
-    {
-        WARNING("[PRINT] Unknown expression type");
-        return 0;
-    }
-
+    Value result = evaluate(node->expression);
+    result.print();
 
+  return 0;
+}
 
 
+Value Compiler::visit_read_variable(Variable *node)
+{
 
-    if (result->type == ExprType::L_NUMBER)
-    {
-        NumberLiteral *nl = static_cast<NumberLiteral *>(result.get());
-        nl->print();
-      //  printf("Variable: %p print\n", (void*)&node->expression);
-         
-    }
-    else if (result->type == ExprType::L_STRING)
-    {
-        StringLiteral *sl = static_cast<StringLiteral *>(result.get());
-        sl->print();
-    } else if (result->type == ExprType::LITERAL)
-    {
-        PRINT("nil");
-    } else if (result->type == ExprType::L_STRUCT)
-    {
-        StructLiteral *sl = static_cast<StructLiteral *>(result.get());
-        sl->print();
 
-    } else if (result->type == ExprType::L_ARRAY)
-    {
-        ArrayLiteral *al = static_cast<ArrayLiteral *>(result.get());
-        al->print();
-    } else if (result->type == ExprType::L_MAP)
-    {
-        MapLiteral *ml = static_cast<MapLiteral *>(result.get());
-        ml->print();
-    } else if (result->type == ExprType::L_CLASS)
+    Value result;
+    if (node->slot >= 0)
     {
-        ClassLiteral *cl = static_cast<ClassLiteral *>(result.get());
-        cl->print();
+        result = environment->getAt(node->depth, node->slot);
     }
-    
-    else 
+    if (result.isEmpty())
     {
-       WARNING("[PRINT] Unknown literal type %s", result->toString().c_str());
+        result = environment->get(node->name.lexeme);
     }
-   
-  return 0;
-}
-
-
-ExprPtr Compiler::visit_read_variable(Variable *node)
-{
-
-
-    ExprPtr result = environment->get(node->name.lexeme);
-    if (result == nullptr)
+    if (result.isEmpty())
     {
         if (prefEnv != nullptr)
         {
             result= prefEnv->get(node->name.lexeme);
-            if (result != nullptr) return result;
-        } 
-    
+            if (!result.isEmpty()) return result;
+        }
+
 
         throw FatalException("Undefined variable: '" + node->name.lexeme +"' at line "+ std::to_string(node->name.line ));
     }
-    // if (result->type == ExprType::LITERAL)
-    // {
-    //   WARNING("Variable: %s is not initialized", node->name.lexeme.c_str());
-    // }
-
-
-  //  printf("read Variable: %x get\n", &result);
 
     return result;
 }
@@ -1104,7 +1387,21 @@ u8 Compiler::visit_declaration(Declaration *node)
         //INFO("Variable: %s", name.lexeme.c_str());
 
 
-        ExprPtr  value = evaluate(node->initializer);
+        Value  value = evaluate(node->initializer);
+        if (node->annotation != A_NONE)
+        {
+            check_type(node->annotation, value, name.lexeme, name.line);
+        }
+        if (!node->slots.empty())
+        {
+            for (u32 i = 0; i < node->names.size(); i++)
+            {
+                if (node->slots[i] >= 0)
+                    environment->defineAt(node->slots[i], value);
+                else
+                    environment->define(node->names[i].lexeme, value);
+            }
+        } else
         if (node->names.size() == 1)
         {
             if (!environment->define(name.lexeme, value))
@@ -1113,10 +1410,10 @@ u8 Compiler::visit_declaration(Declaration *node)
             }
         } else
         {
-            for (u32 i = 1; 0 < node->names.size(); i++)
+            for (u32 i = 0; i < node->names.size(); i++)
             {
                 Token name = node->names[i];
-                if (environment->define(node->names[i].lexeme, value))
+                if (!environment->define(node->names[i].lexeme, value))
                 {
                     WARNING("Variable already defined: %s at line %d", name.lexeme.c_str() ,name.line );
                 }
@@ -1130,37 +1427,14 @@ u8 Compiler::visit_declaration(Declaration *node)
     return 0;
 }
 
-static bool is_truthy(ExprPtr expr)
+static inline bool is_truthy(const Value &value)
 {
-    if (expr == nullptr)
-    {
-        return false;
-    }
-    if (expr->type == ExprType::L_NUMBER)
-    {
-        NumberLiteral *nl = static_cast<NumberLiteral *>(expr.get());
-        return nl->value != 0;
-    }
-    return true;
+    return value.isTruthy();
 }
 
-static bool is_equal(ExprPtr a, ExprPtr b)
+static inline bool is_equal(const Value &a, const Value &b)
 {
-    if (a == nullptr && b == nullptr) return true;
-    if (a->type != b->type) return false;
-    if (a->type == ExprType::L_NUMBER && b->type == ExprType::L_NUMBER)
-    {
-        NumberLiteral *nl = static_cast<NumberLiteral *>(a.get());
-        NumberLiteral *nl2 = static_cast<NumberLiteral *>(b.get());
-        return nl->value == nl2->value;
-    }
-    if (a->type == ExprType::L_STRING && b->type == ExprType::L_STRING)
-    {
-        StringLiteral *sl = static_cast<StringLiteral *>(a.get());
-        StringLiteral *sl2 = static_cast<StringLiteral *>(b.get());
-        return sl->value == sl2->value;
-    }
-    return true;
+    return a.equals(b);
 }
 
 u8 Compiler::visit_if(IFStmt *node)
@@ -1169,27 +1443,26 @@ u8 Compiler::visit_if(IFStmt *node)
        auto previousEnvironment = environment;
 
     //INFO("Visit if: %s", node->condition->toString().c_str());
-    ExprPtr condition = evaluate(node->condition);
-    u8 result = 0;
+    u8 result = C_NORMAL;
+    bool taken = false;
 
     
-    if (is_truthy(condition))
+    if (is_true(node->condition))
     {
         result = execute(node->then_branch.get());
-        
+        taken = true;
     }
     
-    for (auto elif : node->elifBranch)
+    for (u32 i = 0; !taken && i < node->elifBranch.size(); i++)
     {
-        condition = evaluate(elif->condition);
-        if (is_truthy(condition))
+        if (is_true(node->elifBranch[i]->condition))
         {
-            result =  execute(elif->then_branch.get());
-            break;
+            result =  execute(node->elifBranch[i]->then_branch.get());
+            taken = true;
         }
     }
     
-    if (node->else_branch != nullptr)
+    if (!taken && node->else_branch != nullptr)
     {
         result = execute(node->else_branch.get());
     }
@@ -1205,39 +1478,30 @@ u8 Compiler::visit_if(IFStmt *node)
 u8 Compiler::visit_while(WhileStmt *node)
 {
     auto previousEnvironment = environment;
+    u8 completion = C_NORMAL;
 
     loop_count++;
 
-    ExprPtr condition =nullptr;
-    
     while (true)
     {
 
         
-            condition = evaluate(node->condition);
-           
-            if (!is_truthy(condition))
+            if (!is_true(node->condition))
             {
                 break;
             }
            
 
 
-        try  
-        {
-
-        
-                execute(node->body.get());
-
-            
-        }
-        catch (const BreakException &e)
+        u8 result = execute(node->body.get());
+        if (result == C_BREAK)
         {
             break;
         }
-
-        catch (const ContinueException &e)
+        if (result == C_RETURN)
         {
+            completion = C_RETURN;
+            break;
         }
       
     }
@@ -1247,33 +1511,33 @@ u8 Compiler::visit_while(WhileStmt *node)
     environment = previousEnvironment;
    
   
-    return 0;
+    return completion;
 }
 
 
 u8 Compiler::visit_do(DoStmt *node)
 {
     loop_count++;
+    u8 completion = C_NORMAL;
 
     do 
     {
-        try 
-        {
-            execute(node->body.get());
-        }
-        catch (const BreakException &e)
+        u8 result = execute(node->body.get());
+        if (result == C_BREAK)
         {
             break;
         }
-        catch (const ContinueException &e)
+        if (result == C_RETURN)
         {
+            completion = C_RETURN;
+            break;
         }
-    } while (is_truthy(evaluate(node->condition)));
+    } while (is_true(node->condition));
     loop_count--;
 
 
 
-    return 0;
+    return completion;
 }
 
 
@@ -1283,8 +1547,12 @@ u8 Compiler::visit_program(Program *node)
 
     for (auto &s : node->statements)
     {
-        execute(s.get());
+        if (execute(s.get()) == C_RETURN)
+        {
+            break;
+        }
     }
+    returnValue = Value();
 
 
     environment = previousEnvironment;
@@ -1294,19 +1562,42 @@ u8 Compiler::visit_program(Program *node)
 
 u8 Compiler::visit_function(FunctionStmt *node)
 {
-    std::shared_ptr<Function> function = std::make_shared<Function>();
+    Function *function = new Function();
+    Value value(function);
 
     function->name = node->name;
     function->arity = node->args.size();
 
     for (u32 i = 0; i < node->args.size(); i++)
     {
-        function->args[i]=std::move(node->args[i]);
+        function->args[i]=std::move(node->args[i]);
+    }
+    function->body = std::move(node->body);
+    function->argTypes = node->argTypes;
+    function->result = node->result;
+    if (node->memo)
+    {
+        function->memo = std::make_shared<MemoTable>();
+        function->memo->name = function->name.lexeme;
+        function->memo->capacity = node->memoSize;
+        function->nojit = true;   // native code calls itself around the cache
+        memos.push_back(function->memo);
+    }
+    if (binder != nullptr && function->body)
+    {
+        function->code = binder->compile_body(static_cast<BlockStmt *>(function->body.get()));
+    }
+    else if (!bodies.empty())
+    {
+        auto it = bodies.find(function->body.get());
+        if (it != bodies.end())
+        {
+            function->code = it->second;
+        }
     }
-    function->body = std::move(node->body);
     
 
-    environment->define(function->name.lexeme,function);
+    environment->define(function->name.lexeme, std::move(value));
 
 
     return 0;
@@ -1321,8 +1612,6 @@ u8 Compiler::visit_struct(StructStmt *node)
     }
     
    
-    std::shared_ptr<StructLiteral> sl = std::make_shared<StructLiteral>();
-    sl->name = node->name.lexeme;
     Environment *local = new Environment(environment);
     auto previousEnvironment = environment;
     environment = local;
@@ -1334,13 +1623,39 @@ u8 Compiler::visit_struct(StructStmt *node)
          index--;
     }
 
-    std::unordered_map<std::string, ExprPtr> values = environment->values();
-    sl->members = std::move(values);
+    // declaration order, so positional constructor arguments are stable
+    auto layout = std::make_shared<StructLayout>();
+    layout->name = node->name.lexeme;
+    for (auto &value : node->values)
+    {
+        if (value->type == StmtType::DECLARATION)
+        {
+            Declaration *decl = static_cast<Declaration *>(value.get());
+            for (auto &name : decl->names)
+            {
+                layout->add(name.lexeme, decl->annotation);
+            }
+        }
+        else if (value->type == StmtType::ARRAY)
+        {
+            layout->add(static_cast<ArrayStmt *>(value.get())->name.lexeme, A_NONE);
+        }
+        else if (value->type == StmtType::MAP)
+        {
+            layout->add(static_cast<MapStmt *>(value.get())->name.lexeme, A_NONE);
+        }
+    }
+    StructLiteral *sl = StructLiteral::create(layout, (u32)layout->fields.size());
+    Value result(sl);
+    for (u32 i = 0; i < sl->count; i++)
+    {
+        sl->values()[i] = environment->get(layout->fields[i]);
+    }
 
 
     environment = previousEnvironment;
  
-    environment->define(node->name.lexeme, std::move(sl));
+    environment->define(node->name.lexeme, std::move(result));
     delete local;
 
   
@@ -1365,7 +1680,8 @@ u8 Compiler::visit_class(ClassStmt *node)
 
 
     
-    std::shared_ptr<ClassLiteral> cl = std::make_shared<ClassLiteral>();
+    ClassLiteral *cl = new ClassLiteral();
+    Value value(cl);
     cl->environment= new Environment(environment);
     
     cl->name = node->name.lexeme;
@@ -1391,10 +1707,25 @@ u8 Compiler::visit_class(ClassStmt *node)
         for (u32 i = 0; i < node->fields.size(); i++)
         {
             execute(node->fields[i].get());
+            Stmt *field = node->fields[i].get();
+            if (field->type == StmtType::DECLARATION)
+            {
+                for (auto &name : static_cast<Declaration *>(field)->names)
+                    cl->fields.push_back(name.lexeme);
+            }
+            else if (field->type == StmtType::ARRAY)
+            {
+                cl->fields.push_back(static_cast<ArrayStmt *>(field)->name.lexeme);
+            }
+            else if (field->type == StmtType::MAP)
+            {
+                cl->fields.push_back(static_cast<MapStmt *>(field)->name.lexeme);
+            }
         }
         for (u32 i = 0; i < node->methods.size(); i++)
         {
             execute(node->methods[i].get());
+            cl->methods.push_back(static_cast<FunctionStmt *>(node->methods[i].get())->name.lexeme);
         }
         
     }
@@ -1413,7 +1744,14 @@ u8 Compiler::visit_class(ClassStmt *node)
 
 
     environment = previousEnvironment;
-    environment->define(node->name.lexeme, cl);
+    environment->define(node->name.lexeme, value);
+
+    // a parent declared before the class is bound now, one declared later on first call
+    Value parent = cl->isChild ? environment->get(cl->parentName) : Value();
+    if (!cl->isChild || (parent.isObject(O_CLASS) && parent.as<ClassLiteral>()->prepared))
+    {
+        prepare_class(cl);
+    }
 
    
 
@@ -1425,15 +1763,16 @@ u8 Compiler::visit_array(ArrayStmt *node)
 {
   //  INFO("Visit array: %s", node->name.lexeme.c_str());
     
-    std::shared_ptr<ArrayLiteral> al = std::make_shared<ArrayLiteral>();
+    ArrayLiteral *al = new ArrayLiteral();
+    Value value(al);
     al->name = node->name.lexeme;
-    if (environment->define(node->name.lexeme, std::move(al)))
+    if (environment->define(node->name.lexeme, value))
     {
         for (u32 i = 0; i < node->values.size(); i++)
         {
-            ExprPtr expr = evaluate(node->values[i]);
-            al->values.push_back(std::move(expr));
+            al->values.push_back(evaluate(node->values[i]));
         }
+        al->frozen = node->constant;
     }
     return 0;
 }
@@ -1441,26 +1780,27 @@ u8 Compiler::visit_array(ArrayStmt *node)
 u8 Compiler::visit_map(MapStmt *node)
 {
   //  INFO("Visit map: %s", node->name.lexeme.c_str());
-    std::shared_ptr<MapLiteral> ml = std::make_shared<MapLiteral>();
+    MapLiteral *ml = new MapLiteral();
+    Value value(ml);
     
     ml->name = node->name.lexeme;
    
 
-    if (environment->define(node->name.lexeme, std::move(ml)))
+    if (environment->define(node->name.lexeme, value))
     {
         auto it = node->values.begin();
         for (; it != node->values.end(); it++)
         {
-            ExprPtr key  = evaluate(it->first);
-            if (key->type != ExprType::L_STRING && key->type != ExprType::L_NUMBER)
+            Value key  = evaluate(it->first);
+            if (!key.isString() && !key.isNumber())
             {
                 ERROR("Map key must be a string or number.");
                 return 0;
             }
 
-            ExprPtr expr = evaluate(it->second);
-            ml->values[key] = std::move(expr);
+            ml->values[key] = evaluate(it->second);
         }
+        ml->frozen = node->constant;
     }
     return 0;
 }
@@ -1469,7 +1809,7 @@ u8 Compiler::visit_for(ForStmt *node)
 {
 
    
-    std::shared_ptr<Environment> envInit = std::make_shared<Environment>(environment); 
+    std::shared_ptr<Environment> envInit = std::make_shared<Environment>(environment, node->scope.get()); 
     auto previousEnvironment = environment;
     environment = envInit.get();
 
@@ -1482,61 +1822,109 @@ u8 Compiler::visit_for(ForStmt *node)
     {
         throw e;
     }
+    Value *count = node->counted ? counter(node) : nullptr;
 
 
 
 
     loop_count++;
-    ExprPtr condition = nullptr;
-    while (true)
+    u8 completion = C_NORMAL;
+    // one environment for every iteration, cleared at the top of each
+    std::shared_ptr<Environment> local = std::make_shared<Environment>(envInit.get(), node->loopScope.get());
+    environment = local.get();
+    Value bound;
+    if (node->counted)
     {
-        
-            
-            std::shared_ptr<Environment> local = std::make_shared<Environment>(envInit.get());
+        bound = evaluate(static_cast<BinaryExpr *>(node->condition.get())->right);
+    }
+    for (bool first = true; ; first = false)
+    {
+            if (!first)
+            {
+                local->reset(node->loopScope.get());
+            }
             environment = local.get();
-            condition = evaluate(node->condition);
-            if (!is_truthy(condition))
+            if (node->counted ? !count_test(node, count, bound) : !is_true(node->condition))
             {
                 
                 break;
             }
 
-        try 
+        BlockStmt *block = static_cast<BlockStmt *>(node->body.get());
+        u8 result = execte_block(block, local.get());
+        if (result == C_BREAK)
         {
-           BlockStmt *block = static_cast<BlockStmt *>(node->body.get());
-           execte_block(block, local.get());
+            break;
         }
-        catch (const BreakException &e)
+        if (result == C_RETURN)
         {
+            completion = C_RETURN;
             break;
         }
-
-        catch (const ContinueException &e)
+        if (node->counted)
         {
-            continue;
+            count_step(node, count);
+        }
+        else
+        {
+            evaluate(node->increment);
         }
-         evaluate(node->increment);
         
       }
 
     loop_count--;
     environment = previousEnvironment;
 
-    return 0;
+    return completion;
+}
+
+// ForStmt::counted: while the counter holds a number it is compared with the bound and
+// stepped in place, neither the test nor the step node runs
+Value *Compiler::counter(ForStmt *node)
+{
+    Declaration *decl = static_cast<Declaration *>(node->initializer.get());
+    return decl->slots.empty() ? nullptr : environment->slotAt(0, decl->slots[0]);
+}
+
+bool Compiler::count_test(ForStmt *node, const Value *counter, const Value &bound)
+{
+    if (counter == nullptr || !counter->isNumber() || !bound.isNumber())
+    {
+        return is_true(node->condition);
+    }
+    double i = counter->asNumber();
+    double n = bound.asNumber();
+    switch (static_cast<BinaryExpr *>(node->condition.get())->op.type)
+    {
+        case TokenType::LESS:          return i < n;
+        case TokenType::LESS_EQUAL:    return i <= n;
+        case TokenType::GREATER:       return i > n;
+        default:                       return i >= n;
+    }
+}
+
+void Compiler::count_step(ForStmt *node, Value *counter)
+{
+    if (counter == nullptr || !counter->isNumber())
+    {
+        evaluate(node->increment);
+        return;
+    }
+    bool up = static_cast<UnaryExpr *>(node->increment.get())->op.type == TokenType::INC;
+    *counter = Value::number(counter->asNumber() + (up ? 1 : -1));
 }
 
 u8 Compiler::visit_from(FromStmt *node)
 {
 
     auto previousEnvironment = environment;
-    loop_count++;
-    ExprPtr  array = evaluate(node->array);
-    if (!array || array->type != ExprType::L_ARRAY)
+    Value  array = evaluate(node->array);
+    if (!array.isObject(O_ARRAY))
     {
         ERROR("Expected array to iterate");
         return 0;
     }
-    ArrayLiteral *al = static_cast<ArrayLiteral *>(array.get());
+    ArrayLiteral *al = array.as<ArrayLiteral>();
     if (al->values.size() == 0)
     {
         return 0;
@@ -1547,50 +1935,41 @@ u8 Compiler::visit_from(FromStmt *node)
         return 0;
     }
 
+    loop_count++;
+    u8 completion = C_NORMAL;
 
-    std::shared_ptr<Environment> envInit = std::make_shared<Environment>(environment); 
+    std::shared_ptr<Environment> envInit = std::make_shared<Environment>(environment, node->scope.get()); 
     environment = envInit.get();
 
 
-    
+    // the loop variable lives in envInit, each pass only rebinds it
     Declaration *decl = static_cast<Declaration *>(node->variable.get());
-    decl->initializer = al->values[0];
     std::string name = decl->names[0].lexeme; 
-
-    execute(node->variable.get());//define the variable in the environment from
-
-
-
-
+    int slot = decl->slots.empty() ? -1 : decl->slots[0];
 
 
     for (u32 i = 0; i < al->values.size(); i++)
     {
       
-        std::shared_ptr<Environment> env = std::make_shared<Environment>(envInit.get());
+        std::shared_ptr<Environment> env = std::make_shared<Environment>(envInit.get(), node->loopScope.get());
         environment = env.get();
-        ExprPtr value = al->values[i];
-        env->set(name, value);
+        if (slot >= 0)
+            envInit->defineAt(slot, al->values[i]);
+        else
+            envInit->define(name, al->values[i]);
       
-        
             
-        try 
-        {
-            execute(node->body.get());
-        }
-        catch (const BreakException &e)
+        u8 result = execute(node->body.get());
+        if (result == C_BREAK)
         {
             break;
         }
-
-        catch (const ContinueException &e)
+        if (result == C_RETURN)
         {
+            completion = C_RETURN;
+            break;
         }
         
-
-      
-         
-        
       }
 
     loop_count--;
@@ -1601,14 +1980,28 @@ u8 Compiler::visit_from(FromStmt *node)
 
 
 
-    return 0;
+    return completion;
 }
 
 u8 Compiler::visit_return(ReturnStmt *node)
 {
-    ExprPtr value = evaluate(node->value);
-    throw ReturnException(value);
-    return 3;
+    if (node->tail)
+    {
+        CallExpr *call = static_cast<CallExpr *>(node->value.get());
+        Value callee = evaluate(call->callee);
+        if (callee.isObject(O_FUNCTION))
+        {
+            std::vector<Value> args;
+            args.reserve(call->args.size());
+            for (auto &arg : call->args)
+            {
+                args.push_back(evaluate(arg));
+            }
+            return tail_call(callee.as<Function>(), args, call->name);
+        }
+    }
+    returnValue = evaluate(node->value);
+    return C_RETURN;
 }
 
 u8 Compiler::visit_break(BreakStmt *node)
@@ -1618,8 +2011,7 @@ u8 Compiler::visit_break(BreakStmt *node)
        WARNING("BREAK outside of loop");
        return 0;
     }
-    throw BreakException("BREAK");
-    return 1;
+    return C_BREAK;
 }
 
 u8 Compiler::visit_continue(ContinueStmt *node)
@@ -1629,17 +2021,15 @@ u8 Compiler::visit_continue(ContinueStmt *node)
        WARNING("CONTINUE outside of loop");
        return 0;
     }
-   // Factory::as().free_continue(node);
-    throw ContinueException("CONTINUE");
-    return 2;
+    return C_CONTINUE;
 }
 
 u8 Compiler::visit_switch(SwitchStmt *stmt)
 {
     auto previousEnvironment = environment;
 
-    auto condition = evaluate(stmt->condition);
-    if (!condition)
+    Value condition = evaluate(stmt->condition);
+    if (condition.isEmpty())
     {
            throw FatalException("invalid switch condition");
     }
@@ -1648,8 +2038,8 @@ u8 Compiler::visit_switch(SwitchStmt *stmt)
     for (const auto &caseStmt : stmt->cases)
     {
 
-        auto result = evaluate(caseStmt->condition);
-        if (!result)
+        Value result = evaluate(caseStmt->condition);
+        if (result.isEmpty())
         {
                throw FatalException("invalid case condition");
         }
@@ -1675,8 +2065,8 @@ Compiler::Compiler(Interpreter *i, Compiler *c)
     parent = c;
 
     global = std::make_shared<Environment>(nullptr);
-    global->define("string", std::make_shared<StringLiteral>());
-    global->define("number", std::make_shared<NumberLiteral>());
+    global->define("string", Value::string(""));
+    global->define("number", Value::number(0));
     environment= global.get();
     prefEnv = nullptr;
     instance = nullptr;
@@ -1699,319 +2089,263 @@ Compiler::~Compiler()
 
 
 
-ExprPtr Compiler::visit_empty_expression(EmptyExpr *node)
+
+Value Compiler::visit_empty_expression(EmptyExpr *node)
+{
+    return Value::nil();
+}
+
+
+static Value number_binary(BinaryExpr *node, double a, double b)
+{
+    switch (node->op.type)
+    {
+        case TokenType::GREATER:       return Value::boolean(a > b);
+        case TokenType::GREATER_EQUAL: return Value::boolean(a >= b);
+        case TokenType::LESS:          return Value::boolean(a < b);
+        case TokenType::LESS_EQUAL:    return Value::boolean(a <= b);
+        case TokenType::BANG_EQUAL:    return Value::boolean(a != b);
+        case TokenType::EQUAL_EQUAL:   return Value::boolean(a == b);
+        case TokenType::PLUS:
+        case TokenType::PLUS_EQUAL:    return Value::number(a + b);
+        case TokenType::MINUS:
+        case TokenType::MINUS_EQUAL:   return Value::number(a - b);
+        case TokenType::STAR:
+        case TokenType::STAR_EQUAL:    return Value::number(a * b);
+        case TokenType::MOD:           return Value::number(std::fmod(a, b));
+        case TokenType::SLASH:
+        case TokenType::SLASH_EQUAL:
+        {
+            if (b == 0)
+            {
+                throw FatalException("Division by zero");
+            }
+            return Value::number(a / b);
+        }
+        default:
+            break;
+    }
+    throw FatalException("Invalid binary expression, With operator '"+node->op.lexeme+"'");
+}
+
+// TypeInference only marks + == and != on two strings
+static Value string_binary(BinaryExpr *node, const Value &a, const Value &b)
 {
-    return std::make_shared<Literal>();
+    switch (node->op.type)
+    {
+        case TokenType::EQUAL_EQUAL: return Value::boolean(a.asString() == b.asString());
+        case TokenType::BANG_EQUAL:  return Value::boolean(a.asString() != b.asString());
+        default:                     return Value::string(a.asString() + b.asString());
+    }
 }
 
+Value Compiler::visit_binary(BinaryExpr *node)
+{
+    Value left  = evaluate(node->left);
+    Value right = evaluate(node->right);
+    if (node->quick == Q_TYPED_NUMBER)
+    {
+        return number_binary(node, left.asNumber(), right.asNumber());
+    }
+    if (node->quick == Q_TYPED_STRING)
+    {
+        return string_binary(node, left, right);
+    }
+    if (node->quick == Q_NUMBER)
+    {
+        if (left.isNumber() && right.isNumber())
+        {
+            return number_binary(node, left.asNumber(), right.asNumber());
+        }
+        node->quick = Q_GENERIC;
+    }
+    return binary(node, left, right);
+}
 
-ExprPtr Compiler::visit_binary(BinaryExpr *node)
+Value Compiler::binary(BinaryExpr *node, const Value &left, const Value &right)
 {
-    ExprPtr left  = evaluate(node->left);
-    if(!left)
+    if (left.isEmpty())
     {
         throw FatalException("Invalid binary expression left");
-        
+
     }
-    ExprPtr right = evaluate(node->right);
-    if (!right)
+    if (right.isEmpty())
     {
         throw FatalException("Invalid binary expression right");
     }
 
-    if (left->type == ExprType::LITERAL || right->type == ExprType::LITERAL)
+    if (left.isNil() || right.isNil())
     {
         throw FatalException("Invalid binary expression. '"+ node->op.lexeme +"' Literals are not allowed at line "+ std::to_string(node->op.line));
     }
 
-    switch (node->op.type)
+    if (left.isNumber() && right.isNumber())
     {
-        case TokenType::GREATER:
+        if (node->quick == Q_NONE)
         {
-            if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value = l->value > r->value ? 1 : 0;
-
-                return result;
-            } 
-
-            break;
+            node->quick = Q_NUMBER;
         }
+        return number_binary(node, left.asNumber(), right.asNumber());
+    }
+    node->quick = Q_GENERIC;
 
-        case TokenType::GREATER_EQUAL:
+    switch (node->op.type)
+    {
+        case TokenType::PLUS:
+        case TokenType::PLUS_EQUAL://+=
         {
-            if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
+            if (left.isString() && right.isString())
+            {
+                return Value::string(left.asString() + right.asString());
+            } else if (left.isString() && right.isNumber())
             {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value = l->value >= r->value ? 1 : 0;
-                return result;
+                return Value::string(left.asString() + std::to_string(right.asNumber()));
+            } else if (left.isNumber() && right.isString())
+            {
+                return Value::string(std::to_string(left.asNumber()) + right.asString());
             }
-
             break;
         }
-
-        case TokenType::LESS:
+        case TokenType::BANG_EQUAL:
         {
-            if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
+            if ((left.isString() && right.isString()) || (left.isBool() && right.isBool()))
             {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value = l->value < r->value ? 1 : 0;
-                return result;
+                return Value::boolean(!left.equals(right));
             }
-
             break;
         }
 
-        case TokenType::LESS_EQUAL:
+        case TokenType::EQUAL_EQUAL:
         {
-            if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
+            if ((left.isString() && right.isString()) || (left.isBool() && right.isBool()))
             {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value = (l->value <= r->value) ? 1 : 0;
-                
-                return result;
+                return Value::boolean(left.equals(right));
             }
-
             break;
         }
-        case TokenType::PLUS:
-        {
-           if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value = l->value + r->value;
-                return result;
-            } else if (left->type == ExprType::L_STRING && right->type == ExprType::L_STRING)
-            {
-                StringLiteral *l = static_cast<StringLiteral *>(left.get());
-                StringLiteral *r = static_cast<StringLiteral *>(right.get());
-                std::shared_ptr<StringLiteral> result =  std::make_shared<StringLiteral>();
-                result->value = l->value + r->value;
-                return result;
-            } else if (left->type == ExprType::L_STRING && right->type == ExprType::L_NUMBER)
-            {
-                StringLiteral *l = static_cast<StringLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<StringLiteral> result =  std::make_shared<StringLiteral>();
-                result->value = l->value + std::to_string(r->value);
-
-                return result;
-            } else if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_STRING)
-            {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                StringLiteral *r = static_cast<StringLiteral *>(right.get());
-                std::shared_ptr<StringLiteral> result =  std::make_shared<StringLiteral>();
-                result->value = std::to_string(l->value) + r->value;
-                return result;
-            }
+        default:
             break;
-        }
-        case TokenType::MINUS:
-        {
-            if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value = l->value - r->value;
+    }
 
-                return result;
-            }
-            break;
-        }
-        case TokenType::SLASH:
-        {
-            if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                if (r->value == 0)
-                {
 
-                    throw FatalException("Division by zero");
-                }
-                result->value = l->value / r->value;
+    throw FatalException("Invalid binary expression, With operator '"+node->op.lexeme+"'");
 
 
-                return result;
-            }
-            break;
-        }
-        case TokenType::STAR:
-        {
-            if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
-            {
-               NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();   
-                result->value = l->value * r->value;
+}
 
-                return result;
-            }
-            break;
-        }
-        case TokenType::MOD:
+bool Compiler::is_true(const ExprPtr &condition)
+{
+    // compare-then-branch: a quickened number comparison hands back a plain bool
+    if (condition && condition->type == ExprType::BINARY)
+    {
+        BinaryExpr *node = static_cast<BinaryExpr *>(condition.get());
+        if (node->quick == Q_NUMBER || node->quick == Q_TYPED_NUMBER)
         {
-            if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
+            Value left  = evaluate(node->left);
+            Value right = evaluate(node->right);
+            if (node->quick == Q_TYPED_NUMBER || (left.isNumber() && right.isNumber()))
             {
-               NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value =std::fmod(l->value, r->value);
-   
-   
-                return result;
+                double a = left.asNumber();
+                double b = right.asNumber();
+                switch (node->op.type)
+                {
+                    case TokenType::LESS:          return a < b;
+                    case TokenType::LESS_EQUAL:    return a <= b;
+                    case TokenType::GREATER:       return a > b;
+                    case TokenType::GREATER_EQUAL: return a >= b;
+                    case TokenType::EQUAL_EQUAL:   return a == b;
+                    case TokenType::BANG_EQUAL:    return a != b;
+                    default:                       return number_binary(node, a, b).isTruthy();
+                }
             }
-            break;
+            node->quick = Q_GENERIC;
+            return binary(node, left, right).isTruthy();
         }
-        case TokenType::BANG_EQUAL:
+    }
+    return evaluate(condition).isTruthy();
+}
+
+Value Compiler::visit_unary(UnaryExpr *expr)
+{
+    if (expr->op.type == TokenType::INC || expr->op.type == TokenType::DEC)
+    {
+        // numbers are values, so ++/-- store the result back into the variable or member
+        double delta = expr->op.type == TokenType::INC ? 1 : -1;
+        if (expr->quick == Q_SLOT_NUMBER)
         {
-            if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
+            // load, add and store straight into the resolved slot
+            Variable *var = static_cast<Variable *>(expr->right.get());
+            Value *slot = environment->slotAt(var->depth, var->slot);
+            if (slot != nullptr && slot->isNumber())
             {
-               NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value = l->value != r->value ? 1 : 0;
-   
-                return result;
-            } else if (left->type == ExprType::L_STRING && right->type == ExprType::L_STRING)
-            {
-                StringLiteral *l = static_cast<StringLiteral *>(left.get());
-                StringLiteral *r = static_cast<StringLiteral *>(right.get());
-               std::shared_ptr< NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value = l->value != r->value ? 1 : 0;
-                return result;
+                double value = slot->asNumber();
+                *slot = Value::number(value + delta);
+                return Value::number(expr->isPrefix ? value + delta : value);
             }
-            break;
+            expr->quick = Q_GENERIC;
         }
-
-        case TokenType::EQUAL_EQUAL:
+        Value object;
+        Value right;
+        GetExpr *get = nullptr;
+        if (expr->right->type == ExprType::GET)
         {
-            if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value = l->value == r->value ? 1 : 0;
-
-                return result;
-            } else if (left->type == ExprType::L_STRING && right->type == ExprType::L_STRING)
-            {
-                StringLiteral *l = static_cast<StringLiteral *>(left.get());
-                StringLiteral *r = static_cast<StringLiteral *>(right.get());
-                std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                result->value = l->value == r->value ? 1 : 0;
-
-                return result;
-            }
-            break;
+            get = static_cast<GetExpr *>(expr->right.get());
+            object = evaluate(get->object);
+            right = get_member(object, get->name);
         }
-        case TokenType::PLUS_EQUAL://+=
+        else
         {
-              if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-               // std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-               // result->value = l->value += r->value;
-
-                l->value += r->value;
-
-                return left;
-            }
-            break;
+            right = evaluate(expr->right);
         }
-        case TokenType::MINUS_EQUAL:// -=
+        if (!right.isNumber())
         {
-             if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
-            {
-             
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                //std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-
-              //  INFO("l: %f, r: %f", l->value, r->value);
-
-                l->value -= r->value;
-
-                return left;
-                
-
-                //result->value = l->value -= r->value;
-
-             //   return result;
-            }
-            break;
+            throw FatalException("Invalid unary expression, With operator '"+expr->op.lexeme+"'");
         }
-        case TokenType::STAR_EQUAL:// *=
+
+        Value result = Value::number(right.asNumber() + delta);
+        if (get != nullptr)
         {
-             if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                //std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                //result->value = l->value *= r->value;
-                //return result;
-
-                l->value *= r->value;
-                return left;
-            }
-            break;
+            set_member(object, get->name, result);
         }
-        case TokenType::SLASH_EQUAL:// /=
+        else if (expr->right->type == ExprType::VARIABLE)
         {
-             if (left->type == ExprType::L_NUMBER && right->type == ExprType::L_NUMBER)
+            Variable *var = static_cast<Variable *>(expr->right.get());
+            assign_variable(var->name, var->depth, var->slot, result);
+            if (expr->quick == Q_NONE)
             {
-                NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-                NumberLiteral *r = static_cast<NumberLiteral *>(right.get());
-                //std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-                //result->value = l->value /= r->value;
-                if (r->value == 0)
-                {
-                     throw FatalException("Division by zero");
-                }
-
-                l->value /= r->value;
-                return left;
-
-                //return result;
+                expr->quick = var->slot >= 0 ? Q_SLOT_NUMBER : Q_GENERIC;
             }
-            break;
         }
-        default:
-            break;
+        return expr->isPrefix ? result : right;
     }
 
-    
-    throw FatalException("Invalid binary expression, With operator '"+node->op.lexeme+"'");
-
-    
+    Value right = evaluate(expr->right);
+    if (expr->quick == Q_TYPED_NUMBER)
+    {
+        return Value::number(-right.asNumber());
+    }
+    if (expr->quick == Q_NUMBER)
+    {
+        if (right.isNumber())
+        {
+            return Value::number(-right.asNumber());
+        }
+        expr->quick = Q_GENERIC;
+    }
+    return unary(expr, right);
 }
 
-ExprPtr Compiler::visit_unary(UnaryExpr *expr)
+Value Compiler::unary(UnaryExpr *expr, const Value &right)
 {
-    ExprPtr right = evaluate(expr->right);
-    if (!right)
-    { 
+    if (right.isEmpty())
+    {
         throw FatalException("Unknown expression type for UnaryExpr: "+ expr->toString());
     }
-    if ( right->type == ExprType::LITERAL)
+    if (right.isNil())
     {
         throw FatalException("Invalid unary expression. '"+ expr->op.lexeme +"' Literals are not allowed at line "+ std::to_string(expr->op.line));
     }
-    
+
 
 
     switch (expr->op.type)
@@ -2019,139 +2353,94 @@ ExprPtr Compiler::visit_unary(UnaryExpr *expr)
 
         case TokenType::MINUS:
         {
-            if (right->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *num = static_cast<NumberLiteral *>(right.get());   
-                double value = num->value;
-                num->value = -value;
-                return right;
-            }
-            break;
-        }
-        case TokenType::BANG:
-        {
-            if (right->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *num = static_cast<NumberLiteral *>(right.get());
-                double value = num->value;
-                num->value = (value==0) ? 0 : 1;
-                return right;
-            }
-            break;
-        }
-        case TokenType::INC:
-        {
-            if (right->type == ExprType::L_NUMBER)
+            if (right.isNumber())
             {
-                NumberLiteral *num = static_cast<NumberLiteral *>(right.get());
-                if (expr->isPrefix)
-                {
-                   ++num->value;
-                }
-                else
+                if (expr->quick == Q_NONE)
                 {
-                    num->value++;
+                    expr->quick = Q_NUMBER;
                 }
-
-                return right;
+                return Value::number(-right.asNumber());
             }
             break;
         }
-        case TokenType::DEC:
-        {
-            if (right->type == ExprType::L_NUMBER)
-            {
-                NumberLiteral *num = static_cast<NumberLiteral *>(right.get());
-                
-                if (expr->isPrefix)
-                {
-                     --num->value;
-                }
-                else
-                {
-                    
-                    num->value--;
-                }
-                return right;
-            }
-            break;
+        case TokenType::BANG:
+        {
+            return Value::boolean(!right.isTruthy());
         }
         default:
             break;
-       
-    
+
+
     }
-  
-    
+
+
 
     throw FatalException("Invalid unary expression, With operator '"+expr->op.lexeme+"'");
-   
-    return nullptr;
+
+    return Value::nil();
 }
 
-ExprPtr Compiler::visit_logical(LogicalExpr *node)
+Value Compiler::visit_logical(LogicalExpr *node)
 {
-    ExprPtr left = evaluate(node->left);
-    if (!left) 
+    Value left = evaluate(node->left);
+    if (left.isEmpty())
     {
         throw FatalException("Unknown expression type for Logical avaliation: "+ node->toString());
     }
-    if ( left->type == ExprType::LITERAL)
+    if (left.isNil())
     {
         throw FatalException("Invalid logical expression. '"+ node->op.lexeme +"' Literals are not allowed at line "+ std::to_string(node->op.line));
     }
 
 
-    if (left->type == ExprType::L_NUMBER)
+    if (node->op.type == TokenType::OR)
     {
-        NumberLiteral *l = static_cast<NumberLiteral *>(left.get());
-       
-        if (node->op.type == TokenType::OR)
-        {
-            if (l->value != 0)
-            {
-                return left;
-            }
-        }else  if (node->op.type == TokenType::AND)
+        if (left.isTruthy())
         {
-            if (l->value == 0)
-            {
-                return left;
-            }
-        } else if (node->op.type == TokenType::XOR)
+            return left;
+        }
+    } else if (node->op.type == TokenType::AND)
+    {
+        if (!left.isTruthy())
         {
-            if (l->value != 0)
-            {
-                return left;
-            }
-        } 
+            return left;
+        }
+    } else if (node->op.type == TokenType::XOR)
+    {
+        Value right = evaluate(node->right);
+        return Value::boolean(left.isTruthy() != right.isTruthy());
     }
     return evaluate(node->right);
 }
 
-ExprPtr Compiler::visit_grouping(GroupingExpr *node)
+Value Compiler::visit_grouping(GroupingExpr *node)
 {
     return evaluate(node->expr);
 }
 
-ExprPtr Compiler::visit_literal(Literal *node)
+Value Compiler::visit_literal(Literal *node)
 {
-    std::shared_ptr<Literal> result =  std::make_shared<Literal>();
-    return result;
+    return Value::nil();
 }
-std::shared_ptr<Expr> Compiler::visit_number_literal(NumberLiteral *node)
+Value Compiler::visit_number_literal(NumberLiteral *node)
 {
-    std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-    result->value = node->value;
-    return result;
+    return Value::number(node->value);
 }
 
-std::shared_ptr<Expr> Compiler::visit_string_literal(StringLiteral *node)
+Value Compiler::visit_boolean_literal(BooleanLiteral *node)
 {
-    std::shared_ptr<StringLiteral> result =  std::make_shared<StringLiteral>();
-    result->value = node->value;
-    return result;
-   
+    return Value::boolean(node->value);
+}
+
+Value Compiler::visit_string_literal(StringLiteral *node)
+{
+    // strings are immutable, every evaluation can share one object
+    if (node->cached.isEmpty())
+    {
+        node->cached = Value::string(node->value);
+    }
+    return node->cached;
+
 }
 
 Interpreter::~Interpreter()
@@ -2160,6 +2449,8 @@ Interpreter::~Interpreter()
      nativeFunctions.clear();
 
 
+    currentVM = nullptr;
+    vm = nullptr;
     compiler=nullptr;
     context = nullptr;
 
@@ -2175,9 +2466,18 @@ Interpreter::Interpreter()
     compiler = currentCompiler.get();
     context = currentContext.get();
     compiler->init();
+
+    currentVM = std::make_shared<VM>(this);
+    vm = currentVM.get();
+    currentBinder = std::make_shared<Binder>(compiler);
+    binder = currentBinder.get();
+    currentJit = std::make_shared<Jit>();
+    jit = currentJit.get();
+    compiler->jit = jit;
+    backend = Backend::AST;
 }
 
-bool Interpreter::compile(const std::string &source)
+bool Interpreter::compile(const std::string &source, int optimize)
 {
     Lexer lexer;
     lexer.initialize();
@@ -2209,7 +2509,27 @@ bool Interpreter::compile(const std::string &source)
         {
             return false;
         }
-        compiler->execute(program.get());
+        Optimizer optimizer(optimize, optimizerLog);
+        optimizer.setConstants(&constants);
+        optimizer.optimize(program.get());
+        if (backend == Backend::BYTECODE)
+        {
+            vm->execute(program.get());
+        }
+        else if (backend == Backend::CLOSURE)
+        {
+            Resolver resolver;
+            resolver.resolve(program.get());
+            compiler->binder = binder;
+            binder->execute(program.get());
+            compiler->binder = nullptr;
+        }
+        else
+        {
+            Resolver resolver;
+            resolver.resolve(program.get());
+            compiler->execute(program.get());
+        }
         parser.clear();
  
 
@@ -2223,6 +2543,16 @@ void Interpreter::collect()
    
 }
 
+std::vector<MemoStats> Interpreter::memoStats() const
+{
+    std::vector<MemoStats> stats;
+    for (auto &memo : compiler->memos)
+    {
+        stats.push_back({memo->name, memo->hits, memo->misses, memo->entries.size()});
+    }
+    return stats;
+}
+
 void Interpreter::clear()
 {
    
@@ -2240,8 +2570,11 @@ void Interpreter::registerFunction(const std::string &name, NativeFunction funct
     {
         throw FatalException("Native function already defined: " + name);
     }
-    std::shared_ptr<Native> native = std::make_shared<Native>();
-    if (!compiler->environment->define(name, native))
+    Native *native = new Native();
+    Value value(native);
+    native->name.lexeme = name;
+    native->function = function;
+    if (!compiler->environment->define(name, std::move(value)))
     {
            throw FatalException("Native function already defined: " + name);
     }
@@ -2250,31 +2583,54 @@ void Interpreter::registerFunction(const std::string &name, NativeFunction funct
 
 bool Interpreter::registerInteger(const std::string &name, int value)
 {
-    std::shared_ptr<NumberLiteral> num = std::make_shared<NumberLiteral>();
-    num->value = static_cast<double>(value);
-    return compiler->environment->define(name, num);
+    return compiler->environment->define(name, Value::number(static_cast<double>(value)));
     
 }
 
 bool Interpreter::registerBoolean(const std::string &name, bool value)
 {
-    std::shared_ptr<NumberLiteral> num = std::make_shared<NumberLiteral>();
-    num->value = static_cast<double>(value);
-    return compiler->environment->define(name, num);
+    return compiler->environment->define(name, Value::boolean(value));
 }
 
 bool Interpreter::registerDouble(const std::string &name, double value)
 {
-    std::shared_ptr<NumberLiteral> num = std::make_shared<NumberLiteral>();
-    num->value = value;
-    return compiler->environment->define(name, num);
+    return compiler->environment->define(name, Value::number(value));
 }
 
 bool Interpreter::registerString(const std::string &name, std::string value)
 {
-    std::shared_ptr<StringLiteral> str = std::make_shared<StringLiteral>();
-    str->value = value;
-    return compiler->environment->define(name, str);
+    return compiler->environment->define(name, Value::string(value));
+}
+
+bool Interpreter::registerConstInteger(const std::string &name, int value)
+{
+    return registerConst(name, Value::number(static_cast<double>(value)));
+}
+
+bool Interpreter::registerConstBoolean(const std::string &name, bool value)
+{
+    return registerConst(name, Value::boolean(value));
+}
+
+bool Interpreter::registerConstDouble(const std::string &name, double value)
+{
+    return registerConst(name, Value::number(value));
+}
+
+bool Interpreter::registerConstString(const std::string &name, std::string value)
+{
+    return registerConst(name, Value::string(value));
+}
+
+// still defined as a global, -O0 and the VM's own lookups read it from there
+bool Interpreter::registerConst(const std::string &name, Value value)
+{
+    if (!compiler->environment->define(name, value))
+    {
+        return false;
+    }
+    constants[name] = std::move(value);
+    return true;
 }
 
 bool Interpreter::isnative(const std::string &name)
@@ -2282,7 +2638,7 @@ bool Interpreter::isnative(const std::string &name)
      return nativeFunctions.find(name) != nativeFunctions.end();
 }
 
-ExprPtr Interpreter::CallNativeFunction(const std::string &name, int argc)
+Value Interpreter::CallNativeFunction(const std::string &name, int argc)
 {
     
 
@@ -2290,15 +2646,15 @@ ExprPtr Interpreter::CallNativeFunction(const std::string &name, int argc)
     
     
 
-    ExprPtr result = function(context, argc);
+    Value result = function(context, argc);
     
     return result;
 }
 
-bool Interpreter::registerGlobal(const std::string &name, ExprPtr value)
+bool Interpreter::registerGlobal(const std::string &name, Value value)
 {
 
-    return compiler->environment->define(name, value);
+    return compiler->environment->define(name, std::move(value));
 }
 
 void Interpreter::Error(const Token &token, const std::string &message)
@@ -2332,461 +2688,555 @@ void Interpreter::Info(const std::string &message)
 
 
 
-Function::Function():Literal()
+
+
+Function::Function() : Object(O_FUNCTION)
 {
-    type = ExprType::L_FUNCTION;
     body = nullptr;
+    arity = 0;
+    calls = 0;
+    native = nullptr;
+    nojit = false;
+    result = A_NONE;
 }
 
-ExprPtr Function::clone()
+
+
+bool MemoTable::key(const Value *args, u32 count, std::string &key)
 {
-    std::shared_ptr<Function> f = std::make_shared<Function>();
-    f->name = name;
-    f->body = body;
-    return f;
+    for (u32 i = 0; i < count; i++)
+    {
+        const Value &arg = args[i];
+        if (arg.isNumber())
+        {
+            double number = arg.asNumber();
+            key += 'n';
+            key.append(reinterpret_cast<const char *>(&number), sizeof(number));
+        }
+        else if (arg.isString())
+        {
+            const std::string &text = arg.asString();
+            u32 length = text.size();
+            key += 's';
+            key.append(reinterpret_cast<const char *>(&length), sizeof(length));
+            key += text;
+        }
+        else if (arg.isBool())
+        {
+            key += arg.asBool() ? 't' : 'f';
+        }
+        else if (arg.isNil())
+        {
+            key += 'z';
+        }
+        else
+        {
+            return false;   // arrays, maps and instances can change under the same reference
+        }
+    }
+    return true;
 }
 
+bool MemoTable::find(const std::string &key, Value &result)
+{
+    auto it = index.find(key);
+    if (it == index.end())
+    {
+        misses++;
+        return false;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, it->second);
+    result = it->second->second;
+    return true;
+}
 
+void MemoTable::insert(const std::string &key, const Value &result)
+{
+    if (result.isObject() && !result.isString())
+    {
+        return;
+    }
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        it->second->second = result;
+        return;
+    }
+    if (capacity != 0 && entries.size() >= capacity)
+    {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+    entries.emplace_front(key, result);
+    index[key] = entries.begin();
+}
 
-ClassLiteral::ClassLiteral()
+ClassLiteral::ClassLiteral() : Object(O_CLASS)
 {
-    type = ExprType::L_CLASS;
     name = "";
     parentName = "";
     isChild = false;
-   
+    prepared = false;
+    preparing = false;
+
     environment = nullptr;
 }
 
 ClassLiteral::~ClassLiteral()
 {
    INFO("Class deleted: %s", name.c_str());
-   environment->remove("self");
-   delete environment;
+   if (environment)
+   {
+       environment->remove("self");
+       delete environment;
+   }
    environment = nullptr;
 }
 
 
-
-
-std::string BuildClass(ClassLiteral *cl);
+std::string ClassLiteral::toString()
+{
+    return "Class :" + name;
+}
 
 void ClassLiteral::print()
 {
-    std::string data = BuildClass(this);
+    std::string data = toString();
     INFO("%s",data.c_str());
 }
 
-ExprPtr ClassLiteral::clone()
+Value ClassLiteral::clone()
 {
-    std::shared_ptr<ClassLiteral> cl = std::make_shared<ClassLiteral>();
+    ClassLiteral *cl = new ClassLiteral();
+    Value result(cl);
     cl->name = name;
-    
-    if (this->environment)
+
+    if (instance())
     {
-        cl->environment =  new Environment(this->environment->getParent());
-        
-        const std::unordered_map<std::string, ExprPtr > values = this->environment->values();
-        for (auto it = values.begin(); it != values.end(); it++)
+        cl->isChild = isChild;
+        cl->shape = shape;
+        cl->owner = owner;
+        cl->environment = new Environment(environment->getParent(), &shape->scope);
+        for (u32 i = 0; i < shape->scope.names.size(); i++)
         {
-          cl->environment->define(it->first, it->second);
+            cl->environment->defineAt(i, environment->slot(i));
         }
     }
-    return cl;
-}
-
-StructLiteral::StructLiteral()
-{
-    type = ExprType::L_STRUCT;
-    name = "";
-}
-StructLiteral::~StructLiteral()
-{
-   // INFO("Struct deleted: %s", name.c_str());
+    else if (this->environment)
+    {
+        cl->environment =  new Environment(this->environment->getParent());
+        cl->environment->copy(this->environment);
+    }
+    return result;
 }
-std::string BuilArray(ArrayLiteral *al);
 
-std::string BuilMap(MapLiteral *ml)
+// `parent` is the class this one extends, prepared already, or empty
+void ClassLiteral::prepare(const Value &parent)
 {
-    std::string s;
-    auto it = ml->values.begin();
-    u32 size = ml->values.size();
-    for (u32 i = 0; it != ml->values.end(); it++, i++)
+    std::shared_ptr<ClassShape> layout = ClassShape::root();
+    table = std::make_shared<MethodTable>();
+    if (!parent.isEmpty())
     {
-        s +="{";
-        ExprPtr key = it->first;
-        if (key->type == ExprType::LITERAL)
-        {
-            s += "nil";
-        }else  if (key->type == ExprType::L_NUMBER)
-        {
-            NumberLiteral *nl = static_cast<NumberLiteral *>(key.get());
-            s += std::to_string(nl->value);
-        } else if (key->type == ExprType::L_STRING)
+        ClassLiteral *super = parent.as<ClassLiteral>();
+        layout = super->shape;
+        defaults = super->defaults;
+        *table = *super->table;
+        environment->setParent(super->environment);
+        environment->define("super", parent);
+        base = parent;
+    }
+    for (auto &field : fields)
+    {
+        layout = ClassShape::add(layout, field);
+    }
+    defaults.resize(layout->scope.names.size(), nullptr);
+    for (auto &field : fields)
+    {
+        defaults[layout->find(field)] = environment->find(field);
+    }
+    for (auto &name : methods)
+    {
+        Value *binding = environment->find(name);
+        if (binding == nullptr)
         {
-            StringLiteral *sl = static_cast<StringLiteral *>(key.get());
-            s += sl->value;
+            continue;
         }
-        s += ":";
-        ExprPtr value = it->second;
-        if (value->type == ExprType::L_NUMBER)
-        {
-            NumberLiteral *nl = static_cast<NumberLiteral *>(value.get());
-            s += std::to_string(nl->value);
-        } else if (value->type == ExprType::L_STRING)
+        auto it = table->slots.find(name);
+        if (it == table->slots.end())
         {
-            StringLiteral *sl = static_cast<StringLiteral *>(value.get());
-            s += sl->value;
-        } else if (value->type == ExprType::L_ARRAY)
-        {
-            ArrayLiteral *al = static_cast<ArrayLiteral *>(value.get());
-            s += BuilArray(al);
-        } else if (value->type == ExprType::L_MAP)
-        {
-            MapLiteral *ml = static_cast<MapLiteral *>(value.get());
-            s += BuilMap(ml);
-        } else if (value->type == ExprType::L_CLASS)
-        {
-            ClassLiteral *cl = static_cast<ClassLiteral *>(value.get());
-            s += BuildClass(cl);
+            table->slots[name] = (u32)table->methods.size();
+            table->methods.push_back(binding);
+            table->owners.push_back(this);
         }
-        s += "}";
-        if (i < size - 1)
+        else
         {
-            s += ",";
+            table->methods[it->second] = binding;
+            table->owners[it->second] = this;
         }
+    }
+    shape = std::move(layout);
+    prepared = true;
+}
 
-       
+Value ClassLiteral::instantiate()
+{
+    ClassLiteral *cl = new ClassLiteral();
+    Value result(cl);
+    cl->name = name;
+    cl->isChild = isChild;
+    cl->shape = shape;
+    cl->owner = Value(this);
+    cl->environment = new Environment(environment, &shape->scope);
+    for (u32 i = 0; i < defaults.size(); i++)
+    {
+        cl->environment->defineAt(i, defaults[i] != nullptr ? defaults[i]->clone() : Value::nil());
     }
-    return s;
-} 
+    return result;
+}
+
+// an instance gets a field of its own, e.g. one that overrides a method for it alone
+void ClassLiteral::add(const std::string &name, Value value)
+{
+    shape = ClassShape::add(shape, name);
+    environment->extend(&shape->scope, std::move(value));
+}
 
-std::string BuilStruct(StructLiteral *sl)
+// what obj.name(...) calls: a field of the instance, else the method its class has in that
+// slot of its table. holder is set to the class that declares it.
+Value *ClassLiteral::method(const std::string &name, ClassLiteral *&holder)
 {
-    std::string s=sl->name+ " ";
-    auto it = sl->members.begin();
-    while (it != sl->members.end())
+    ClassLiteral *cl = this;
+    if (instance())
     {
-        std::string name = it->first;
-        std::string value;
-        ExprPtr expr = it->second;
-        if (expr->type == ExprType::LITERAL)
+        int slot = shape->find(name);
+        cl = owner.as<ClassLiteral>();
+        if (slot >= 0)
         {
-                value ="nil";
-        }else if (expr->type == ExprType::L_NUMBER)
-        {
-            NumberLiteral *nl = static_cast<NumberLiteral *>(expr.get());
-            value = std::to_string(nl->value);
-        } else if (expr->type == ExprType::L_STRING)
-        {
-            StringLiteral *sl = static_cast<StringLiteral *>(expr.get());
-            value = sl->value;
-        } else if (expr->type == ExprType::L_STRUCT)
-        {
-            StructLiteral *sl = static_cast<StructLiteral *>(expr.get());
-            value = BuilStruct(sl);            
-        }else if (expr->type == ExprType::L_ARRAY)
-        {
-            ArrayLiteral *al = static_cast<ArrayLiteral *>(expr.get());
-            value = BuilArray(al);
-        } else if (expr->type == ExprType::L_MAP)
-        {
-            MapLiteral *ml = static_cast<MapLiteral *>(expr.get());
-            value = BuilMap(ml);
-        } else if (expr->type == ExprType::L_CLASS)
-        {
-            ClassLiteral *cl = static_cast<ClassLiteral *>(expr.get());
-            value = BuildClass(cl);
+            holder = cl;
+            return &environment->slot(slot);
         }
-        s  += "("+ name+ ":" + value+")";
-        
-        it++;
-    }    
-    return s;
+    }
+    if (!cl->table)
+    {
+        return nullptr;
+    }
+    int slot = cl->table->find(name);
+    if (slot < 0)
+    {
+        return nullptr;
+    }
+    holder = cl->table->owners[slot];
+    return cl->table->methods[slot];
 }
 
-std::string BuilArray(ArrayLiteral *al)
+int MethodTable::find(const std::string &name) const
 {
-    std::string s = "[";
-    for (u32 i = 0; i < al->values.size(); i++)
+    auto it = slots.find(name);
+    return it == slots.end() ? -1 : (int)it->second;
+}
+
+std::shared_ptr<ClassShape> ClassShape::root()
+{
+    static std::shared_ptr<ClassShape> root = std::make_shared<ClassShape>();
+    return root;
+}
+
+std::shared_ptr<ClassShape> ClassShape::add(const std::shared_ptr<ClassShape> &shape, const std::string &name)
+{
+    if (shape->slots.find(name) != shape->slots.end())
     {
-        if (i > 0)
-        {
-            s += ", ";
-        }
-        if (al->values[i]->type == ExprType::LITERAL)
-        {
-                s+="nil";
-        }
-        else if (al->values[i]->type == ExprType::L_NUMBER)
-        {
-            NumberLiteral *nl = static_cast<NumberLiteral *>(al->values[i].get());
-            s +=  std::to_string(nl->value);
-        } else if (al->values[i]->type == ExprType::L_STRING)
-        {
-            StringLiteral *sl = static_cast<StringLiteral *>(al->values[i].get());
-            s += sl->value;
-        } else if (al->values[i]->type == ExprType::L_STRUCT)
-        {
-            StructLiteral *sl = static_cast<StructLiteral *>(al->values[i].get());
-            s += BuilStruct(sl);
-        } else if (al->values[i]->type == ExprType::L_ARRAY)
-        {
-            ArrayLiteral *al = static_cast<ArrayLiteral *>(al->values[i].get());
-            s += BuilArray(al);
-        } else if (al->values[i]->type == ExprType::L_MAP)
-        {
-            MapLiteral *ml = static_cast<MapLiteral *>(al->values[i].get());
-            s += BuilMap(ml);
-        } else if (al->values[i]->type == ExprType::L_CLASS)
-        {
-            ClassLiteral *cl = static_cast<ClassLiteral *>(al->values[i].get());
-            s += BuildClass(cl);
-        }
+        return shape;
+    }
+    std::shared_ptr<ClassShape> &next = shape->transitions[name];
+    if (!next)
+    {
+        next = std::make_shared<ClassShape>();
+        next->scope.names = shape->scope.names;
+        next->scope.names.push_back(name);
+        next->slots = shape->slots;
+        next->slots[name] = (u32)shape->scope.names.size();
+    }
+    return next;
+}
+
+int ClassShape::find(const std::string &name) const
+{
+    auto it = slots.find(name);
+    return it == slots.end() ? -1 : (int)it->second;
+}
 
+StructLiteral::StructLiteral(std::shared_ptr<StructLayout> layout, u32 count) : Object(O_STRUCT), layout(std::move(layout)), count(count)
+{
+    Value *slots = values();
+    for (u32 i = 0; i < count; i++)
+    {
+        new (&slots[i]) Value();
     }
-    s += "]";
-    return s;
 }
 
-std::string BuildClass(ClassLiteral *cl)
+StructLiteral *StructLiteral::create(std::shared_ptr<StructLayout> layout, u32 count)
 {
-    std::string s ="Class :"+ cl->name;
-    // auto list  =    cl->environment->values();
-    // auto it = list.begin();
-    // while (it != list.end())
-    // {
-    //     std::string name = it->first;
-    //     s += "("+ name +")";
-    //     // ExprPtr expr = it->second;
-    //     // if (expr->type == ExprType::L_STRUCT)
-    //     // {
-    //     //     StructLiteral *sl = static_cast<StructLiteral *>(expr);
-    //     //     s += BuilStruct(sl);
-    //     // } else if (expr->type == ExprType::L_ARRAY)
-    //     // {
-    //     //     ArrayLiteral *al = static_cast<ArrayLiteral *>(expr);
-    //     //     s += BuilArray(al);
-    //     // } else if (expr->type == ExprType::L_MAP)
-    //     // {
-    //     //     MapLiteral *ml = static_cast<MapLiteral *>(expr);
-    //     //     s += BuilMap(ml);
-    //     // }   else 
-    //     // if (expr->type == ExprType::L_NUMBER)
-    //     // {
-    //     //     NumberLiteral *nl = static_cast<NumberLiteral *>(expr);
-    //     //     s +=  std::to_string(nl->value) + ")";
-    //     // } else if (expr->type == ExprType::L_STRING)
-    //     //  {
-    //     //      StringLiteral *sl = static_cast<StringLiteral *>(expr);
-    //     //      s += sl->value + ")";
-    //     //  }
-    //      // else if (expr->type == ExprType::L_CLASS)
-    //     // {
-    //     //     ClassLiteral *cl = static_cast<ClassLiteral *>(expr);
-    //     //     s += BuildClass(cl);
-    //     // }
-
-    //     it++;
-    // }
+    void *memory = ::operator new(sizeof(StructLiteral) + count * sizeof(Value));
+    return new (memory) StructLiteral(std::move(layout), count);
+}
+
+void StructLiteral::operator delete(void *p)
+{
+    ::operator delete(p);
+}
+
+StructLiteral::~StructLiteral()
+{
+    Value *slots = values();
+    for (u32 i = 0; i < count; i++)
+    {
+        slots[i].~Value();
+    }
+}
+
+std::string StructLiteral::toString()
+{
+    std::string s=layout->name+ " ";
+    Value *slots = values();
+    for (u32 i = 0; i < count; i++)
+    {
+        s  += "("+ layout->fields[i]+ ":" + slots[i].toString()+")";
+    }
     return s;
 }
 
 void StructLiteral::print()
 {
-        std::string s=BuilStruct(this);
+        std::string s=toString();
         PRINT("%s", s.c_str());
 }
 
-ExprPtr StructLiteral::clone()
+Value StructLiteral::clone()
 {
-    
-    std::shared_ptr<StructLiteral> l = std::make_shared<StructLiteral>();
+    StructLiteral *l = create(layout, count);
+    Value result(l);
+    Value *slots = values();
+    for (u32 i = 0; i < count; i++)
+    {
+        l->values()[i] = slots[i].clone();
+    }
+    return result;
+}
 
-    l->name = name;
-    for (auto it = members.begin(); it != members.end(); it++)
+int StructLayout::find(const std::string &name) const
+{
+    auto it = slots.find(name);
+    return it == slots.end() ? -1 : (int)it->second;
+}
+
+// a name declared twice keeps its first slot, types stays empty until a field has one
+u32 StructLayout::add(const std::string &name, u8 type)
+{
+    auto it = slots.find(name);
+    if (it != slots.end())
+    {
+        return it->second;
+    }
+    u32 slot = (u32)fields.size();
+    slots[name] = slot;
+    fields.push_back(name);
+    if (type != A_NONE || !types.empty())
     {
-        l->members[it->first] = it->second->clone();
+        types.resize(fields.size(), A_NONE);
+        types.back() = type;
     }
-    return l;
+    return slot;
 }
 
-ArrayLiteral::ArrayLiteral()
+ArrayLiteral::ArrayLiteral() : Object(O_ARRAY)
 {
-    type = ExprType::L_ARRAY;
 
 }
 
+std::string ArrayLiteral::toString()
+{
+    std::string s = "[";
+    for (u32 i = 0; i < values.size(); i++)
+    {
+        if (i > 0)
+        {
+            s += ", ";
+        }
+        s += values[i].toString();
+    }
+    s += "]";
+    return s;
+}
+
 void ArrayLiteral::print()
 {
-    std::string str = BuilArray(this);
+    std::string str = toString();
     PRINT("Array %s", str.c_str());
-    
+
 }
 
-ExprPtr ArrayLiteral::clone()
+Value ArrayLiteral::clone()
 {
-    std::shared_ptr<ArrayLiteral> l = std::make_shared<ArrayLiteral>();
+    if (frozen)
+    {
+        return Value(this);
+    }
+    ArrayLiteral *l = new ArrayLiteral();
+    Value result(l);
     l->name = name;
+    l->values.reserve(values.size());
     for (u32 i = 0; i < values.size(); i++)
     {
-        l->values.push_back(values[i]->clone());
+        l->values.push_back(values[i].clone());
     }
-    return l;
+    return result;
+}
+
+MapLiteral::MapLiteral() : Object(O_MAP)
+{
 }
 
-MapLiteral::MapLiteral()
+std::string MapLiteral::toString()
 {
-    type = ExprType::L_MAP;
+    std::string s;
+    u32 i = 0;
+    for (auto it = values.begin(); it != values.end(); it++, i++)
+    {
+        if (i > 0)
+        {
+            s += ",";
+        }
+        s += "{" + it->first.toString() + ":" + it->second.toString() + "}";
+    }
+    return s;
 }
 
 void MapLiteral::print()
 {
-    std::string str = BuilMap(this);
+    std::string str = toString();
     PRINT("Map [%s]", str.c_str());
 }
 
-ExprPtr MapLiteral::clone()
+Value MapLiteral::clone()
 {
-    std::shared_ptr<MapLiteral> l = std::make_shared<MapLiteral>();
+    if (frozen)
+    {
+        return Value(this);
+    }
+    MapLiteral *l = new MapLiteral();
+    Value result(l);
+    l->name = name;
     for (auto it = values.begin(); it != values.end(); it++)
     {
-        l->values[it->first] = it->second->clone();
+        l->values[it->first] = it->second.clone();
     }
-    return l;
+    return result;
 }
 
-Native::Native()
+Native::Native() : Object(O_NATIVE)
 {
-    type = ExprType::L_NATIVE;
+    function = nullptr;
 }
 
 Context::Context(Interpreter *interpreter)
 {
     this->interpreter = interpreter;
-    NIL = std::make_shared<Literal>();
 }
 
 Context::~Context()
 {
-    NIL = nullptr;
     clear();
 }
 
-void Context::add(ExprPtr value,Literal *literal)
+void Context::add(Value value)
 {
-    expressions.push_back(std::move(value));
-    literals.push_back(literal);
+    args.push_back(std::move(value));
 }
 
 void Context::clear()
 {
-    values.clear();
-    literals.clear();
-    expressions.clear();
+    args.clear();
 }
 
 long Context::getLong(u8 index)
 {
-    NumberLiteral *l = static_cast<NumberLiteral *>(literals[index]);
-    return static_cast<long>(l->value);
+    return static_cast<long>(args[index].asNumber());
 }
 
 int Context::getInt(u8 index)
 {
-    NumberLiteral *l = static_cast<NumberLiteral *>(literals[index]);
-    return static_cast<int>(l->value);
+    return static_cast<int>(args[index].asNumber());
 }
 
 double Context::getDouble(u8 index)
 {
-    NumberLiteral *l = static_cast<NumberLiteral *>(literals[index]);
-    return l->value;
+    return args[index].asNumber();
 }
 
 float Context::getFloat(u8 index)
 {
-    NumberLiteral *l = static_cast<NumberLiteral *>(literals[index]);
-    return static_cast<float>(l->value);
+    return static_cast<float>(args[index].asNumber());
 }
 
 std::string Context::getString(u8 index)
 {
-    return static_cast<StringLiteral *>(literals[index])->value;
+    return args[index].asString();
 }
 
 bool Context::getBoolean(u8 index)
 {
-    NumberLiteral *l = static_cast<NumberLiteral *>(literals[index]);
-    return l->value != 0;
+    return args[index].isTruthy();
 }
-ExprPtr Context::asFloat(float value)
+Value Context::asFloat(float value)
 {
-    std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-    result->value = static_cast<double>(value);
-    values.push_back(result);
-    return result;
+    return Value::number(static_cast<double>(value));
 }
 
-ExprPtr Context::asDouble(double value)
+Value Context::asDouble(double value)
 {
-    std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-    result->value = value;
-    values.push_back(result);
-    return result;
+    return Value::number(value);
 }
 
-ExprPtr Context::asInt(int value)
+Value Context::asInt(int value)
 {
-    std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-    result->value = static_cast<double>(value);
-    values.push_back(result);
-    return result;
+    return Value::number(static_cast<double>(value));
 }
 
-ExprPtr Context::asLong(long value)
+Value Context::asLong(long value)
 {
-    std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-    result->value = static_cast<double>(value);
-    values.push_back(result);
-    return result;
+    return Value::number(static_cast<double>(value));
 }
 
-ExprPtr Context::asString(std::string value)
+Value Context::asString(std::string value)
 {
-    std::shared_ptr<StringLiteral> result =  std::make_shared<StringLiteral>();
-    result->value = value;
-    values.push_back(result);
-    return result;
+    return Value::string(value);
 }
 
-ExprPtr Context::asBoolean(bool value)
+Value Context::asBoolean(bool value)
 {
-    std::shared_ptr<NumberLiteral> result =  std::make_shared<NumberLiteral>();
-    result->value = value ? 1 : 0;
-    values.push_back(result);
-    return result;
+    return Value::boolean(value);
 }
 
-ExprPtr Context::asNil()
+Value Context::asNil()
 {
-    return  NIL;
+    return Value::nil();
 }
 
 bool Context::isNumber(u8 index)
 {
-    if (index >= literals.size())
+    if (index >= args.size())
     {
         return false;
     }
-    return literals[index]->type == ExprType::L_NUMBER;
+    return args[index].isNumber();
 }
 
 bool Context::isString(u8 index)
 {
-    if (index >= literals.size())
+    if (index >= args.size())
     {
         return false;
     }
-    return literals[index]->type == ExprType::L_STRING;
+    return args[index].isString();
 }
@@ -0,0 +1,735 @@
+#include "pch.h"
+#include "Jit.hpp"
+#include "Utils.hpp"
+
+#if defined(BULANG_JIT) && defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+// Frame layout: rbx keeps the result pointer, every local and temporary is a double at
+// [rsp + 8 * slot]. Expressions leave their value in xmm0.
+struct JitFunction
+{
+    struct Loop
+    {
+        int start;      // continue target
+        int end;        // break target
+    };
+
+    Function *function;
+    std::vector<u8> code;
+    std::vector<int> labels;
+    std::vector<std::pair<int, int>> fixups;   // rel32 position, label
+    std::vector<std::vector<std::pair<std::string, int>>> scopes;
+    std::vector<Loop> loops;
+    int top{0};
+    int maxTop{0};
+    int frameFixup{0};
+    int epilogue{0};
+    int deopt{0};
+    int entry{0};
+    std::vector<int> params;
+
+    explicit JitFunction(Function *function) : function(function) {}
+
+    void emit(std::initializer_list<u8> bytes) { code.insert(code.end(), bytes); }
+
+    void emit32(u32 value)
+    {
+        for (int i = 0; i < 4; i++)
+            code.push_back((value >> (i * 8)) & 0xFF);
+    }
+
+    void emit64(u64 value)
+    {
+        for (int i = 0; i < 8; i++)
+            code.push_back((value >> (i * 8)) & 0xFF);
+    }
+
+    int label()
+    {
+        labels.push_back(-1);
+        return labels.size() - 1;
+    }
+
+    void bind(int l) { labels[l] = code.size(); }
+
+    void jump(int l)
+    {
+        emit({0xE9});
+        fixups.push_back({(int)code.size(), l});
+        emit32(0);
+    }
+
+    // cc is the low nibble of the 0F 8x opcode
+    void jump_if(u8 cc, int l)
+    {
+        emit({0x0F, (u8)(0x80 | cc)});
+        fixups.push_back({(int)code.size(), l});
+        emit32(0);
+    }
+
+    int alloc()
+    {
+        int slot = top++;
+        if (top > maxTop)
+            maxTop = top;
+        return slot;
+    }
+
+    // movsd xmm, [rsp + 8*slot]
+    void load(u8 xmm, int slot)
+    {
+        emit({0xF2, 0x0F, 0x10, (u8)(0x84 | (xmm << 3)), 0x24});
+        emit32(slot * 8);
+    }
+
+    // movsd [rsp + 8*slot], xmm
+    void store(int slot, u8 xmm)
+    {
+        emit({0xF2, 0x0F, 0x11, (u8)(0x84 | (xmm << 3)), 0x24});
+        emit32(slot * 8);
+    }
+
+    // mov rax, imm64 ; movq xmm, rax
+    void constant(u8 xmm, double value)
+    {
+        u64 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        emit({0x48, 0xB8});
+        emit64(bits);
+        emit({0x66, 0x48, 0x0F, 0x6E, (u8)(0xC0 | (xmm << 3))});
+    }
+
+    int find(const std::string &name)
+    {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+        {
+            for (auto &local : *scope)
+            {
+                if (local.first == name)
+                    return local.second;
+            }
+        }
+        return -1;
+    }
+
+    int local(const ExprPtr &expr)
+    {
+        if (expr->type != ExprType::VARIABLE)
+            return -1;
+        return find(static_cast<Variable *>(expr.get())->name.lexeme);
+    }
+
+    bool declare(const std::string &name)
+    {
+        if (name == function->name.lexeme)
+            return false;
+        for (auto &local : scopes.back())
+        {
+            if (local.first == name)
+                return true;   // define() overwrites, the slot is reused
+        }
+        scopes.back().push_back({name, alloc()});
+        return true;
+    }
+
+    void push_scope() { scopes.emplace_back(); }
+
+    void pop_scope()
+    {
+        top -= scopes.back().size();
+        scopes.pop_back();
+    }
+
+    //******************************************************************************* */
+
+    // leaves the right operand in xmm1 and the left one in xmm0
+    bool operands(BinaryExpr *node)
+    {
+        int slot = local(node->right);
+        if (node->right->type == ExprType::L_NUMBER)
+        {
+            if (!expression(node->left))
+                return false;
+            constant(1, static_cast<NumberLiteral *>(node->right.get())->value);
+            return true;
+        }
+        if (slot >= 0)
+        {
+            if (!expression(node->left))
+                return false;
+            load(1, slot);
+            return true;
+        }
+
+        if (!expression(node->left))
+            return false;
+        int temp = alloc();
+        store(temp, 0);
+        if (!expression(node->right))
+            return false;
+        emit({0x66, 0x0F, 0x28, 0xC8});   // movapd xmm1, xmm0
+        load(0, temp);
+        top--;
+        return true;
+    }
+
+    bool binary(BinaryExpr *node)
+    {
+        switch (node->op.type)
+        {
+            case TokenType::PLUS:
+            case TokenType::PLUS_EQUAL:
+            case TokenType::MINUS:
+            case TokenType::MINUS_EQUAL:
+            case TokenType::STAR:
+            case TokenType::STAR_EQUAL:
+            case TokenType::SLASH:
+            case TokenType::SLASH_EQUAL:
+            case TokenType::MOD:
+                break;
+            default:
+                return false;   // comparisons only appear as conditions
+        }
+        if (!operands(node))
+            return false;
+
+        switch (node->op.type)
+        {
+            case TokenType::PLUS:
+            case TokenType::PLUS_EQUAL:
+                emit({0xF2, 0x0F, 0x58, 0xC1});   // addsd xmm0, xmm1
+                break;
+            case TokenType::MINUS:
+            case TokenType::MINUS_EQUAL:
+                emit({0xF2, 0x0F, 0x5C, 0xC1});   // subsd
+                break;
+            case TokenType::STAR:
+            case TokenType::STAR_EQUAL:
+                emit({0xF2, 0x0F, 0x59, 0xC1});   // mulsd
+                break;
+            case TokenType::SLASH:
+            case TokenType::SLASH_EQUAL:
+            {
+                // the interpreter throws on x / 0, let it
+                int ok = label();
+                emit({0x66, 0x0F, 0x57, 0xD2});   // xorpd xmm2, xmm2
+                emit({0x66, 0x0F, 0x2E, 0xCA});   // ucomisd xmm1, xmm2
+                jump_if(0xA, ok);                 // jp
+                jump_if(0x4, deopt);              // je
+                bind(ok);
+                emit({0xF2, 0x0F, 0x5E, 0xC1});   // divsd
+                break;
+            }
+            case TokenType::MOD:
+            {
+                double (*mod)(double, double) = std::fmod;
+                emit({0x48, 0xB8});
+                emit64(reinterpret_cast<u64>(mod));
+                emit({0xFF, 0xD0});               // call rax
+                break;
+            }
+            default:
+                break;
+        }
+        return true;
+    }
+
+    bool unary(UnaryExpr *node)
+    {
+        if (node->op.type == TokenType::MINUS)
+        {
+            if (!expression(node->right))
+                return false;
+            constant(1, -0.0);
+            emit({0x66, 0x0F, 0x57, 0xC1});       // xorpd xmm0, xmm1
+            return true;
+        }
+        if (node->op.type != TokenType::INC && node->op.type != TokenType::DEC)
+            return false;
+
+        int slot = local(node->right);
+        if (slot < 0)
+            return false;
+        load(0, slot);
+        constant(1, node->op.type == TokenType::INC ? 1 : -1);
+        emit({0x66, 0x0F, 0x28, 0xD0});           // movapd xmm2, xmm0
+        emit({0xF2, 0x0F, 0x58, 0xD1});           // addsd xmm2, xmm1
+        store(slot, 2);
+        if (node->isPrefix)
+            emit({0x66, 0x0F, 0x28, 0xC2});       // movapd xmm0, xmm2
+        return true;
+    }
+
+    bool self_call(CallExpr *node)
+    {
+        if (node->callee->type != ExprType::VARIABLE)
+            return false;
+        const std::string &name = static_cast<Variable *>(node->callee.get())->name.lexeme;
+        return name == function->name.lexeme && find(name) < 0 && node->args.size() == function->arity;
+    }
+
+    bool call(CallExpr *node)
+    {
+        if (!self_call(node))
+            return false;
+
+        int base = top;
+        for (u32 i = 0; i < node->args.size(); i++)
+            alloc();
+        int result = alloc();
+        for (u32 i = 0; i < node->args.size(); i++)
+        {
+            if (!expression(node->args[i]))
+                return false;
+            store(base + i, 0);
+        }
+        emit({0x48, 0x8D, 0xBC, 0x24});           // lea rdi, [rsp + args]
+        emit32(base * 8);
+        emit({0x48, 0x8D, 0xB4, 0x24});           // lea rsi, [rsp + result]
+        emit32(result * 8);
+        emit({0xE8});                             // call self
+        emit32((u32)(0 - (int)(code.size() + 4)));
+        emit({0x85, 0xC0});                       // test eax, eax
+        jump_if(0x5, deopt);                      // jne
+        load(0, result);
+        top = base;
+        return true;
+    }
+
+    // a self call in tail position overwrites the parameters and starts over
+    bool tail_call(CallExpr *node)
+    {
+        int base = top;
+        for (u32 i = 0; i < node->args.size(); i++)
+            alloc();
+        for (u32 i = 0; i < node->args.size(); i++)
+        {
+            if (!expression(node->args[i]))
+                return false;
+            store(base + i, 0);
+        }
+        for (u32 i = 0; i < node->args.size(); i++)
+        {
+            load(0, base + i);
+            store(params[i], 0);
+        }
+        top = base;
+        jump(entry);
+        return true;
+    }
+
+    bool expression(const ExprPtr &expr)
+    {
+        if (!expr)
+            return false;
+        switch (expr->type)
+        {
+            case ExprType::L_NUMBER:
+                constant(0, static_cast<NumberLiteral *>(expr.get())->value);
+                return true;
+            case ExprType::GROUPING:
+                return expression(static_cast<GroupingExpr *>(expr.get())->expr);
+            case ExprType::VARIABLE:
+            {
+                int slot = local(expr);
+                if (slot < 0)
+                    return false;
+                load(0, slot);
+                return true;
+            }
+            case ExprType::ASSIGN:
+            {
+                Assign *assign = static_cast<Assign *>(expr.get());
+                int slot = find(assign->name.lexeme);
+                if (slot < 0 || !expression(assign->value))
+                    return false;
+                store(slot, 0);
+                return true;
+            }
+            case ExprType::BINARY:
+                return binary(static_cast<BinaryExpr *>(expr.get()));
+            case ExprType::UNARY:
+                return unary(static_cast<UnaryExpr *>(expr.get()));
+            case ExprType::CALL:
+                return call(static_cast<CallExpr *>(expr.get()));
+            default:
+                return false;
+        }
+    }
+
+    // jumps to target when the truthiness of expr equals when
+    bool condition(const ExprPtr &expr, bool when, int target)
+    {
+        if (!expr)
+            return false;
+        switch (expr->type)
+        {
+            case ExprType::GROUPING:
+                return condition(static_cast<GroupingExpr *>(expr.get())->expr, when, target);
+            case ExprType::L_BOOLEAN:
+                if (static_cast<BooleanLiteral *>(expr.get())->value == when)
+                    jump(target);
+                return true;
+            case ExprType::UNARY:
+            {
+                UnaryExpr *node = static_cast<UnaryExpr *>(expr.get());
+                if (node->op.type == TokenType::BANG)
+                    return condition(node->right, !when, target);
+                break;
+            }
+            case ExprType::LOGICAL:
+            {
+                LogicalExpr *node = static_cast<LogicalExpr *>(expr.get());
+                if (node->op.type != TokenType::AND && node->op.type != TokenType::OR)
+                    return false;
+                // and/or stop as soon as the left side decides
+                bool decides = node->op.type == TokenType::OR;
+                if (decides == when)
+                {
+                    return condition(node->left, when, target) && condition(node->right, when, target);
+                }
+                int skip = label();
+                if (!condition(node->left, decides, skip) || !condition(node->right, when, target))
+                    return false;
+                bind(skip);
+                return true;
+            }
+            case ExprType::BINARY:
+            {
+                BinaryExpr *node = static_cast<BinaryExpr *>(expr.get());
+                bool swap = false;
+                u8 cc = 0;   // jump when the comparison holds, unordered counts as false
+                switch (node->op.type)
+                {
+                    case TokenType::LESS:          swap = true;  cc = 0x7; break;   // ja
+                    case TokenType::LESS_EQUAL:    swap = true;  cc = 0x3; break;   // jae
+                    case TokenType::GREATER:       cc = 0x7; break;
+                    case TokenType::GREATER_EQUAL: cc = 0x3; break;
+                    case TokenType::EQUAL_EQUAL:
+                    case TokenType::BANG_EQUAL:
+                        break;
+                    default:
+                        return number_condition(expr, when, target);
+                }
+                if (!operands(node))
+                    return false;
+                if (swap)
+                    emit({0x66, 0x0F, 0x2E, 0xC8});   // ucomisd xmm1, xmm0
+                else
+                    emit({0x66, 0x0F, 0x2E, 0xC1});   // ucomisd xmm0, xmm1
+
+                if (node->op.type == TokenType::EQUAL_EQUAL)
+                    equal(when, target);
+                else if (node->op.type == TokenType::BANG_EQUAL)
+                    equal(!when, target);
+                else
+                    jump_if(when ? cc : cc ^ 1, target);   // ja/jbe, jae/jb
+                return true;
+            }
+            default:
+                break;
+        }
+        return number_condition(expr, when, target);
+    }
+
+    // after ucomisd: jump when (ZF && !PF) equals when
+    void equal(bool when, int target)
+    {
+        if (when)
+        {
+            int skip = label();
+            jump_if(0xA, skip);     // jp
+            jump_if(0x4, target);   // je
+            bind(skip);
+        }
+        else
+        {
+            jump_if(0xA, target);   // jp
+            jump_if(0x5, target);   // jne
+        }
+    }
+
+    // numbers are true when not zero
+    bool number_condition(const ExprPtr &expr, bool when, int target)
+    {
+        if (!expression(expr))
+            return false;
+        emit({0x66, 0x0F, 0x57, 0xC9});   // xorpd xmm1, xmm1
+        emit({0x66, 0x0F, 0x2E, 0xC1});   // ucomisd xmm0, xmm1
+        equal(!when, target);
+        return true;
+    }
+
+    //******************************************************************************* */
+
+    bool list(const std::vector<StmtPtr> &statements)
+    {
+        for (auto &s : statements)
+        {
+            // a declaration only counts once it sits directly in a block
+            if (s && s->type == StmtType::DECLARATION)
+            {
+                if (!declaration(static_cast<Declaration *>(s.get())))
+                    return false;
+                continue;
+            }
+            if (!statement(s))
+                return false;
+        }
+        return true;
+    }
+
+    bool declaration(Declaration *node)
+    {
+        if (!expression(node->initializer))
+            return false;
+        for (auto &name : node->names)
+        {
+            if (!declare(name.lexeme))
+                return false;
+            store(find(name.lexeme), 0);
+        }
+        return true;
+    }
+
+    bool body(const StmtPtr &stmt)
+    {
+        if (!stmt || stmt->type != StmtType::BLOCK)
+            return statement(stmt);
+        push_scope();
+        bool ok = list(static_cast<BlockStmt *>(stmt.get())->statements);
+        pop_scope();
+        return ok;
+    }
+
+    bool statement(const StmtPtr &stmt)
+    {
+        if (!stmt)
+            return true;
+        switch (stmt->type)
+        {
+            case StmtType::BLOCK:
+                return body(stmt);
+            case StmtType::EXPRESSION:
+            {
+                ExpressionStmt *node = static_cast<ExpressionStmt *>(stmt.get());
+                return !node->expression || expression(node->expression);
+            }
+            case StmtType::RETURN:
+            {
+                ReturnStmt *node = static_cast<ReturnStmt *>(stmt.get());
+                if (node->tail && self_call(static_cast<CallExpr *>(node->value.get())))
+                    return tail_call(static_cast<CallExpr *>(node->value.get()));
+                if (!expression(node->value))
+                    return false;
+                emit({0xF2, 0x0F, 0x11, 0x03});   // movsd [rbx], xmm0
+                emit({0x31, 0xC0});               // xor eax, eax
+                jump(epilogue);
+                return true;
+            }
+            case StmtType::IF:
+            {
+                IFStmt *node = static_cast<IFStmt *>(stmt.get());
+                int end = label();
+                int next = label();
+                if (!condition(node->condition, false, next) || !body(node->then_branch))
+                    return false;
+                jump(end);
+                bind(next);
+                for (auto &elif : node->elifBranch)
+                {
+                    next = label();
+                    if (!condition(elif->condition, false, next) || !body(elif->then_branch))
+                        return false;
+                    jump(end);
+                    bind(next);
+                }
+                if (!body(node->else_branch))
+                    return false;
+                bind(end);
+                return true;
+            }
+            case StmtType::WHILE:
+            {
+                WhileStmt *node = static_cast<WhileStmt *>(stmt.get());
+                Loop loop{label(), label()};
+                bind(loop.start);
+                if (!condition(node->condition, false, loop.end))
+                    return false;
+                loops.push_back(loop);
+                if (!body(node->body))
+                    return false;
+                loops.pop_back();
+                jump(loop.start);
+                bind(loop.end);
+                return true;
+            }
+            case StmtType::DO:
+            {
+                DoStmt *node = static_cast<DoStmt *>(stmt.get());
+                Loop loop{label(), label()};
+                int start = label();
+                bind(start);
+                loops.push_back(loop);
+                if (!body(node->body))
+                    return false;
+                loops.pop_back();
+                bind(loop.start);
+                if (!condition(node->condition, true, start))
+                    return false;
+                bind(loop.end);
+                return true;
+            }
+            case StmtType::FOR:
+            {
+                ForStmt *node = static_cast<ForStmt *>(stmt.get());
+                push_scope();
+                bool ok = node->initializer && node->initializer->type == StmtType::DECLARATION
+                    ? declaration(static_cast<Declaration *>(node->initializer.get()))
+                    : statement(node->initializer);
+                if (!ok)
+                    return false;
+                Loop loop{label(), label()};
+                int start = label();
+                bind(start);
+                if (!condition(node->condition, false, loop.end))
+                    return false;
+                loops.push_back(loop);
+                if (!body(node->body))
+                    return false;
+                loops.pop_back();
+                bind(loop.start);
+                if (node->increment && !expression(node->increment))
+                    return false;
+                jump(start);
+                bind(loop.end);
+                pop_scope();
+                return true;
+            }
+            case StmtType::BREAK:
+            case StmtType::CONTINUE:
+            {
+                if (loops.empty())
+                    return false;
+                jump(stmt->type == StmtType::BREAK ? loops.back().end : loops.back().start);
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool compile()
+    {
+        if (!function->body || function->body->type != StmtType::BLOCK)
+            return false;
+
+        emit({0x55});                         // push rbp
+        emit({0x48, 0x89, 0xE5});             // mov rbp, rsp
+        emit({0x53});                         // push rbx
+        emit({0x41, 0x54});                   // push r12
+        emit({0x48, 0x81, 0xEC});             // sub rsp, frame
+        frameFixup = code.size();
+        emit32(0);
+        emit({0x48, 0x89, 0xF3});             // mov rbx, rsi
+
+        epilogue = label();
+        deopt = label();
+        entry = label();
+
+        push_scope();
+        for (u32 i = 0; i < function->arity; i++)
+        {
+            if (!declare(function->args[i]))
+                return false;
+            emit({0xF2, 0x0F, 0x10, 0x87});   // movsd xmm0, [rdi + 8*i]
+            emit32(i * 8);
+            params.push_back(find(function->args[i]));
+            store(params.back(), 0);
+        }
+        bind(entry);
+        if (!list(static_cast<BlockStmt *>(function->body.get())->statements))
+            return false;
+        pop_scope();
+
+        // falling off the end returns nil
+        bind(deopt);
+        emit({0xB8});                         // mov eax, JIT_DEOPT
+        emit32(JIT_DEOPT);
+        bind(epilogue);
+        emit({0x48, 0x81, 0xC4});             // add rsp, frame
+        int frameFixup2 = code.size();
+        emit32(0);
+        emit({0x41, 0x5C});                   // pop r12
+        emit({0x5B});                         // pop rbx
+        emit({0x5D});                         // pop rbp
+        emit({0xC3});                         // ret
+
+        u32 frame = (maxTop * 8 + 15) & ~15u;
+        memcpy(&code[frameFixup], &frame, 4);
+        memcpy(&code[frameFixup2], &frame, 4);
+        for (auto &fixup : fixups)
+        {
+            s32 rel = labels[fixup.second] - (fixup.first + 4);
+            memcpy(&code[fixup.first], &rel, 4);
+        }
+        return true;
+    }
+};
+
+Jit::Jit()
+{
+}
+
+Jit::~Jit()
+{
+    for (auto &page : pages)
+    {
+        munmap(page.first, page.second);
+    }
+}
+
+JitCode Jit::compile(Function *function)
+{
+    JitFunction compiler(function);
+    if (!compiler.compile())
+    {
+        return nullptr;
+    }
+
+    size_t size = (compiler.code.size() + 4095) & ~size_t(4095);
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        WARNING("JIT: could not map %zu bytes", size);
+        return nullptr;
+    }
+    memcpy(memory, compiler.code.data(), compiler.code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, size);
+        return nullptr;
+    }
+    pages.push_back({memory, size});
+    INFO("JIT: %s compiled to %zu bytes", function->name.lexeme.c_str(), compiler.code.size());
+    return reinterpret_cast<JitCode>(memory);
+}
+
+#else
+
+Jit::Jit()
+{
+}
+
+Jit::~Jit()
+{
+}
+
+JitCode Jit::compile(Function *function)
+{
+    return nullptr;
+}
+
+#endif
@@ -65,6 +65,9 @@ void Lexer::process()
   case ',':
     addToken(TokenType::COMMA);
     break;
+  case '@':
+    addToken(TokenType::AT);
+    break;
   case '.':
     addToken(TokenType::DOT);
     break;
@@ -415,6 +418,7 @@ void Lexer::initialize()
 
   keywords["nil"] = TokenType::NIL;
   keywords["var"] = TokenType::VAR;
+  keywords["const"] = TokenType::CONST;
   keywords["false"] = TokenType::FALSE;
   keywords["true"] = TokenType::TRUE;
 
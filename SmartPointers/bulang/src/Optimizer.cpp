@@ -0,0 +1,1969 @@
+#include "pch.h"
+#include "Optimizer.hpp"
+#include "TypeInference.hpp"
+#include "Utils.hpp"
+
+std::string toLower(const std::string &str);
+
+static bool constant(const ExprPtr &expr, Value &value)
+{
+    if (!expr)
+    {
+        return false;
+    }
+    switch (expr->type)
+    {
+        case ExprType::L_NUMBER:  value = Value::number(static_cast<NumberLiteral *>(expr.get())->value); return true;
+        case ExprType::L_BOOLEAN: value = Value::boolean(static_cast<BooleanLiteral *>(expr.get())->value); return true;
+        case ExprType::L_STRING:  value = Value::string(static_cast<StringLiteral *>(expr.get())->value); return true;
+        default:                  return false;
+    }
+}
+
+static ExprPtr literal(const Value &value)
+{
+    if (value.isNumber())
+    {
+        std::shared_ptr<NumberLiteral> node = std::make_shared<NumberLiteral>();
+        node->value = value.asNumber();
+        return node;
+    }
+    if (value.isBool())
+    {
+        std::shared_ptr<BooleanLiteral> node = std::make_shared<BooleanLiteral>();
+        node->value = value.asBool();
+        return node;
+    }
+    std::shared_ptr<StringLiteral> node = std::make_shared<StringLiteral>();
+    node->value = value.asString();
+    return node;
+}
+
+// Compiler::binary without the throws: false leaves the error for run time
+static bool fold(TokenType op, const Value &a, const Value &b, Value &result)
+{
+    if (a.isNumber() && b.isNumber())
+    {
+        double x = a.asNumber();
+        double y = b.asNumber();
+        switch (op)
+        {
+            case TokenType::GREATER:       result = Value::boolean(x > y); return true;
+            case TokenType::GREATER_EQUAL: result = Value::boolean(x >= y); return true;
+            case TokenType::LESS:          result = Value::boolean(x < y); return true;
+            case TokenType::LESS_EQUAL:    result = Value::boolean(x <= y); return true;
+            case TokenType::BANG_EQUAL:    result = Value::boolean(x != y); return true;
+            case TokenType::EQUAL_EQUAL:   result = Value::boolean(x == y); return true;
+            case TokenType::PLUS:
+            case TokenType::PLUS_EQUAL:    result = Value::number(x + y); return true;
+            case TokenType::MINUS:
+            case TokenType::MINUS_EQUAL:   result = Value::number(x - y); return true;
+            case TokenType::STAR:
+            case TokenType::STAR_EQUAL:    result = Value::number(x * y); return true;
+            case TokenType::MOD:           result = Value::number(std::fmod(x, y)); return true;
+            case TokenType::SLASH:
+            case TokenType::SLASH_EQUAL:
+                if (y == 0)
+                    return false;
+                result = Value::number(x / y);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    switch (op)
+    {
+        case TokenType::PLUS:
+        case TokenType::PLUS_EQUAL:
+            if (a.isString() && b.isString())
+                result = Value::string(a.asString() + b.asString());
+            else if (a.isString() && b.isNumber())
+                result = Value::string(a.asString() + std::to_string(b.asNumber()));
+            else if (a.isNumber() && b.isString())
+                result = Value::string(std::to_string(a.asNumber()) + b.asString());
+            else
+                return false;
+            return true;
+        case TokenType::EQUAL_EQUAL:
+        case TokenType::BANG_EQUAL:
+            if ((a.isString() && b.isString()) || (a.isBool() && b.isBool()))
+            {
+                result = Value::boolean(a.equals(b) == (op == TokenType::EQUAL_EQUAL));
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+static bool is_number(bool known, const Value &value, double number)
+{
+    return known && value.isNumber() && value.asNumber() == number;
+}
+
+// nodes in the returned expression of a function that may still be inlined
+static const int INLINE_MAX_NODES = 24;
+
+static void children(Stmt *stmt, const std::function<void(StmtPtr &)> &onStmt, const std::function<void(ExprPtr &)> &onExpr)
+{
+    switch (stmt->type)
+    {
+        case StmtType::BLOCK:
+            for (auto &s : static_cast<BlockStmt *>(stmt)->statements)
+                onStmt(s);
+            break;
+        case StmtType::EXPRESSION:  onExpr(static_cast<ExpressionStmt *>(stmt)->expression); break;
+        case StmtType::PRINT:       onExpr(static_cast<PrintStmt *>(stmt)->expression); break;
+        case StmtType::DECLARATION: onExpr(static_cast<Declaration *>(stmt)->initializer); break;
+        case StmtType::RETURN:      onExpr(static_cast<ReturnStmt *>(stmt)->value); break;
+        case StmtType::FUNCTION:    onStmt(static_cast<FunctionStmt *>(stmt)->body); break;
+        case StmtType::IF:
+        {
+            IFStmt *node = static_cast<IFStmt *>(stmt);
+            onExpr(node->condition);
+            onStmt(node->then_branch);
+            for (auto &elif : node->elifBranch)
+            {
+                onExpr(elif->condition);
+                onStmt(elif->then_branch);
+            }
+            onStmt(node->else_branch);
+            break;
+        }
+        case StmtType::SWITCH:
+        {
+            SwitchStmt *node = static_cast<SwitchStmt *>(stmt);
+            onExpr(node->condition);
+            for (auto &c : node->cases)
+            {
+                onExpr(c->condition);
+                onStmt(c->body);
+            }
+            onStmt(node->defaultBranch);
+            break;
+        }
+        case StmtType::WHILE:
+            onExpr(static_cast<WhileStmt *>(stmt)->condition);
+            onStmt(static_cast<WhileStmt *>(stmt)->body);
+            break;
+        case StmtType::DO:
+            onStmt(static_cast<DoStmt *>(stmt)->body);
+            onExpr(static_cast<DoStmt *>(stmt)->condition);
+            break;
+        case StmtType::FOR:
+        {
+            ForStmt *node = static_cast<ForStmt *>(stmt);
+            onStmt(node->initializer);
+            onExpr(node->condition);
+            onExpr(node->increment);
+            onStmt(node->body);
+            break;
+        }
+        case StmtType::FROM:
+        {
+            FromStmt *node = static_cast<FromStmt *>(stmt);
+            onStmt(node->variable);
+            onExpr(node->array);
+            onStmt(node->body);
+            break;
+        }
+        case StmtType::CLASS:
+        {
+            ClassStmt *node = static_cast<ClassStmt *>(stmt);
+            onExpr(node->superClass);
+            for (auto &field : node->fields)
+                onStmt(field);
+            for (auto &method : node->methods)
+                onStmt(method);
+            break;
+        }
+        case StmtType::STRUCT:
+            for (auto &value : static_cast<StructStmt *>(stmt)->values)
+                onStmt(value);
+            break;
+        case StmtType::ARRAY:
+            for (auto &value : static_cast<ArrayStmt *>(stmt)->values)
+                onExpr(value);
+            break;
+        case StmtType::MAP:
+            for (auto &entry : static_cast<MapStmt *>(stmt)->values)
+            {
+                ExprPtr key = entry.first;   // keys are not rewritten
+                onExpr(key);
+                onExpr(entry.second);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void children(Expr *expr, const std::function<void(ExprPtr &)> &onExpr)
+{
+    switch (expr->type)
+    {
+        case ExprType::BINARY:
+            onExpr(static_cast<BinaryExpr *>(expr)->left);
+            onExpr(static_cast<BinaryExpr *>(expr)->right);
+            break;
+        case ExprType::LOGICAL:
+            onExpr(static_cast<LogicalExpr *>(expr)->left);
+            onExpr(static_cast<LogicalExpr *>(expr)->right);
+            break;
+        case ExprType::UNARY:    onExpr(static_cast<UnaryExpr *>(expr)->right); break;
+        case ExprType::GROUPING: onExpr(static_cast<GroupingExpr *>(expr)->expr); break;
+        case ExprType::ASSIGN:   onExpr(static_cast<Assign *>(expr)->value); break;
+        case ExprType::GET:      onExpr(static_cast<GetExpr *>(expr)->object); break;
+        case ExprType::SET:
+            onExpr(static_cast<SetExpr *>(expr)->object);
+            onExpr(static_cast<SetExpr *>(expr)->value);
+            break;
+        case ExprType::GET_DEF:
+        {
+            GetDefinitionExpr *node = static_cast<GetDefinitionExpr *>(expr);
+            onExpr(node->variable);
+            for (auto &value : node->values)
+                onExpr(value);
+            break;
+        }
+        case ExprType::CALL:
+        {
+            CallExpr *node = static_cast<CallExpr *>(expr);
+            onExpr(node->callee);
+            for (auto &arg : node->args)
+                onExpr(arg);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static int size(const ExprPtr &expr)
+{
+    int count = 0;
+    std::function<void(ExprPtr &)> visit = [&](ExprPtr &e)
+    {
+        if (e)
+        {
+            count++;
+            children(e.get(), visit);
+        }
+    };
+    ExprPtr root = expr;
+    visit(root);
+    return count;
+}
+
+static int uses(const ExprPtr &expr, const std::string &name)
+{
+    int count = 0;
+    std::function<void(ExprPtr &)> visit = [&](ExprPtr &e)
+    {
+        if (!e)
+            return;
+        if (e->type == ExprType::VARIABLE && static_cast<Variable *>(e.get())->name.lexeme == name)
+            count++;
+        children(e.get(), visit);
+    };
+    ExprPtr root = expr;
+    visit(root);
+    return count;
+}
+
+// the first line a token of the expression was on, for the log
+static int line_of(const ExprPtr &expr)
+{
+    if (!expr)
+    {
+        return 0;
+    }
+    switch (expr->type)
+    {
+        case ExprType::BINARY:   return static_cast<BinaryExpr *>(expr.get())->op.line;
+        case ExprType::UNARY:    return static_cast<UnaryExpr *>(expr.get())->op.line;
+        case ExprType::LOGICAL:  return static_cast<LogicalExpr *>(expr.get())->op.line;
+        case ExprType::VARIABLE: return static_cast<Variable *>(expr.get())->name.line;
+        case ExprType::GET:      return static_cast<GetExpr *>(expr.get())->name.line;
+        case ExprType::GET_DEF:  return static_cast<GetDefinitionExpr *>(expr.get())->name.line;
+        case ExprType::CALL:     return static_cast<CallExpr *>(expr.get())->name.line;
+        case ExprType::GROUPING: return line_of(static_cast<GroupingExpr *>(expr.get())->expr);
+        default:                 return 0;
+    }
+}
+
+static bool simple(const ExprPtr &expr)
+{
+    switch (expr->type)
+    {
+        case ExprType::L_NUMBER:
+        case ExprType::L_STRING:
+        case ExprType::L_BOOLEAN:
+        case ExprType::VARIABLE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// what share() may compute once: operators over locals, literals and field reads
+static bool shareable(const ExprPtr &expr)
+{
+    if (!expr)
+    {
+        return false;
+    }
+    switch (expr->type)
+    {
+        case ExprType::LITERAL:
+        case ExprType::L_NUMBER:
+        case ExprType::L_STRING:
+        case ExprType::L_BOOLEAN:
+        case ExprType::VARIABLE:
+        case ExprType::SELF:
+            return true;
+        case ExprType::BINARY:
+            return shareable(static_cast<BinaryExpr *>(expr.get())->left) && shareable(static_cast<BinaryExpr *>(expr.get())->right);
+        case ExprType::UNARY:
+        {
+            UnaryExpr *node = static_cast<UnaryExpr *>(expr.get());
+            return node->op.type != TokenType::INC && node->op.type != TokenType::DEC && shareable(node->right);
+        }
+        case ExprType::GROUPING:
+            return shareable(static_cast<GroupingExpr *>(expr.get())->expr);
+        case ExprType::GET:
+            return shareable(static_cast<GetExpr *>(expr.get())->object);
+        default:
+            return false;
+    }
+}
+
+static bool fields(const ExprPtr &expr)
+{
+    if (!expr)
+    {
+        return false;
+    }
+    bool result = expr->type == ExprType::GET;
+    children(expr.get(), [&](ExprPtr &e) { result = result || fields(e); });
+    return result;
+}
+
+// structural equality for shareable() trees, hash() is only the first filter
+static bool same(const ExprPtr &a, const ExprPtr &b)
+{
+    if (!a || !b)
+    {
+        return a == b;
+    }
+    if (a->type != b->type)
+    {
+        return false;
+    }
+    switch (a->type)
+    {
+        case ExprType::LITERAL:
+        case ExprType::SELF:
+            return true;
+        case ExprType::L_NUMBER:
+        {
+            double x = static_cast<NumberLiteral *>(a.get())->value, y = static_cast<NumberLiteral *>(b.get())->value;
+            return x == y && std::signbit(x) == std::signbit(y);
+        }
+        case ExprType::L_STRING:  return static_cast<StringLiteral *>(a.get())->value == static_cast<StringLiteral *>(b.get())->value;
+        case ExprType::L_BOOLEAN: return static_cast<BooleanLiteral *>(a.get())->value == static_cast<BooleanLiteral *>(b.get())->value;
+        case ExprType::VARIABLE:  return static_cast<Variable *>(a.get())->name.lexeme == static_cast<Variable *>(b.get())->name.lexeme;
+        case ExprType::GROUPING:  return same(static_cast<GroupingExpr *>(a.get())->expr, static_cast<GroupingExpr *>(b.get())->expr);
+        case ExprType::BINARY:
+        {
+            BinaryExpr *x = static_cast<BinaryExpr *>(a.get()), *y = static_cast<BinaryExpr *>(b.get());
+            return x->op.type == y->op.type && same(x->left, y->left) && same(x->right, y->right);
+        }
+        case ExprType::UNARY:
+        {
+            UnaryExpr *x = static_cast<UnaryExpr *>(a.get()), *y = static_cast<UnaryExpr *>(b.get());
+            return x->op.type == y->op.type && same(x->right, y->right);
+        }
+        case ExprType::GET:
+        {
+            GetExpr *x = static_cast<GetExpr *>(a.get()), *y = static_cast<GetExpr *>(b.get());
+            return x->name.lexeme == y->name.lexeme && same(x->object, y->object);
+        }
+        default:
+            return false;
+    }
+}
+
+// a fresh tree for one call site, variables named in `with` are replaced by a copy of their value
+static ExprPtr copy(const ExprPtr &expr, const std::unordered_map<std::string, ExprPtr> &with)
+{
+    if (!expr)
+    {
+        return nullptr;
+    }
+    switch (expr->type)
+    {
+        case ExprType::L_NUMBER:
+        case ExprType::L_STRING:
+        case ExprType::L_BOOLEAN:
+        {
+            Value value;
+            constant(expr, value);
+            return literal(value);
+        }
+        case ExprType::VARIABLE:
+        {
+            Variable *node = static_cast<Variable *>(expr.get());
+            auto it = with.find(node->name.lexeme);
+            if (it != with.end())
+            {
+                return copy(it->second, {});
+            }
+            std::shared_ptr<Variable> result = std::make_shared<Variable>();
+            result->name = node->name;
+            return result;
+        }
+        case ExprType::BINARY:
+        {
+            BinaryExpr *node = static_cast<BinaryExpr *>(expr.get());
+            std::shared_ptr<BinaryExpr> result = std::make_shared<BinaryExpr>();
+            result->op = node->op;
+            result->left = copy(node->left, with);
+            result->right = copy(node->right, with);
+            return result;
+        }
+        case ExprType::UNARY:
+        {
+            UnaryExpr *node = static_cast<UnaryExpr *>(expr.get());
+            std::shared_ptr<UnaryExpr> result = std::make_shared<UnaryExpr>();
+            result->op = node->op;
+            result->isPrefix = node->isPrefix;
+            result->right = copy(node->right, with);
+            return result;
+        }
+        case ExprType::LOGICAL:
+        {
+            LogicalExpr *node = static_cast<LogicalExpr *>(expr.get());
+            std::shared_ptr<LogicalExpr> result = std::make_shared<LogicalExpr>();
+            result->op = node->op;
+            result->left = copy(node->left, with);
+            result->right = copy(node->right, with);
+            return result;
+        }
+        case ExprType::GROUPING:
+        {
+            std::shared_ptr<GroupingExpr> result = std::make_shared<GroupingExpr>();
+            result->expr = copy(static_cast<GroupingExpr *>(expr.get())->expr, with);
+            return result;
+        }
+        case ExprType::GET:
+        {
+            GetExpr *node = static_cast<GetExpr *>(expr.get());
+            std::shared_ptr<GetExpr> result = std::make_shared<GetExpr>();
+            result->name = node->name;
+            result->object = copy(node->object, with);
+            return result;
+        }
+        case ExprType::CALL:
+        {
+            CallExpr *node = static_cast<CallExpr *>(expr.get());
+            std::shared_ptr<CallExpr> result = std::make_shared<CallExpr>();
+            result->name = node->name;
+            result->callee = copy(node->callee, with);
+            for (auto &arg : node->args)
+                result->args.push_back(copy(arg, with));
+            return result;
+        }
+        default:
+            DEBUG_BREAK_IF(true);
+            return nullptr;
+    }
+}
+
+void Optimizer::optimize(Program *program)
+{
+    if (program == nullptr)
+    {
+        return;
+    }
+    for (auto &s : program->statements)
+    {
+        fix(s);
+    }
+    for (auto &s : program->statements)
+    {
+        bind(s);
+    }
+    if (level <= 0)
+    {
+        return;
+    }
+    for (auto &s : program->statements)
+    {
+        shadow(s, true);
+    }
+    // a def only becomes a candidate once it has been walked, so a call is never
+    // inlined ahead of the def at the top level, nor into the function itself
+    for (auto &s : program->statements)
+    {
+        statement(s);
+        if (s && s->type == StmtType::FUNCTION)
+        {
+            candidate(static_cast<FunctionStmt *>(s.get()));
+        }
+    }
+    program->statements.erase(std::remove(program->statements.begin(), program->statements.end(), nullptr), program->statements.end());
+    eliminate(program);
+    share(program->statements);
+    if (verbose)
+    {
+        INFO("Optimizer: %d constant reads folded, %d expressions shared", substituted, shared);
+    }
+    TypeInference().run(program);
+    if (level >= 2)
+    {
+        // again, now that operand types are known some initializers cannot throw
+        typed = true;
+        eliminate(program);
+    }
+}
+
+//***************************************************************************************** */
+
+void Optimizer::bind(const StmtPtr &stmt)
+{
+    if (!stmt)
+    {
+        return;
+    }
+    switch (stmt->type)
+    {
+        case StmtType::DECLARATION:
+        {
+            Declaration *node = static_cast<Declaration *>(stmt.get());
+            for (auto &name : node->names)
+            {
+                if (node->constant)
+                    bindings[name.lexeme]++;
+                else
+                    bind(name.lexeme, name.line);
+            }
+            break;
+        }
+        case StmtType::FUNCTION:
+        {
+            FunctionStmt *node = static_cast<FunctionStmt *>(stmt.get());
+            bind(node->name.lexeme, node->name.line);
+            for (auto &arg : node->args)
+                bind(arg, node->name.line);
+            break;
+        }
+        case StmtType::CLASS:  bind(static_cast<ClassStmt *>(stmt.get())->name.lexeme, static_cast<ClassStmt *>(stmt.get())->name.line); break;
+        case StmtType::STRUCT: bind(static_cast<StructStmt *>(stmt.get())->name.lexeme, static_cast<StructStmt *>(stmt.get())->name.line); break;
+        case StmtType::ARRAY:
+        {
+            ArrayStmt *node = static_cast<ArrayStmt *>(stmt.get());
+            if (node->constant)
+                bindings[node->name.lexeme]++;
+            else
+                bind(node->name.lexeme, node->name.line);
+            containers[node->name.lexeme]++;
+            break;
+        }
+        case StmtType::MAP:
+        {
+            MapStmt *node = static_cast<MapStmt *>(stmt.get());
+            if (node->constant)
+                bindings[node->name.lexeme]++;
+            else
+                bind(node->name.lexeme, node->name.line);
+            containers[node->name.lexeme]++;
+            break;
+        }
+        default:
+            break;
+    }
+    children(stmt.get(), [this](StmtPtr &s) { bind(s); }, [this](ExprPtr &e) { bind(e); });
+}
+
+void Optimizer::bind(const ExprPtr &expr)
+{
+    if (!expr)
+    {
+        return;
+    }
+    if (expr->type == ExprType::ASSIGN)
+    {
+        Assign *node = static_cast<Assign *>(expr.get());
+        bind(node->name.lexeme, node->name.line);
+    }
+    else if (expr->type == ExprType::UNARY)
+    {
+        UnaryExpr *node = static_cast<UnaryExpr *>(expr.get());
+        bool step = node->op.type == TokenType::INC || node->op.type == TokenType::DEC;
+        if (step && node->right && node->right->type == ExprType::VARIABLE)
+        {
+            bind(static_cast<Variable *>(node->right.get())->name.lexeme, node->op.line);
+        }
+    }
+    else if (expr->type == ExprType::GET_DEF)
+    {
+        // the array and map methods that change the container
+        GetDefinitionExpr *node = static_cast<GetDefinitionExpr *>(expr.get());
+        std::string method = toLower(node->name.lexeme);
+        bool changes = method == "push" || method == "pop" || method == "set" || method == "remove" || method == "clear" || method == "erase";
+        if (changes && node->variable && node->variable->type == ExprType::VARIABLE)
+        {
+            const std::string &name = static_cast<Variable *>(node->variable.get())->name.lexeme;
+            if (fixed.count(name))
+            {
+                throw FatalException("Cannot change const '" + name + "' with '" + node->name.lexeme + "' at line " + std::to_string(node->name.line));
+            }
+        }
+    }
+    children(expr.get(), [this](ExprPtr &e) { bind(e); });
+}
+
+void Optimizer::bind(const std::string &name, int line)
+{
+    if (constants && constants->count(name))
+    {
+        throw FatalException("Cannot bind host constant '" + name + "' at line " + std::to_string(line));
+    }
+    if (fixed.count(name))
+    {
+        throw FatalException("Cannot assign to const '" + name + "' at line " + std::to_string(line));
+    }
+    bindings[name]++;
+}
+
+// names a by-name lookup could find before the globals: locals, parameters, and the fields
+// and methods in a class environment
+void Optimizer::shadow(const StmtPtr &stmt, bool top)
+{
+    if (!stmt)
+    {
+        return;
+    }
+    switch (stmt->type)
+    {
+        case StmtType::DECLARATION:
+            if (!top)
+                for (auto &name : static_cast<Declaration *>(stmt.get())->names)
+                    nested.insert(name.lexeme);
+            break;
+        case StmtType::FUNCTION:
+        {
+            FunctionStmt *node = static_cast<FunctionStmt *>(stmt.get());
+            if (!top)
+                nested.insert(node->name.lexeme);
+            nested.insert(node->args.begin(), node->args.end());
+            break;
+        }
+        case StmtType::CLASS:  if (!top) nested.insert(static_cast<ClassStmt *>(stmt.get())->name.lexeme); break;
+        case StmtType::ARRAY:  if (!top) nested.insert(static_cast<ArrayStmt *>(stmt.get())->name.lexeme); break;
+        case StmtType::MAP:    if (!top) nested.insert(static_cast<MapStmt *>(stmt.get())->name.lexeme); break;
+        case StmtType::STRUCT:
+            // its fields are members of the instances, not bindings
+            if (!top)
+                nested.insert(static_cast<StructStmt *>(stmt.get())->name.lexeme);
+            return;
+        default:
+            break;
+    }
+    children(stmt.get(), [this](StmtPtr &s) { shadow(s, false); }, [](ExprPtr &) {});
+}
+
+// a const name is declared once in the whole program, dynamic scoping could otherwise
+// let a read reach a different binding of it
+void Optimizer::fix(const StmtPtr &stmt)
+{
+    if (!stmt)
+    {
+        return;
+    }
+    std::vector<Token> names;
+    switch (stmt->type)
+    {
+        case StmtType::DECLARATION:
+            if (static_cast<Declaration *>(stmt.get())->constant)
+                names = static_cast<Declaration *>(stmt.get())->names;
+            break;
+        case StmtType::ARRAY:
+            if (static_cast<ArrayStmt *>(stmt.get())->constant)
+                names.push_back(static_cast<ArrayStmt *>(stmt.get())->name);
+            break;
+        case StmtType::MAP:
+            if (static_cast<MapStmt *>(stmt.get())->constant)
+                names.push_back(static_cast<MapStmt *>(stmt.get())->name);
+            break;
+        default:
+            break;
+    }
+    for (auto &name : names)
+    {
+        if (constants && constants->count(name.lexeme))
+        {
+            throw FatalException("Cannot bind host constant '" + name.lexeme + "' at line " + std::to_string(name.line));
+        }
+        if (!fixed.emplace(name.lexeme, name.line).second)
+        {
+            throw FatalException("Const '" + name.lexeme + "' at line " + std::to_string(name.line) + " is already declared at line " + std::to_string(fixed[name.lexeme]));
+        }
+    }
+    children(stmt.get(), [this](StmtPtr &s) { fix(s); }, [](ExprPtr &) {});
+}
+
+// every variable is a parameter or a name the script never binds (a native or host
+// global), so the expression reads the same at the call site as in the function
+bool Optimizer::free(const ExprPtr &expr, const std::vector<std::string> &params)
+{
+    bool result = true;
+    std::function<void(ExprPtr &)> visit = [&](ExprPtr &e)
+    {
+        if (!e || !result)
+            return;
+        if (e->type == ExprType::VARIABLE)
+        {
+            const std::string &name = static_cast<Variable *>(e.get())->name.lexeme;
+            auto it = bindings.find(name);
+            result = std::find(params.begin(), params.end(), name) != params.end() || it == bindings.end() || it->second == 0;
+        }
+        children(e.get(), visit);
+    };
+    ExprPtr root = expr;
+    visit(root);
+    return result;
+}
+
+// reads only; with `calls` a call to a native (a name the script never binds) is allowed too
+bool Optimizer::pure(const ExprPtr &expr, bool calls)
+{
+    if (!expr)
+    {
+        return true;
+    }
+    switch (expr->type)
+    {
+        case ExprType::L_NUMBER:
+        case ExprType::L_STRING:
+        case ExprType::L_BOOLEAN:
+        case ExprType::VARIABLE:
+            return true;
+        case ExprType::BINARY:
+        case ExprType::LOGICAL:
+        case ExprType::GROUPING:
+        case ExprType::GET:
+            break;
+        case ExprType::UNARY:
+        {
+            TokenType op = static_cast<UnaryExpr *>(expr.get())->op.type;
+            if (op == TokenType::INC || op == TokenType::DEC)
+                return false;
+            break;
+        }
+        case ExprType::CALL:
+        {
+            CallExpr *node = static_cast<CallExpr *>(expr.get());
+            if (!calls || !node->callee || node->callee->type != ExprType::VARIABLE)
+                return false;
+            auto it = bindings.find(static_cast<Variable *>(node->callee.get())->name.lexeme);
+            if (it != bindings.end() && it->second != 0)
+                return false;
+            break;
+        }
+        default:
+            return false;
+    }
+    bool result = true;
+    children(expr.get(), [&](ExprPtr &e) { result = result && pure(e, calls); });
+    return result;
+}
+
+// A top-level def qualifies when its name is bound nowhere else in the program and its
+// body is a few `var name = value;` followed by `return value;`, all free of side effects
+// except native calls. The locals are substituted into the returned expression here, the
+// parameters at each call site.
+void Optimizer::candidate(FunctionStmt *node)
+{
+    if (bindings[node->name.lexeme] != 1 || node->memo || !node->argTypes.empty() || node->result != A_NONE)
+    {
+        return;
+    }
+    BlockStmt *body = static_cast<BlockStmt *>(node->body.get());
+    if (body == nullptr || body->statements.empty() || body->statements.back()->type != StmtType::RETURN)
+    {
+        return;
+    }
+    ExprPtr result = static_cast<ReturnStmt *>(body->statements.back().get())->value;
+    if (!result)
+    {
+        return;
+    }
+    std::vector<std::string> names = node->args;
+    for (size_t i = 0; i + 1 < body->statements.size(); i++)
+    {
+        StmtPtr &s = body->statements[i];
+        if (s->type != StmtType::DECLARATION)
+        {
+            return;
+        }
+        Declaration *decl = static_cast<Declaration *>(s.get());
+        if (decl->names.size() != 1 || !decl->initializer || decl->annotation != A_NONE)
+        {
+            return;
+        }
+        names.push_back(decl->names[0].lexeme);
+    }
+    std::sort(names.begin(), names.end());
+    if (std::adjacent_find(names.begin(), names.end()) != names.end())
+    {
+        return;   // a local shadows a parameter or another local
+    }
+
+    for (size_t i = body->statements.size() - 1; i-- > 0;)
+    {
+        Declaration *decl = static_cast<Declaration *>(body->statements[i].get());
+        const std::string &local = decl->names[0].lexeme;
+        if (!pure(decl->initializer, true) || (!simple(decl->initializer) && uses(result, local) != 1))
+        {
+            return;
+        }
+        result = copy(result, {{local, decl->initializer}});
+    }
+    if (!pure(result, true) || !free(result, node->args) || size(result) > INLINE_MAX_NODES)
+    {
+        return;
+    }
+    inlines[node->name.lexeme] = {node->args, result};
+}
+
+void Optimizer::inline_call(ExprPtr &expr)
+{
+    CallExpr *node = static_cast<CallExpr *>(expr.get());
+    if (!node->callee || node->callee->type != ExprType::VARIABLE)
+    {
+        return;
+    }
+    const std::string &name = static_cast<Variable *>(node->callee.get())->name.lexeme;
+    auto it = inlines.find(name);
+    if (it == inlines.end() || it->second.params.size() != node->args.size())
+    {
+        return;
+    }
+    // an argument that is not a literal or a variable must be read exactly once, without calls,
+    // so it still runs once and nothing it reads can change in between
+    Inline &target = it->second;
+    std::unordered_map<std::string, ExprPtr> with;
+    for (size_t i = 0; i < node->args.size(); i++)
+    {
+        const ExprPtr &arg = node->args[i];
+        if (!simple(arg) && (uses(target.body, target.params[i]) != 1 || !pure(arg, false)))
+        {
+            return;
+        }
+        with[target.params[i]] = arg;
+    }
+    if (verbose)
+    {
+        INFO("Optimizer: inlined '%s' at line %d", name.c_str(), node->name.line);
+    }
+    expr = copy(target.body, with);
+    expression(expr);
+}
+
+//***************************************************************************************** */
+
+void Optimizer::statements(std::vector<StmtPtr> &list)
+{
+    for (auto &s : list)
+    {
+        statement(s);
+    }
+    list.erase(std::remove(list.begin(), list.end(), nullptr), list.end());
+}
+
+// a statement that must stay, an empty block stands in for one that was pruned away
+void Optimizer::branch(StmtPtr &stmt)
+{
+    if (!stmt)
+    {
+        return;
+    }
+    statement(stmt);
+    if (!stmt)
+    {
+        stmt = std::make_shared<BlockStmt>();
+    }
+}
+
+void Optimizer::statement(StmtPtr &stmt)
+{
+    if (!stmt)
+    {
+        return;
+    }
+    switch (stmt->type)
+    {
+        case StmtType::BLOCK:       statements(static_cast<BlockStmt *>(stmt.get())->statements); break;
+        case StmtType::EXPRESSION:  expression(static_cast<ExpressionStmt *>(stmt.get())->expression); break;
+        case StmtType::PRINT:       expression(static_cast<PrintStmt *>(stmt.get())->expression); break;
+        case StmtType::DECLARATION:
+        {
+            Declaration *node = static_cast<Declaration *>(stmt.get());
+            expression(node->initializer);
+            Value value;
+            if (node->constant && constant(node->initializer, value))
+            {
+                for (auto &name : node->names)
+                    known[name.lexeme] = value;
+            }
+            break;
+        }
+        case StmtType::RETURN:      expression(static_cast<ReturnStmt *>(stmt.get())->value); break;
+        case StmtType::FUNCTION:    statement(static_cast<FunctionStmt *>(stmt.get())->body); break;
+        case StmtType::IF:
+        {
+            IFStmt *node = static_cast<IFStmt *>(stmt.get());
+            condition(node->condition);
+            branch(node->then_branch);
+            for (auto &elif : node->elifBranch)
+            {
+                condition(elif->condition);
+                branch(elif->then_branch);
+            }
+            statement(node->else_branch);
+            prune(stmt);
+            break;
+        }
+        case StmtType::SWITCH:
+        {
+            SwitchStmt *node = static_cast<SwitchStmt *>(stmt.get());
+            expression(node->condition);
+            for (auto &c : node->cases)
+            {
+                expression(c->condition);
+                branch(c->body);
+            }
+            statement(node->defaultBranch);
+            break;
+        }
+        case StmtType::WHILE:
+        {
+            WhileStmt *node = static_cast<WhileStmt *>(stmt.get());
+            condition(node->condition);
+            branch(node->body);
+            loop(stmt);
+            break;
+        }
+        case StmtType::DO:
+        {
+            DoStmt *node = static_cast<DoStmt *>(stmt.get());
+            branch(node->body);
+            condition(node->condition);
+            break;
+        }
+        case StmtType::FOR:
+        {
+            ForStmt *node = static_cast<ForStmt *>(stmt.get());
+            statement(node->initializer);
+            condition(node->condition);
+            expression(node->increment);
+            branch(node->body);
+            loop(stmt);
+            break;
+        }
+        case StmtType::FROM:
+        {
+            FromStmt *node = static_cast<FromStmt *>(stmt.get());
+            expression(node->array);
+            branch(node->body);
+            loop(stmt);
+            break;
+        }
+        case StmtType::CLASS:
+        {
+            ClassStmt *node = static_cast<ClassStmt *>(stmt.get());
+            statements(node->fields);
+            statements(node->methods);
+            break;
+        }
+        case StmtType::STRUCT:
+            statements(static_cast<StructStmt *>(stmt.get())->values);
+            break;
+        case StmtType::ARRAY:
+            for (auto &value : static_cast<ArrayStmt *>(stmt.get())->values)
+                expression(value);
+            break;
+        case StmtType::MAP:
+            for (auto &entry : static_cast<MapStmt *>(stmt.get())->values)
+                expression(entry.second);
+            break;
+        default:
+            break;
+    }
+}
+
+// Loop-invariant code motion. An invariant expression reads nothing the loop writes: its
+// variables are neither declared nor assigned inside, and a field or `.size()` read also
+// needs a loop that stores nothing and calls nothing. Each one is computed once into a
+// `$n` temporary declared in a block around the loop; `$` keeps the name out of reach of
+// scripts. Condition parts are safe to move, the condition runs before anything else in
+// the loop; body parts are only moved from level 2.
+void Optimizer::loop(StmtPtr &stmt)
+{
+    Region r;
+    std::vector<StmtPtr> out;
+    switch (stmt->type)
+    {
+        case StmtType::WHILE:
+        {
+            WhileStmt *node = static_cast<WhileStmt *>(stmt.get());
+            region(stmt, r);
+            hoist(node->condition, r, out);
+            if (level >= 2)
+                hoist_body(node->body, r, out);
+            break;
+        }
+        case StmtType::FOR:
+        {
+            ForStmt *node = static_cast<ForStmt *>(stmt.get());
+            region(stmt, r);
+            hoist(node->condition, r, out);
+            if (level >= 2)
+            {
+                hoist_body(node->body, r, out);
+                hoist(node->increment, r, out);
+            }
+            count(node, r);
+            break;
+        }
+        case StmtType::FROM:
+        {
+            // the array is read once already
+            FromStmt *node = static_cast<FromStmt *>(stmt.get());
+            region(node->variable, r);
+            region(node->body, r);
+            if (level >= 2)
+                hoist_body(node->body, r, out);
+            break;
+        }
+        default:
+            return;
+    }
+    if (out.empty())
+    {
+        return;
+    }
+    std::shared_ptr<BlockStmt> block = std::make_shared<BlockStmt>();
+    block->statements = std::move(out);
+    block->statements.push_back(stmt);
+    stmt = block;
+}
+
+void Optimizer::region(const StmtPtr &stmt, Region &r)
+{
+    if (!stmt)
+    {
+        return;
+    }
+    switch (stmt->type)
+    {
+        case StmtType::DECLARATION:
+            for (auto &name : static_cast<Declaration *>(stmt.get())->names)
+                r.bound.insert(name.lexeme);
+            break;
+        // their bodies only run when called, and a call is already the worst case
+        case StmtType::FUNCTION: r.bound.insert(static_cast<FunctionStmt *>(stmt.get())->name.lexeme); return;
+        case StmtType::CLASS:    r.bound.insert(static_cast<ClassStmt *>(stmt.get())->name.lexeme); return;
+        case StmtType::STRUCT:   r.bound.insert(static_cast<StructStmt *>(stmt.get())->name.lexeme); return;
+        case StmtType::ARRAY:    r.bound.insert(static_cast<ArrayStmt *>(stmt.get())->name.lexeme); break;
+        case StmtType::MAP:      r.bound.insert(static_cast<MapStmt *>(stmt.get())->name.lexeme); break;
+        default:
+            break;
+    }
+    children(stmt.get(), [&](StmtPtr &s) { region(s, r); }, [&](ExprPtr &e) { region(e, r); });
+}
+
+void Optimizer::region(const ExprPtr &expr, Region &r)
+{
+    if (!expr)
+    {
+        return;
+    }
+    switch (expr->type)
+    {
+        case ExprType::ASSIGN:
+            r.bound.insert(static_cast<Assign *>(expr.get())->name.lexeme);
+            break;
+        case ExprType::UNARY:
+        {
+            UnaryExpr *node = static_cast<UnaryExpr *>(expr.get());
+            if (node->op.type == TokenType::INC || node->op.type == TokenType::DEC)
+            {
+                if (node->right && node->right->type == ExprType::VARIABLE)
+                    r.bound.insert(static_cast<Variable *>(node->right.get())->name.lexeme);
+                else
+                    r.stores = true;
+            }
+            break;
+        }
+        case ExprType::SET:
+            r.stores = true;
+            break;
+        case ExprType::GET_DEF:
+        {
+            // on anything but an array or map it is a method call
+            GetDefinitionExpr *node = static_cast<GetDefinitionExpr *>(expr.get());
+            std::string method = toLower(node->name.lexeme);
+            bool container = node->variable && node->variable->type == ExprType::VARIABLE &&
+                             containers[static_cast<Variable *>(node->variable.get())->name.lexeme] == bindings[static_cast<Variable *>(node->variable.get())->name.lexeme];
+            if (!container)
+                r.calls = true;
+            if (method != "size" && method != "at" && method != "last" && method != "find")
+                r.stores = true;
+            break;
+        }
+        case ExprType::CALL:
+        {
+            CallExpr *node = static_cast<CallExpr *>(expr.get());
+            bool native = false;
+            if (node->callee && node->callee->type == ExprType::VARIABLE)
+            {
+                auto it = bindings.find(static_cast<Variable *>(node->callee.get())->name.lexeme);
+                native = it == bindings.end() || it->second == 0;
+            }
+            if (native)
+                r.natives = true;
+            else
+                r.calls = true;
+            break;
+        }
+        default:
+            break;
+    }
+    children(expr.get(), [&](ExprPtr &e) { region(e, r); });
+}
+
+bool Optimizer::invariant(const ExprPtr &expr, const Region &r)
+{
+    if (!expr)
+    {
+        return false;
+    }
+    auto all = [&]()
+    {
+        bool result = true;
+        children(expr.get(), [&](ExprPtr &e) { result = result && invariant(e, r); });
+        return result;
+    };
+    bool quiet = !r.calls && !r.natives && !r.stores;
+    switch (expr->type)
+    {
+        case ExprType::L_NUMBER:
+        case ExprType::L_STRING:
+        case ExprType::L_BOOLEAN:
+            return true;
+        case ExprType::VARIABLE:
+        {
+            const std::string &name = static_cast<Variable *>(expr.get())->name.lexeme;
+            return !r.bound.count(name) && (!r.calls || name[0] == '$');
+        }
+        case ExprType::BINARY:
+        case ExprType::LOGICAL:
+        case ExprType::GROUPING:
+            return all();
+        case ExprType::UNARY:
+        {
+            TokenType op = static_cast<UnaryExpr *>(expr.get())->op.type;
+            return op != TokenType::INC && op != TokenType::DEC && all();
+        }
+        case ExprType::GET:
+            return quiet && all();
+        case ExprType::GET_DEF:
+        {
+            GetDefinitionExpr *node = static_cast<GetDefinitionExpr *>(expr.get());
+            if (!quiet || !node->values.empty() || toLower(node->name.lexeme) != "size" ||
+                !node->variable || node->variable->type != ExprType::VARIABLE)
+            {
+                return false;
+            }
+            const std::string &name = static_cast<Variable *>(node->variable.get())->name.lexeme;
+            return containers[name] == bindings[name] && invariant(node->variable, r);
+        }
+        default:
+            return false;
+    }
+}
+
+// the largest invariant pieces go to `out`, the right side of and/or may not run so it stays
+void Optimizer::hoist(ExprPtr &expr, const Region &r, std::vector<StmtPtr> &out)
+{
+    if (!expr)
+    {
+        return;
+    }
+    if (invariant(expr, r))
+    {
+        if (simple(expr))
+        {
+            return;
+        }
+        std::string name = "$" + std::to_string(temps++);
+        int line = line_of(expr);
+        std::shared_ptr<Declaration> decl = std::make_shared<Declaration>();
+        decl->names.push_back(Token(TokenType::IDENTIFIER, name, "", line));
+        decl->initializer = expr;
+        out.push_back(decl);
+        std::shared_ptr<Variable> temp = std::make_shared<Variable>();
+        temp->name = decl->names[0];
+        expr = temp;
+        if (verbose)
+        {
+            INFO("Optimizer: hoisted an invariant %s at line %d out of its loop as '%s'", decl->initializer->toString().c_str(), line, name.c_str());
+        }
+        return;
+    }
+    if (expr->type == ExprType::LOGICAL)
+    {
+        hoist(static_cast<LogicalExpr *>(expr.get())->left, r, out);
+        return;
+    }
+    children(expr.get(), [&](ExprPtr &e) { hoist(e, r, out); });
+}
+
+void Optimizer::hoist_body(const StmtPtr &stmt, const Region &r, std::vector<StmtPtr> &out)
+{
+    if (!stmt || stmt->type == StmtType::FUNCTION || stmt->type == StmtType::CLASS || stmt->type == StmtType::STRUCT)
+    {
+        return;
+    }
+    children(stmt.get(), [&](StmtPtr &s) { hoist_body(s, r, out); }, [&](ExprPtr &e) { hoist(e, r, out); });
+}
+
+// `for (var i = a; i < n; i++)` and the `>`, `>=` / `--` mirror, with the body leaving i alone
+void Optimizer::count(ForStmt *node, const Region &r)
+{
+    if (!node->initializer || node->initializer->type != StmtType::DECLARATION ||
+        !node->condition || node->condition->type != ExprType::BINARY ||
+        !node->increment || node->increment->type != ExprType::UNARY)
+    {
+        return;
+    }
+    Declaration *init = static_cast<Declaration *>(node->initializer.get());
+    BinaryExpr *test = static_cast<BinaryExpr *>(node->condition.get());
+    UnaryExpr *step = static_cast<UnaryExpr *>(node->increment.get());
+    if (init->names.size() != 1 || !init->initializer || !test->left || test->left->type != ExprType::VARIABLE ||
+        !step->right || step->right->type != ExprType::VARIABLE)
+    {
+        return;
+    }
+    const std::string &name = init->names[0].lexeme;
+    if (static_cast<Variable *>(test->left.get())->name.lexeme != name ||
+        static_cast<Variable *>(step->right.get())->name.lexeme != name)
+    {
+        return;
+    }
+    bool up = test->op.type == TokenType::LESS || test->op.type == TokenType::LESS_EQUAL;
+    bool down = test->op.type == TokenType::GREATER || test->op.type == TokenType::GREATER_EQUAL;
+    if (!(up && step->op.type == TokenType::INC) && !(down && step->op.type == TokenType::DEC))
+    {
+        return;
+    }
+    if (!invariant(test->right, r) || (!simple(test->right)))
+    {
+        return;
+    }
+    Region body;
+    region(node->body, body);
+    if (body.bound.count(name))
+    {
+        return;
+    }
+    node->counted = true;
+    if (verbose)
+    {
+        INFO("Optimizer: counted loop on '%s' at line %d", name.c_str(), init->names[0].line);
+    }
+}
+
+// Dead code, after inlining so helpers that were inlined everywhere go too:
+//  - top-level defs, classes and structs no code that runs can reach by name
+//  - statements after return, break or continue in the same block
+//  - local declarations (and `var a[]` / `var m{}`) of a name nothing in the program reads
+//    or assigns, through dynamic scoping any function could; the initializer has to be a
+//    literal, or from level 2 an operator TypeInference typed that cannot throw (see settled)
+// Top-level variables stay unless they are `const`, class and struct fields are not locals.
+void Optimizer::eliminate(Program *program)
+{
+    std::unordered_map<std::string, std::vector<Stmt *>> definitions;
+    std::unordered_map<std::string, int> uses;
+    for (auto &s : program->statements)
+    {
+        switch (s->type)
+        {
+            case StmtType::FUNCTION: definitions[static_cast<FunctionStmt *>(s.get())->name.lexeme].push_back(s.get()); break;
+            case StmtType::CLASS:    definitions[static_cast<ClassStmt *>(s.get())->name.lexeme].push_back(s.get()); break;
+            case StmtType::STRUCT:   definitions[static_cast<StructStmt *>(s.get())->name.lexeme].push_back(s.get()); break;
+            default:                 references(s, uses); break;
+        }
+    }
+
+    std::vector<std::string> work;
+    for (auto &it : uses)
+    {
+        work.push_back(it.first);
+    }
+    std::unordered_set<std::string> reached;
+    while (!work.empty())
+    {
+        std::string name = work.back();
+        work.pop_back();
+        auto it = definitions.find(name);
+        if (it == definitions.end() || !reached.insert(name).second)
+        {
+            continue;
+        }
+        for (Stmt *def : it->second)
+        {
+            std::unordered_map<std::string, int> inner;
+            StmtPtr ref(def, [](Stmt *) {});
+            references(ref, inner);
+            for (auto &use : inner)
+                work.push_back(use.first);
+        }
+    }
+
+    auto &list = program->statements;
+    list.erase(std::remove_if(list.begin(), list.end(), [&](const StmtPtr &s)
+    {
+        std::string name;
+        switch (s->type)
+        {
+            case StmtType::FUNCTION: name = static_cast<FunctionStmt *>(s.get())->name.lexeme; break;
+            case StmtType::CLASS:    name = static_cast<ClassStmt *>(s.get())->name.lexeme; break;
+            case StmtType::STRUCT:   name = static_cast<StructStmt *>(s.get())->name.lexeme; break;
+            default:                 return false;
+        }
+        if (reached.count(name))
+        {
+            return false;
+        }
+        if (verbose)
+        {
+            INFO("Optimizer: removed unused '%s'", name.c_str());
+        }
+        return true;
+    }), list.end());
+
+    // a dropped declaration can leave the names its initializer read unused
+    for (bool changed = true; changed;)
+    {
+        uses.clear();
+        for (auto &s : list)
+            references(s, uses);
+        changed = false;
+        for (auto &s : list)
+            changed = sweep(s, uses) || changed;
+        // a top-level const every read of which was folded
+        size_t size = list.size();
+        list.erase(std::remove_if(list.begin(), list.end(), [&](const StmtPtr &s)
+        {
+            bool constant = (s->type == StmtType::DECLARATION && static_cast<Declaration *>(s.get())->constant) ||
+                            (s->type == StmtType::ARRAY && static_cast<ArrayStmt *>(s.get())->constant) ||
+                            (s->type == StmtType::MAP && static_cast<MapStmt *>(s.get())->constant);
+            return constant && unused(s, uses);
+        }), list.end());
+        changed = changed || list.size() != size;
+    }
+}
+
+void Optimizer::references(const StmtPtr &stmt, std::unordered_map<std::string, int> &uses)
+{
+    if (!stmt)
+    {
+        return;
+    }
+    children(stmt.get(), [&](StmtPtr &s) { references(s, uses); }, [&](ExprPtr &e) { references(e, uses); });
+}
+
+void Optimizer::references(const ExprPtr &expr, std::unordered_map<std::string, int> &uses)
+{
+    if (!expr)
+    {
+        return;
+    }
+    if (expr->type == ExprType::VARIABLE)
+    {
+        uses[static_cast<Variable *>(expr.get())->name.lexeme]++;
+    }
+    else if (expr->type == ExprType::ASSIGN)
+    {
+        uses[static_cast<Assign *>(expr.get())->name.lexeme]++;
+    }
+    children(expr.get(), [&](ExprPtr &e) { references(e, uses); });
+}
+
+// the blocks inside one statement, the statement itself stays
+bool Optimizer::sweep(const StmtPtr &stmt, const std::unordered_map<std::string, int> &uses)
+{
+    if (!stmt || stmt->type == StmtType::STRUCT)
+    {
+        return false;
+    }
+    if (stmt->type == StmtType::BLOCK)
+    {
+        return sweep(static_cast<BlockStmt *>(stmt.get())->statements, uses);
+    }
+    bool changed = false;
+    if (stmt->type == StmtType::CLASS)
+    {
+        for (auto &method : static_cast<ClassStmt *>(stmt.get())->methods)
+            changed = sweep(method, uses) || changed;
+        return changed;
+    }
+    children(stmt.get(), [&](StmtPtr &s) { changed = sweep(s, uses) || changed; }, [](ExprPtr &) {});
+    return changed;
+}
+
+bool Optimizer::sweep(std::vector<StmtPtr> &list, const std::unordered_map<std::string, int> &uses)
+{
+    bool changed = false;
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        StmtType type = list[i]->type;
+        if ((type == StmtType::RETURN || type == StmtType::BREAK || type == StmtType::CONTINUE) && i + 1 < list.size())
+        {
+            if (verbose)
+            {
+                INFO("Optimizer: removed %d unreachable statement(s) after %s", (int)(list.size() - i - 1), list[i]->toString().c_str());
+            }
+            list.resize(i + 1);
+            changed = true;
+        }
+    }
+    size_t size = list.size();
+    list.erase(std::remove_if(list.begin(), list.end(), [&](const StmtPtr &s) { return unused(s, uses); }), list.end());
+    changed = changed || list.size() != size;
+    for (auto &s : list)
+    {
+        changed = sweep(s, uses) || changed;
+    }
+    return changed;
+}
+
+// cannot throw: literals, and operators TypeInference proved the operand types of, apart
+// from / and % (x / 0)
+static bool settled(const ExprPtr &expr)
+{
+    Value value;
+    if (!expr || constant(expr, value))
+    {
+        return true;
+    }
+    auto operand = [](const ExprPtr &e) { return e && (e->type == ExprType::VARIABLE || settled(e)); };
+    switch (expr->type)
+    {
+        case ExprType::GROUPING:
+            return settled(static_cast<GroupingExpr *>(expr.get())->expr);
+        case ExprType::BINARY:
+        {
+            BinaryExpr *node = static_cast<BinaryExpr *>(expr.get());
+            if (node->quick != Q_TYPED_NUMBER && node->quick != Q_TYPED_STRING)
+                return false;
+            if (node->op.type == TokenType::SLASH || node->op.type == TokenType::MOD)
+                return false;
+            return operand(node->left) && operand(node->right);
+        }
+        case ExprType::UNARY:
+        {
+            UnaryExpr *node = static_cast<UnaryExpr *>(expr.get());
+            return node->op.type == TokenType::MINUS && node->quick == Q_TYPED_NUMBER && operand(node->right);
+        }
+        default:
+            return false;
+    }
+}
+
+bool Optimizer::unused(const StmtPtr &stmt, const std::unordered_map<std::string, int> &uses)
+{
+    auto dead = [&](const std::string &name)
+    {
+        auto it = uses.find(name);
+        return it == uses.end() || it->second == 0;
+    };
+    auto removable = [&](const ExprPtr &expr)
+    {
+        Value value;
+        return !expr || constant(expr, value) || (level >= 2 && typed && settled(expr));
+    };
+
+    std::string name;
+    switch (stmt->type)
+    {
+        case StmtType::DECLARATION:
+        {
+            Declaration *node = static_cast<Declaration *>(stmt.get());
+            if (node->annotation != A_NONE || !removable(node->initializer))
+                return false;
+            for (auto &n : node->names)
+                if (!dead(n.lexeme))
+                    return false;
+            name = node->names[0].lexeme;
+            break;
+        }
+        case StmtType::ARRAY:
+        {
+            ArrayStmt *node = static_cast<ArrayStmt *>(stmt.get());
+            for (auto &value : node->values)
+                if (!removable(value))
+                    return false;
+            name = node->name.lexeme;
+            if (!dead(name))
+                return false;
+            break;
+        }
+        case StmtType::MAP:
+        {
+            MapStmt *node = static_cast<MapStmt *>(stmt.get());
+            for (auto &entry : node->values)
+                if (!removable(entry.first) || !removable(entry.second))
+                    return false;
+            name = node->name.lexeme;
+            if (!dead(name))
+                return false;
+            break;
+        }
+        default:
+            return false;
+    }
+    if (verbose)
+    {
+        INFO("Optimizer: removed unused variable '%s'", name.c_str());
+    }
+    return true;
+}
+
+// Common subexpressions. A basic block is a run of expression, print, declaration and
+// return statements (an if's condition closes it); in one, the second and later
+// occurrences of a shareable() expression read a temporary the first one assigns, as long
+// as nothing in between writes a variable it reads. Any call, method or not, ends every
+// match (dynamic scoping lets it write anything), a field store ends the field reads.
+// Only the left side of and/or always runs, a first occurrence on the right is not reused.
+void Optimizer::share(std::vector<StmtPtr> &list)
+{
+    Block b;
+    std::vector<std::pair<size_t, StmtPtr>> temporaries;
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        const StmtPtr &stmt = list[i];
+        b.statement = i;
+        switch (stmt->type)
+        {
+            case StmtType::EXPRESSION: common(static_cast<ExpressionStmt *>(stmt.get())->expression, b); break;
+            case StmtType::PRINT:      common(static_cast<PrintStmt *>(stmt.get())->expression, b); break;
+            case StmtType::RETURN:     common(static_cast<ReturnStmt *>(stmt.get())->value, b); break;
+            case StmtType::DECLARATION:
+            {
+                Declaration *node = static_cast<Declaration *>(stmt.get());
+                common(node->initializer, b);
+                for (auto &name : node->names)
+                    kill(b, name.lexeme, false);
+                break;
+            }
+            case StmtType::IF:
+                common(static_cast<IFStmt *>(stmt.get())->condition, b);
+                reuse(b, temporaries);
+                share(stmt);
+                break;
+            default:
+                reuse(b, temporaries);
+                share(stmt);
+                break;
+        }
+    }
+    reuse(b, temporaries);
+    for (auto it = temporaries.rbegin(); it != temporaries.rend(); ++it)
+    {
+        list.insert(list.begin() + it->first, it->second);
+    }
+}
+
+void Optimizer::share(const StmtPtr &stmt)
+{
+    if (!stmt || stmt->type == StmtType::STRUCT)
+    {
+        return;
+    }
+    if (stmt->type == StmtType::BLOCK)
+    {
+        share(static_cast<BlockStmt *>(stmt.get())->statements);
+        return;
+    }
+    children(stmt.get(), [&](StmtPtr &s) { share(s); }, [](ExprPtr &) {});
+}
+
+void Optimizer::common(ExprPtr &expr, Block &b)
+{
+    if (!expr)
+    {
+        return;
+    }
+    bool candidate = !simple(expr) && expr->type != ExprType::LITERAL && shareable(expr);
+    std::size_t hash = 0;
+    if (candidate)
+    {
+        hash = expr->hash();
+        auto range = b.available.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (same(b.seen[it->second].expr, expr))
+            {
+                b.seen[it->second].uses.push_back(&expr);
+                return;
+            }
+        }
+    }
+    if (expr->type == ExprType::LOGICAL)
+    {
+        LogicalExpr *node = static_cast<LogicalExpr *>(expr.get());
+        common(node->left, b);
+        b.conditional++;
+        common(node->right, b);
+        b.conditional--;
+    }
+    else if (expr->type == ExprType::UNARY && (static_cast<UnaryExpr *>(expr.get())->op.type == TokenType::INC ||
+                                                static_cast<UnaryExpr *>(expr.get())->op.type == TokenType::DEC))
+    {
+        // the operand is stored to, only what it reads on the way can be shared
+        ExprPtr &target = static_cast<UnaryExpr *>(expr.get())->right;
+        if (target)
+            children(target.get(), [&](ExprPtr &e) { common(e, b); });
+    }
+    else
+    {
+        children(expr.get(), [&](ExprPtr &e) { common(e, b); });
+    }
+
+    // what it changes, once its operands have run
+    switch (expr->type)
+    {
+        case ExprType::ASSIGN:
+            kill(b, static_cast<Assign *>(expr.get())->name.lexeme, false);
+            break;
+        case ExprType::UNARY:
+        {
+            UnaryExpr *node = static_cast<UnaryExpr *>(expr.get());
+            if (node->op.type == TokenType::INC || node->op.type == TokenType::DEC)
+            {
+                if (node->right && node->right->type == ExprType::VARIABLE)
+                    kill(b, static_cast<Variable *>(node->right.get())->name.lexeme, false);
+                else
+                    kill(b, "", true);
+            }
+            break;
+        }
+        case ExprType::SET:
+            kill(b, "", true);
+            break;
+        case ExprType::CALL:
+        case ExprType::GET_DEF:
+            b.available.clear();
+            break;
+        default:
+            break;
+    }
+
+    if (candidate && b.conditional == 0)
+    {
+        b.available.emplace(hash, b.seen.size());
+        b.seen.push_back({expr, {&expr}, b.statement});
+    }
+}
+
+void Optimizer::kill(Block &b, const std::string &name, bool fields)
+{
+    for (auto it = b.available.begin(); it != b.available.end();)
+    {
+        const ExprPtr &expr = b.seen[it->second].expr;
+        if (fields ? ::fields(expr) : uses(expr, name) > 0)
+            it = b.available.erase(it);
+        else
+            ++it;
+    }
+}
+
+// `var $n = 0;` before the first occurrence's statement, which becomes `$n = expr`
+void Optimizer::reuse(Block &b, std::vector<std::pair<size_t, StmtPtr>> &temporaries)
+{
+    for (auto &c : b.seen)
+    {
+        if (c.uses.size() < 2)
+        {
+            continue;
+        }
+        std::string name = "$" + std::to_string(temps++);
+        int line = line_of(c.expr);
+        std::shared_ptr<Declaration> decl = std::make_shared<Declaration>();
+        decl->names.push_back(Token(TokenType::IDENTIFIER, name, "", line));
+        decl->initializer = literal(Value::number(0));   // never read, a number keeps the JIT happy
+        temporaries.push_back({c.statement, decl});
+
+        std::shared_ptr<Assign> first = std::make_shared<Assign>();
+        first->name = decl->names[0];
+        first->value = c.expr;
+        *c.uses[0] = first;
+        for (size_t i = 1; i < c.uses.size(); i++)
+        {
+            std::shared_ptr<Variable> temp = std::make_shared<Variable>();
+            temp->name = decl->names[0];
+            *c.uses[i] = temp;
+        }
+        shared += (int)c.uses.size() - 1;
+        if (verbose)
+        {
+            INFO("Optimizer: %s at line %d computed once for %d uses as '%s'", c.expr->toString().c_str(), line, (int)c.uses.size(), name.c_str());
+        }
+    }
+    b.seen.clear();
+    b.available.clear();
+}
+
+// if/elif arms with a literal condition: false ones go, a true one becomes the else
+void Optimizer::prune(StmtPtr &stmt)
+{
+    IFStmt *node = static_cast<IFStmt *>(stmt.get());
+    std::vector<std::shared_ptr<ElifStmt>> arms;
+    std::shared_ptr<ElifStmt> first = std::make_shared<ElifStmt>();
+    first->condition = node->condition;
+    first->then_branch = node->then_branch;
+    arms.push_back(first);
+    arms.insert(arms.end(), node->elifBranch.begin(), node->elifBranch.end());
+
+    std::vector<std::shared_ptr<ElifStmt>> kept;
+    StmtPtr otherwise = node->else_branch;
+    bool changed = false;
+    for (auto &arm : arms)
+    {
+        Value value;
+        if (!constant(arm->condition, value))
+        {
+            kept.push_back(arm);
+            continue;
+        }
+        changed = true;
+        if (value.isTruthy())
+        {
+            otherwise = arm->then_branch;
+            break;
+        }
+    }
+    if (!changed)
+    {
+        return;
+    }
+
+    if (kept.empty())
+    {
+        stmt = otherwise;
+        return;
+    }
+    node->condition = kept[0]->condition;
+    node->then_branch = kept[0]->then_branch;
+    node->elifBranch.assign(kept.begin() + 1, kept.end());
+    node->else_branch = otherwise;
+}
+
+//***************************************************************************************** */
+
+void Optimizer::expression(ExprPtr &expr)
+{
+    if (!expr)
+    {
+        return;
+    }
+    switch (expr->type)
+    {
+        case ExprType::BINARY:  binary(expr); break;
+        case ExprType::UNARY:   unary(expr); break;
+        case ExprType::LOGICAL: logical(expr); break;
+        case ExprType::GROUPING:
+        {
+            ExprPtr inner = static_cast<GroupingExpr *>(expr.get())->expr;
+            if (inner)
+            {
+                expression(inner);
+                expr = inner;
+            }
+            break;
+        }
+        case ExprType::VARIABLE:
+        {
+            const std::string &name = static_cast<Variable *>(expr.get())->name.lexeme;
+            auto it = known.find(name);
+            const Value *value = it != known.end() ? &it->second : nullptr;
+            if (!value && constants)
+            {
+                auto host = constants->find(name);
+                value = host != constants->end() ? &host->second : nullptr;
+            }
+            if (value)
+            {
+                expr = literal(*value);
+                substituted++;
+            }
+            break;
+        }
+        case ExprType::ASSIGN:
+            expression(static_cast<Assign *>(expr.get())->value);
+            break;
+        case ExprType::CALL:
+        {
+            CallExpr *node = static_cast<CallExpr *>(expr.get());
+            node->global = node->callee && node->callee->type == ExprType::VARIABLE &&
+                           !nested.count(static_cast<Variable *>(node->callee.get())->name.lexeme);
+            expression(node->callee);
+            for (auto &arg : node->args)
+                expression(arg);
+            inline_call(expr);
+            break;
+        }
+        case ExprType::GET:
+            expression(static_cast<GetExpr *>(expr.get())->object);
+            break;
+        case ExprType::SET:
+        {
+            SetExpr *node = static_cast<SetExpr *>(expr.get());
+            expression(node->object);
+            expression(node->value);
+            break;
+        }
+        case ExprType::GET_DEF:
+        {
+            GetDefinitionExpr *node = static_cast<GetDefinitionExpr *>(expr.get());
+            expression(node->variable);
+            for (auto &value : node->values)
+                expression(value);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// only the truth of a condition is read, so !!x can be x
+void Optimizer::condition(ExprPtr &expr)
+{
+    expression(expr);
+    while (expr && expr->type == ExprType::UNARY)
+    {
+        UnaryExpr *outer = static_cast<UnaryExpr *>(expr.get());
+        if (outer->op.type != TokenType::BANG || !outer->right || outer->right->type != ExprType::UNARY)
+            break;
+        UnaryExpr *inner = static_cast<UnaryExpr *>(outer->right.get());
+        if (inner->op.type != TokenType::BANG)
+            break;
+        ExprPtr operand = inner->right;
+        expr = operand;
+    }
+}
+
+void Optimizer::binary(ExprPtr &expr)
+{
+    BinaryExpr *node = static_cast<BinaryExpr *>(expr.get());
+    expression(node->left);
+    expression(node->right);
+
+    Value a, b, result;
+    bool left = constant(node->left, a);
+    bool right = constant(node->right, b);
+    if (left && right && fold(node->op.type, a, b, result))
+    {
+        expr = literal(result);
+        return;
+    }
+    if (level < 2)
+    {
+        return;
+    }
+
+    ExprPtr operand;
+    switch (node->op.type)
+    {
+        case TokenType::STAR:
+            if (is_number(right, b, 1))      operand = node->left;
+            else if (is_number(left, a, 1))  operand = node->right;
+            break;
+        case TokenType::SLASH:
+            if (is_number(right, b, 1))      operand = node->left;
+            break;
+        case TokenType::PLUS:
+            if (is_number(right, b, 0))      operand = node->left;
+            else if (is_number(left, a, 0))  operand = node->right;
+            break;
+        case TokenType::MINUS:
+            if (is_number(right, b, 0))      operand = node->left;
+            break;
+        default:
+            break;
+    }
+    if (operand)
+    {
+        expr = operand;
+    }
+}
+
+void Optimizer::unary(ExprPtr &expr)
+{
+    UnaryExpr *node = static_cast<UnaryExpr *>(expr.get());
+    expression(node->right);
+
+    Value value;
+    if (!constant(node->right, value))
+    {
+        return;
+    }
+    if (node->op.type == TokenType::MINUS && value.isNumber())
+    {
+        expr = literal(Value::number(-value.asNumber()));
+    }
+    else if (node->op.type == TokenType::BANG)
+    {
+        expr = literal(Value::boolean(!value.isTruthy()));
+    }
+}
+
+void Optimizer::logical(ExprPtr &expr)
+{
+    LogicalExpr *node = static_cast<LogicalExpr *>(expr.get());
+    expression(node->left);
+    expression(node->right);
+
+    Value a, b;
+    if (!constant(node->left, a))
+    {
+        return;
+    }
+    ExprPtr result;
+    switch (node->op.type)
+    {
+        case TokenType::OR:
+            result = a.isTruthy() ? node->left : node->right;
+            break;
+        case TokenType::AND:
+            result = a.isTruthy() ? node->right : node->left;
+            break;
+        case TokenType::XOR:
+            if (constant(node->right, b))
+                result = literal(Value::boolean(a.isTruthy() != b.isTruthy()));
+            break;
+        default:
+            break;
+    }
+    if (result)
+    {
+        expr = result;
+    }
+}
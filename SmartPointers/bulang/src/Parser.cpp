@@ -20,6 +20,7 @@ current = 0;
 panicMode = false;
 countBegins = 0;
 countEnds = 0;
+annotations.assign(1, {});
 }
 
 Parser::~Parser()
@@ -36,6 +37,41 @@ void Parser::clear()
     panicMode = false;
     countBegins = 0;
     countEnds = 0;
+    annotations.clear();
+}
+
+// `: number`, `: string` or `: bool`
+u8 Parser::type_annotation()
+{
+    if (!match(TokenType::COLON))
+    {
+        return A_NONE;
+    }
+    Token type = consume(TokenType::IDENTIFIER, "Expect type after ':'.");
+    if (type.lexeme == "number") return A_NUMBER;
+    if (type.lexeme == "string") return A_STRING;
+    if (type.lexeme == "bool")   return A_BOOL;
+    Error(type, "Unknown type '" + type.lexeme + "'");
+    return A_NONE;
+}
+
+void Parser::annotate(const std::string &name, u8 annotation)
+{
+    annotations.back()[name] = annotation;
+}
+
+// assignments inside a function only see what that function declared
+u8 Parser::annotation_of(const std::string &name)
+{
+    for (size_t i = annotations.size(); i-- > 0;)
+    {
+        auto it = annotations[i].find(name);
+        if (it != annotations[i].end())
+        {
+            return it->second;
+        }
+    }
+    return A_NONE;
 }
 
 bool Parser::match(const std::vector<TokenType> &types)
@@ -100,6 +136,7 @@ void Parser::synchronize()
             case TokenType::FUNCTION:
             case TokenType::STRUCT:
             case TokenType::VAR:
+            case TokenType::CONST:
             case TokenType::IDENTIFIER:
             case TokenType::FOR:
             case TokenType::IF:
@@ -193,6 +230,7 @@ ExprPtr Parser::assignment()
            
             std::shared_ptr<Assign> assign = std::make_shared<Assign>();
            assign->name = var->name;
+           assign->annotation = annotation_of(var->name.lexeme);
            assign->value = value;
            expr = assign;
            return assign;
@@ -219,6 +257,7 @@ ExprPtr Parser::assignment()
             Variable *var = (Variable *)expr.get();
             std::shared_ptr<Assign> assign = std::make_shared<Assign>();
             assign->name = var->name;
+            assign->annotation = annotation_of(var->name.lexeme);
 
 
             std::shared_ptr<BinaryExpr> addition =  std::make_shared<BinaryExpr>();
@@ -256,6 +295,7 @@ ExprPtr Parser::assignment()
             Variable *var = (Variable *)expr.get();
             std::shared_ptr<Assign> assign = std::make_shared<Assign>();
             assign->name = var->name;
+            assign->annotation = annotation_of(var->name.lexeme);
             std::shared_ptr<BinaryExpr> addition =  std::make_shared<BinaryExpr>();
             addition->left  = expr;
             addition->right = value;
@@ -288,6 +328,7 @@ ExprPtr Parser::assignment()
             Variable *var = (Variable *)expr.get();
             std::shared_ptr<Assign> assign =  std::make_shared<Assign>();
             assign->name = var->name;
+            assign->annotation = annotation_of(var->name.lexeme);
             std::shared_ptr<BinaryExpr> addition =  std::make_shared<BinaryExpr>();
             addition->left  = expr;
             addition->right = value;
@@ -319,6 +360,7 @@ ExprPtr Parser::assignment()
             Variable *var = (Variable *)expr.get();
             std::shared_ptr<Assign> assign =  std::make_shared<Assign>();
             assign->name = var->name;
+            assign->annotation = annotation_of(var->name.lexeme);
             std::shared_ptr<BinaryExpr> addition =  std::make_shared<BinaryExpr>();
             addition->left  = expr;
             addition->right = value;
@@ -528,6 +570,7 @@ std::shared_ptr<Expr> Parser::call()
                     consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
 
                     get->name = std::move(name);
+                    get->super = expr->type == ExprType::VARIABLE && static_cast<Variable *>(expr.get())->name.lexeme == "super";
                     get->variable = std::move(expr);
                     return get;
                 } else if (match(TokenType::INC))
@@ -608,14 +651,14 @@ std::shared_ptr<Expr> Parser::primary()
      if (match(TokenType::FALSE))
     {
         
-          std::shared_ptr<NumberLiteral> b =  std::make_shared<NumberLiteral>();
-          b->value = 0;
+          std::shared_ptr<BooleanLiteral> b =  std::make_shared<BooleanLiteral>();
+          b->value = false;
           return b;
     }
     if (match(TokenType::TRUE))
     {
-          std::shared_ptr<NumberLiteral> b =    std::make_shared<NumberLiteral>();
-          b->value = 1;
+          std::shared_ptr<BooleanLiteral> b =    std::make_shared<BooleanLiteral>();
+          b->value = true;
           return b;
     }
     
@@ -734,6 +777,8 @@ StmtPtr Parser::variable_declaration(bool inIntern)
     Token name = consume(TokenType::IDENTIFIER, "Expect variable name.");
     std::vector<Token> names;
     names.push_back(name);
+    // `from (var x : list)` uses the ':' for the list
+    u8 annotation = inIntern ? A_NONE : type_annotation();
 
    ExprPtr initializer = nullptr;
    bool is_initialized = false;
@@ -799,6 +844,10 @@ StmtPtr Parser::variable_declaration(bool inIntern)
         {
            Token name = consume(TokenType::IDENTIFIER, "Expect variable name.");
            names.push_back(name);
+        }
+        if (annotation == A_NONE && !inIntern)
+        {
+            annotation = type_annotation();
         }
          if (match(TokenType::EQUAL))
         {
@@ -812,18 +861,69 @@ StmtPtr Parser::variable_declaration(bool inIntern)
    } 
    std::shared_ptr<Declaration> stmt =    std::make_shared<Declaration>();
    stmt->names = std::move(names);
-   if (!is_initialized)
+   stmt->annotation = annotation;
+   if (!is_initialized && annotation != A_NONE)
+   {
+       // a typed variable starts at its type's zero
+       if (annotation == A_NUMBER)
+       {
+           std::shared_ptr<NumberLiteral> zero = std::make_shared<NumberLiteral>();
+           zero->value = 0;
+           initializer = zero;
+       }
+       else if (annotation == A_STRING)
+       {
+           initializer = std::make_shared<StringLiteral>();
+       }
+       else
+       {
+           std::shared_ptr<BooleanLiteral> zero = std::make_shared<BooleanLiteral>();
+           zero->value = false;
+           initializer = zero;
+       }
+   }
+   else if (!is_initialized)
    {
        WARNING("Variable '%s' is not initialized !", name.lexeme.c_str());
        initializer = std::make_shared<Literal>();
    }
    stmt->initializer = initializer;
+   for (auto &n : stmt->names)
+   {
+       annotate(n.lexeme, annotation);
+   }
    return stmt;
 }
+// `const name = value;`, `const name[] = [...]` or `const name{} = {...}`, bound once
+StmtPtr Parser::const_declaration()
+{
+    Token name = peek();
+    StmtPtr stmt = variable_declaration();
+    switch (stmt->type)
+    {
+        case StmtType::DECLARATION:
+        {
+            Declaration *node = static_cast<Declaration *>(stmt.get());
+            if (!node->initializer || node->initializer->type == ExprType::LITERAL)
+            {
+                Error(name, "Expect '=' after const name");
+            }
+            node->constant = true;
+            break;
+        }
+        case StmtType::ARRAY: static_cast<ArrayStmt *>(stmt.get())->constant = true; break;
+        case StmtType::MAP:   static_cast<MapStmt *>(stmt.get())->constant = true; break;
+        default: break;
+    }
+    return stmt;
+}
+
 std::shared_ptr<Stmt> Parser::function_declaration()
 {
     Token name = consume(TokenType::IDENTIFIER, "Expect function name.");
     std::vector<std::string> names;
+    std::vector<u8> types;
+    bool typed = false;
 
     consume(TokenType::LEFT_PAREN, "Expect '(' after function name.");
 
@@ -833,19 +933,59 @@ std::shared_ptr<Stmt> Parser::function_declaration()
         {
            Token name =  consume(TokenType::IDENTIFIER, "Expect parameter name.");
            names.push_back(std::move(name.lexeme));
+           types.push_back(type_annotation());
+           typed = typed || types.back() != A_NONE;
         } while (match(TokenType::COMMA));
     }
     
 
     consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
+    u8 result = type_annotation();
 
 
     consume(TokenType::LEFT_BRACE, "Expect '{' before function body.");
 
     std::shared_ptr<FunctionStmt> stmt =    std::make_shared<FunctionStmt>();
     stmt->name = std::move(name);
+    stmt->result = result;
+    if (typed)
+    {
+        stmt->argTypes = types;
+    }
+
+    std::vector<std::unordered_map<std::string, u8>> outer = std::move(annotations);
+    annotations.assign(1, {});
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        annotate(names[i], types[i]);
+    }
     stmt->args = std::move(names);
     stmt->body = std::move(block());
+    annotations = std::move(outer);
+    return stmt;
+}
+
+// @memo def f(...) caches every result, @memo(n) keeps the n most recently used
+StmtPtr Parser::annotated_declaration()
+{
+    Token annotation = consume(TokenType::IDENTIFIER, "Expect annotation name after '@'.");
+    if (annotation.lexeme != "memo")
+    {
+        Error(annotation, "Unknown annotation '@" + annotation.lexeme + "'");
+    }
+    u32 size = 0;
+    if (match(TokenType::LEFT_PAREN))
+    {
+        Token number = consume(TokenType::NUMBER, "Expect cache size after '@memo('.");
+        size = (u32)std::stoul(number.literal);
+        consume(TokenType::RIGHT_PAREN, "Expect ')' after cache size.");
+    }
+    consume(TokenType::FUNCTION, "Expect 'def' after '@" + annotation.lexeme + "'.");
+
+    StmtPtr stmt = function_declaration();
+    FunctionStmt *function = static_cast<FunctionStmt *>(stmt.get());
+    function->memo = true;
+    function->memoSize = size;
     return stmt;
 }
 
@@ -867,6 +1007,10 @@ StmtPtr Parser::statement()
     {
         return function_declaration();
     }
+    if (match(TokenType::AT))
+    {
+        return annotated_declaration();
+    }
     if (match(TokenType::IF))
     {
         return if_statement();
@@ -923,6 +1067,10 @@ StmtPtr Parser::declarations()
         {
             return variable_declaration();
         }
+        if (match(TokenType::CONST))
+        {
+            return const_declaration();
+        }
         if (match(TokenType::STRUCT))
         {
             return struct_declaration();
@@ -939,10 +1087,12 @@ StmtPtr Parser::declarations()
 StmtPtr Parser::block()
 {
      std::shared_ptr<BlockStmt> stmt =   std::make_shared<BlockStmt>();
+    annotations.emplace_back();
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd())
     {
         stmt->statements.push_back(std::move(declarations()));
     }
+    annotations.pop_back();
     consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
 
 
@@ -1017,12 +1167,14 @@ StmtPtr Parser::from_statement()
 
     consume(TokenType::LEFT_PAREN, "Expect '(' after 'from'.");
     consume(TokenType::VAR, "Expect variable declaration  .");
+    annotations.emplace_back();
     StmtPtr  var =  variable_declaration(true);
     
     consume(TokenType::COLON, "Expect ':' after variable.");
     ExprPtr array =  expression();
     consume(TokenType::RIGHT_PAREN, "Expect ')' after 'from' condition.");
     StmtPtr body = statement();
+    annotations.pop_back();
     std::shared_ptr<FromStmt> stmt =    std::make_shared<FromStmt>();
     stmt->variable = std::move(var);
     stmt->array = std::move(array);
@@ -1033,6 +1185,7 @@ StmtPtr Parser::from_statement()
 StmtPtr Parser::for_statement()
 {
    consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
+   annotations.emplace_back();
    std::shared_ptr<Stmt> initializer;
    if (match({TokenType::SEMICOLON}))
    {
@@ -1066,6 +1219,7 @@ StmtPtr Parser::for_statement()
     consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses.");
     
     std::shared_ptr<Stmt> body = statement();
+    annotations.pop_back();
 
 
     std::shared_ptr<ForStmt> stmt =    std::make_shared<ForStmt>();
@@ -1168,6 +1322,7 @@ StmtPtr Parser::class_declaration()
     stmt->name = std::move(name);
     stmt->superClass = superClass;
 
+    annotations.emplace_back();
      while (!check(TokenType::RIGHT_BRACE) && !isAtEnd())
     {
         if (match(TokenType::VAR))
@@ -1184,6 +1339,7 @@ StmtPtr Parser::class_declaration()
         }
           
     }
+    annotations.pop_back();
 
 
     consume(TokenType::RIGHT_BRACE, "Expect '}' after class body.");
@@ -1203,6 +1359,7 @@ StmtPtr Parser::struct_declaration()
 
     
 
+    annotations.emplace_back();
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd())
     {
         if (match(TokenType::VAR))
@@ -1212,6 +1369,7 @@ StmtPtr Parser::struct_declaration()
         }
           
     }
+    annotations.pop_back();
 
     consume(TokenType::RIGHT_BRACE, "Expect '}' after struct body.");
     consume(TokenType::SEMICOLON, "Expect ';' after struct declaration.");
@@ -0,0 +1,489 @@
+#include "pch.h"
+#include "Resolver.hpp"
+#include "Utils.hpp"
+
+Resolver::Resolver()
+{
+}
+
+Resolver::~Resolver()
+{
+    frames.clear();
+}
+
+void Resolver::resolve(Program *program)
+{
+    frames.clear();
+    functions.clear();
+    open.clear();
+    byName.clear();
+    classes = 0;
+    execute(program);
+    mark_tail_calls();
+}
+
+void Resolver::mark_tail_calls()
+{
+    for (auto &function : functions)
+    {
+        bool visible = false;
+        for (auto &name : function.names)
+        {
+            if (byName.count(name) != 0)
+            {
+                visible = true;
+                break;
+            }
+        }
+        for (auto tail : function.tails)
+        {
+            tail->tail = !visible;
+        }
+    }
+}
+
+//***************************************************************************************** */
+
+void Resolver::begin_scope(Scope *scope, bool boundary)
+{
+    frames.push_back({scope, {}, boundary});
+}
+
+void Resolver::end_scope()
+{
+    frames.pop_back();
+}
+
+int Resolver::declare(const std::string &name)
+{
+    Frame &frame = frames.back();
+    if (frame.scope == nullptr)
+    {
+        declare_named(name);
+        return -1;
+    }
+
+    // redeclaration reuses the slot, unless the name is already owned by a by-name define
+    auto it = frame.names.find(name);
+    if (it != frame.names.end())
+    {
+        return it->second;
+    }
+
+    int slot = (int)frame.scope->names.size();
+    frame.scope->names.push_back(name);
+    frame.names[name] = slot;
+    if (!open.empty())
+    {
+        functions[open.back()].names.insert(name);
+    }
+    return slot;
+}
+
+void Resolver::declare_named(const std::string &name)
+{
+    frames.back().names[name] = -1;
+    if (!open.empty())
+    {
+        functions[open.back()].names.insert(name);
+    }
+}
+
+void Resolver::lookup(const std::string &name, int slot)
+{
+    if (slot < 0 && !open.empty())
+    {
+        byName.insert(name);
+    }
+}
+
+void Resolver::resolve_name(const std::string &name, int &depth, int &slot)
+{
+    depth = -1;
+    slot = -1;
+    int hops = 0;
+    for (int i = (int)frames.size() - 1; i >= 0; i--)
+    {
+        Frame &frame = frames[i];
+        auto it = frame.names.find(name);
+        if (it != frame.names.end())
+        {
+            if (it->second >= 0)
+            {
+                depth = hops;
+                slot = it->second;
+            }
+            return;
+        }
+        if (frame.boundary)
+        {
+            return;
+        }
+        hops++;
+    }
+}
+
+void Resolver::resolve_statements(std::vector<StmtPtr> &statements)
+{
+    for (auto &s : statements)
+    {
+        execute(s.get());
+    }
+}
+
+//***************************************************************************************** */
+
+Value Resolver::visit(ExprPtr node)
+{
+    if (node)
+    {
+        node->accept(*this);
+    }
+    return Value();
+}
+
+Value Resolver::visit_empty_expression(EmptyExpr *node)
+{
+    return Value();
+}
+
+Value Resolver::visit_binary(BinaryExpr *node)
+{
+    visit(node->left);
+    visit(node->right);
+    return Value();
+}
+
+Value Resolver::visit_unary(UnaryExpr *node)
+{
+    visit(node->right);
+    return Value();
+}
+
+Value Resolver::visit_logical(LogicalExpr *node)
+{
+    visit(node->left);
+    visit(node->right);
+    return Value();
+}
+
+Value Resolver::visit_grouping(GroupingExpr *node)
+{
+    visit(node->expr);
+    return Value();
+}
+
+Value Resolver::visit_literal(Literal *node)
+{
+    return Value();
+}
+
+Value Resolver::visit_number_literal(NumberLiteral *node)
+{
+    return Value();
+}
+
+Value Resolver::visit_string_literal(StringLiteral *node)
+{
+    return Value();
+}
+
+Value Resolver::visit_boolean_literal(BooleanLiteral *node)
+{
+    return Value();
+}
+
+Value Resolver::visit_now_expression(NowExpr *node)
+{
+    return Value();
+}
+
+Value Resolver::visit_read_variable(Variable *node)
+{
+    resolve_name(node->name.lexeme, node->depth, node->slot);
+    lookup(node->name.lexeme, node->slot);
+    return Value();
+}
+
+Value Resolver::visit_assign(Assign *node)
+{
+    visit(node->value);
+    resolve_name(node->name.lexeme, node->depth, node->slot);
+    lookup(node->name.lexeme, node->slot);
+    return Value();
+}
+
+Value Resolver::visit_call(CallExpr *node)
+{
+    if (node->callee->type != ExprType::VARIABLE)
+    {
+        lookup(node->name.lexeme, -1);
+    }
+    visit(node->callee);
+    for (auto &arg : node->args)
+    {
+        visit(arg);
+    }
+    return Value();
+}
+
+Value Resolver::visit_get(GetExpr *node)
+{
+    visit(node->object);
+    return Value();
+}
+
+Value Resolver::visit_get_definition(GetDefinitionExpr *node)
+{
+    visit(node->variable);
+    for (auto &value : node->values)
+    {
+        visit(value);
+    }
+    return Value();
+}
+
+Value Resolver::visit_set(SetExpr *node)
+{
+    visit(node->value);
+    visit(node->object);
+    return Value();
+}
+
+Value Resolver::visit_self(SelfExpr *node)
+{
+    return Value();
+}
+
+Value Resolver::visit_super(SuperExpr *node)
+{
+    return Value();
+}
+
+//***************************************************************************************** */
+
+u8 Resolver::execute(Stmt *stmt)
+{
+    if (!stmt)
+    {
+        return 0;
+    }
+    return stmt->visit(*this);
+}
+
+u8 Resolver::visit_block_smt(BlockStmt *node)
+{
+    node->scope = std::make_shared<Scope>();
+    begin_scope(node->scope.get(), false);
+    resolve_statements(node->statements);
+    end_scope();
+    return 0;
+}
+
+u8 Resolver::visit_expression_smt(ExpressionStmt *node)
+{
+    visit(node->expression);
+    return 0;
+}
+
+u8 Resolver::visit_print_smt(PrintStmt *node)
+{
+    visit(node->expression);
+    return 0;
+}
+
+u8 Resolver::visit_declaration(Declaration *node)
+{
+    visit(node->initializer);
+
+    node->slots.clear();
+    std::vector<int> slots;
+    for (auto &name : node->names)
+    {
+        slots.push_back(declare(name.lexeme));
+    }
+    if (frames.back().scope != nullptr)
+    {
+        node->slots = std::move(slots);
+    }
+    return 0;
+}
+
+u8 Resolver::visit_if(IFStmt *node)
+{
+    visit(node->condition);
+    execute(node->then_branch.get());
+    for (auto &elif : node->elifBranch)
+    {
+        visit(elif->condition);
+        execute(elif->then_branch.get());
+    }
+    execute(node->else_branch.get());
+    return 0;
+}
+
+u8 Resolver::visit_while(WhileStmt *node)
+{
+    visit(node->condition);
+    execute(node->body.get());
+    return 0;
+}
+
+u8 Resolver::visit_do(DoStmt *node)
+{
+    execute(node->body.get());
+    visit(node->condition);
+    return 0;
+}
+
+u8 Resolver::visit_program(Program *node)
+{
+    begin_scope(nullptr, true);
+    resolve_statements(node->statements);
+    end_scope();
+    return 0;
+}
+
+u8 Resolver::visit_function(FunctionStmt *node)
+{
+    declare_named(node->name.lexeme);
+
+    if (!node->body || node->body->type != StmtType::BLOCK)
+    {
+        return 0;
+    }
+
+    // parameters and the body share the call Environment
+    BlockStmt *body = static_cast<BlockStmt *>(node->body.get());
+    body->scope = std::make_shared<Scope>();
+    begin_scope(body->scope.get(), true);
+    open.push_back(functions.size());
+    functions.emplace_back();
+    for (auto &arg : node->args)
+    {
+        declare(arg);
+    }
+    resolve_statements(body->statements);
+    open.pop_back();
+    end_scope();
+    return 0;
+}
+
+u8 Resolver::visit_for(ForStmt *node)
+{
+    node->scope = std::make_shared<Scope>();
+    begin_scope(node->scope.get(), false);
+    execute(node->initializer.get());
+
+    node->loopScope = std::make_shared<Scope>();
+    begin_scope(node->loopScope.get(), false);
+    visit(node->condition);
+    if (node->body && node->body->type == StmtType::BLOCK)
+    {
+        resolve_statements(static_cast<BlockStmt *>(node->body.get())->statements);
+    }
+    else
+    {
+        execute(node->body.get());
+    }
+    visit(node->increment);
+    end_scope();
+
+    end_scope();
+    return 0;
+}
+
+u8 Resolver::visit_from(FromStmt *node)
+{
+    visit(node->array);
+
+    node->scope = std::make_shared<Scope>();
+    begin_scope(node->scope.get(), false);
+    execute(node->variable.get());
+
+    node->loopScope = std::make_shared<Scope>();
+    begin_scope(node->loopScope.get(), false);
+    execute(node->body.get());
+    end_scope();
+
+    end_scope();
+    return 0;
+}
+
+u8 Resolver::visit_return(ReturnStmt *node)
+{
+    visit(node->value);
+
+    // methods keep their frame, it holds `self`
+    node->tail = false;
+    if (!open.empty() && classes == 0 && node->value && node->value->type == ExprType::CALL &&
+        static_cast<CallExpr *>(node->value.get())->callee->type == ExprType::VARIABLE)
+    {
+        functions[open.back()].tails.push_back(node);
+    }
+    return 0;
+}
+
+u8 Resolver::visit_break(BreakStmt *node)
+{
+    return 0;
+}
+
+u8 Resolver::visit_switch(SwitchStmt *node)
+{
+    visit(node->condition);
+    for (auto &c : node->cases)
+    {
+        visit(c->condition);
+        execute(c->body.get());
+    }
+    execute(node->defaultBranch.get());
+    return 0;
+}
+
+u8 Resolver::visit_continue(ContinueStmt *node)
+{
+    return 0;
+}
+
+u8 Resolver::visit_struct(StructStmt *node)
+{
+    begin_scope(nullptr, true);
+    resolve_statements(node->values);
+    end_scope();
+    declare_named(node->name.lexeme);
+    return 0;
+}
+
+u8 Resolver::visit_class(ClassStmt *node)
+{
+    begin_scope(nullptr, true);
+    classes++;
+    resolve_statements(node->fields);
+    resolve_statements(node->methods);
+    classes--;
+    end_scope();
+    declare_named(node->name.lexeme);
+    return 0;
+}
+
+u8 Resolver::visit_array(ArrayStmt *node)
+{
+    for (auto &value : node->values)
+    {
+        visit(value);
+    }
+    declare_named(node->name.lexeme);
+    return 0;
+}
+
+u8 Resolver::visit_map(MapStmt *node)
+{
+    for (auto &it : node->values)
+    {
+        visit(it.first);
+        visit(it.second);
+    }
+    declare_named(node->name.lexeme);
+    return 0;
+}
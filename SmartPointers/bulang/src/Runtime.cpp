@@ -0,0 +1,315 @@
+#include "pch.h"
+#include "Runtime.hpp"
+#include "Resolver.hpp"
+#include "Optimizer.hpp"
+#include "Utils.hpp"
+
+void NodeTable::build(Program *program)
+{
+    for (auto &s : program->statements)
+    {
+        add(s);
+    }
+}
+
+void NodeTable::add(const ExprPtr &expr)
+{
+    if (!expr)
+    {
+        return;
+    }
+    exprIds[expr.get()] = exprs.size();
+    exprs.push_back(expr);
+
+    switch (expr->type)
+    {
+        case ExprType::BINARY:
+        {
+            BinaryExpr *node = static_cast<BinaryExpr *>(expr.get());
+            add(node->left);
+            add(node->right);
+            break;
+        }
+        case ExprType::LOGICAL:
+        {
+            LogicalExpr *node = static_cast<LogicalExpr *>(expr.get());
+            add(node->left);
+            add(node->right);
+            break;
+        }
+        case ExprType::UNARY:    add(static_cast<UnaryExpr *>(expr.get())->right); break;
+        case ExprType::GROUPING: add(static_cast<GroupingExpr *>(expr.get())->expr); break;
+        case ExprType::ASSIGN:   add(static_cast<Assign *>(expr.get())->value); break;
+        case ExprType::GET:      add(static_cast<GetExpr *>(expr.get())->object); break;
+        case ExprType::SET:
+        {
+            SetExpr *node = static_cast<SetExpr *>(expr.get());
+            add(node->object);
+            add(node->value);
+            break;
+        }
+        case ExprType::CALL:
+        {
+            CallExpr *node = static_cast<CallExpr *>(expr.get());
+            add(node->callee);
+            for (auto &arg : node->args)
+                add(arg);
+            break;
+        }
+        case ExprType::GET_DEF:
+        {
+            GetDefinitionExpr *node = static_cast<GetDefinitionExpr *>(expr.get());
+            add(node->variable);
+            for (auto &value : node->values)
+                add(value);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void NodeTable::add(const StmtPtr &stmt)
+{
+    if (!stmt)
+    {
+        return;
+    }
+    stmtIds[stmt.get()] = stmts.size();
+    stmts.push_back(stmt);
+
+    switch (stmt->type)
+    {
+        case StmtType::BLOCK:
+            for (auto &s : static_cast<BlockStmt *>(stmt.get())->statements)
+                add(s);
+            break;
+        case StmtType::EXPRESSION:  add(static_cast<ExpressionStmt *>(stmt.get())->expression); break;
+        case StmtType::PRINT:       add(static_cast<PrintStmt *>(stmt.get())->expression); break;
+        case StmtType::DECLARATION: add(static_cast<Declaration *>(stmt.get())->initializer); break;
+        case StmtType::RETURN:      add(static_cast<ReturnStmt *>(stmt.get())->value); break;
+        case StmtType::FUNCTION:    add(static_cast<FunctionStmt *>(stmt.get())->body); break;
+        case StmtType::IF:
+        {
+            IFStmt *node = static_cast<IFStmt *>(stmt.get());
+            add(node->condition);
+            add(node->then_branch);
+            for (auto &elif : node->elifBranch)
+            {
+                add(elif->condition);
+                add(elif->then_branch);
+            }
+            add(node->else_branch);
+            break;
+        }
+        case StmtType::SWITCH:
+        {
+            SwitchStmt *node = static_cast<SwitchStmt *>(stmt.get());
+            add(node->condition);
+            for (auto &c : node->cases)
+            {
+                add(c->condition);
+                add(c->body);
+            }
+            add(node->defaultBranch);
+            break;
+        }
+        case StmtType::WHILE:
+        {
+            WhileStmt *node = static_cast<WhileStmt *>(stmt.get());
+            add(node->condition);
+            add(node->body);
+            break;
+        }
+        case StmtType::DO:
+        {
+            DoStmt *node = static_cast<DoStmt *>(stmt.get());
+            add(node->condition);
+            add(node->body);
+            break;
+        }
+        case StmtType::FOR:
+        {
+            ForStmt *node = static_cast<ForStmt *>(stmt.get());
+            add(node->initializer);
+            add(node->condition);
+            add(node->increment);
+            add(node->body);
+            break;
+        }
+        case StmtType::FROM:
+        {
+            FromStmt *node = static_cast<FromStmt *>(stmt.get());
+            add(node->variable);
+            add(node->array);
+            add(node->body);
+            break;
+        }
+        case StmtType::CLASS:
+        {
+            ClassStmt *node = static_cast<ClassStmt *>(stmt.get());
+            for (auto &f : node->fields)
+                add(f);
+            for (auto &m : node->methods)
+                add(m);
+            break;
+        }
+        default:
+            // struct fields, array and map literals only ever run through the Compiler
+            break;
+    }
+}
+
+//***************************************************************************************** */
+
+Runtime::Runtime(Interpreter *interpreter)
+{
+    this->interpreter = interpreter;
+    c = interpreter->compiler;
+}
+
+Runtime::~Runtime()
+{
+    c->bodies.clear();
+    parser.clear();
+}
+
+bool Runtime::load(const std::string &source, int optimize)
+{
+    Lexer lexer;
+    lexer.initialize();
+    lexer.Load(source);
+    std::vector<Token> tokens = lexer.GetTokens();
+    if (tokens.size() == 0)
+    {
+        return false;
+    }
+
+    parser.Load(tokens);
+    program = parser.parse();
+    if (program == nullptr)
+    {
+        return false;
+    }
+
+    // the same level as the Transpiler, or the node indices would not line up
+    Optimizer optimizer(optimize);
+    optimizer.optimize(program.get());
+    Resolver resolver;
+    resolver.resolve(program.get());
+    nodes.build(program.get());
+    return true;
+}
+
+void Runtime::bind(u32 function, u8 (*code)(Runtime &))
+{
+    Stmt *body = stmt<FunctionStmt>(function)->body.get();
+    c->bodies[body] = [this, code]() { return code(*this); };
+}
+
+void Runtime::run(u8 (*code)(Runtime &))
+{
+    auto previousEnvironment = c->environment;
+    code(*this);
+    c->returnValue = Value();
+    c->environment = previousEnvironment;
+    c->clear();
+}
+
+Value Runtime::step(UnaryExpr *node)
+{
+    if (node->right->type == ExprType::VARIABLE)
+    {
+        Variable *var = static_cast<Variable *>(node->right.get());
+        Value *value = var->slot >= 0 ? c->environment->slotAt(var->depth, var->slot) : nullptr;
+        if (value != nullptr && value->isNumber())
+        {
+            double old = value->asNumber();
+            double result = old + (node->op.type == TokenType::INC ? 1 : -1);
+            *value = Value::number(result);
+            return Value::number(node->isPrefix ? result : old);
+        }
+    }
+    return c->visit_unary(node);
+}
+
+Value Runtime::logical(LogicalExpr *node, const Value &left)
+{
+    if (left.isEmpty())
+    {
+        throw FatalException("Unknown expression type for Logical avaliation: "+ node->toString());
+    }
+    if (left.isNil())
+    {
+        throw FatalException("Invalid logical expression. '"+ node->op.lexeme +"' Literals are not allowed at line "+ std::to_string(node->op.line));
+    }
+    return left;
+}
+
+Value Runtime::get_definition(GetDefinitionExpr *node, const Value &value)
+{
+    if (!value.isObject())
+    {
+        return value;
+    }
+    switch (value.asObject()->type)
+    {
+        case O_ARRAY:  return c->ProcessArray(value, node);
+        case O_MAP:    return c->ProcessMap(value, node);
+        case O_CLASS:  return c->ProcessClass(value, node);
+        case O_STRING: return c->ProcessString(value, node);
+        default:       return value;
+    }
+}
+
+void Runtime::declare(Declaration *node, const Value &value)
+{
+    if (node->annotation != A_NONE)
+    {
+        c->check_type(node->annotation, value, node->names[0].lexeme, node->names[0].line);
+    }
+    Environment *environment = c->environment;
+    if (!node->slots.empty())
+    {
+        for (u32 i = 0; i < node->names.size(); i++)
+        {
+            if (node->slots[i] >= 0)
+                environment->defineAt(node->slots[i], value);
+            else
+                environment->define(node->names[i].lexeme, value);
+        }
+        return;
+    }
+    if (node->names.size() == 1)
+    {
+        environment->define(node->names[0].lexeme, value);
+        return;
+    }
+    for (auto &name : node->names)
+    {
+        if (!environment->define(name.lexeme, value))
+        {
+            WARNING("Variable already defined: %s at line %d", name.lexeme.c_str(), name.line);
+        }
+    }
+}
+
+ArrayLiteral *Runtime::iterate(const Value &array)
+{
+    if (!array.isObject(O_ARRAY))
+    {
+        ERROR("Expected array to iterate");
+        return nullptr;
+    }
+    ArrayLiteral *al = array.as<ArrayLiteral>();
+    return al->values.size() == 0 ? nullptr : al;
+}
+
+void Runtime::define(FromStmt *node, Frame &init, const Value &value)
+{
+    Declaration *decl = static_cast<Declaration *>(node->variable.get());
+    if (!decl->slots.empty() && decl->slots[0] >= 0)
+        init.env.defineAt(decl->slots[0], value);
+    else
+        init.env.define(decl->names[0].lexeme, value);
+}
@@ -0,0 +1,640 @@
+#include "pch.h"
+#include "Transpiler.hpp"
+#include "Optimizer.hpp"
+#include "Utils.hpp"
+
+static const char *binary_op(TokenType op)
+{
+    switch (op)
+    {
+        case TokenType::PLUS:          return "PLUS";
+        case TokenType::PLUS_EQUAL:    return "PLUS_EQUAL";
+        case TokenType::MINUS:         return "MINUS";
+        case TokenType::MINUS_EQUAL:   return "MINUS_EQUAL";
+        case TokenType::STAR:          return "STAR";
+        case TokenType::STAR_EQUAL:    return "STAR_EQUAL";
+        case TokenType::SLASH:         return "SLASH";
+        case TokenType::SLASH_EQUAL:   return "SLASH_EQUAL";
+        case TokenType::MOD:           return "MOD";
+        case TokenType::LESS:          return "LESS";
+        case TokenType::LESS_EQUAL:    return "LESS_EQUAL";
+        case TokenType::GREATER:       return "GREATER";
+        case TokenType::GREATER_EQUAL: return "GREATER_EQUAL";
+        case TokenType::EQUAL_EQUAL:   return "EQUAL_EQUAL";
+        case TokenType::BANG_EQUAL:    return "BANG_EQUAL";
+        default:                       return nullptr;
+    }
+}
+
+static bool is_compare(TokenType op)
+{
+    return op == TokenType::LESS || op == TokenType::LESS_EQUAL || op == TokenType::GREATER ||
+           op == TokenType::GREATER_EQUAL || op == TokenType::EQUAL_EQUAL || op == TokenType::BANG_EQUAL;
+}
+
+// literals can be evaluated in any order
+static bool is_constant(const ExprPtr &node)
+{
+    return node && (node->type == ExprType::L_NUMBER || node->type == ExprType::L_BOOLEAN || node->type == ExprType::L_STRING);
+}
+
+static std::string quote(const std::string &text)
+{
+    std::string result = "\"";
+    for (unsigned char ch : text)
+    {
+        switch (ch)
+        {
+            case '\\': result += "\\\\"; break;
+            case '"':  result += "\\\""; break;
+            case '\n': result += "\\n\"\n\""; break;
+            case '\r': result += "\\r"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if (ch < 0x20)
+                {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\%03o", ch);
+                    result += buffer;
+                }
+                else
+                {
+                    result += ch;
+                }
+        }
+    }
+    return result + "\"";
+}
+
+bool Transpiler::translate(const std::string &source, const std::string &path, std::string &output, int optimize)
+{
+    Lexer lexer;
+    lexer.initialize();
+    lexer.Load(source);
+    std::vector<Token> tokens = lexer.GetTokens();
+    if (tokens.size() == 0)
+    {
+        return false;
+    }
+    Parser parser;
+    parser.Load(tokens);
+    std::shared_ptr<Program> program = parser.parse();
+    if (program == nullptr)
+    {
+        return false;
+    }
+    Optimizer optimizer(optimize);
+    optimizer.optimize(program.get());
+    nodes.build(program.get());
+
+    code.clear();
+    depth = 1;
+    for (auto &s : program->statements)
+    {
+        statement(s);
+    }
+    std::string main = "static u8 program(Runtime &rt)\n{\n" + code + "    return C_NORMAL;\n}\n";
+
+    // bodies queue the functions they declare
+    std::string functions;
+    std::string prototypes;
+    std::string binds;
+    for (u32 i = 0; i < pending.size(); i++)
+    {
+        FunctionStmt *node = pending[i];
+        u32 id = nodes.stmtIds[node];
+        std::string name = "f" + std::to_string(id);
+        code.clear();
+        depth = 1;
+        loops.clear();
+        function(node);
+        prototypes += "static u8 " + name + "(Runtime &rt);\n";
+        functions += "// def " + node->name.lexeme + "\nstatic u8 " + name + "(Runtime &rt)\n{\n" + code + "    return C_NORMAL;\n}\n\n";
+        binds += "    rt.bind(" + std::to_string(id) + ", " + name + ");\n";
+    }
+
+    output.clear();
+    output += "// Generated by bpc from " + path + ", do not edit.\n";
+    output += "#include \"pch.h\"\n#include <iostream>\n#include \"Runtime.hpp\"\n#include \"Utils.hpp\"\n\n";
+    output += "static const char *source =\n" + quote(source) + ";\n\n";
+    for (auto &e : usedExprs)
+        output += "static " + e.second + " *e" + std::to_string(e.first) + ";\n";
+    for (auto &s : usedStmts)
+        output += "static " + s.second + " *st" + std::to_string(s.first) + ";\n";
+    output += "\n" + prototypes + "\n";
+    output += "static void bind_nodes(Runtime &rt)\n{\n";
+    for (auto &e : usedExprs)
+        output += "    e" + std::to_string(e.first) + " = rt.expr<" + e.second + ">(" + std::to_string(e.first) + ");\n";
+    for (auto &s : usedStmts)
+        output += "    st" + std::to_string(s.first) + " = rt.stmt<" + s.second + ">(" + std::to_string(s.first) + ");\n";
+    output += binds + "}\n\n";
+    output += functions;
+    output += main + "\n";
+    output +=
+        "int bulang_run(Interpreter &interpreter)\n"
+        "{\n"
+        "    Runtime rt(&interpreter);\n"
+        "    if (!rt.load(source, " + std::to_string(optimize) + "))\n"
+        "    {\n"
+        "        return 1;\n"
+        "    }\n"
+        "    bind_nodes(rt);\n"
+        "    rt.run(program);\n"
+        "    return 0;\n"
+        "}\n\n"
+        "// define BULANG_AOT_NO_MAIN to register natives and call bulang_run from the host\n"
+        "#ifndef BULANG_AOT_NO_MAIN\n"
+        "int main()\n"
+        "{\n"
+        "    Interpreter interpreter;\n"
+        "    try\n"
+        "    {\n"
+        "        bulang_run(interpreter);\n"
+        "    }\n"
+        "    catch (const FatalException &e)\n"
+        "    {\n"
+        "        std::cout << \"Abort \" << e.what() << std::endl;\n"
+        "    }\n"
+        "    interpreter.clear();\n"
+        "    std::cout << \"Exit \" << std::endl;\n"
+        "    return 0;\n"
+        "}\n"
+        "#endif\n";
+
+    parser.clear();
+    return true;
+}
+
+std::string Transpiler::expr_ref(const ExprPtr &node, const char *type)
+{
+    u32 id = nodes.exprIds[node.get()];
+    usedExprs[id] = type;
+    return "e" + std::to_string(id);
+}
+
+std::string Transpiler::stmt_ref(Stmt *node, const char *type)
+{
+    u32 id = nodes.stmtIds[node];
+    usedStmts[id] = type;
+    return "st" + std::to_string(id);
+}
+
+//***************************************************************************************** */
+
+std::string Transpiler::expression(const ExprPtr &node)
+{
+    if (!node)
+    {
+        return "rt.evaluate()";
+    }
+    std::string generic = "rt.evaluate(" + std::to_string(nodes.exprIds[node.get()]) + ")";
+
+    switch (node->type)
+    {
+        case ExprType::L_NUMBER:
+        {
+            double value = static_cast<NumberLiteral *>(node.get())->value;
+            if (!std::isfinite(value))
+            {
+                return generic;
+            }
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "Value::number(%a)", value);
+            return buffer;
+        }
+        case ExprType::L_BOOLEAN:
+            return static_cast<BooleanLiteral *>(node.get())->value ? "Value::boolean(true)" : "Value::boolean(false)";
+        case ExprType::GROUPING:
+            return expression(static_cast<GroupingExpr *>(node.get())->expr);
+        case ExprType::VARIABLE:
+            return "rt.read(" + expr_ref(node, "Variable") + ")";
+        case ExprType::ASSIGN:
+        {
+            Assign *assign = static_cast<Assign *>(node.get());
+            return "rt.assign(" + expr_ref(node, "Assign") + ", " + expression(assign->value) + ")";
+        }
+        case ExprType::BINARY:
+        {
+            BinaryExpr *binary = static_cast<BinaryExpr *>(node.get());
+            if (binary_op(binary->op.type) == nullptr)
+            {
+                return generic;
+            }
+            return this->binary(binary, node);
+        }
+        case ExprType::UNARY:
+        {
+            UnaryExpr *unary = static_cast<UnaryExpr *>(node.get());
+            std::string ref = expr_ref(node, "UnaryExpr");
+            if (unary->op.type == TokenType::INC || unary->op.type == TokenType::DEC)
+            {
+                return "rt.step(" + ref + ")";
+            }
+            if (unary->op.type == TokenType::MINUS && unary->quick == Q_TYPED_NUMBER)
+            {
+                return "Value::number(-(" + expression(unary->right) + ").asNumber())";
+            }
+            if (unary->op.type == TokenType::MINUS)
+            {
+                return "rt.negate(" + ref + ", " + expression(unary->right) + ")";
+            }
+            return "rt.unary(" + ref + ", " + expression(unary->right) + ")";
+        }
+        case ExprType::LOGICAL:
+        {
+            LogicalExpr *logical = static_cast<LogicalExpr *>(node.get());
+            std::string left = "Value l = rt.logical(" + expr_ref(node, "LogicalExpr") + ", " + expression(logical->left) + "); ";
+            std::string right = expression(logical->right);
+            switch (logical->op.type)
+            {
+                case TokenType::OR:
+                    return "[&]() -> Value { " + left + "if (l.isTruthy()) return l; return " + right + "; }()";
+                case TokenType::AND:
+                    return "[&]() -> Value { " + left + "if (!l.isTruthy()) return l; return " + right + "; }()";
+                case TokenType::XOR:
+                    return "[&]() -> Value { " + left + "return Value::boolean(l.isTruthy() != " + right + ".isTruthy()); }()";
+                default:
+                    return "[&]() -> Value { " + left + "return " + right + "; }()";
+            }
+        }
+        case ExprType::CALL:
+        {
+            CallExpr *call = static_cast<CallExpr *>(node.get());
+            if (call->callee->type != ExprType::VARIABLE)
+            {
+                return generic;
+            }
+            // natives, structs and classes take the Compiler's way, it evaluates the arguments itself
+            std::string result = "[&]() -> Value { Value f = " + expression(call->callee) + "; ";
+            result += "if (!f.isObject(O_FUNCTION)) return " + generic + "; ";
+            result += "std::vector<Value> args; args.reserve(" + std::to_string(call->args.size()) + "); ";
+            for (auto &arg : call->args)
+            {
+                result += "args.push_back(" + expression(arg) + "); ";
+            }
+            return result + "return rt.call(" + expr_ref(node, "CallExpr") + ", f, args); }()";
+        }
+        case ExprType::GET_DEF:
+        {
+            GetDefinitionExpr *get = static_cast<GetDefinitionExpr *>(node.get());
+            return "rt.get_definition(" + expr_ref(node, "GetDefinitionExpr") + ", " + expression(get->variable) + ")";
+        }
+        default:
+            return generic;
+    }
+}
+
+// C++ leaves argument order open, a side effect on the right must not run first
+std::string Transpiler::binary(BinaryExpr *node, const ExprPtr &ref)
+{
+    std::string call = std::string("<TokenType::") + binary_op(node->op.type) + ">(" + expr_ref(ref, "BinaryExpr");
+    if (node->quick == Q_TYPED_NUMBER)
+    {
+        std::string right = "(" + expression(node->right) + ").asNumber())";
+        if (is_constant(node->left) || is_constant(node->right))
+        {
+            return "rt.typed" + call + ", (" + expression(node->left) + ").asNumber(), " + right;
+        }
+        return "[&]() -> Value { double l = (" + expression(node->left) + ").asNumber(); return rt.typed" + call + ", l, " + right + "; }()";
+    }
+    if (is_constant(node->left) || is_constant(node->right))
+    {
+        return "rt.binary" + call + ", " + expression(node->left) + ", " + expression(node->right) + ")";
+    }
+    return "[&]() -> Value { Value l = " + expression(node->left) + "; return rt.binary" + call + ", l, " + expression(node->right) + "); }()";
+}
+
+std::string Transpiler::test(const ExprPtr &node)
+{
+    if (node && node->type == ExprType::GROUPING)
+    {
+        return test(static_cast<GroupingExpr *>(node.get())->expr);
+    }
+    if (node && node->type == ExprType::BINARY)
+    {
+        BinaryExpr *binary = static_cast<BinaryExpr *>(node.get());
+        if (is_compare(binary->op.type))
+        {
+            if (binary->quick == Q_TYPED_NUMBER)
+            {
+                return this->binary(binary, node) + ".asBool()";
+            }
+            std::string call = std::string("rt.test<TokenType::") + binary_op(binary->op.type) + ">(" + expr_ref(node, "BinaryExpr");
+            if (is_constant(binary->left) || is_constant(binary->right))
+            {
+                return call + ", " + expression(binary->left) + ", " + expression(binary->right) + ")";
+            }
+            return "[&]() { Value l = " + expression(binary->left) + "; return " + call + ", l, " + expression(binary->right) + "); }()";
+        }
+    }
+    return expression(node) + ".isTruthy()";
+}
+
+//***************************************************************************************** */
+
+void Transpiler::line(const std::string &text)
+{
+    code += std::string(depth * 4, ' ') + text + "\n";
+}
+
+void Transpiler::block(const std::vector<StmtPtr> &statements)
+{
+    for (auto &s : statements)
+    {
+        statement(s);
+    }
+}
+
+// whatever the Compiler hands back has to leave the C++ scopes the same way
+void Transpiler::fallback(Stmt *node)
+{
+    std::string run = "rt.execute(" + stmt_ref(node, "Stmt") + ")";
+    switch (node->type)
+    {
+        case StmtType::FUNCTION:
+        case StmtType::STRUCT:
+        case StmtType::CLASS:
+        case StmtType::ARRAY:
+        case StmtType::MAP:
+            line(run + ";");
+            return;
+        default:
+            break;
+    }
+
+    line("{");
+    depth++;
+    line("u8 r = " + run + ";");
+    if (loops.empty())
+    {
+        line("if (r != C_NORMAL) return r;");
+    }
+    else
+    {
+        line("if (r == C_BREAK) break;");
+        if (loops.back().isFor)
+            line("if (r == C_CONTINUE) goto next" + std::to_string(loops.back().label) + ";");
+        else
+            line("if (r == C_CONTINUE) continue;");
+        line("if (r == C_RETURN) return C_RETURN;");
+    }
+    depth--;
+    line("}");
+}
+
+void Transpiler::loop_body(const StmtPtr &body)
+{
+    line("{");
+    depth++;
+    statement(body);
+    depth--;
+    line("}");
+}
+
+void Transpiler::statement(const StmtPtr &node)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    switch (node->type)
+    {
+        case StmtType::EXPRESSION:
+        {
+            ExpressionStmt *stmt = static_cast<ExpressionStmt *>(node.get());
+            if (stmt->expression)
+            {
+                line(expression(stmt->expression) + ";");
+            }
+            return;
+        }
+        case StmtType::PRINT:
+            line("rt.print(" + expression(static_cast<PrintStmt *>(node.get())->expression) + ");");
+            return;
+        case StmtType::DECLARATION:
+        {
+            Declaration *stmt = static_cast<Declaration *>(node.get());
+            line("rt.declare(" + stmt_ref(stmt, "Declaration") + ", " + expression(stmt->initializer) + ");");
+            return;
+        }
+        case StmtType::RETURN:
+        {
+            ReturnStmt *stmt = static_cast<ReturnStmt *>(node.get());
+            CallExpr *call = stmt->value && stmt->value->type == ExprType::CALL ? static_cast<CallExpr *>(stmt->value.get()) : nullptr;
+            if (call != nullptr && call->callee->type == ExprType::VARIABLE)
+            {
+                // the Resolver decides at load time whether this may reuse the frame
+                line("if (" + stmt_ref(stmt, "ReturnStmt") + "->tail)");
+                line("{");
+                depth++;
+                line("Value f = " + expression(call->callee) + ";");
+                line("if (f.isObject(O_FUNCTION))");
+                line("{");
+                depth++;
+                line("std::vector<Value> args;");
+                line("args.reserve(" + std::to_string(call->args.size()) + ");");
+                for (auto &arg : call->args)
+                {
+                    line("args.push_back(" + expression(arg) + ");");
+                }
+                line("return rt.tail_call(" + expr_ref(stmt->value, "CallExpr") + ", f, args);");
+                depth--;
+                line("}");
+                depth--;
+                line("}");
+            }
+            line("rt.ret(" + expression(stmt->value) + ");");
+            line("return C_RETURN;");
+            return;
+        }
+        case StmtType::BLOCK:
+        {
+            BlockStmt *stmt = static_cast<BlockStmt *>(node.get());
+            line("{");
+            depth++;
+            line("Runtime::Frame frame(rt, " + stmt_ref(stmt, "BlockStmt") + "->scope.get());");
+            block(stmt->statements);
+            depth--;
+            line("}");
+            return;
+        }
+        case StmtType::IF:
+        {
+            IFStmt *stmt = static_cast<IFStmt *>(node.get());
+            line("if (" + test(stmt->condition) + ")");
+            loop_body(stmt->then_branch);
+            for (auto &elif : stmt->elifBranch)
+            {
+                line("else if (" + test(elif->condition) + ")");
+                loop_body(elif->then_branch);
+            }
+            if (stmt->else_branch)
+            {
+                line("else");
+                loop_body(stmt->else_branch);
+            }
+            return;
+        }
+        case StmtType::WHILE:
+        {
+            WhileStmt *stmt = static_cast<WhileStmt *>(node.get());
+            line("{");
+            depth++;
+            line("Runtime::Loop loop(rt);");
+            line("while (" + test(stmt->condition) + ")");
+            loops.push_back({false, 0});
+            loop_body(stmt->body);
+            loops.pop_back();
+            depth--;
+            line("}");
+            return;
+        }
+        case StmtType::DO:
+        {
+            DoStmt *stmt = static_cast<DoStmt *>(node.get());
+            line("{");
+            depth++;
+            line("Runtime::Loop loop(rt);");
+            line("do");
+            loops.push_back({false, 0});
+            loop_body(stmt->body);
+            loops.pop_back();
+            line("while (" + test(stmt->condition) + ");");
+            depth--;
+            line("}");
+            return;
+        }
+        case StmtType::FOR:
+        {
+            // the increment runs in the iteration's environment, so continue jumps to it
+            ForStmt *stmt = static_cast<ForStmt *>(node.get());
+            std::string ref = stmt_ref(stmt, "ForStmt");
+            int label = labels++;
+            line("{");
+            depth++;
+            line("Runtime::Frame init(rt, " + ref + "->scope.get());");
+            statement(stmt->initializer);
+            if (stmt->counted)
+            {
+                // the bound is invariant, it is read once from where the test would read it
+                line("Value *counter = rt.counter(" + ref + ");");
+                line("Value bound;");
+                line("{");
+                depth++;
+                line("Runtime::Frame local(rt, " + ref + "->loopScope.get());");
+                line("bound = " + expression(static_cast<BinaryExpr *>(stmt->condition.get())->right) + ";");
+                depth--;
+                line("}");
+            }
+            line("Runtime::Loop loop(rt);");
+            line("while (true)");
+            line("{");
+            depth++;
+            line("Runtime::Frame local(rt, " + ref + "->loopScope.get());");
+            if (stmt->counted)
+                line("if (!rt.count_test(" + ref + ", counter, bound)) break;");
+            else
+                line("if (!(" + test(stmt->condition) + ")) break;");
+            line("{");
+            depth++;
+            loops.push_back({true, label});
+            block(static_cast<BlockStmt *>(stmt->body.get())->statements);
+            loops.pop_back();
+            depth--;
+            line("}");
+            line("next" + std::to_string(label) + ":");
+            if (stmt->counted)
+                line("rt.count_step(" + ref + ", counter);");
+            else
+                line(expression(stmt->increment) + ";");
+            depth--;
+            line("}");
+            depth--;
+            line("}");
+            return;
+        }
+        case StmtType::FROM:
+        {
+            FromStmt *stmt = static_cast<FromStmt *>(node.get());
+            if (!stmt->variable || stmt->variable->type != StmtType::DECLARATION)
+            {
+                fallback(stmt);
+                return;
+            }
+            std::string ref = stmt_ref(stmt, "FromStmt");
+            line("{");
+            depth++;
+            line("ArrayLiteral *al = rt.iterate(" + expression(stmt->array) + ");");
+            line("if (al != nullptr)");
+            line("{");
+            depth++;
+            line("Runtime::Loop loop(rt);");
+            line("Runtime::Frame init(rt, " + ref + "->scope.get());");
+            line("for (u32 i = 0; i < al->values.size(); i++)");
+            line("{");
+            depth++;
+            line("Runtime::Frame local(rt, " + ref + "->loopScope.get());");
+            line("rt.define(" + ref + ", init, al->values[i]);");
+            loops.push_back({false, 0});
+            statement(stmt->body);
+            loops.pop_back();
+            depth--;
+            line("}");
+            depth--;
+            line("}");
+            depth--;
+            line("}");
+            return;
+        }
+        case StmtType::BREAK:
+        case StmtType::CONTINUE:
+        {
+            if (loops.empty())
+            {
+                fallback(node.get());   // may still end a loop of a caller
+            }
+            else if (node->type == StmtType::BREAK)
+            {
+                line("break;");
+            }
+            else if (loops.back().isFor)
+            {
+                line("goto next" + std::to_string(loops.back().label) + ";");
+            }
+            else
+            {
+                line("continue;");
+            }
+            return;
+        }
+        case StmtType::FUNCTION:
+            pending.push_back(static_cast<FunctionStmt *>(node.get()));
+            fallback(node.get());
+            return;
+        case StmtType::CLASS:
+        {
+            ClassStmt *stmt = static_cast<ClassStmt *>(node.get());
+            for (auto &method : stmt->methods)
+            {
+                if (method && method->type == StmtType::FUNCTION)
+                    pending.push_back(static_cast<FunctionStmt *>(method.get()));
+            }
+            fallback(node.get());
+            return;
+        }
+        default:
+            fallback(node.get());
+            return;
+    }
+}
+
+void Transpiler::function(FunctionStmt *node)
+{
+    if (!node->body || node->body->type != StmtType::BLOCK)
+    {
+        return;
+    }
+    // the call environment already holds the arguments, the body runs straight in it
+    block(static_cast<BlockStmt *>(node->body.get())->statements);
+}
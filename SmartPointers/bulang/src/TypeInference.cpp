@@ -0,0 +1,906 @@
+#include "pch.h"
+#include "TypeInference.hpp"
+#include "Utils.hpp"
+
+// calls feed parameter types back into the functions they reach, a few passes settle it
+static const int MAX_PASSES = 8;
+
+static bool is_compare(TokenType op)
+{
+    switch (op)
+    {
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL:
+        case TokenType::LESS:
+        case TokenType::LESS_EQUAL:
+        case TokenType::BANG_EQUAL:
+        case TokenType::EQUAL_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// the operators Compiler::binary only ever takes numbers for
+static bool is_arithmetic(TokenType op)
+{
+    switch (op)
+    {
+        case TokenType::MINUS:
+        case TokenType::MINUS_EQUAL:
+        case TokenType::STAR:
+        case TokenType::STAR_EQUAL:
+        case TokenType::SLASH:
+        case TokenType::SLASH_EQUAL:
+        case TokenType::MOD:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool is_plus(TokenType op)
+{
+    return op == TokenType::PLUS || op == TokenType::PLUS_EQUAL;
+}
+
+void TypeInference::run(Program *program)
+{
+    if (program == nullptr)
+    {
+        return;
+    }
+
+    for (auto &s : program->statements)
+    {
+        collect(s, nullptr);
+    }
+    // only a function that is the single binding of its name is followed through calls
+    for (auto &s : program->statements)
+    {
+        if (s && s->type == StmtType::FUNCTION)
+        {
+            FunctionStmt *node = static_cast<FunctionStmt *>(s.get());
+            if (declared[node->name.lexeme] == 1)
+            {
+                FunctionInfo &info = functions[node->name.lexeme];
+                info.args.assign(node->args.size(), T_NONE);
+                info.annotation = node->result;
+            }
+        }
+    }
+
+    for (int i = 0; i < MAX_PASSES; i++)
+    {
+        changed = false;
+        pass(program);
+        if (!changed)
+        {
+            return;
+        }
+    }
+
+    // did not settle, give up on what crosses calls and mark once more from that
+    for (auto &f : functions)
+    {
+        f.second.open = true;
+        f.second.result = T_ANY;
+    }
+    pass(program);
+}
+
+//***************************************************************************************** */
+
+u8 TypeInference::annotated(u8 annotation, u8 type)
+{
+    switch (annotation)
+    {
+        case A_NUMBER: return T_NUMBER;
+        case A_STRING: return T_STRING;
+        case A_BOOL:   return T_BOOL;
+        default:       return type;
+    }
+}
+
+u8 TypeInference::join(u8 a, u8 b)
+{
+    if (a == T_NONE) return b;
+    if (b == T_NONE) return a;
+    return a == b ? a : T_ANY;
+}
+
+void TypeInference::join(State &into, const State &from)
+{
+    if (from.dead)
+    {
+        return;
+    }
+    if (into.dead)
+    {
+        into = from;
+        return;
+    }
+    size_t count = std::min(into.scopes.size(), from.scopes.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        Scope &a = into.scopes[i];
+        const Scope &b = from.scopes[i];
+        for (auto &entry : a)
+        {
+            auto it = b.find(entry.first);
+            entry.second = it == b.end() ? T_ANY : join(entry.second, it->second);
+        }
+        for (auto &entry : b)
+        {
+            if (a.find(entry.first) == a.end())
+            {
+                a[entry.first] = T_ANY;
+            }
+        }
+    }
+}
+
+bool TypeInference::same(const State &a, const State &b)
+{
+    return a.dead == b.dead && a.scopes == b.scopes;
+}
+
+//***************************************************************************************** */
+
+// counts every binding of every name, and finds the names a function assigns without
+// declaring them (those can land in any caller)
+void TypeInference::name(const std::string &name, Locals *locals)
+{
+    declared[name]++;
+    if (locals != nullptr && !locals->empty())
+    {
+        locals->back().insert(name);
+    }
+}
+
+void TypeInference::collect_function(FunctionStmt *node)
+{
+    Locals locals(1);
+    for (auto &arg : node->args)
+    {
+        name(arg, &locals);
+    }
+    collect(node->body, &locals);
+}
+
+void TypeInference::collect(const StmtPtr &stmt, Locals *locals)
+{
+    if (!stmt)
+    {
+        return;
+    }
+    switch (stmt->type)
+    {
+        case StmtType::BLOCK:
+        {
+            if (locals) locals->emplace_back();
+            for (auto &s : static_cast<BlockStmt *>(stmt.get())->statements)
+                collect(s, locals);
+            if (locals) locals->pop_back();
+            break;
+        }
+        case StmtType::EXPRESSION: collect(static_cast<ExpressionStmt *>(stmt.get())->expression, locals); break;
+        case StmtType::PRINT:      collect(static_cast<PrintStmt *>(stmt.get())->expression, locals); break;
+        case StmtType::RETURN:     collect(static_cast<ReturnStmt *>(stmt.get())->value, locals); break;
+        case StmtType::DECLARATION:
+        {
+            Declaration *node = static_cast<Declaration *>(stmt.get());
+            collect(node->initializer, locals);
+            for (auto &n : node->names)
+                name(n.lexeme, locals);
+            break;
+        }
+        case StmtType::IF:
+        {
+            IFStmt *node = static_cast<IFStmt *>(stmt.get());
+            collect(node->condition, locals);
+            collect(node->then_branch, locals);
+            for (auto &elif : node->elifBranch)
+            {
+                collect(elif->condition, locals);
+                collect(elif->then_branch, locals);
+            }
+            collect(node->else_branch, locals);
+            break;
+        }
+        case StmtType::SWITCH:
+        {
+            SwitchStmt *node = static_cast<SwitchStmt *>(stmt.get());
+            collect(node->condition, locals);
+            for (auto &c : node->cases)
+            {
+                collect(c->condition, locals);
+                collect(c->body, locals);
+            }
+            collect(node->defaultBranch, locals);
+            break;
+        }
+        case StmtType::WHILE:
+        {
+            WhileStmt *node = static_cast<WhileStmt *>(stmt.get());
+            collect(node->condition, locals);
+            collect(node->body, locals);
+            break;
+        }
+        case StmtType::DO:
+        {
+            DoStmt *node = static_cast<DoStmt *>(stmt.get());
+            collect(node->body, locals);
+            collect(node->condition, locals);
+            break;
+        }
+        case StmtType::FOR:
+        {
+            ForStmt *node = static_cast<ForStmt *>(stmt.get());
+            if (locals) locals->emplace_back();
+            collect(node->initializer, locals);
+            collect(node->condition, locals);
+            collect(node->increment, locals);
+            collect(node->body, locals);
+            if (locals) locals->pop_back();
+            break;
+        }
+        case StmtType::FROM:
+        {
+            FromStmt *node = static_cast<FromStmt *>(stmt.get());
+            collect(node->array, locals);
+            if (locals) locals->emplace_back();
+            collect(node->variable, locals);
+            collect(node->body, locals);
+            if (locals) locals->pop_back();
+            break;
+        }
+        case StmtType::FUNCTION:
+        {
+            FunctionStmt *node = static_cast<FunctionStmt *>(stmt.get());
+            name(node->name.lexeme, locals);
+            collect_function(node);
+            break;
+        }
+        case StmtType::CLASS:
+        {
+            ClassStmt *node = static_cast<ClassStmt *>(stmt.get());
+            name(node->name.lexeme, locals);
+            collect(node->superClass, locals);
+            for (auto &field : node->fields)
+                collect(field, nullptr);
+            for (auto &method : node->methods)
+            {
+                if (method && method->type == StmtType::FUNCTION)
+                {
+                    FunctionStmt *function = static_cast<FunctionStmt *>(method.get());
+                    declared[function->name.lexeme]++;
+                    collect_function(function);
+                }
+            }
+            break;
+        }
+        case StmtType::STRUCT:
+        {
+            StructStmt *node = static_cast<StructStmt *>(stmt.get());
+            name(node->name.lexeme, locals);
+            for (auto &value : node->values)
+                collect(value, nullptr);
+            break;
+        }
+        case StmtType::ARRAY:
+        {
+            ArrayStmt *node = static_cast<ArrayStmt *>(stmt.get());
+            for (auto &value : node->values)
+                collect(value, locals);
+            name(node->name.lexeme, locals);
+            break;
+        }
+        case StmtType::MAP:
+        {
+            MapStmt *node = static_cast<MapStmt *>(stmt.get());
+            for (auto &entry : node->values)
+            {
+                collect(entry.first, locals);
+                collect(entry.second, locals);
+            }
+            name(node->name.lexeme, locals);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void TypeInference::collect(const ExprPtr &expr, Locals *locals)
+{
+    if (!expr)
+    {
+        return;
+    }
+    auto target = [&](const std::string &name)
+    {
+        if (locals == nullptr)
+        {
+            return;
+        }
+        for (auto &scope : *locals)
+        {
+            if (scope.count(name))
+            {
+                return;
+            }
+        }
+        dynamic.insert(name);
+    };
+
+    switch (expr->type)
+    {
+        case ExprType::ASSIGN:
+        {
+            Assign *node = static_cast<Assign *>(expr.get());
+            collect(node->value, locals);
+            target(node->name.lexeme);
+            break;
+        }
+        case ExprType::UNARY:
+        {
+            UnaryExpr *node = static_cast<UnaryExpr *>(expr.get());
+            collect(node->right, locals);
+            bool step = node->op.type == TokenType::INC || node->op.type == TokenType::DEC;
+            if (step && node->right && node->right->type == ExprType::VARIABLE)
+            {
+                target(static_cast<Variable *>(node->right.get())->name.lexeme);
+            }
+            break;
+        }
+        case ExprType::BINARY:
+        {
+            BinaryExpr *node = static_cast<BinaryExpr *>(expr.get());
+            collect(node->left, locals);
+            collect(node->right, locals);
+            break;
+        }
+        case ExprType::LOGICAL:
+        {
+            LogicalExpr *node = static_cast<LogicalExpr *>(expr.get());
+            collect(node->left, locals);
+            collect(node->right, locals);
+            break;
+        }
+        case ExprType::GROUPING: collect(static_cast<GroupingExpr *>(expr.get())->expr, locals); break;
+        case ExprType::GET:      collect(static_cast<GetExpr *>(expr.get())->object, locals); break;
+        case ExprType::SET:
+        {
+            SetExpr *node = static_cast<SetExpr *>(expr.get());
+            collect(node->object, locals);
+            collect(node->value, locals);
+            break;
+        }
+        case ExprType::GET_DEF:
+        {
+            GetDefinitionExpr *node = static_cast<GetDefinitionExpr *>(expr.get());
+            collect(node->variable, locals);
+            for (auto &value : node->values)
+                collect(value, locals);
+            break;
+        }
+        case ExprType::CALL:
+        {
+            CallExpr *node = static_cast<CallExpr *>(expr.get());
+            collect(node->callee, locals);
+            for (auto &arg : node->args)
+                collect(arg, locals);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+//***************************************************************************************** */
+
+void TypeInference::declare(const std::string &name, u8 type)
+{
+    state.scopes.back()[name] = dynamic.count(name) ? T_ANY : type;
+}
+
+void TypeInference::assign(const std::string &name, u8 type)
+{
+    for (size_t i = state.scopes.size(); i-- > 0;)
+    {
+        auto it = state.scopes[i].find(name);
+        if (it != state.scopes[i].end())
+        {
+            it->second = dynamic.count(name) ? T_ANY : type;
+            return;
+        }
+    }
+}
+
+// a name the walk never saw declared comes from a caller, the host or a native
+u8 TypeInference::lookup(const std::string &name)
+{
+    for (size_t i = state.scopes.size(); i-- > 0;)
+    {
+        auto it = state.scopes[i].find(name);
+        if (it != state.scopes[i].end())
+        {
+            return it->second;
+        }
+    }
+    return T_ANY;
+}
+
+void TypeInference::raise(u8 &slot, u8 type)
+{
+    u8 value = join(slot, type);
+    if (value != slot)
+    {
+        slot = value;
+        changed = true;
+    }
+}
+
+//***************************************************************************************** */
+
+void TypeInference::pass(Program *program)
+{
+    state = State();
+    state.scopes.emplace_back();
+    loops.clear();
+    current = nullptr;
+    statements(program->statements);
+}
+
+void TypeInference::statements(const std::vector<StmtPtr> &list)
+{
+    for (auto &s : list)
+    {
+        statement(s);
+    }
+}
+
+void TypeInference::block(const std::vector<StmtPtr> &list)
+{
+    state.scopes.emplace_back();
+    statements(list);
+    state.scopes.pop_back();
+}
+
+// runs on its own state, nothing in the body sees the caller's variables
+void TypeInference::function(FunctionStmt *node, FunctionInfo *info)
+{
+    State saved = std::move(state);
+    std::vector<Loop> savedLoops = std::move(loops);
+    FunctionInfo *savedCurrent = current;
+
+    state = State();
+    state.scopes.emplace_back();
+    loops.clear();
+    current = info;
+    for (size_t i = 0; i < node->args.size(); i++)
+    {
+        u8 type = info && !info->open ? info->args[i] : T_ANY;
+        declare(node->args[i], node->argTypes.empty() ? type : annotated(node->argTypes[i], type));
+    }
+    statement(node->body);
+    if (info && !state.dead)
+    {
+        raise(info->result, T_ANY);   // falls off the end with nil
+    }
+
+    state = std::move(saved);
+    loops = std::move(savedLoops);
+    current = savedCurrent;
+}
+
+// class fields and struct values are evaluated away from the code around them
+void TypeInference::detached(const std::vector<StmtPtr> &list)
+{
+    State saved = std::move(state);
+    FunctionInfo *savedCurrent = current;
+    state = State();
+    state.scopes.emplace_back();
+    current = nullptr;
+    statements(list);
+    state = std::move(saved);
+    current = savedCurrent;
+}
+
+void TypeInference::loop(const ExprPtr &condition, const StmtPtr &body, const ExprPtr &increment, bool testFirst)
+{
+    State head = state;
+    for (;;)
+    {
+        state = head;
+        loops.emplace_back();
+        loops.back().breaks.dead = true;
+        loops.back().continues.dead = true;
+
+        State exit;
+        if (testFirst)
+        {
+            expression(condition);
+            exit = state;
+        }
+        statement(body);
+        join(state, loops.back().continues);
+        expression(increment);
+        if (!testFirst)
+        {
+            expression(condition);
+            exit = state;
+        }
+
+        Loop done = std::move(loops.back());
+        loops.pop_back();
+
+        State next = head;
+        join(next, state);
+        if (same(next, head))
+        {
+            state = std::move(exit);
+            join(state, done.breaks);
+            return;
+        }
+        head = std::move(next);
+    }
+}
+
+void TypeInference::statement(const StmtPtr &stmt)
+{
+    if (!stmt || state.dead)
+    {
+        return;
+    }
+    switch (stmt->type)
+    {
+        case StmtType::BLOCK:      block(static_cast<BlockStmt *>(stmt.get())->statements); break;
+        case StmtType::EXPRESSION: expression(static_cast<ExpressionStmt *>(stmt.get())->expression); break;
+        case StmtType::PRINT:      expression(static_cast<PrintStmt *>(stmt.get())->expression); break;
+        case StmtType::DECLARATION:
+        {
+            Declaration *node = static_cast<Declaration *>(stmt.get());
+            u8 type = annotated(node->annotation, node->initializer ? expression(node->initializer) : T_ANY);
+            for (auto &n : node->names)
+                declare(n.lexeme, type);
+            break;
+        }
+        case StmtType::IF:
+        {
+            IFStmt *node = static_cast<IFStmt *>(stmt.get());
+            expression(node->condition);
+            State rest = state;
+            statement(node->then_branch);
+            State out = std::move(state);
+            for (auto &elif : node->elifBranch)
+            {
+                state = rest;
+                expression(elif->condition);
+                rest = state;
+                statement(elif->then_branch);
+                join(out, state);
+            }
+            state = std::move(rest);
+            statement(node->else_branch);
+            join(out, state);
+            state = std::move(out);
+            break;
+        }
+        case StmtType::SWITCH:
+        {
+            SwitchStmt *node = static_cast<SwitchStmt *>(stmt.get());
+            expression(node->condition);
+            State out;
+            out.dead = true;
+            for (auto &c : node->cases)
+            {
+                expression(c->condition);
+                State rest = state;
+                statement(c->body);
+                join(out, state);
+                state = std::move(rest);
+            }
+            statement(node->defaultBranch);
+            join(out, state);
+            state = std::move(out);
+            break;
+        }
+        case StmtType::WHILE:
+        {
+            WhileStmt *node = static_cast<WhileStmt *>(stmt.get());
+            loop(node->condition, node->body, nullptr, true);
+            break;
+        }
+        case StmtType::DO:
+        {
+            DoStmt *node = static_cast<DoStmt *>(stmt.get());
+            loop(node->condition, node->body, nullptr, false);
+            break;
+        }
+        case StmtType::FOR:
+        {
+            ForStmt *node = static_cast<ForStmt *>(stmt.get());
+            state.scopes.emplace_back();
+            statement(node->initializer);
+            loop(node->condition, node->body, node->increment, true);
+            state.scopes.pop_back();
+            break;
+        }
+        case StmtType::FROM:
+        {
+            FromStmt *node = static_cast<FromStmt *>(stmt.get());
+            expression(node->array);
+            state.scopes.emplace_back();
+            if (node->variable && node->variable->type == StmtType::DECLARATION)
+            {
+                for (auto &n : static_cast<Declaration *>(node->variable.get())->names)
+                    declare(n.lexeme, T_ANY);
+            }
+            loop(nullptr, node->body, nullptr, true);
+            state.scopes.pop_back();
+            break;
+        }
+        case StmtType::RETURN:
+        {
+            ReturnStmt *node = static_cast<ReturnStmt *>(stmt.get());
+            u8 type = node->value ? expression(node->value) : T_ANY;
+            if (current)
+            {
+                raise(current->result, type);
+            }
+            state.dead = true;
+            break;
+        }
+        case StmtType::BREAK:
+        case StmtType::CONTINUE:
+        {
+            if (!loops.empty())
+            {
+                join(stmt->type == StmtType::BREAK ? loops.back().breaks : loops.back().continues, state);
+            }
+            state.dead = true;
+            break;
+        }
+        case StmtType::FUNCTION:
+        {
+            FunctionStmt *node = static_cast<FunctionStmt *>(stmt.get());
+            declare(node->name.lexeme, T_ANY);
+            auto it = functions.find(node->name.lexeme);
+            function(node, it != functions.end() ? &it->second : nullptr);
+            break;
+        }
+        case StmtType::CLASS:
+        {
+            ClassStmt *node = static_cast<ClassStmt *>(stmt.get());
+            expression(node->superClass);
+            declare(node->name.lexeme, T_ANY);
+            detached(node->fields);
+            for (auto &method : node->methods)
+            {
+                if (method && method->type == StmtType::FUNCTION)
+                    function(static_cast<FunctionStmt *>(method.get()), nullptr);
+            }
+            break;
+        }
+        case StmtType::STRUCT:
+        {
+            StructStmt *node = static_cast<StructStmt *>(stmt.get());
+            declare(node->name.lexeme, T_ANY);
+            detached(node->values);
+            break;
+        }
+        case StmtType::ARRAY:
+        {
+            ArrayStmt *node = static_cast<ArrayStmt *>(stmt.get());
+            for (auto &value : node->values)
+                expression(value);
+            declare(node->name.lexeme, T_ANY);
+            break;
+        }
+        case StmtType::MAP:
+        {
+            MapStmt *node = static_cast<MapStmt *>(stmt.get());
+            for (auto &entry : node->values)
+            {
+                expression(entry.first);
+                expression(entry.second);
+            }
+            declare(node->name.lexeme, T_ANY);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+//***************************************************************************************** */
+
+u8 TypeInference::expression(const ExprPtr &expr)
+{
+    if (!expr)
+    {
+        return T_ANY;
+    }
+    switch (expr->type)
+    {
+        case ExprType::L_NUMBER:  return T_NUMBER;
+        case ExprType::L_STRING:  return T_STRING;
+        case ExprType::L_BOOLEAN: return T_BOOL;
+        case ExprType::NOW:       return T_NUMBER;
+        case ExprType::GROUPING:  return expression(static_cast<GroupingExpr *>(expr.get())->expr);
+        case ExprType::BINARY:    return binary(static_cast<BinaryExpr *>(expr.get()));
+        case ExprType::UNARY:     return unary(static_cast<UnaryExpr *>(expr.get()));
+        case ExprType::CALL:      return call(static_cast<CallExpr *>(expr.get()));
+        case ExprType::VARIABLE:
+        {
+            const std::string &name = static_cast<Variable *>(expr.get())->name.lexeme;
+            auto it = functions.find(name);
+            if (it != functions.end() && !it->second.open)
+            {
+                // handed around as a value, it can be called with anything
+                it->second.open = true;
+                changed = true;
+            }
+            return lookup(name);
+        }
+        case ExprType::ASSIGN:
+        {
+            Assign *node = static_cast<Assign *>(expr.get());
+            u8 type = annotated(node->annotation, expression(node->value));
+            assign(node->name.lexeme, type);
+            return type;
+        }
+        case ExprType::LOGICAL:
+        {
+            LogicalExpr *node = static_cast<LogicalExpr *>(expr.get());
+            u8 left = expression(node->left);
+            if (node->op.type == TokenType::XOR)
+            {
+                expression(node->right);
+                return T_BOOL;
+            }
+            // the right side may not run, and either side can be the result
+            State skipped = state;
+            u8 right = expression(node->right);
+            join(state, skipped);
+            return join(left, right);
+        }
+        case ExprType::GET:
+            expression(static_cast<GetExpr *>(expr.get())->object);
+            return T_ANY;
+        case ExprType::SET:
+        {
+            SetExpr *node = static_cast<SetExpr *>(expr.get());
+            expression(node->object);
+            expression(node->value);
+            return T_ANY;
+        }
+        case ExprType::GET_DEF:
+        {
+            GetDefinitionExpr *node = static_cast<GetDefinitionExpr *>(expr.get());
+            expression(node->variable);
+            for (auto &value : node->values)
+                expression(value);
+            return T_ANY;
+        }
+        default:
+            return T_ANY;
+    }
+}
+
+u8 TypeInference::binary(BinaryExpr *node)
+{
+    u8 left = expression(node->left);
+    u8 right = expression(node->right);
+    TokenType op = node->op.type;
+    bool compare = is_compare(op);
+
+    node->quick = Q_NONE;
+    if (left == T_NONE || right == T_NONE)
+    {
+        return T_NONE;
+    }
+    if (left == T_NUMBER && right == T_NUMBER && (compare || is_arithmetic(op) || is_plus(op)))
+    {
+        node->quick = Q_TYPED_NUMBER;
+        return compare ? T_BOOL : T_NUMBER;
+    }
+    if (left == T_STRING && right == T_STRING)
+    {
+        if (is_plus(op))
+        {
+            node->quick = Q_TYPED_STRING;
+            return T_STRING;
+        }
+        if (op == TokenType::EQUAL_EQUAL || op == TokenType::BANG_EQUAL)
+        {
+            node->quick = Q_TYPED_STRING;
+            return T_BOOL;
+        }
+    }
+
+    // whatever else gets past Compiler::binary without throwing
+    if (compare)
+        return T_BOOL;
+    if (is_arithmetic(op))
+        return T_NUMBER;
+    if (is_plus(op) && (left == T_STRING || right == T_STRING))
+        return T_STRING;
+    return T_ANY;
+}
+
+u8 TypeInference::unary(UnaryExpr *node)
+{
+    switch (node->op.type)
+    {
+        case TokenType::INC:
+        case TokenType::DEC:
+        {
+            // anything but a number throws, so afterwards the variable holds one
+            if (node->right && node->right->type == ExprType::VARIABLE)
+            {
+                const std::string &name = static_cast<Variable *>(node->right.get())->name.lexeme;
+                if (lookup(name) != T_NONE)
+                    assign(name, T_NUMBER);
+            }
+            else if (node->right && node->right->type == ExprType::GET)
+            {
+                expression(static_cast<GetExpr *>(node->right.get())->object);
+            }
+            return T_NUMBER;
+        }
+        case TokenType::MINUS:
+        {
+            u8 right = expression(node->right);
+            node->quick = right == T_NUMBER ? Q_TYPED_NUMBER : Q_NONE;
+            return right == T_NONE ? T_NONE : T_NUMBER;
+        }
+        case TokenType::BANG:
+            expression(node->right);
+            return T_BOOL;
+        default:
+            expression(node->right);
+            return T_ANY;
+    }
+}
+
+u8 TypeInference::call(CallExpr *node)
+{
+    if (!node->callee || node->callee->type != ExprType::VARIABLE)
+    {
+        expression(node->callee);
+        for (auto &arg : node->args)
+            expression(arg);
+        return T_ANY;
+    }
+
+    std::vector<u8> args;
+    for (auto &arg : node->args)
+    {
+        args.push_back(expression(arg));
+    }
+
+    const std::string &name = static_cast<Variable *>(node->callee.get())->name.lexeme;
+    auto it = functions.find(name);
+    if (it == functions.end())
+    {
+        return T_ANY;
+    }
+    // at the top level the def has to have run already, before it a native may answer
+    if (current == nullptr && state.scopes.front().find(name) == state.scopes.front().end())
+    {
+        return T_ANY;
+    }
+    FunctionInfo &info = it->second;
+    if (args.size() != info.args.size())
+    {
+        return T_ANY;   // throws
+    }
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        raise(info.args[i], args[i]);
+    }
+    return annotated(info.annotation, info.result);
+}
@@ -0,0 +1,1247 @@
+#include "pch.h"
+#include "VM.hpp"
+#include "Utils.hpp"
+
+#if !defined(BULANG_NO_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define BULANG_COMPUTED_GOTO 1
+#endif
+
+std::string toLower(const std::string &str);
+
+static inline bool is_truthy(const Value &value)
+{
+    return value.isTruthy();
+}
+
+//***************************************************************************************** */
+
+VM::VM(Interpreter *i)
+{
+    interpreter = i;
+    globals = nullptr;
+    stack.resize(VM_STACK_MAX);
+    sp = stack.data();
+    frameCount = 0;
+}
+
+VM::~VM()
+{
+    reset();
+    interpreter = nullptr;
+}
+
+void VM::reset()
+{
+    while (sp > stack.data())
+    {
+        --sp;
+        *sp = Value();
+    }
+    frameCount = 0;
+}
+
+void VM::drop(u32 count)
+{
+    while (count--)
+    {
+        --sp;
+        *sp = Value();
+    }
+}
+
+void VM::runtime_error(const std::string &message)
+{
+    int line = 0;
+    if (frameCount > 0)
+    {
+        CallFrame *frame = &frames[frameCount - 1];
+        Chunk *chunk = frame->function->chunk.get();
+        size_t offset = frame->ip - chunk->code.data();
+        if (offset > 0) offset--;
+        if (offset < chunk->lines.size()) line = chunk->lines[offset];
+    }
+    throw FatalException(message + " at line " + std::to_string(line));
+}
+
+u8 VM::execute(Program *program)
+{
+    Emitter emitter;
+    emitter.memos = &interpreter->compiler->memos;
+    Value script = emitter.compile(program);
+
+    reset();
+    globals = interpreter->compiler->global.get();
+
+    push(script);
+    call_function(script.as<Function>(), 0, false);
+    run(0);
+    pop();
+    return 0;
+}
+
+//***************************************************************************************** */
+
+void VM::call_function(Function *function, u8 argc, bool constructor)
+{
+    if (!function->chunk)
+    {
+        runtime_error("Function '" + function->name.lexeme + "' was not compiled to bytecode");
+    }
+    if (function->arity != argc)
+    {
+        runtime_error("Incorrect number of arguments in call to '" + function->name.lexeme + "' expected " + std::to_string(function->arity) + " but got " + std::to_string(argc));
+    }
+    if (frameCount == VM_FRAMES_MAX || sp + VM_LOCALS_MAX > stack.data() + stack.size())
+    {
+        runtime_error("Stack overflow");
+    }
+    for (u32 i = 0; i < function->argTypes.size(); i++)
+    {
+        const Value &arg = sp[(int)i - argc];
+        if (!annotation_fits(function->argTypes[i], arg))
+        {
+            runtime_error("Type mismatch: '" + function->name.lexeme + "(" + function->args[i] + ")' is " + annotation_name(function->argTypes[i]) + ", got " + arg.typeName());
+        }
+    }
+
+    CallFrame *frame = &frames[frameCount++];
+    frame->function = function;
+    frame->ip = function->chunk->code.data();
+    frame->slots = sp - argc - 1;
+    frame->constructor = constructor;
+    frame->memo = nullptr;
+    frame->holder = nullptr;
+}
+
+bool VM::call_memo(Function *function, u8 argc)
+{
+    std::string key;
+    if (!MemoTable::key(sp - argc, argc, key))
+    {
+        call_function(function, argc, false);
+        return true;
+    }
+    Value result;
+    if (function->memo->find(key, result))
+    {
+        drop(argc + 1);
+        push(std::move(result));
+        return false;
+    }
+    call_function(function, argc, false);
+    CallFrame *frame = &frames[frameCount - 1];
+    frame->memo = function->memo.get();
+    frame->key = std::move(key);
+    return true;
+}
+
+bool VM::call_value(u8 argc)
+{
+    const Value &value = sp[-argc - 1];
+    if (!value.isObject())
+    {
+        runtime_error(std::string("Can only call functions, structs and classes, got ") + value.typeName());
+    }
+    Object *callee = value.asObject();
+    switch (callee->type)
+    {
+        case O_FUNCTION:
+        {
+            Function *function = static_cast<Function *>(callee);
+            if (function->memo)
+            {
+                return call_memo(function, argc);
+            }
+            call_function(function, argc, false);
+            return true;
+        }
+        case O_NATIVE:
+        {
+            Native *native = static_cast<Native *>(callee);
+            Context *context = interpreter->context;
+            context->clear();
+            Value *args = sp - argc;
+            for (u32 i = 0; i < argc; i++)
+            {
+                context->add(args[i]);
+            }
+            Value result = native->function != nullptr
+                               ? native->function(context, argc)
+                               : interpreter->CallNativeFunction(native->name.lexeme, argc);
+            drop(argc + 1);
+            push(result.isEmpty() ? Value::nil() : std::move(result));
+            return false;
+        }
+        case O_STRUCT:
+        {
+            Value result = construct_struct(static_cast<StructLiteral *>(callee), argc);
+            drop(argc + 1);
+            push(std::move(result));
+            return false;
+        }
+        case O_CLASS:
+        {
+            return construct_class(static_cast<ClassLiteral *>(callee), argc);
+        }
+        default:
+            runtime_error(std::string("Can only call functions, structs and classes, got ") + value.typeName());
+    }
+    return false;
+}
+
+Value VM::call_sync(const Value &callee, const std::vector<Value> &args)
+{
+    push(callee);
+    for (auto &arg : args)
+    {
+        push(arg);
+    }
+    u32 exitFrame = frameCount;
+    if (call_value((u8)args.size()))
+    {
+        run(exitFrame);
+    }
+    return pop();
+}
+
+Value VM::construct_struct(StructLiteral *original, u8 argc)
+{
+    Value *args = sp - argc;
+    StructLayout *layout = original->layout.get();
+    if (argc > original->count)
+    {
+        WARNING("Too many arguments in struct call: '%s' (pass %d / %d have) ", layout->name.c_str(), argc, original->count);
+    }
+
+    StructLiteral *result = StructLiteral::create(original->layout, original->count);
+    Value value(result);
+    Value *slots = result->values();
+    const Value *defaults = original->values();
+    for (u32 i = 0; i < original->count; i++)
+    {
+        if (i < argc)
+        {
+            if (!layout->types.empty() && !annotation_fits(layout->types[i], args[i]))
+            {
+                runtime_error("Type mismatch: '" + layout->name + "." + layout->fields[i] + "' is " + annotation_name(layout->types[i]) + ", got " + args[i].typeName());
+            }
+            slots[i] = args[i];
+        }
+        else
+        {
+            slots[i] = defaults[i].clone();
+        }
+    }
+    return value;
+}
+
+void VM::prepare_class(ClassLiteral *cl)
+{
+    if (cl->prepared)
+    {
+        return;
+    }
+    Value parent;
+    if (cl->isChild)
+    {
+        parent = globals->get(cl->parentName);
+        if (!parent.isObject(O_CLASS) || parent.as<ClassLiteral>()->instance())
+        {
+            runtime_error("Undefined parent class: '" + cl->parentName + "'");
+        }
+        if (cl->preparing)
+        {
+            runtime_error("Class '" + cl->name + "' extends itself");
+        }
+        cl->preparing = true;
+        try
+        {
+            prepare_class(parent.as<ClassLiteral>());
+        }
+        catch (...)
+        {
+            cl->preparing = false;
+            throw;
+        }
+        cl->preparing = false;
+    }
+    cl->prepare(parent);
+}
+
+bool VM::construct_class(ClassLiteral *main, u8 argc)
+{
+    if (main->instance())
+    {
+        main = main->owner.as<ClassLiteral>();
+    }
+    prepare_class(main);
+
+    Value value = main->instantiate();
+    ClassLiteral *instance = value.as<ClassLiteral>();
+
+    ClassLiteral *owner = nullptr;
+    Value *init = instance->method("init", owner);
+    sp[-argc - 1] = std::move(value);
+
+    if (init != nullptr && init->isObject(O_FUNCTION))
+    {
+        call_function(init->as<Function>(), argc, true);
+        frames[frameCount - 1].holder = owner;
+        return true;
+    }
+    drop(argc);
+    return false;
+}
+
+void VM::invoke(const std::string &name, u8 argc)
+{
+    Value receiver = sp[-argc - 1];
+    if (!receiver.isObject())
+    {
+        runtime_error("Unknown function '" + name + "' for " + receiver.typeName());
+    }
+    switch (receiver.asObject()->type)
+    {
+        case O_CLASS:
+        {
+            ClassLiteral *instance = receiver.as<ClassLiteral>();
+            ClassLiteral *owner = nullptr;
+            Value *method = instance->method(name, owner);
+            Value value = method != nullptr ? *method : instance->environment->get(name);
+            if (value.isEmpty())
+            {
+                runtime_error("Function '" + name + "' not found in class");
+            }
+            if (value.isObject(O_FUNCTION))
+            {
+                call_function(value.as<Function>(), argc, false);
+                frames[frameCount - 1].holder = owner;
+                return;
+            }
+            sp[-argc - 1] = std::move(value);
+            call_value(argc);
+            return;
+        }
+        case O_ARRAY:
+        {
+            Value result = array_method(receiver.as<ArrayLiteral>(), name, argc);
+            drop(argc + 1);
+            push(std::move(result));
+            return;
+        }
+        case O_MAP:
+        {
+            Value result = map_method(receiver.as<MapLiteral>(), name, argc);
+            drop(argc + 1);
+            push(std::move(result));
+            return;
+        }
+        case O_STRING:
+        {
+            Value result = string_method(receiver.asString(), name, argc);
+            drop(argc + 1);
+            push(std::move(result));
+            return;
+        }
+        default:
+            runtime_error("Unknown function '" + name + "' for " + receiver.typeName());
+    }
+}
+
+// super.name(...) in a method, the running instance is already in the receiver slot
+void VM::invoke_super(const std::string &name, u8 argc)
+{
+    ClassLiteral *holder = frames[frameCount - 1].holder;
+    if (holder == nullptr || holder->base.isEmpty())
+    {
+        // not called through a method table, super is looked up like any other name
+        const Value &self = sp[-argc - 1];
+        Environment *scope = self.isObject(O_CLASS) ? self.as<ClassLiteral>()->environment : globals;
+        Value super = scope->get("super");
+        if (super.isEmpty())
+        {
+            runtime_error("Undefined variable: 'super'");
+        }
+        sp[-argc - 1] = std::move(super);
+        invoke(name, argc);
+        return;
+    }
+    MethodTable *table = holder->base.as<ClassLiteral>()->table.get();
+    int slot = table->find(name);
+    if (slot < 0)
+    {
+        runtime_error("Function '" + name + "' not found in class");
+    }
+    Value value = *table->methods[slot];
+    if (value.isObject(O_FUNCTION))
+    {
+        call_function(value.as<Function>(), argc, false);
+        frames[frameCount - 1].holder = table->owners[slot];
+        return;
+    }
+    sp[-argc - 1] = std::move(value);
+    call_value(argc);
+}
+
+//***************************************************************************************** */
+
+Value VM::array_method(ArrayLiteral *array, const std::string &name, u8 argc)
+{
+    Value *args = sp - argc;
+    Value self = sp[-argc - 1];
+    std::string action = toLower(name);
+    if (array->frozen && (action == "push" || action == "pop" || action == "set" || action == "remove" || action == "clear"))
+    {
+        runtime_error("Cannot change const array '" + array->name + "'");
+    }
+
+    if (action == "push")
+    {
+        if (argc < 1)
+        {
+            runtime_error("Array 'push' requires 1 or more argument");
+        }
+        for (u32 i = 0; i < argc; i++)
+        {
+            array->values.push_back(args[i].clone());
+        }
+        return self;
+    }
+    else if (action == "pop")
+    {
+        if (array->values.empty())
+        {
+            runtime_error("Array 'pop' on empty array");
+        }
+        Value value = std::move(array->values.back());
+        array->values.pop_back();
+        return value;
+    }
+    else if (action == "size")
+    {
+        return Value::number((double)array->values.size());
+    }
+    else if (action == "at")
+    {
+        if (argc != 1)
+        {
+            ERROR("Array 'at' requires 1 argument");
+            return self;
+        }
+        if (!args[0].isNumber())
+        {
+            ERROR("Array index must be a number");
+            return self;
+        }
+        double index = args[0].asNumber();
+        if (index < 0 || index >= array->values.size())
+        {
+            ERROR("Array index out of bounds");
+            return self;
+        }
+        return array->values[(u32)index];
+    }
+    else if (action == "set")
+    {
+        if (argc != 2)
+        {
+            runtime_error("Array 'set' requires 2 arguments");
+        }
+        if (!args[0].isNumber())
+        {
+            runtime_error("Array index must be a number");
+        }
+        double index = args[0].asNumber();
+        if (index < 0 || index >= array->values.size())
+        {
+            runtime_error("Array index out of bounds");
+        }
+        array->values[(u32)index] = args[1];
+        return self;
+    }
+    else if (action == "last")
+    {
+        if (array->values.empty()) return Value::nil();
+        return array->values.back();
+    }
+    else if (action == "remove")
+    {
+        if (argc != 1)
+        {
+            runtime_error("Array 'remove' requires 1 argument");
+        }
+        if (!args[0].isNumber())
+        {
+            runtime_error("Array index must be a number");
+        }
+        double index = args[0].asNumber();
+        if (index < 0 || index >= array->values.size())
+        {
+            runtime_error("Array index out of bounds");
+        }
+        Value item = array->values[(u32)index];
+        array->values.erase(array->values.begin() + (u32)index);
+        return item;
+    }
+    else if (action == "clear")
+    {
+        array->values.clear();
+        return self;
+    }
+    else if (action == "foreach")
+    {
+        if (argc < 1 || !args[0].isObject(O_FUNCTION))
+        {
+            runtime_error("Array 'foreach' requires 1 function argument");
+        }
+        Value function = args[0];
+        for (u32 i = 0; i < array->values.size(); i++)
+        {
+            call_sync(function, {array->values[i]});
+        }
+        return self;
+    }
+
+    runtime_error("Unknown array function: " + name);
+    return Value::nil();
+}
+
+Value VM::map_method(MapLiteral *map, const std::string &name, u8 argc)
+{
+    Value *args = sp - argc;
+    std::string action = toLower(name);
+    if (map->frozen && (action == "erase" || action == "set" || action == "clear"))
+    {
+        runtime_error("Cannot change const map '" + map->name + "'");
+    }
+
+    if (action == "erase")
+    {
+        if (argc != 1)
+        {
+            runtime_error("Dictionary 'erase' requires 1 arguments");
+        }
+        auto it = map->values.find(args[0]);
+        if (it == map->values.end())
+        {
+            WARNING("Key not found: %s", args[0].toString().c_str());
+            return Value::nil();
+        }
+        Value value = it->second;
+        map->values.erase(it);
+        return value;
+    }
+    else if (action == "size")
+    {
+        return Value::number((double)map->values.size());
+    }
+    else if (action == "set")
+    {
+        if (argc != 2)
+        {
+            runtime_error("Dictionary 'set' requires 2 arguments");
+        }
+        map->values[args[0]] = args[1].clone();
+        return args[1];
+    }
+    else if (action == "find")
+    {
+        if (argc != 1)
+        {
+            runtime_error("Dictionary 'find' requires 1 arguments");
+        }
+        auto it = map->values.find(args[0]);
+        if (it == map->values.end())
+        {
+            WARNING("Key not found: %s", args[0].toString().c_str());
+            return Value::nil();
+        }
+        return it->second;
+    }
+    else if (action == "clear")
+    {
+        map->values.clear();
+        return Value::nil();
+    }
+    else if (action == "foreach")
+    {
+        if (argc < 1 || !args[0].isObject(O_FUNCTION))
+        {
+            runtime_error("Dictionary 'foreach' requires 1 function argument");
+        }
+        Value function = args[0];
+        std::vector<std::pair<Value, Value>> items(map->values.begin(), map->values.end());
+        for (auto &item : items)
+        {
+            call_sync(function, {item.first, item.second});
+        }
+        return Value::nil();
+    }
+
+    runtime_error("Unknown dictionary function: " + name);
+    return Value::nil();
+}
+
+Value VM::string_method(const std::string &string, const std::string &name, u8 argc)
+{
+    Value *args = sp - argc;
+    if (name == "length")
+    {
+        return Value::number((double)string.length());
+    }
+    else if (name == "asInt")
+    {
+        if (argc < 1 || !args[0].isNumber())
+        {
+            runtime_error("String 'asInt' requires a number argument");
+        }
+        return Value::string(std::to_string(static_cast<long>(args[0].asNumber())));
+    }
+
+    runtime_error("Unknown string function '" + name + "'");
+    return Value::nil();
+}
+
+//***************************************************************************************** */
+
+void VM::run(u32 exitFrame)
+{
+    CallFrame *frame = &frames[frameCount - 1];
+    const u8 *ip = frame->ip;
+    Value *slots = frame->slots;
+    const Value *constants = frame->function->chunk->constants.data();
+
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, (u16)((ip[-2] << 8) | ip[-1]))
+#define READ_CONSTANT() (constants[READ_SHORT()])
+#define READ_NAME() (READ_CONSTANT().asString())
+#define SAVE_FRAME() (frame->ip = ip)
+#define LOAD_FRAME()                                             \
+    do                                                           \
+    {                                                            \
+        frame = &frames[frameCount - 1];                         \
+        ip = frame->ip;                                          \
+        slots = frame->slots;                                    \
+        constants = frame->function->chunk->constants.data();    \
+    } while (0)
+#define VM_ERROR(message)          \
+    do                             \
+    {                              \
+        SAVE_FRAME();              \
+        runtime_error(message);    \
+    } while (0)
+
+#define BINARY_ERROR(a, b, op)                                                                      \
+    do                                                                                              \
+    {                                                                                               \
+        if ((a).isNil() || (b).isNil())                                                             \
+            VM_ERROR("Invalid binary expression. '" op "' Literals are not allowed");               \
+        VM_ERROR("Invalid binary expression, With operator '" op "'");                              \
+    } while (0)
+
+#define NUMBER_OP(expression, op)                                                        \
+    do                                                                                   \
+    {                                                                                    \
+        const Value &b = sp[-1];                                                         \
+        const Value &a = sp[-2];                                                         \
+        if (!a.isNumber() || !b.isNumber())                                              \
+            BINARY_ERROR(a, b, op);                                                      \
+        double x = a.asNumber();                                                         \
+        double y = b.asNumber();                                                         \
+        drop(1);                                                                         \
+        sp[-1] = (expression);                                                           \
+    } while (0)
+
+#define EQUALITY_CHECK(op)                                                                          \
+    do                                                                                              \
+    {                                                                                               \
+        const Value &b = sp[-1];                                                                    \
+        const Value &a = sp[-2];                                                                    \
+        if (!(a.isNumber() && b.isNumber()) && !(a.isString() && b.isString()) &&                   \
+            !(a.isBool() && b.isBool()))                                                            \
+            BINARY_ERROR(a, b, op);                                                                 \
+    } while (0)
+
+#ifdef BULANG_COMPUTED_GOTO
+    static void *dispatchTable[] =
+    {
+#define BULANG_OPCODE_LABEL(name) &&op_##name,
+        BULANG_OPCODES(BULANG_OPCODE_LABEL)
+#undef BULANG_OPCODE_LABEL
+    };
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() goto *dispatchTable[*ip++]
+    VM_NEXT();
+#else
+#define VM_CASE(name) case OP_##name:
+#define VM_NEXT() break
+    for (;;)
+    {
+        switch (*ip++)
+        {
+#endif
+
+    VM_CASE(CONSTANT)
+    {
+        push(READ_CONSTANT());
+        VM_NEXT();
+    }
+    VM_CASE(NIL)
+    {
+        push(Value::nil());
+        VM_NEXT();
+    }
+    VM_CASE(TRUE)
+    {
+        push(Value::boolean(true));
+        VM_NEXT();
+    }
+    VM_CASE(FALSE)
+    {
+        push(Value::boolean(false));
+        VM_NEXT();
+    }
+    VM_CASE(POP)
+    {
+        drop(1);
+        VM_NEXT();
+    }
+    VM_CASE(DUP)
+    {
+        Value value = sp[-1];
+        push(std::move(value));
+        VM_NEXT();
+    }
+    VM_CASE(GET_LOCAL)
+    {
+        u8 slot = READ_BYTE();
+        push(slots[slot]);
+        VM_NEXT();
+    }
+    VM_CASE(SET_LOCAL)
+    {
+        u8 slot = READ_BYTE();
+        slots[slot] = sp[-1];
+        VM_NEXT();
+    }
+    VM_CASE(GET_GLOBAL)
+    {
+        const std::string &name = READ_NAME();
+        Value value = globals->get(name);
+        if (value.isEmpty())
+        {
+            VM_ERROR("Undefined variable: '" + name + "'");
+        }
+        push(std::move(value));
+        VM_NEXT();
+    }
+    VM_CASE(SET_GLOBAL)
+    {
+        const std::string &name = READ_NAME();
+        if (!globals->assign(name, sp[-1]))
+        {
+            VM_ERROR("Undefined variable: '" + name + "'");
+        }
+        VM_NEXT();
+    }
+    VM_CASE(DEFINE_GLOBAL)
+    {
+        const std::string &name = READ_NAME();
+        globals->define(name, pop());
+        VM_NEXT();
+    }
+    VM_CASE(GET_NAME)
+    {
+        const std::string &name = READ_NAME();
+        Environment *scope = slots[0].isObject(O_CLASS) ? slots[0].as<ClassLiteral>()->environment : globals;
+        Value value = scope->get(name);
+        if (value.isEmpty())
+        {
+            VM_ERROR("Undefined variable: '" + name + "'");
+        }
+        push(std::move(value));
+        VM_NEXT();
+    }
+    VM_CASE(SET_NAME)
+    {
+        const std::string &name = READ_NAME();
+        Environment *scope = slots[0].isObject(O_CLASS) ? slots[0].as<ClassLiteral>()->environment : globals;
+        if (!scope->assign(name, sp[-1]))
+        {
+            VM_ERROR("Undefined variable: '" + name + "'");
+        }
+        VM_NEXT();
+    }
+    VM_CASE(GET_PROPERTY)
+    {
+        const std::string &name = READ_NAME();
+        const Value &object = sp[-1];
+        Value value;
+        if (object.isObject(O_STRUCT))
+        {
+            StructLiteral *sl = object.as<StructLiteral>();
+            int slot = sl->layout->find(name);
+            if (slot >= 0)
+            {
+                value = sl->values()[slot];
+            }
+            else
+            {
+                ERROR("Member not found: %s", name.c_str());
+            }
+        }
+        else if (object.isObject(O_CLASS))
+        {
+            value = object.as<ClassLiteral>()->environment->get(name);
+            if (value.isEmpty())
+            {
+                WARNING("Class member not found: %s", name.c_str());
+            }
+        }
+        else
+        {
+            VM_ERROR("Only structs and classes have properties, got " + object.toString());
+        }
+        sp[-1] = value.isEmpty() ? Value::nil() : std::move(value);
+        VM_NEXT();
+    }
+    VM_CASE(SET_PROPERTY)
+    {
+        const std::string &name = READ_NAME();
+        const Value &object = sp[-2];
+        if (object.isObject(O_STRUCT))
+        {
+            StructLiteral *sl = object.as<StructLiteral>();
+            int slot = sl->layout->find(name);
+            if (slot >= 0)
+            {
+                if (!sl->layout->types.empty() && !annotation_fits(sl->layout->types[slot], sp[-1]))
+                {
+                    VM_ERROR("Type mismatch: '" + sl->layout->name + "." + name + "' is " + annotation_name(sl->layout->types[slot]) + ", got " + sp[-1].typeName());
+                }
+                sl->values()[slot] = sp[-1];
+            }
+        }
+        else if (object.isObject(O_CLASS))
+        {
+            ClassLiteral *cl = object.as<ClassLiteral>();
+            Environment *env = cl->environment;
+            int slot = cl->instance() ? cl->shape->find(name) : -1;
+            if (slot >= 0)
+            {
+                env->slot(slot) = sp[-1];
+            }
+            else if (!env->get(name).isEmpty())
+            {
+                if (cl->instance())
+                    cl->add(name, sp[-1]);
+                else
+                    env->set(name, sp[-1]);
+            }
+            else
+            {
+                WARNING("Class member not found: %s", name.c_str());
+            }
+        }
+        else
+        {
+            VM_ERROR("SET not implemented for " + object.toString());
+        }
+        sp[-2] = std::move(sp[-1]);
+        drop(1);
+        VM_NEXT();
+    }
+    VM_CASE(ADD)
+    {
+        const Value &b = sp[-1];
+        const Value &a = sp[-2];
+        if (a.isNumber() && b.isNumber())
+        {
+            double value = a.asNumber() + b.asNumber();
+            drop(1);
+            sp[-1] = Value::number(value);
+            VM_NEXT();
+        }
+
+        Value result;
+        if (a.isString() && b.isString())
+        {
+            result = Value::string(a.asString() + b.asString());
+        }
+        else if (a.isString() && b.isNumber())
+        {
+            result = Value::string(a.asString() + std::to_string(b.asNumber()));
+        }
+        else if (a.isNumber() && b.isString())
+        {
+            result = Value::string(std::to_string(a.asNumber()) + b.asString());
+        }
+        else
+        {
+            BINARY_ERROR(a, b, "+");
+        }
+        drop(1);
+        sp[-1] = std::move(result);
+        VM_NEXT();
+    }
+    VM_CASE(SUBTRACT)
+    {
+        NUMBER_OP(Value::number(x - y), "-");
+        VM_NEXT();
+    }
+    VM_CASE(MULTIPLY)
+    {
+        NUMBER_OP(Value::number(x * y), "*");
+        VM_NEXT();
+    }
+    VM_CASE(DIVIDE)
+    {
+        if (sp[-1].isNumber() && sp[-1].asNumber() == 0)
+        {
+            VM_ERROR("Division by zero");
+        }
+        NUMBER_OP(Value::number(x / y), "/");
+        VM_NEXT();
+    }
+    VM_CASE(MOD)
+    {
+        NUMBER_OP(Value::number(std::fmod(x, y)), "%");
+        VM_NEXT();
+    }
+    VM_CASE(EQUAL)
+    {
+        EQUALITY_CHECK("==");
+        bool equal = sp[-2].equals(sp[-1]);
+        drop(1);
+        sp[-1] = Value::boolean(equal);
+        VM_NEXT();
+    }
+    VM_CASE(NOT_EQUAL)
+    {
+        EQUALITY_CHECK("!=");
+        bool equal = sp[-2].equals(sp[-1]);
+        drop(1);
+        sp[-1] = Value::boolean(!equal);
+        VM_NEXT();
+    }
+    VM_CASE(GREATER)
+    {
+        NUMBER_OP(Value::boolean(x > y), ">");
+        VM_NEXT();
+    }
+    VM_CASE(GREATER_EQUAL)
+    {
+        NUMBER_OP(Value::boolean(x >= y), ">=");
+        VM_NEXT();
+    }
+    VM_CASE(LESS)
+    {
+        NUMBER_OP(Value::boolean(x < y), "<");
+        VM_NEXT();
+    }
+    VM_CASE(LESS_EQUAL)
+    {
+        NUMBER_OP(Value::boolean(x <= y), "<=");
+        VM_NEXT();
+    }
+    VM_CASE(NEGATE)
+    {
+        if (!sp[-1].isNumber())
+        {
+            VM_ERROR("Invalid unary expression, With operator '-'");
+        }
+        sp[-1] = Value::number(-sp[-1].asNumber());
+        VM_NEXT();
+    }
+    VM_CASE(NOT)
+    {
+        sp[-1] = Value::boolean(!is_truthy(sp[-1]));
+        VM_NEXT();
+    }
+    VM_CASE(XOR)
+    {
+        bool value = is_truthy(sp[-2]) != is_truthy(sp[-1]);
+        drop(1);
+        sp[-1] = Value::boolean(value);
+        VM_NEXT();
+    }
+    VM_CASE(JUMP)
+    {
+        u16 offset = READ_SHORT();
+        ip += offset;
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF_FALSE)
+    {
+        u16 offset = READ_SHORT();
+        if (!is_truthy(sp[-1])) ip += offset;
+        drop(1);
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF_FALSE_KEEP)
+    {
+        u16 offset = READ_SHORT();
+        if (!is_truthy(sp[-1])) ip += offset;
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF_TRUE_KEEP)
+    {
+        u16 offset = READ_SHORT();
+        if (is_truthy(sp[-1])) ip += offset;
+        VM_NEXT();
+    }
+    VM_CASE(LOOP)
+    {
+        u16 offset = READ_SHORT();
+        ip -= offset;
+        VM_NEXT();
+    }
+    VM_CASE(ITERATE)
+    {
+        u8 array = READ_BYTE();
+        u8 variable = READ_BYTE();
+        u16 offset = READ_SHORT();
+        if (!slots[array].isObject(O_ARRAY))
+        {
+            VM_ERROR("Expected array to iterate");
+        }
+        ArrayLiteral *al = slots[array].as<ArrayLiteral>();
+        u32 index = (u32)slots[array + 1].asNumber();
+        if (index >= al->values.size())
+        {
+            ip += offset;
+            VM_NEXT();
+        }
+        slots[variable] = al->values[index];
+        slots[array + 1] = Value::number(index + 1);
+        VM_NEXT();
+    }
+    VM_CASE(CALL)
+    {
+        u8 argc = READ_BYTE();
+        SAVE_FRAME();
+        if (call_value(argc))
+        {
+            LOAD_FRAME();
+        }
+        VM_NEXT();
+    }
+    VM_CASE(TAIL_CALL)
+    {
+        u8 argc = READ_BYTE();
+        Value *callee = sp - argc - 1;
+        // a frame with a result annotation is only reused by a callee that checks the same one
+        if (!frame->constructor && frame->memo == nullptr && callee->isObject(O_FUNCTION) && !callee->as<Function>()->memo &&
+            (frame->function->result == A_NONE || frame->function->result == callee->as<Function>()->result))
+        {
+            // slide the callee and its arguments down over this frame and reuse it
+            Value *base = frame->slots;
+            for (u32 i = 0; i <= argc; i++)
+            {
+                base[i] = std::move(callee[i]);
+            }
+            while (sp > base + argc + 1)
+            {
+                --sp;
+                *sp = Value();
+            }
+            SAVE_FRAME();
+            frameCount--;
+            call_function(base->as<Function>(), argc, false);
+            LOAD_FRAME();
+            VM_NEXT();
+        }
+        SAVE_FRAME();
+        if (call_value(argc))
+        {
+            LOAD_FRAME();
+        }
+        VM_NEXT();
+    }
+    VM_CASE(INVOKE)
+    {
+        const std::string &name = READ_NAME();
+        u8 argc = READ_BYTE();
+        SAVE_FRAME();
+        invoke(name, argc);
+        LOAD_FRAME();
+        VM_NEXT();
+    }
+    VM_CASE(SUPER_INVOKE)
+    {
+        const std::string &name = READ_NAME();
+        u8 argc = READ_BYTE();
+        SAVE_FRAME();
+        invoke_super(name, argc);
+        LOAD_FRAME();
+        VM_NEXT();
+    }
+    VM_CASE(RETURN)
+    {
+        Value result = pop();
+        if (frame->constructor)
+        {
+            result = frame->slots[0];
+        }
+        else if (!annotation_fits(frame->function->result, result))
+        {
+            VM_ERROR("Type mismatch: '" + frame->function->name.lexeme + "' is " + annotation_name(frame->function->result) + ", got " + result.typeName());
+        }
+        if (frame->memo != nullptr)
+        {
+            frame->memo->insert(frame->key, result);
+        }
+        while (sp > frame->slots)
+        {
+            --sp;
+            *sp = Value();
+        }
+        frameCount--;
+        push(std::move(result));
+        if (frameCount == exitFrame)
+        {
+            return;
+        }
+        LOAD_FRAME();
+        VM_NEXT();
+    }
+    VM_CASE(PRINT)
+    {
+        sp[-1].print();
+        drop(1);
+        VM_NEXT();
+    }
+    VM_CASE(NOW)
+    {
+        push(Value::number(time_now()));
+        VM_NEXT();
+    }
+    VM_CASE(ARRAY)
+    {
+        const std::string &name = READ_NAME();
+        u16 count = READ_SHORT();
+        ArrayLiteral *array = new ArrayLiteral();
+        Value result(array);
+        array->name = name;
+        array->values.reserve(count);
+        Value *items = sp - count;
+        for (u32 i = 0; i < count; i++)
+        {
+            array->values.push_back(std::move(items[i]));
+        }
+        drop(count);
+        push(std::move(result));
+        VM_NEXT();
+    }
+    VM_CASE(MAP)
+    {
+        const std::string &name = READ_NAME();
+        u16 count = READ_SHORT();
+        MapLiteral *map = new MapLiteral();
+        Value result(map);
+        map->name = name;
+        Value *pairs = sp - count * 2;
+        for (u32 i = 0; i < count; i++)
+        {
+            const Value &key = pairs[i * 2];
+            if (!key.isString() && !key.isNumber())
+            {
+                VM_ERROR("Map key must be a string or number.");
+            }
+            map->values[key] = std::move(pairs[i * 2 + 1]);
+        }
+        drop(count * 2);
+        push(std::move(result));
+        VM_NEXT();
+    }
+    VM_CASE(FREEZE)
+    {
+        if (sp[-1].isObject(O_ARRAY))
+            sp[-1].as<ArrayLiteral>()->frozen = true;
+        else
+            sp[-1].as<MapLiteral>()->frozen = true;
+        VM_NEXT();
+    }
+    VM_CASE(STRUCT)
+    {
+        auto layout = std::make_shared<StructLayout>();
+        layout->name = READ_NAME();
+        u16 count = READ_SHORT();
+        push(Value(StructLiteral::create(std::move(layout), count)));
+        VM_NEXT();
+    }
+    VM_CASE(STRUCT_FIELD)
+    {
+        const std::string &name = READ_NAME();
+        StructLiteral *sl = sp[-2].as<StructLiteral>();
+        sl->values()[sl->layout->add(name, A_NONE)] = pop();
+        VM_NEXT();
+    }
+    VM_CASE(CLASS)
+    {
+        const std::string &name = READ_NAME();
+        u16 parent = READ_SHORT();
+        ClassLiteral *cl = new ClassLiteral();
+        Value result(cl);
+        cl->name = name;
+        cl->environment = new Environment(globals);
+        cl->isChild = parent != UINT16_MAX;
+        cl->parentName = cl->isChild ? constants[parent].asString() : "";
+        push(std::move(result));
+        VM_NEXT();
+    }
+    VM_CASE(FIELD)
+    {
+        const std::string &name = READ_NAME();
+        ClassLiteral *cl = sp[-2].as<ClassLiteral>();
+        cl->environment->define(name, pop());
+        cl->fields.push_back(name);
+        VM_NEXT();
+    }
+    VM_CASE(METHOD)
+    {
+        const std::string &name = READ_NAME();
+        ClassLiteral *cl = sp[-2].as<ClassLiteral>();
+        cl->environment->define(name, pop());
+        cl->methods.push_back(name);
+        VM_NEXT();
+    }
+    VM_CASE(FIELD_TYPE)
+    {
+        StructLiteral *sl = sp[-1].as<StructLiteral>();
+        StructLayout *layout = sl->layout.get();
+        layout->types.resize(layout->fields.size(), A_NONE);
+        layout->types.back() = READ_BYTE();
+        VM_NEXT();
+    }
+    VM_CASE(CHECK_TYPE)
+    {
+        const std::string &name = READ_NAME();
+        u8 annotation = READ_BYTE();
+        if (!annotation_fits(annotation, sp[-1]))
+        {
+            VM_ERROR("Type mismatch: '" + name + "' is " + annotation_name(annotation) + ", got " + sp[-1].typeName());
+        }
+        VM_NEXT();
+    }
+
+#ifndef BULANG_COMPUTED_GOTO
+            default:
+                VM_ERROR("Unknown opcode " + std::to_string(ip[-1]));
+        }
+    }
+#endif
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef READ_NAME
+#undef SAVE_FRAME
+#undef LOAD_FRAME
+#undef VM_ERROR
+#undef BINARY_ERROR
+#undef NUMBER_OP
+#undef EQUALITY_CHECK
+#undef VM_CASE
+#undef VM_NEXT
+}
@@ -0,0 +1,134 @@
+#include "pch.h"
+#include "Value.hpp"
+#include "Utils.hpp"
+
+std::string Object::toString()
+{
+    return "";
+}
+
+void Object::print()
+{
+    WARNING("[PRINT] Unknown literal type %s", Value(this).typeName());
+}
+
+Value Object::clone()
+{
+    return Value(this);
+}
+
+void StringObject::print()
+{
+    PRINT("%s", value.c_str());
+}
+
+//***************************************************************************************** */
+
+ValueType Value::type() const
+{
+    if (isNumber()) return ValueType::NUMBER;
+    if (isObject())
+    {
+        switch (asObject()->type)
+        {
+            case O_STRING:   return ValueType::STRING;
+            case O_FUNCTION: return ValueType::FUNCTION;
+            case O_NATIVE:   return ValueType::NATIVE;
+            case O_CLASS:    return ValueType::CLASS;
+            case O_STRUCT:   return ValueType::STRUCT;
+            case O_ARRAY:    return ValueType::ARRAY;
+            case O_MAP:      return ValueType::MAP;
+        }
+    }
+    if (isBool()) return ValueType::BOOLEAN;
+    if (isNil()) return ValueType::NIL;
+    return ValueType::EMPTY;
+}
+
+const char *Value::typeName() const
+{
+    switch (type())
+    {
+        case ValueType::EMPTY:    return "EMPTY";
+        case ValueType::NIL:      return "NIL";
+        case ValueType::BOOLEAN:  return "BOOLEAN";
+        case ValueType::NUMBER:   return "NUMBER";
+        case ValueType::STRING:   return "STRING";
+        case ValueType::FUNCTION: return "FUNCTION";
+        case ValueType::NATIVE:   return "NATIVE";
+        case ValueType::CLASS:    return "CLASS";
+        case ValueType::STRUCT:   return "STRUCT";
+        case ValueType::ARRAY:    return "ARRAY";
+        case ValueType::MAP:      return "MAP";
+    }
+    return "UNKNOWN";
+}
+
+bool Value::equals(const Value &other) const
+{
+    if (isNumber() && other.isNumber())
+    {
+        return asNumber() == other.asNumber();
+    }
+    if (isString() && other.isString())
+    {
+        return asString() == other.asString();
+    }
+    return bits == other.bits;
+}
+
+size_t Value::hash() const
+{
+    if (isNumber())
+    {
+        double value = asNumber();
+        return std::hash<double>()(value == 0 ? 0 : value);
+    }
+    if (isString())
+    {
+        return std::hash<std::string>()(asString());
+    }
+    return std::hash<u64>()(bits);
+}
+
+std::string Value::toString() const
+{
+    if (isNumber()) return std::to_string(asNumber());
+    if (isObject()) return asObject()->toString();
+    if (isBool()) return asBool() ? "true" : "false";
+    if (isNil()) return "nil";
+    return "";
+}
+
+void Value::print() const
+{
+    if (isNumber())
+    {
+        PRINT("%f", asNumber());
+    }
+    else if (isObject())
+    {
+        asObject()->print();
+    }
+    else if (isBool())
+    {
+        PRINT("%s", asBool() ? "true" : "false");
+    }
+    else if (isNil())
+    {
+        PRINT("nil");
+    }
+    else
+    {
+        WARNING("[PRINT] Unknown expression type");
+    }
+}
+
+Value Value::clone() const
+{
+    if (isObject())
+    {
+        return asObject()->clone();
+    }
+    return *this;
+}
@@ -10,7 +10,7 @@
 #include "Interpreter.hpp" 
 
 
-ExprPtr native_writeln(Context* ctx, int argc) 
+Value native_writeln(Context* ctx, int argc) 
 {
     for (int i = 0; i < argc; i++)
     {
@@ -43,28 +43,96 @@ std::string readFile(const std::string& filePath)
 }
 
 
-int main() 
+int main(int argc, char *argv[]) 
 {
 
    // Lexer lexer;
 
-    std::string code = readFile("main.pc");
+    std::string path = "main.pc";
+    Backend backend = Backend::AST;
+    bool jit = true;
+    bool memoStats = false;
+    bool optimizerLog = false;
+    int optimize = OPT_LEVEL_DEFAULT;
+    std::vector<std::string> constants;   // -DNAME=value
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--vm")
+        {
+            backend = Backend::BYTECODE;
+        }
+        else if (arg == "--closure")
+        {
+            backend = Backend::CLOSURE;
+        }
+        else if (arg == "--nojit")
+        {
+            jit = false;
+        }
+        else if (arg == "--memo-stats")
+        {
+            memoStats = true;
+        }
+        else if (arg == "--opt-log")
+        {
+            optimizerLog = true;
+        }
+        else if (arg.size() > 2 && arg.compare(0, 2, "-D") == 0)
+        {
+            constants.push_back(arg.substr(2));
+        }
+        else if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0 && isdigit(arg[2]))
+        {
+            optimize = arg[2] - '0';
+        }
+        else
+        {
+            path = arg;
+        }
+    }
+
+    std::string code = readFile(path);
     if (code.length() == 0)
     {
         return 0;
     } 
 
     Interpreter interpreter;
+    interpreter.setBackend(backend);
+    interpreter.setJit(jit);
+    interpreter.setOptimizerLog(optimizerLog);
    // interpreter.registerFunction("writeln", native_writeln);
     try 
     {
-        interpreter.compile(code);
+        for (auto &constant : constants)
+        {
+            size_t eq = constant.find('=');
+            std::string name = constant.substr(0, eq);
+            std::string value = eq == std::string::npos ? "true" : constant.substr(eq + 1);
+            char *end = nullptr;
+            double number = strtod(value.c_str(), &end);
+            if (value == "true" || value == "false")
+                interpreter.registerConstBoolean(name, value == "true");
+            else if (!value.empty() && *end == '\0')
+                interpreter.registerConstDouble(name, number);
+            else
+                interpreter.registerConstString(name, value);
+        }
+        interpreter.compile(code, optimize);
     }
     catch (const FatalException &e)
     {
         std::cout <<"Abort "<< e.what() << std::endl;
         
     }
+    if (memoStats)
+    {
+        for (auto &stats : interpreter.memoStats())
+        {
+            std::cout << "memo " << stats.name << ": " << stats.hits << " hits, " << stats.misses << " misses, " << stats.entries << " entries" << std::endl;
+        }
+    }
     
     interpreter.clear();
     std::cout <<"Exit " << std::endl;